@@ -0,0 +1,310 @@
+// LoopbackHttp2.cpp
+// HTTP/2 side of LoopbackServer: h2c with prior knowledge through nghttp2,
+// with the same synthetic bodies, delays, bandwidth cap and faults as the
+// HTTP/1.1 server. Only built when CMake finds nghttp2 (LOOPBACK_WITH_HTTP2).
+
+#include "LoopbackServer.hpp"
+#include <nghttp2/nghttp2.h>
+
+using namespace std;
+
+void LoopbackServer::serveHttp2()
+{
+    struct Stream
+    {
+        string path;
+        string range;     // After "bytes=", empty when not asked for
+        string ifNoneMatch;
+        long long readyAt; // Response held until then, 0 once submitted
+        long long offset;  // Next body byte
+        long long end;     // One past the last body byte to send
+        bool cut;          // Reset the stream instead of ending it
+        bool deferred;     // The body waits for the bandwidth cap
+    };
+
+    struct Peer
+    {
+        LoopbackServer *server;
+        nghttp2_session *session;
+        unordered_map<int32_t, Stream> streams;
+        string output;        // Frames nghttp2 produced that the socket did not take yet
+        long long pacedUntil; // Bandwidth cap of the whole connection
+    };
+
+    auto respond = [](Peer &peer, int32_t id, Stream &stream)
+    {
+        LoopbackServer &server = *peer.server;
+        stream.readyAt = 0;
+        Response response = server.plan(stream.path, stream.range.empty() ? NULL : stream.range.c_str(), stream.ifNoneMatch);
+        string status = to_string(response.status);
+        string length = to_string(response.status >= 400 ? 0 : response.length);
+        string contentRange = "bytes " + to_string(response.first) + "-" + to_string(response.first + response.length - 1) +
+                              "/" + to_string(response.size);
+        vector<nghttp2_nv> headers;
+        auto add = [&headers](const char *name, const string &value)
+        {
+            headers.push_back({reinterpret_cast<uint8_t *>(const_cast<char *>(name)),
+                               reinterpret_cast<uint8_t *>(const_cast<char *>(value.c_str())), strlen(name), value.size(),
+                               NGHTTP2_NV_FLAG_NONE});
+        };
+        string bytes = "bytes";
+        add(":status", status);
+        add("content-length", length);
+        if (response.status < 400 && server.options.ranges)
+        {
+            add("accept-ranges", bytes);
+        }
+        if (response.status == 206)
+        {
+            add("content-range", contentRange);
+        }
+        string etag = etagFor(response.size);
+        string modified = lastModified();
+        if (response.status < 400 && server.options.validators)
+        {
+            add("etag", etag);
+            add("last-modified", modified);
+        }
+
+        if (response.status >= 400 || response.length == 0)
+        {
+            nghttp2_submit_response(peer.session, id, headers.data(), headers.size(), NULL);
+            return;
+        }
+        stream.offset = response.first;
+        stream.end = response.sendEnd;
+        stream.cut = response.sendEnd < response.first + response.length;
+        nghttp2_data_provider body;
+        body.source.ptr = NULL;
+        body.read_callback = [](nghttp2_session *, int32_t id, uint8_t *buffer, size_t length, uint32_t *flags,
+                                nghttp2_data_source *, void *user) -> ssize_t
+        {
+            Peer &peer = *static_cast<Peer *>(user);
+            auto found = peer.streams.find(id);
+            if (found == peer.streams.end())
+            {
+                return NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE;
+            }
+            Stream &stream = found->second;
+            const LoopbackServer &server = *peer.server;
+            if (stream.offset >= stream.end)
+            {
+                return NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE; // Cut: the client sees the stream reset
+            }
+            long long now = nowUs();
+            if (server.options.bytesPerSecond > 0 && now < peer.pacedUntil)
+            {
+                stream.deferred = true;
+                return NGHTTP2_ERR_DEFERRED;
+            }
+            size_t chunk = server.pacedChunk(static_cast<size_t>(min<long long>(length, stream.end - stream.offset)));
+            for (size_t i = 0; i < chunk; ++i)
+            {
+                buffer[i] = static_cast<uint8_t>(patternByte(stream.offset + i));
+            }
+            stream.offset += chunk;
+            if (server.options.bytesPerSecond > 0)
+            {
+                peer.pacedUntil = server.pacedUntil(max(now, peer.pacedUntil), chunk);
+            }
+            if (stream.offset >= stream.end && !stream.cut)
+            {
+                *flags |= NGHTTP2_DATA_FLAG_EOF;
+            }
+            return static_cast<ssize_t>(chunk);
+        };
+        nghttp2_submit_response(peer.session, id, headers.data(), headers.size(), &body);
+    };
+
+    nghttp2_session_callbacks *callbacks;
+    nghttp2_session_callbacks_new(&callbacks);
+    nghttp2_session_callbacks_set_on_begin_headers_callback(
+        callbacks, [](nghttp2_session *, const nghttp2_frame *frame, void *user) -> int
+        {
+            if (frame->hd.type == NGHTTP2_HEADERS && frame->headers.cat == NGHTTP2_HCAT_REQUEST)
+            {
+                static_cast<Peer *>(user)->streams[frame->hd.stream_id] = Stream{"", "", "", 0, 0, 0, false, false};
+            }
+            return 0;
+        });
+    nghttp2_session_callbacks_set_on_header_callback(
+        callbacks, [](nghttp2_session *, const nghttp2_frame *frame, const uint8_t *name, size_t nameLength,
+                      const uint8_t *value, size_t valueLength, uint8_t, void *user) -> int
+        {
+            Peer &peer = *static_cast<Peer *>(user);
+            auto found = peer.streams.find(frame->hd.stream_id);
+            if (found == peer.streams.end())
+            {
+                return 0;
+            }
+            string key(reinterpret_cast<const char *>(name), nameLength);
+            string text(reinterpret_cast<const char *>(value), valueLength);
+            if (key == ":path")
+            {
+                found->second.path = text;
+            }
+            else if (key == "range" && text.compare(0, 6, "bytes=") == 0)
+            {
+                found->second.range = text.substr(6);
+            }
+            else if (key == "if-none-match")
+            {
+                found->second.ifNoneMatch = text;
+            }
+            return 0;
+        });
+    nghttp2_session_callbacks_set_on_frame_recv_callback(
+        callbacks, [](nghttp2_session *, const nghttp2_frame *frame, void *user) -> int
+        {
+            Peer &peer = *static_cast<Peer *>(user);
+            auto found = peer.streams.find(frame->hd.stream_id);
+            if (found != peer.streams.end() && (frame->hd.flags & NGHTTP2_FLAG_END_STREAM))
+            {
+                found->second.readyAt = max(peer.server->holdUntil(), 1LL); // 1: due now, pump() answers it
+            }
+            return 0;
+        });
+    nghttp2_session_callbacks_set_on_stream_close_callback(
+        callbacks, [](nghttp2_session *, int32_t id, uint32_t, void *user) -> int
+        {
+            static_cast<Peer *>(user)->streams.erase(id);
+            return 0;
+        });
+
+    int epollFd = epoll_create1(0);
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = listenFd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &event);
+
+    unordered_map<int, Peer> peers;
+    vector<epoll_event> events(256);
+    char buffer[16 * 1024];
+
+    // Runs nghttp2 and the socket until neither can make progress; false closes the connection
+    auto pump = [&respond](int fd, Peer &peer) -> bool
+    {
+        long long now = nowUs();
+        for (auto &entry : peer.streams)
+        {
+            Stream &stream = entry.second;
+            if (stream.readyAt > 0 && stream.readyAt <= now)
+            {
+                respond(peer, entry.first, stream);
+            }
+            if (stream.deferred && now >= peer.pacedUntil)
+            {
+                stream.deferred = false;
+                nghttp2_session_resume_data(peer.session, entry.first);
+            }
+        }
+        while (true)
+        {
+            while (peer.output.size() < 256 * 1024)
+            {
+                const uint8_t *data;
+                ssize_t produced = nghttp2_session_mem_send(peer.session, &data);
+                if (produced < 0)
+                {
+                    return false;
+                }
+                if (produced == 0)
+                {
+                    break;
+                }
+                peer.output.append(reinterpret_cast<const char *>(data), produced);
+            }
+            if (peer.output.empty())
+            {
+                return nghttp2_session_want_read(peer.session) || nghttp2_session_want_write(peer.session);
+            }
+            ssize_t sent = send(fd, peer.output.data(), peer.output.size(), MSG_NOSIGNAL);
+            if (sent < 0)
+            {
+                return errno == EAGAIN; // The next EPOLLOUT continues
+            }
+            peer.output.erase(0, sent);
+        }
+    };
+
+    while (true)
+    {
+        // Held responses and paced bodies are released by polling, like the HTTP/1.1 server
+        bool holding = false;
+        for (auto entry = peers.begin(); entry != peers.end();)
+        {
+            bool waiting = false;
+            for (const auto &stream : entry->second.streams)
+            {
+                waiting = waiting || stream.second.readyAt > 0 || stream.second.deferred;
+            }
+            if (waiting && !pump(entry->first, entry->second))
+            {
+                nghttp2_session_del(entry->second.session);
+                close(entry->first);
+                entry = peers.erase(entry);
+                continue;
+            }
+            holding = holding || waiting;
+            ++entry;
+        }
+
+        int count = epoll_wait(epollFd, events.data(), static_cast<int>(events.size()), holding ? 1 : -1);
+        for (int i = 0; i < count; ++i)
+        {
+            int fd = events[i].data.fd;
+            if (fd == listenFd)
+            {
+                int client;
+                while ((client = accept(listenFd, NULL, NULL)) >= 0)
+                {
+                    setNonBlocking(client);
+                    int noDelay = 1;
+                    setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+                    epoll_event clientEvent = {};
+                    clientEvent.events = EPOLLIN | EPOLLOUT | EPOLLET;
+                    clientEvent.data.fd = client;
+                    epoll_ctl(epollFd, EPOLL_CTL_ADD, client, &clientEvent);
+
+                    Peer &peer = peers[client];
+                    peer.server = this;
+                    peer.pacedUntil = 0;
+                    nghttp2_session_server_new(&peer.session, callbacks, &peer);
+                    nghttp2_settings_entry settings[] = {{NGHTTP2_SETTINGS_MAX_CONCURRENT_STREAMS, 1000},
+                                                         {NGHTTP2_SETTINGS_INITIAL_WINDOW_SIZE, 16 * 1024 * 1024}};
+                    nghttp2_submit_settings(peer.session, NGHTTP2_FLAG_NONE, settings, 2);
+                }
+                continue;
+            }
+
+            auto found = peers.find(fd);
+            if (found == peers.end())
+            {
+                continue;
+            }
+            Peer &peer = found->second;
+            bool open = true;
+            while (open)
+            {
+                ssize_t received = recv(fd, buffer, sizeof(buffer), 0);
+                if (received > 0)
+                {
+                    open = nghttp2_session_mem_recv(peer.session, reinterpret_cast<uint8_t *>(buffer), received) >= 0;
+                    continue;
+                }
+                open = (received < 0 && errno == EAGAIN);
+                break;
+            }
+            if (open)
+            {
+                open = pump(fd, peer);
+            }
+            if (!open)
+            {
+                nghttp2_session_del(peer.session);
+                close(fd);
+                peers.erase(found);
+            }
+        }
+    }
+}
@@ -0,0 +1,456 @@
+// LoopbackServer.hpp
+#ifndef LOOPBACKSERVER_HPP
+#define LOOPBACKSERVER_HPP
+
+// Minimal HTTP/1.1 server for the benchmarks. It runs in a forked child so the
+// memory and threads it uses never show up in the measured process.
+// GET /bytes/<n> returns n bytes of synthetic data and honours "Range: bytes=a-b".
+// An optional delay holds each response back; a serialized server answers one
+// request per delay, like a slow backend behind a single worker. Options can
+// also cap each connection's bandwidth, ignore ranges, answer every n-th
+// request with a 503 or stop every n-th body halfway, and with nghttp2
+// (LOOPBACK_WITH_HTTP2) the same server speaks HTTP/2 with prior knowledge.
+// With validators, bodies carry an ETag (one per size, as the content only
+// depends on it) and a request whose If-None-Match matches gets a 304.
+
+#include <string>
+#include <chrono>
+#include <vector>
+#include <unordered_map>
+#include <cstring>
+#include <cstdlib>
+#include <csignal>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/wait.h>
+
+using namespace std;
+
+// Shaping and faults of a LoopbackServer
+struct LoopbackOptions
+{
+    int delayMs;              // Before each response
+    bool serialized;          // Requests wait for each other's delay
+    long long bytesPerSecond; // Per connection, 0 = unlimited
+    bool ranges;              // Honour Range; false answers 200 with the whole body
+    int failEvery;            // Every n-th request gets a 503, 0 = never
+    int cutEvery;             // Every n-th body stops halfway and the connection (HTTP/2: stream) is reset, 0 = never
+    bool http2;               // HTTP/2 with prior knowledge instead of HTTP/1.1; needs LOOPBACK_WITH_HTTP2
+    bool validators;          // ETag and Last-Modified on every body, 304 for a matching If-None-Match
+
+    LoopbackOptions()
+        : delayMs(0), serialized(false), bytesPerSecond(0), ranges(true), failEvery(0), cutEvery(0), http2(false),
+          validators(false) {}
+};
+
+class LoopbackServer
+{
+private:
+    // What to send back for one request
+    struct Response
+    {
+        int status;        // 200, 206, 304, 404 or 503
+        long long size;    // Of the whole synthetic file
+        long long first;   // Offset of the first body byte
+        long long length;  // Body bytes announced
+        long long sendEnd; // One past the last body byte actually sent (halfway when cut)
+    };
+
+    struct Connection
+    {
+        string input;
+        string header;
+        long long bodyOffset; // Next byte of the synthetic body to send
+        long long bodyEnd;    // One past the last byte to send
+        long long readyAt;    // Microseconds; the response is held until then
+        bool cut;             // Close once the body is sent
+    };
+
+    int listenFd;
+    int port;
+    pid_t child;
+    LoopbackOptions options;
+    long long delayUs;
+    long long nextFree; // Serialized mode: when the backend takes the next request
+    long long requests; // Served so far, for failEvery and cutEvery
+
+    static long long nowUs()
+    {
+        return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static void setNonBlocking(int fd)
+    {
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+    }
+
+    // When a response that arrives now may start, 0 = at once
+    long long holdUntil()
+    {
+        if (delayUs == 0)
+        {
+            return 0;
+        }
+        long long start = options.serialized ? max(nowUs(), nextFree) : nowUs();
+        nextFree = start + delayUs;
+        return nextFree;
+    }
+
+    static string etagFor(long long size)
+    {
+        return "\"bytes-" + to_string(size) + "\"";
+    }
+
+    static const char *lastModified()
+    {
+        return "Thu, 01 Jan 2026 00:00:00 GMT";
+    }
+
+    // path: from the request line or :path; range: the value after "bytes=", NULL when absent;
+    // ifNoneMatch: that header's value, empty when absent
+    Response plan(const string &path, const char *range, const string &ifNoneMatch = string())
+    {
+        ++requests;
+        Response response = {200, 0, 0, 0, 0};
+        size_t bytes = path.find("/bytes/");
+        if (bytes == string::npos)
+        {
+            response.status = 404;
+            return response;
+        }
+        if (options.failEvery > 0 && requests % options.failEvery == 0)
+        {
+            response.status = 503;
+            return response;
+        }
+        response.size = atoll(path.c_str() + bytes + 7);
+        response.length = response.size;
+        if (options.validators && ifNoneMatch == etagFor(response.size))
+        {
+            response.status = 304;
+            response.length = 0;
+            return response;
+        }
+
+        if (range && options.ranges && response.size > 0)
+        {
+            char *dash = NULL;
+            long long first = strtoll(range, &dash, 10);
+            long long last = response.size - 1;
+            if (dash && *dash == '-' && dash[1] >= '0' && dash[1] <= '9')
+            {
+                last = min(strtoll(dash + 1, NULL, 10), response.size - 1);
+            }
+            if (first <= last)
+            {
+                response.status = 206;
+                response.first = first;
+                response.length = last - first + 1;
+            }
+        }
+        response.sendEnd = response.first + response.length;
+        if (options.cutEvery > 0 && requests % options.cutEvery == 0 && response.length > 1)
+        {
+            response.sendEnd = response.first + response.length / 2;
+        }
+        return response;
+    }
+
+    // Body chunk under the bandwidth cap, about 5 ms worth so the pacing is smooth
+    size_t pacedChunk(size_t wanted) const
+    {
+        if (options.bytesPerSecond <= 0)
+        {
+            return wanted;
+        }
+        return static_cast<size_t>(min<long long>(wanted, max<long long>(1024, options.bytesPerSecond / 200)));
+    }
+
+    // When the connection may send again after this chunk
+    long long pacedUntil(long long from, size_t sent) const
+    {
+        return from + static_cast<long long>(sent) * 1000000 / options.bytesPerSecond;
+    }
+
+    bool parseRequest(Connection &connection)
+    {
+        size_t end = connection.input.find("\r\n\r\n");
+        if (end == string::npos)
+        {
+            return false;
+        }
+        string request = connection.input.substr(0, end);
+        connection.input.erase(0, end + 4);
+
+        connection.readyAt = holdUntil();
+        size_t pathEnd = request.find(' ', 4);
+        size_t range = request.find("Range: bytes=");
+        size_t match = request.find("If-None-Match: ");
+        string ifNoneMatch;
+        if (match != string::npos)
+        {
+            size_t lineEnd = request.find("\r\n", match);
+            ifNoneMatch = request.substr(match + 15, lineEnd == string::npos ? string::npos : lineEnd - match - 15);
+        }
+        Response response = plan(request.substr(4, pathEnd == string::npos ? string::npos : pathEnd - 4),
+                                 range != string::npos ? request.c_str() + range + 13 : NULL, ifNoneMatch);
+
+        if (response.status == 404 || response.status == 503)
+        {
+            connection.header = (response.status == 404) ? "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\n\r\n"
+                                                          : "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\n\r\n";
+            connection.bodyOffset = connection.bodyEnd = 0;
+            connection.cut = false;
+            return true;
+        }
+        string validators = options.validators ? "ETag: " + etagFor(response.size) + "\r\nLast-Modified: " + lastModified() + "\r\n" : "";
+        if (response.status == 304)
+        {
+            connection.header = "HTTP/1.1 304 Not Modified\r\n" + validators + "\r\n";
+            connection.bodyOffset = connection.bodyEnd = 0;
+            connection.cut = false;
+            return true;
+        }
+
+        bool ranged = response.status == 206;
+        long long last = response.first + response.length - 1;
+        connection.header = string(ranged ? "HTTP/1.1 206 Partial Content\r\n" : "HTTP/1.1 200 OK\r\n") +
+                            "Content-Length: " + to_string(response.length) + "\r\n" +
+                            (options.ranges ? "Accept-Ranges: bytes\r\n" : "") +
+                            (ranged ? "Content-Range: bytes " + to_string(response.first) + "-" + to_string(last) + "/" + to_string(response.size) + "\r\n" : "") +
+                            validators + "\r\n";
+        connection.bodyOffset = response.first;
+        connection.bodyEnd = response.sendEnd;
+        connection.cut = response.sendEnd < response.first + response.length;
+        return true;
+    }
+
+    // Returns false when the connection should be closed
+    bool flush(int fd, Connection &connection)
+    {
+        static char body[64 * 1024];
+        while (true)
+        {
+            if (connection.readyAt > 0)
+            {
+                if (nowUs() < connection.readyAt)
+                {
+                    return true; // serve() retries once it is due
+                }
+                connection.readyAt = 0;
+            }
+            if (!connection.header.empty())
+            {
+                ssize_t sent = send(fd, connection.header.data(), connection.header.size(), MSG_NOSIGNAL);
+                if (sent < 0)
+                {
+                    return errno == EAGAIN;
+                }
+                connection.header.erase(0, sent);
+                continue;
+            }
+            if (connection.bodyOffset < connection.bodyEnd)
+            {
+                size_t chunk = pacedChunk(static_cast<size_t>(min<long long>(sizeof(body), connection.bodyEnd - connection.bodyOffset)));
+                for (size_t i = 0; i < chunk; ++i)
+                {
+                    body[i] = patternByte(connection.bodyOffset + i);
+                }
+                ssize_t sent = send(fd, body, chunk, MSG_NOSIGNAL);
+                if (sent < 0)
+                {
+                    return errno == EAGAIN;
+                }
+                connection.bodyOffset += sent;
+                if (options.bytesPerSecond > 0)
+                {
+                    connection.readyAt = pacedUntil(nowUs(), static_cast<size_t>(sent));
+                }
+                continue;
+            }
+            if (connection.cut)
+            {
+                return false; // The client sees the connection drop partway through the body
+            }
+            if (!parseRequest(connection))
+            {
+                return true; // Wait for the next request on this keep-alive connection
+            }
+        }
+    }
+
+    void serve()
+    {
+        int epollFd = epoll_create1(0);
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.fd = listenFd;
+        epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &event);
+
+        unordered_map<int, Connection> connections;
+        vector<epoll_event> events(256);
+        char buffer[16 * 1024];
+
+        while (true)
+        {
+            // Held responses are released by polling: the delays are milliseconds anyway
+            bool holding = false;
+            for (auto &entry : connections)
+            {
+                if (entry.second.readyAt > 0)
+                {
+                    holding = true;
+                    if (nowUs() >= entry.second.readyAt && !flush(entry.first, entry.second))
+                    {
+                        entry.second.readyAt = -1; // Closed below
+                    }
+                }
+            }
+            for (auto entry = connections.begin(); entry != connections.end();)
+            {
+                if (entry->second.readyAt < 0)
+                {
+                    close(entry->first);
+                    entry = connections.erase(entry);
+                    continue;
+                }
+                ++entry;
+            }
+
+            int count = epoll_wait(epollFd, events.data(), static_cast<int>(events.size()), holding ? 1 : -1);
+            for (int i = 0; i < count; ++i)
+            {
+                int fd = events[i].data.fd;
+                if (fd == listenFd)
+                {
+                    int client;
+                    while ((client = accept(listenFd, NULL, NULL)) >= 0)
+                    {
+                        setNonBlocking(client);
+                        int noDelay = 1; // Header and body go out in separate sends
+                        setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &noDelay, sizeof(noDelay));
+                        epoll_event clientEvent = {};
+                        clientEvent.events = EPOLLIN | EPOLLOUT | EPOLLET;
+                        clientEvent.data.fd = client;
+                        epoll_ctl(epollFd, EPOLL_CTL_ADD, client, &clientEvent);
+                        connections[client] = Connection{"", "", 0, 0, 0, false};
+                    }
+                    continue;
+                }
+
+                Connection &connection = connections[fd];
+                bool open = true;
+                while (true)
+                {
+                    ssize_t received = recv(fd, buffer, sizeof(buffer), 0);
+                    if (received > 0)
+                    {
+                        connection.input.append(buffer, received);
+                        continue;
+                    }
+                    open = (received < 0 && errno == EAGAIN);
+                    break;
+                }
+                if (open)
+                {
+                    open = flush(fd, connection);
+                }
+                if (!open)
+                {
+                    close(fd);
+                    connections.erase(fd);
+                }
+            }
+        }
+    }
+
+#ifdef LOOPBACK_WITH_HTTP2
+    void serveHttp2(); // LoopbackHttp2.cpp
+#endif
+
+    void start()
+    {
+        listenFd = socket(AF_INET, SOCK_STREAM, 0);
+        int yes = 1;
+        setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        address.sin_port = 0; // Let the kernel pick a free port
+        bind(listenFd, reinterpret_cast<sockaddr *>(&address), sizeof(address));
+        listen(listenFd, 4096);
+
+        socklen_t length = sizeof(address);
+        getsockname(listenFd, reinterpret_cast<sockaddr *>(&address), &length);
+        port = ntohs(address.sin_port);
+        setNonBlocking(listenFd);
+
+        child = fork();
+        if (child == 0)
+        {
+#ifdef LOOPBACK_WITH_HTTP2
+            if (options.http2)
+            {
+                serveHttp2();
+                _exit(0);
+            }
+#endif
+            serve();
+            _exit(0);
+        }
+        close(listenFd);
+    }
+
+public:
+    explicit LoopbackServer(int delayMs = 0, bool serialized = false)
+        : listenFd(-1), port(0), child(-1), delayUs(delayMs * 1000LL), nextFree(0), requests(0)
+    {
+        options.delayMs = delayMs;
+        options.serialized = serialized;
+        start();
+    }
+
+    explicit LoopbackServer(const LoopbackOptions &options)
+        : listenFd(-1), port(0), child(-1), options(options), delayUs(options.delayMs * 1000LL), nextFree(0), requests(0)
+    {
+        start();
+    }
+
+    static bool supportsHttp2()
+    {
+#ifdef LOOPBACK_WITH_HTTP2
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    ~LoopbackServer()
+    {
+        if (child > 0)
+        {
+            kill(child, SIGKILL);
+            waitpid(child, NULL, 0);
+        }
+    }
+
+    // Byte at offset of every /bytes/<n> body, to know a download's digest in advance
+    static char patternByte(long long offset)
+    {
+        return static_cast<char>((offset * 2654435761ULL) >> 24);
+    }
+
+    string url(long long size, int id) const
+    {
+        return "http://127.0.0.1:" + to_string(port) + "/bytes/" + to_string(size) + "?id=" + to_string(id);
+    }
+};
+
+#endif // LOOPBACKSERVER_HPP
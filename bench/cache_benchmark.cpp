@@ -0,0 +1,144 @@
+// cache_benchmark.cpp
+// What the content cache costs and saves. First the index alone: a log of
+// synthetic records is loaded and looked up by URL, hits and misses, with
+// the memory the tables take. Then downloads from a loopback server that
+// sends ETags: a cold pass fills the cache, a warm pass of the same URLs is
+// answered with 304s, and a pass of new URLs with the same content is
+// downloaded again but stored only once.
+//
+// Usage: cache_benchmark [index entries] [files] [bytes per file] [ranges] [pool threads]
+
+#include "DownloadManager.hpp"
+#include "LoopbackServer.hpp"
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <filesystem>
+#include <sys/resource.h>
+
+using namespace std;
+
+static double secondsSince(chrono::steady_clock::time_point started)
+{
+    return chrono::duration<double>(chrono::steady_clock::now() - started).count();
+}
+
+static long peakRssKb()
+{
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+static string syntheticUrl(size_t i)
+{
+    return "https://mirror" + to_string(i % 16) + ".example.org/releases/artifact-" + to_string(i) + ".tar.gz";
+}
+
+static void indexLookups(size_t entries, const string &directory)
+{
+    filesystem::create_directories(directory);
+    {
+        ofstream index(directory + "/index", ios::binary);
+        index << "dmcache 1\n";
+        char sha[65];
+        for (size_t i = 0; i < entries; ++i)
+        {
+            snprintf(sha, sizeof(sha), "%016llx%048x", static_cast<unsigned long long>(i) * 0x9e3779b97f4a7c15ULL, 0);
+            index << syntheticUrl(i) << "\t\"v" << i << "\"\t\t" << 1024 * 1024 << '\t' << sha << "\t1\n";
+        }
+    }
+
+    long rssBefore = peakRssKb();
+    ContentCache cache;
+    auto started = chrono::steady_clock::now();
+    bool opened = cache.open(directory);
+    double loadSeconds = secondsSince(started);
+    long tableKb = peakRssKb() - rssBefore;
+
+    const size_t probes = 200000;
+    mt19937_64 random(42);
+    vector<string> present;
+    vector<string> absent;
+    for (size_t i = 0; i < probes; ++i)
+    {
+        present.push_back(syntheticUrl(random() % entries));
+        absent.push_back(syntheticUrl(entries + random() % entries));
+    }
+    CacheEntry entry;
+    size_t found = 0;
+    started = chrono::steady_clock::now();
+    for (const string &url : present)
+    {
+        found += cache.find(url, entry) ? 1 : 0;
+    }
+    double hitNs = secondsSince(started) * 1e9 / probes;
+    started = chrono::steady_clock::now();
+    for (const string &url : absent)
+    {
+        found += cache.find(url, entry) ? 1 : 0;
+    }
+    double missNs = secondsSince(started) * 1e9 / probes;
+
+    printf("{\"phase\": \"index\", \"entries\": %zu, \"opened\": %s, \"load_sec\": %.3f, \"table_rss_kb\": %ld, "
+           "\"hit_ns\": %.0f, \"miss_ns\": %.0f, \"found\": %zu}\n",
+           cache.getStats().entries, opened ? "true" : "false", loadSeconds, tableKb, hitNs, missNs, found);
+    filesystem::remove_all(directory);
+}
+
+static void downloadPass(const char *phase, LoopbackServer &server, int files, long long fileSize, int firstId,
+                         size_t ranges, size_t threads, const string &directory)
+{
+    streambuf *original = cout.rdbuf(NULL); // Keep per-task logging out of the results
+    double seconds;
+    MetricsSnapshot metrics;
+    CacheStats stats;
+    size_t completed = 0;
+    {
+        DownloadManager manager(threads);
+        manager.setSegmentsPerDownload(ranges);
+        manager.setCacheDirectory(directory + "/cache");
+        vector<TaskId> ids;
+        for (int i = 0; i < files; ++i)
+        {
+            ids.push_back(manager.addDownload(server.url(fileSize, firstId + i), directory + "/out/file" + to_string(i)).id);
+        }
+        auto started = chrono::steady_clock::now();
+        manager.startDownloads();
+        manager.waitAll(ids);
+        seconds = secondsSince(started);
+        metrics = manager.getMetrics();
+        stats = manager.getCacheStats();
+        completed = manager.getDownloadsWithStatus(DownloadStatus::Completed).size();
+    }
+    cout.rdbuf(original);
+
+    printf("{\"phase\": \"%s\", \"files\": %d, \"completed\": %zu, \"makespan_sec\": %.3f, \"transferred_mb\": %.1f, "
+           "\"revalidated\": %llu, \"stored\": %llu, \"deduplicated\": %llu, \"saved_mb\": %.1f, \"blobs\": %zu}\n",
+           phase, files, completed, seconds, metrics.bytes / (1024.0 * 1024.0), stats.revalidated, stats.stored,
+           stats.deduplicated, (stats.revalidatedBytes + stats.deduplicatedBytes) / (1024.0 * 1024.0), stats.blobs);
+}
+
+int main(int argc, char **argv)
+{
+    size_t entries = (argc > 1) ? strtoull(argv[1], NULL, 10) : 1000000;
+    int files = (argc > 2) ? atoi(argv[2]) : 32;
+    long long fileSize = (argc > 3) ? atoll(argv[3]) : 8 * 1024 * 1024;
+    size_t ranges = (argc > 4) ? atoi(argv[4]) : 4;
+    size_t threads = (argc > 5) ? atoi(argv[5]) : 8;
+
+    string directory = (filesystem::temp_directory_path() / ("cache_benchmark_" + to_string(getpid()))).string();
+    indexLookups(entries, directory + "/index");
+
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    LoopbackOptions options;
+    options.validators = true;
+    LoopbackServer server(options);
+    filesystem::create_directories(directory + "/out");
+    downloadPass("cold", server, files, fileSize, 0, ranges, threads, directory);
+    downloadPass("warm", server, files, fileSize, 0, ranges, threads, directory);
+    downloadPass("new_urls", server, files, fileSize, files, ranges, threads, directory);
+    curl_global_cleanup();
+    filesystem::remove_all(directory);
+    return 0;
+}
@@ -0,0 +1,115 @@
+// checksum_benchmark.cpp
+// Cost of verifying downloads. First the raw hashing speed of SHA-256 and
+// CRC32C over an in-memory buffer, portable code against the SHA-NI /
+// SSE4.2 paths; then whole downloads from a loopback server without a
+// digest, against a CRC32C digest and against a SHA-256 digest, with one
+// range and with several.
+//
+// Usage: checksum_benchmark [megabytes] [ranges] [pool threads]
+
+#include "DownloadManager.hpp"
+#include "LoopbackServer.hpp"
+#include <cstdio>
+#include <filesystem>
+
+using namespace std;
+
+static double secondsSince(chrono::steady_clock::time_point started)
+{
+    return chrono::duration<double>(chrono::steady_clock::now() - started).count();
+}
+
+static void hashThroughput(const vector<char> &data)
+{
+    double megabytes = data.size() / (1024.0 * 1024.0);
+    for (bool accelerated : {false, true})
+    {
+        setChecksumAcceleration(accelerated);
+        if (accelerated && !Sha256::accelerated() && !Crc32c::accelerated())
+        {
+            break; // No hardware path on this CPU
+        }
+
+        auto started = chrono::steady_clock::now();
+        Sha256 sha;
+        sha.update(data.data(), data.size());
+        string digest = sha.finalHex();
+        double shaSeconds = secondsSince(started);
+
+        started = chrono::steady_clock::now();
+        uint32_t crc = Crc32c::update(0, data.data(), data.size());
+        double crcSeconds = secondsSince(started);
+
+        printf("{\"hash\": \"%s\", \"sha256_mb_per_sec\": %.0f, \"crc32c_mb_per_sec\": %.0f, \"check\": \"%.8s/%08x\"}\n",
+               accelerated ? "accelerated" : "portable", megabytes / shaSeconds, megabytes / crcSeconds,
+               digest.c_str(), crc);
+    }
+    setChecksumAcceleration(true);
+}
+
+static double downloadOnce(LoopbackServer &server, long long size, int id, size_t ranges, size_t threads,
+                           const string &digest, const string &directory)
+{
+    DownloadManager manager(threads);
+    manager.setSegmentsPerDownload(ranges);
+    string url = server.url(size, id);
+    if (!digest.empty())
+    {
+        manager.setDownloadChecksum(url, digest);
+    }
+    auto started = chrono::steady_clock::now();
+    DownloadHandle handle = manager.addDownload(url, directory + "/file" + to_string(id));
+    manager.startDownload(handle.id);
+    DownloadResult result = handle.result.get();
+    double seconds = secondsSince(started);
+    return result.status == DownloadStatus::Completed ? seconds : -1;
+}
+
+int main(int argc, char **argv)
+{
+    long long megabytes = (argc > 1) ? atoll(argv[1]) : 256;
+    size_t ranges = (argc > 2) ? atoi(argv[2]) : 4;
+    size_t threads = (argc > 3) ? atoi(argv[3]) : 4;
+    long long size = megabytes * 1024 * 1024;
+
+    vector<char> data(static_cast<size_t>(size));
+    for (long long i = 0; i < size; ++i)
+    {
+        data[i] = LoopbackServer::patternByte(i);
+    }
+    hashThroughput(data);
+
+    Sha256 sha;
+    sha.update(data.data(), data.size());
+    string sha256 = "sha256:" + sha.finalHex();
+    char crc32c[32];
+    snprintf(crc32c, sizeof(crc32c), "crc32c:%08x", Crc32c::update(0, data.data(), data.size()));
+    vector<char>().swap(data);
+
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    LoopbackServer server;
+    string directory = filesystem::temp_directory_path().string() + "/checksum_bench";
+    filesystem::create_directories(directory);
+    streambuf *original = cout.rdbuf(NULL);
+
+    int id = 0;
+    downloadOnce(server, size, id++, ranges, threads, string(), directory); // Warm up the server and page cache
+    filesystem::remove(directory + "/file0");
+    for (size_t segments : {static_cast<size_t>(1), ranges})
+    {
+        for (const string &digest : {string(), string(crc32c), sha256})
+        {
+            double seconds = downloadOnce(server, size, id++, segments, threads, digest, directory);
+            printf("{\"verify\": \"%s\", \"ranges\": %zu, \"seconds\": %.3f, \"mb_per_sec\": %.0f}\n",
+                   digest.empty() ? "none" : digest.substr(0, digest.find(':')).c_str(), segments, seconds,
+                   seconds > 0 ? megabytes / seconds : 0.0);
+            fflush(stdout);
+            filesystem::remove(directory + "/file" + to_string(id - 1));
+        }
+    }
+
+    cout.rdbuf(original);
+    filesystem::remove_all(directory);
+    curl_global_cleanup();
+    return 0;
+}
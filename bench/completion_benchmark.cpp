@@ -0,0 +1,132 @@
+// completion_benchmark.cpp
+// How long after a download finishes does a waiting consumer find out?
+// "poll" checks every task's status in 100 ms steps, as the old
+// waitForCompletion did; "event" blocks in waitAny() on the remaining tasks.
+// The finish time is taken in the task's completion callback.
+//
+// Usage: completion_benchmark [files] [bytes per file] [pool threads]
+
+#include "DownloadManager.hpp"
+#include "LoopbackServer.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <sstream>
+
+using namespace std;
+
+static double percentile(vector<double> values, double fraction)
+{
+    if (values.empty())
+    {
+        return 0;
+    }
+    sort(values.begin(), values.end());
+    return values[static_cast<size_t>(fraction * (values.size() - 1))];
+}
+
+static void runMode(bool event, const LoopbackServer &server, int files, long long fileSize, size_t threads)
+{
+    ostringstream sink;
+    streambuf *original = cout.rdbuf(sink.rdbuf()); // Keep per-task logging out of the results
+    string directory = filesystem::temp_directory_path().string() + "/completion_bench";
+    filesystem::create_directories(directory);
+
+    vector<double> latencies;
+    double makespan;
+    {
+        DownloadManager manager(threads);
+        manager.setSegmentsPerDownload(1);
+
+        auto started = chrono::steady_clock::now();
+        vector<atomic<long long>> finishedAt(files);
+        vector<TaskId> ids;
+        for (int i = 0; i < files; ++i)
+        {
+            atomic<long long> *slot = &finishedAt[i];
+            ids.push_back(manager.addDownload(server.url(fileSize, i), directory + "/file" + to_string(i),
+                                              [slot, started](const DownloadResult &)
+                                              {
+                                                  slot->store(chrono::duration_cast<chrono::microseconds>(
+                                                                  chrono::steady_clock::now() - started)
+                                                                  .count());
+                                              }));
+        }
+        manager.startDownloads();
+
+        vector<long long> seenAt(files);
+        auto seen = [&](size_t index)
+        {
+            seenAt[index] = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - started).count();
+        };
+        if (event)
+        {
+            vector<TaskId> remaining = ids;
+            while (!remaining.empty())
+            {
+                TaskId done = manager.waitAny(remaining);
+                remaining.erase(find(remaining.begin(), remaining.end(), done));
+                seen(find(ids.begin(), ids.end(), done) - ids.begin());
+            }
+        }
+        else
+        {
+            vector<bool> reported(files, false);
+            size_t left = files;
+            while (left > 0)
+            {
+                for (int i = 0; i < files; ++i)
+                {
+                    DownloadStatus status = manager.getDownloadStatus(ids[i]);
+                    if (!reported[i] && (status == DownloadStatus::Completed || status == DownloadStatus::Failed))
+                    {
+                        reported[i] = true;
+                        --left;
+                        seen(i);
+                    }
+                }
+                if (left > 0)
+                {
+                    this_thread::sleep_for(chrono::milliseconds(100));
+                }
+            }
+        }
+        makespan = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+
+        // Waiters are woken before the callbacks run, so a consumer can be ahead of the timestamp
+        for (int i = 0; i < files; ++i)
+        {
+            while (finishedAt[i].load() == 0)
+            {
+                this_thread::yield();
+            }
+            latencies.push_back(max(0LL, seenAt[i] - finishedAt[i].load()) / 1000.0);
+        }
+    }
+    filesystem::remove_all(directory);
+    cout.rdbuf(original);
+
+    double sum = 0;
+    for (double latency : latencies)
+    {
+        sum += latency;
+    }
+    printf("{\"mode\": \"%s\", \"files\": %d, \"makespan_sec\": %.3f, \"mean_notify_ms\": %.2f, "
+           "\"p50_notify_ms\": %.2f, \"p99_notify_ms\": %.2f}\n",
+           event ? "event" : "poll", files, makespan, sum / latencies.size(), percentile(latencies, 0.5),
+           percentile(latencies, 0.99));
+}
+
+int main(int argc, char **argv)
+{
+    int files = (argc > 1) ? atoi(argv[1]) : 200;
+    long long fileSize = (argc > 2) ? atoll(argv[2]) : 256 * 1024;
+    size_t threads = (argc > 3) ? atoi(argv[3]) : 8;
+
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    LoopbackServer server;
+    runMode(false, server, files, fileSize, threads);
+    runMode(true, server, files, fileSize, threads);
+    curl_global_cleanup();
+    return 0;
+}
@@ -0,0 +1,97 @@
+// engine_benchmark.cpp
+// Compares the thread-per-transfer pool with the event-loop engine on loopback:
+// transfers per second and peak RSS of the downloading process.
+//
+// Usage: engine_benchmark [transfers] [bytes per file] [pool threads] [event loops]
+
+#include "DownloadManager.hpp"
+#include "LoopbackServer.hpp"
+#include <cstdio>
+#include <filesystem>
+#include <sstream>
+#include <sys/resource.h>
+
+using namespace std;
+
+struct BenchConfig
+{
+    int transfers;
+    long long fileSize;
+    size_t poolThreads;
+    size_t eventLoops;
+};
+
+static void runScenario(const LoopbackServer &server, const BenchConfig &config, EngineMode mode, const string &directory)
+{
+    ostringstream sink;
+    streambuf *original = cout.rdbuf(sink.rdbuf()); // Keep per-task logging out of the results
+
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    auto started = chrono::steady_clock::now();
+    int completed = 0;
+    int failed = 0;
+    {
+        size_t threads = (mode == EngineMode::ThreadPerTransfer) ? config.poolThreads : config.eventLoops;
+        DownloadManager manager(threads, mode);
+        manager.setSegmentsPerDownload(1);
+
+        vector<string> urls;
+        for (int i = 0; i < config.transfers; ++i)
+        {
+            urls.push_back(server.url(config.fileSize, i));
+            manager.addDownload(urls.back(), directory + "/file" + to_string(i));
+        }
+        manager.startDownloads();
+
+        size_t next = 0;
+        while (next < urls.size())
+        {
+            DownloadStatus status = manager.getDownloadStatus(urls[next]);
+            if (status == DownloadStatus::Completed || status == DownloadStatus::Failed)
+            {
+                (status == DownloadStatus::Completed) ? ++completed : ++failed;
+                ++next;
+                continue;
+            }
+            this_thread::sleep_for(chrono::milliseconds(5));
+        }
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+    curl_global_cleanup();
+    cout.rdbuf(original);
+
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    printf("{\"engine\": \"%s\", \"transfers\": %d, \"failed\": %d, \"seconds\": %.3f, "
+           "\"transfers_per_sec\": %.1f, \"peak_rss_kb\": %ld}\n",
+           mode == EngineMode::ThreadPerTransfer ? "thread_per_transfer" : "event_loop",
+           completed, failed, seconds, completed / seconds, usage.ru_maxrss);
+    fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+    BenchConfig config;
+    config.transfers = (argc > 1) ? atoi(argv[1]) : 2000;
+    config.fileSize = (argc > 2) ? atoll(argv[2]) : 16 * 1024;
+    config.poolThreads = (argc > 3) ? atoi(argv[3]) : 256;
+    config.eventLoops = (argc > 4) ? atoi(argv[4]) : 2;
+
+    LoopbackServer server;
+    string directory = (filesystem::temp_directory_path() / ("engine_benchmark_" + to_string(getpid()))).string();
+
+    // Each engine runs in its own child so peak RSS is measured separately
+    for (EngineMode mode : {EngineMode::ThreadPerTransfer, EngineMode::EventLoop})
+    {
+        filesystem::create_directories(directory);
+        pid_t child = fork();
+        if (child == 0)
+        {
+            runScenario(server, config, mode, directory);
+            _exit(0);
+        }
+        waitpid(child, NULL, 0);
+        filesystem::remove_all(directory);
+    }
+    return 0;
+}
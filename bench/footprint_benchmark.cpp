@@ -0,0 +1,91 @@
+// footprint_benchmark.cpp
+// Memory and file descriptors held per queued download. Queues tasks that
+// are never started, once through addDownload() and once through
+// addManifest(), and reports heap bytes per task (glibc mallinfo2), open
+// descriptors and the size of the task object itself, against the target
+// in TARGET_BYTES_PER_TASK.
+//
+// Usage: footprint_benchmark [tasks]
+
+#include "DownloadManager.hpp"
+#include <cstdio>
+#include <filesystem>
+#include <malloc.h>
+
+using namespace std;
+
+// Heap per queued task, registry indexes included
+static const double TARGET_BYTES_PER_TASK = 1024;
+
+static size_t heapInUse()
+{
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+}
+
+static size_t openDescriptors()
+{
+    size_t count = 0;
+    for (auto it = filesystem::directory_iterator("/proc/self/fd"); it != filesystem::directory_iterator(); ++it)
+    {
+        ++count;
+    }
+    return count;
+}
+
+static string urlOf(size_t index)
+{
+    return "http://mirror" + to_string(index % 16) + ".example.com:8080/datasets/part-" + to_string(index) + ".bin";
+}
+
+static void runMode(bool manifest, size_t tasks, const string &directory)
+{
+    string path = directory + "/manifest.txt";
+    if (manifest)
+    {
+        ofstream out(path, ios::trunc);
+        for (size_t i = 0; i < tasks; ++i)
+        {
+            out << urlOf(i) << " part-" << i << ".bin\n";
+        }
+    }
+
+    streambuf *original = cout.rdbuf(NULL);
+    DownloadManager manager(4);
+    size_t heapBefore = heapInUse();
+    size_t descriptorsBefore = openDescriptors();
+    if (manifest)
+    {
+        manager.addManifest(path, directory, false);
+    }
+    else
+    {
+        for (size_t i = 0; i < tasks; ++i)
+        {
+            manager.addDownload(urlOf(i), directory + "/part-" + to_string(i) + ".bin");
+        }
+    }
+    double perTask = (static_cast<double>(heapInUse()) - heapBefore) / tasks;
+    long long descriptors = static_cast<long long>(openDescriptors()) - static_cast<long long>(descriptorsBefore);
+    cout.rdbuf(original);
+
+    printf("{\"mode\": \"%s\", \"tasks\": %zu, \"task_object_bytes\": %zu, \"heap_bytes_per_task\": %.0f, "
+           "\"target_bytes_per_task\": %.0f, \"within_target\": %s, \"extra_descriptors\": %lld}\n",
+           manifest ? "manifest" : "addDownload", tasks, sizeof(DownloadTask), perTask, TARGET_BYTES_PER_TASK,
+           perTask <= TARGET_BYTES_PER_TASK ? "true" : "false", descriptors);
+    fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+    size_t tasks = (argc > 1) ? strtoull(argv[1], NULL, 10) : 100000;
+
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    string directory = filesystem::temp_directory_path().string() + "/footprint_bench";
+    filesystem::create_directories(directory);
+    runMode(false, tasks, directory);
+    runMode(true, tasks, directory);
+    filesystem::remove_all(directory);
+    curl_global_cleanup();
+    return 0;
+}
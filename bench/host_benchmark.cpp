@@ -0,0 +1,160 @@
+// host_benchmark.cpp
+// Mixed fast-host/slow-host workload for the thread pool: a batch to a slow,
+// serialized host is queued ahead of a batch to a fast host. Reports makespan,
+// when each host's batch finished, and Jain's fairness index over the per-host
+// slowdown against running that host's batch alone.
+//
+// Usage: host_benchmark [files per host] [bytes per file] [pool threads] [slow delay ms] [connections per host]
+
+#include "DownloadManager.hpp"
+#include "LoopbackServer.hpp"
+#include <cstdio>
+#include <filesystem>
+#include <sstream>
+
+using namespace std;
+
+struct BenchConfig
+{
+    int files;
+    long long fileSize;
+    size_t poolThreads;
+    int slowDelayMs;
+    size_t connectionsPerHost;
+};
+
+struct HostBatch
+{
+    const LoopbackServer *server;
+    int firstId;
+};
+
+struct RunResult
+{
+    double makespan;
+    vector<double> hostDone; // Seconds until the last file of each batch finished
+    int failed;
+};
+
+static RunResult runScenario(const vector<HostBatch> &batches, const BenchConfig &config, DispatchPolicy policy,
+                             const string &directory)
+{
+    ostringstream sink;
+    streambuf *original = cout.rdbuf(sink.rdbuf()); // Keep per-task logging out of the results
+    filesystem::create_directories(directory);
+
+    RunResult result;
+    result.hostDone.assign(batches.size(), 0);
+    result.failed = 0;
+    auto started = chrono::steady_clock::now();
+    {
+        DownloadManager manager(config.poolThreads, EngineMode::ThreadPerTransfer);
+        manager.setSegmentsPerDownload(1);
+        manager.setDispatchPolicy(policy);
+        manager.setMaxConnectionsPerHost(config.connectionsPerHost);
+
+        vector<vector<string>> urls(batches.size());
+        for (size_t host = 0; host < batches.size(); ++host)
+        {
+            for (int i = 0; i < config.files; ++i)
+            {
+                int id = batches[host].firstId + i;
+                urls[host].push_back(batches[host].server->url(config.fileSize, id));
+                manager.addDownload(urls[host].back(), directory + "/file" + to_string(id));
+            }
+        }
+        // Started batch by batch so the FIFO order puts the first host ahead of the rest
+        for (auto &batch : urls)
+        {
+            for (auto &url : batch)
+            {
+                manager.startDownload(url);
+            }
+        }
+
+        vector<size_t> next(batches.size(), 0);
+        size_t remaining = batches.size();
+        while (remaining > 0)
+        {
+            for (size_t host = 0; host < batches.size(); ++host)
+            {
+                while (next[host] < urls[host].size())
+                {
+                    DownloadStatus status = manager.getDownloadStatus(urls[host][next[host]]);
+                    if (status != DownloadStatus::Completed && status != DownloadStatus::Failed)
+                    {
+                        break;
+                    }
+                    result.failed += (status == DownloadStatus::Failed);
+                    if (++next[host] == urls[host].size())
+                    {
+                        result.hostDone[host] = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+                        --remaining;
+                    }
+                }
+            }
+            this_thread::sleep_for(chrono::milliseconds(2));
+        }
+    }
+    result.makespan = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+    filesystem::remove_all(directory);
+    cout.rdbuf(original);
+    return result;
+}
+
+// 1 when every host is slowed down equally, 1/n when one host gets all the service
+static double jainIndex(const vector<double> &values)
+{
+    double sum = 0;
+    double squares = 0;
+    for (double value : values)
+    {
+        sum += value;
+        squares += value * value;
+    }
+    return (squares > 0) ? sum * sum / (values.size() * squares) : 1.0;
+}
+
+int main(int argc, char **argv)
+{
+    BenchConfig config;
+    config.files = (argc > 1) ? atoi(argv[1]) : 200;
+    config.fileSize = (argc > 2) ? atoll(argv[2]) : 256 * 1024;
+    config.poolThreads = (argc > 3) ? atoi(argv[3]) : 8;
+    config.slowDelayMs = (argc > 4) ? atoi(argv[4]) : 5;
+    config.connectionsPerHost = (argc > 5) ? atoi(argv[5]) : 2;
+
+    LoopbackServer slow(config.slowDelayMs, true);
+    LoopbackServer fast;
+    vector<HostBatch> batches = {{&slow, 0}, {&fast, config.files}};
+    const char *names[] = {"slow", "fast"};
+    string directory = (filesystem::temp_directory_path() / ("host_benchmark_" + to_string(getpid()))).string();
+
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+
+    // Each host's batch on an otherwise idle pool is the baseline for its slowdown
+    vector<double> alone;
+    for (auto &batch : batches)
+    {
+        alone.push_back(runScenario({batch}, config, DispatchPolicy::Fifo, directory).makespan);
+    }
+
+    for (DispatchPolicy policy : {DispatchPolicy::Fifo, DispatchPolicy::PerHost})
+    {
+        RunResult result = runScenario(batches, config, policy, directory);
+        vector<double> service;
+        printf("{\"policy\": \"%s\", \"files\": %d, \"failed\": %d, \"makespan_sec\": %.3f",
+               policy == DispatchPolicy::Fifo ? "fifo" : "per_host", config.files * 2, result.failed, result.makespan);
+        for (size_t host = 0; host < batches.size(); ++host)
+        {
+            printf(", \"%s_done_sec\": %.3f, \"%s_alone_sec\": %.3f", names[host], result.hostDone[host], names[host],
+                   alone[host]);
+            service.push_back(alone[host] / result.hostDone[host]);
+        }
+        printf(", \"jain_fairness\": %.3f}\n", jainIndex(service));
+        fflush(stdout);
+    }
+
+    curl_global_cleanup();
+    return 0;
+}
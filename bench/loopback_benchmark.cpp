@@ -0,0 +1,202 @@
+// loopback_benchmark.cpp
+// End-to-end scenarios against local servers, so a run is repeatable and
+// needs no network: one huge file in ranges, 10k small files, files spread
+// over a fast, a high-latency and a bandwidth-capped host, a flaky server
+// that answers 503s and drops connections mid-body (every file is verified
+// against its CRC32C), many small files multiplexed over HTTP/2 when the
+// build has nghttp2, and 64 ranges sharing a 2 MB write buffer pool. Each
+// scenario downloads in its own child process, so the CPU time and peak RSS
+// it reports are the download manager's alone.
+//
+// Usage: loopback_benchmark [scenario|all] [scale]
+//   scenario: huge, small, mixed, flaky, http2, lowmem; scale multiplies file counts and the huge file's size
+
+#include "DownloadManager.hpp"
+#include "LoopbackServer.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <sys/resource.h>
+
+using namespace std;
+
+struct Scenario
+{
+    string name;
+    vector<LoopbackOptions> hosts; // Files go to the hosts round-robin
+    int files;
+    long long fileSize;
+    EngineMode mode;
+    size_t threads;  // Pool threads or event loops
+    size_t segments; // Ranges per file
+    bool verify;     // Check every file against the CRC32C of its synthetic body
+    long long bufferPool; // Write buffer limit in bytes, 0 = the manager's default
+};
+
+static double percentile(vector<double> values, double fraction)
+{
+    if (values.empty())
+    {
+        return 0;
+    }
+    sort(values.begin(), values.end());
+    return values[static_cast<size_t>(fraction * (values.size() - 1))];
+}
+
+static string syntheticCrc(long long size)
+{
+    vector<char> chunk(1024 * 1024);
+    uint32_t crc = 0;
+    for (long long offset = 0; offset < size; offset += chunk.size())
+    {
+        size_t length = static_cast<size_t>(min<long long>(chunk.size(), size - offset));
+        for (size_t i = 0; i < length; ++i)
+        {
+            chunk[i] = LoopbackServer::patternByte(offset + i);
+        }
+        crc = Crc32c::update(crc, chunk.data(), length);
+    }
+    char digest[32];
+    snprintf(digest, sizeof(digest), "crc32c:%08x", crc);
+    return digest;
+}
+
+static double seconds(const timeval &time)
+{
+    return time.tv_sec + time.tv_usec / 1e6;
+}
+
+// In the child: download everything and print one JSON line
+static void runScenario(const Scenario &scenario, const vector<LoopbackServer *> &servers, const string &directory)
+{
+    streambuf *original = cout.rdbuf(NULL); // Keep per-task logging out of the results
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+
+    vector<double> finishedMs;
+    int completed = 0;
+    int failed = 0;
+    double elapsed;
+    unsigned long long retries;
+    double stallSeconds;
+    {
+        DownloadManager manager(scenario.threads, scenario.mode);
+        manager.setSegmentsPerDownload(scenario.segments);
+        manager.setHttp2PriorKnowledge(scenario.hosts[0].http2);
+        if (scenario.bufferPool > 0)
+        {
+            manager.setBufferPoolLimit(scenario.bufferPool);
+        }
+        if (scenario.name == "flaky")
+        {
+            // Short backoff so the faults cost seconds, not minutes
+            RetrySettings retry;
+            retry.baseDelay = chrono::milliseconds(100);
+            retry.maxDelay = chrono::milliseconds(1000);
+            retry.maxAttempts = 10;
+            manager.setRetrySettings(retry);
+        }
+        string digest = scenario.verify ? syntheticCrc(scenario.fileSize) : string();
+
+        mutex resultsMutex;
+        auto started = chrono::steady_clock::now();
+        manager.setCompletionCallback([&](const DownloadResult &result)
+                                      {
+                                          double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - started).count();
+                                          lock_guard<mutex> lock(resultsMutex);
+                                          finishedMs.push_back(ms);
+                                          (result.status == DownloadStatus::Completed) ? ++completed : ++failed;
+                                      });
+        for (int i = 0; i < scenario.files; ++i)
+        {
+            string url = servers[i % servers.size()]->url(scenario.fileSize, i);
+            manager.addDownload(url, directory + "/file" + to_string(i));
+            if (!digest.empty())
+            {
+                manager.setDownloadChecksum(url, digest);
+            }
+        }
+        manager.startDownloads();
+        manager.waitAll();
+        elapsed = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+        retries = manager.getMetrics().retries;
+        stallSeconds = manager.getBufferPoolStats().stallSeconds;
+    }
+    curl_global_cleanup();
+    cout.rdbuf(original);
+
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    double megabytes = static_cast<double>(completed) * scenario.fileSize / (1024 * 1024);
+    printf("{\"scenario\": \"%s\", \"files\": %d, \"completed\": %d, \"failed\": %d, \"retries\": %llu, "
+           "\"seconds\": %.3f, \"mb_per_sec\": %.1f, \"files_per_sec\": %.1f, \"p50_ms\": %.1f, \"p99_ms\": %.1f, "
+           "\"cpu_user_sec\": %.3f, \"cpu_sys_sec\": %.3f, \"peak_rss_kb\": %ld, \"buffer_stall_sec\": %.3f}\n",
+           scenario.name.c_str(), scenario.files, completed, failed, retries, elapsed, megabytes / elapsed,
+           completed / elapsed, percentile(finishedMs, 0.5), percentile(finishedMs, 0.99), seconds(usage.ru_utime),
+           seconds(usage.ru_stime), usage.ru_maxrss, stallSeconds);
+    fflush(stdout);
+}
+
+static vector<Scenario> scenarios(double scale)
+{
+    auto scaled = [scale](long long value) { return max(1LL, static_cast<long long>(value * scale)); };
+    LoopbackOptions plain;
+    LoopbackOptions slow;
+    slow.delayMs = 100;
+    slow.ranges = false; // Whole files only, like an old server behind a slow link
+    LoopbackOptions capped;
+    capped.bytesPerSecond = 4 * 1024 * 1024;
+    LoopbackOptions flaky;
+    flaky.failEvery = 7;
+    flaky.cutEvery = 5;
+    LoopbackOptions http2;
+    http2.http2 = true;
+
+    vector<Scenario> all;
+    all.push_back({"huge", {plain}, 1, scaled(1024LL * 1024 * 1024), EngineMode::ThreadPerTransfer, 4, 8, false, 0});
+    all.push_back({"small", {plain}, static_cast<int>(scaled(10000)), 16 * 1024, EngineMode::EventLoop, 2, 1, false, 0});
+    all.push_back({"mixed", {plain, slow, capped}, static_cast<int>(scaled(600)), 256 * 1024, EngineMode::ThreadPerTransfer,
+                   16, 2, false, 0});
+    all.push_back({"flaky", {flaky}, static_cast<int>(scaled(200)), 1024 * 1024, EngineMode::ThreadPerTransfer, 8, 4, true, 0});
+    if (LoopbackServer::supportsHttp2())
+    {
+        all.push_back({"http2", {http2}, static_cast<int>(scaled(2000)), 16 * 1024, EngineMode::Multiplexed, 1, 1, false, 0});
+    }
+    // More ranges than buffers: transfers take turns instead of growing memory
+    all.push_back({"lowmem", {plain}, static_cast<int>(scaled(64)), 16 * 1024 * 1024, EngineMode::ThreadPerTransfer, 16, 4,
+                   true, 2 * 1024 * 1024});
+    return all;
+}
+
+int main(int argc, char **argv)
+{
+    string only = (argc > 1) ? argv[1] : "all";
+    double scale = (argc > 2) ? atof(argv[2]) : 1.0;
+
+    string directory = (filesystem::temp_directory_path() / ("loopback_benchmark_" + to_string(getpid()))).string();
+    for (const Scenario &scenario : scenarios(scale))
+    {
+        if (only != "all" && only != scenario.name)
+        {
+            continue;
+        }
+        // Servers are forked from here, outside the measured child
+        vector<unique_ptr<LoopbackServer>> hosts;
+        vector<LoopbackServer *> servers;
+        for (const LoopbackOptions &options : scenario.hosts)
+        {
+            hosts.emplace_back(new LoopbackServer(options));
+            servers.push_back(hosts.back().get());
+        }
+
+        filesystem::create_directories(directory);
+        pid_t child = fork();
+        if (child == 0)
+        {
+            runScenario(scenario, servers, directory);
+            _exit(0);
+        }
+        waitpid(child, NULL, 0);
+        filesystem::remove_all(directory);
+    }
+    return 0;
+}
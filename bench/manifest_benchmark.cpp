@@ -0,0 +1,108 @@
+// manifest_benchmark.cpp
+// Ingest of a large manifest of small files on a loopback server. "single"
+// is the old way: read every line, addDownload() each one, then start them
+// all; "streaming" is addManifest(), which registers and starts batch by
+// batch while it is still parsing. Each mode runs in its own process so the
+// peak RSS (ru_maxrss) is its own.
+//
+// Usage: manifest_benchmark [lines] [bytes per file] [pool threads]
+
+#include "DownloadManager.hpp"
+#include "LoopbackServer.hpp"
+#include <cstdio>
+#include <filesystem>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+using namespace std;
+
+static double secondsSince(chrono::steady_clock::time_point started)
+{
+    return chrono::duration<double>(chrono::steady_clock::now() - started).count();
+}
+
+static void runMode(bool streaming, const string &manifest, const string &directory, size_t threads)
+{
+    cout.rdbuf(NULL); // Drop per-task logging; a string sink would be written by many threads at once
+
+    atomic<long long> firstDoneMicros(-1);
+    auto started = chrono::steady_clock::now();
+    double ingestSeconds;
+    size_t added;
+    {
+        DownloadManager manager(threads);
+        manager.setSegmentsPerDownload(1);
+        manager.setCompletionCallback([&](const DownloadResult &)
+                                      {
+            long long none = -1;
+            long long now = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - started).count();
+            firstDoneMicros.compare_exchange_strong(none, now); });
+
+        if (streaming)
+        {
+            added = manager.addManifest(manifest, directory).entries;
+        }
+        else
+        {
+            ifstream in(manifest);
+            string line;
+            added = 0;
+            while (getline(in, line))
+            {
+                size_t split = line.find(' ');
+                manager.addDownload(line.substr(0, split), directory + "/" + line.substr(split + 1));
+                ++added;
+            }
+            manager.startDownloads();
+        }
+        ingestSeconds = secondsSince(started);
+
+        while (firstDoneMicros.load() < 0)
+        {
+            this_thread::sleep_for(chrono::milliseconds(1));
+        }
+    }
+
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    printf("{\"mode\": \"%s\", \"lines\": %zu, \"ingest_sec\": %.3f, \"first_transfer_done_ms\": %.1f, "
+           "\"peak_rss_mb\": %.1f}\n",
+           streaming ? "streaming" : "single", added, ingestSeconds, firstDoneMicros.load() / 1000.0,
+           usage.ru_maxrss / 1024.0);
+    fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+    size_t lines = (argc > 1) ? strtoull(argv[1], NULL, 10) : 1000000;
+    long long fileSize = (argc > 2) ? atoll(argv[2]) : 1024;
+    size_t threads = (argc > 3) ? atoi(argv[3]) : 8;
+
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    LoopbackServer server;
+    string directory = filesystem::temp_directory_path().string() + "/manifest_bench";
+    string manifest = directory + ".txt";
+    {
+        ofstream out(manifest, ios::trunc);
+        for (size_t i = 0; i < lines; ++i)
+        {
+            out << server.url(fileSize, static_cast<int>(i)) << " file" << i << "\n";
+        }
+    }
+
+    for (bool streaming : {false, true})
+    {
+        filesystem::create_directories(directory);
+        pid_t child = fork();
+        if (child == 0)
+        {
+            runMode(streaming, manifest, directory, threads);
+            _exit(0);
+        }
+        waitpid(child, NULL, 0);
+        filesystem::remove_all(directory);
+    }
+    filesystem::remove(manifest);
+    curl_global_cleanup();
+    return 0;
+}
@@ -0,0 +1,190 @@
+// multiplex_benchmark.cpp
+// Small-file throughput against one HTTP/2 origin: the thread-per-transfer
+// pool, the event-loop engine and the multiplexed engine (one connection,
+// many streams) each fetch the same object under distinct query strings.
+// Without a URL it starts nghttpd from PATH on a temporary directory, over
+// TLS with a throwaway certificate made by the openssl tool. An http:// URL
+// is fetched with HTTP/2 prior knowledge.
+//
+// Usage: multiplex_benchmark [files] [bytes] [streams per origin] [url]
+
+#include "DownloadManager.hpp"
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <csignal>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+using namespace std;
+
+struct BenchConfig
+{
+    int files;
+    size_t streams;
+    string url;
+    bool priorKnowledge;
+};
+
+static int freePort()
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address));
+    socklen_t length = sizeof(address);
+    getsockname(fd, reinterpret_cast<sockaddr *>(&address), &length);
+    close(fd);
+    return ntohs(address.sin_port);
+}
+
+static bool waitForPort(int port)
+{
+    for (int attempt = 0; attempt < 200; ++attempt)
+    {
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(port);
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        bool connected = connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) == 0;
+        close(fd);
+        if (connected)
+        {
+            return true;
+        }
+        usleep(10000);
+    }
+    return false;
+}
+
+static void runScenario(const BenchConfig &config, EngineMode mode, size_t threads, const char *name, const string &directory)
+{
+    ostringstream sink;
+    streambuf *original = cout.rdbuf(sink.rdbuf()); // Keep per-task logging out of the results
+
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    auto started = chrono::steady_clock::now();
+    int completed = 0;
+    int failed = 0;
+    {
+        DownloadManager manager(threads, mode);
+        manager.setSegmentsPerDownload(1);
+        manager.setHttp2PriorKnowledge(config.priorKnowledge);
+        manager.setStreamsPerOrigin(config.streams);
+
+        char separator = (config.url.find('?') == string::npos) ? '?' : '&';
+        vector<string> urls;
+        for (int i = 0; i < config.files; ++i)
+        {
+            urls.push_back(config.url + separator + "n=" + to_string(i));
+            manager.addDownload(urls.back(), directory + "/file" + to_string(i));
+        }
+        manager.startDownloads();
+
+        size_t next = 0;
+        while (next < urls.size())
+        {
+            DownloadStatus status = manager.getDownloadStatus(urls[next]);
+            if (status == DownloadStatus::Completed || status == DownloadStatus::Failed)
+            {
+                (status == DownloadStatus::Completed) ? ++completed : ++failed;
+                ++next;
+                continue;
+            }
+            this_thread::sleep_for(chrono::milliseconds(2));
+        }
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+    curl_global_cleanup();
+    cout.rdbuf(original);
+
+    printf("{\"mode\": \"%s\", \"threads\": %zu, \"files\": %d, \"failed\": %d, \"seconds\": %.3f, \"files_per_sec\": %.1f}\n",
+           name, threads, completed, failed, seconds, completed / seconds);
+    fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+    BenchConfig config;
+    config.files = (argc > 1) ? atoi(argv[1]) : 1000;
+    long long fileSize = (argc > 2) ? atoll(argv[2]) : 8 * 1024;
+    config.streams = (argc > 3) ? atoi(argv[3]) : 100;
+    config.url = (argc > 4) ? argv[4] : "";
+    config.priorKnowledge = true;
+
+    string directory = (filesystem::temp_directory_path() / ("multiplex_benchmark_" + to_string(getpid()))).string();
+    string served = directory + "_www";
+    pid_t server = -1;
+    if (config.url.empty())
+    {
+        filesystem::create_directories(served);
+        ofstream(served + "/small.bin", ios::binary) << string(fileSize, 'x');
+        string key = served + "/key.pem";
+        string certificate = served + "/cert.pem";
+        string command = "openssl req -x509 -newkey rsa:2048 -nodes -days 1 -subj /CN=127.0.0.1 -keyout " + key +
+                         " -out " + certificate + " >/dev/null 2>&1";
+        if (system(command.c_str()) != 0)
+        {
+            fprintf(stderr, "openssl could not create a certificate; pass the URL of a small file on an HTTP/2 server\n");
+            filesystem::remove_all(served);
+            return 1;
+        }
+        int port = freePort();
+        server = fork();
+        if (server == 0)
+        {
+            int null = open("/dev/null", O_WRONLY);
+            dup2(null, STDOUT_FILENO);
+            dup2(null, STDERR_FILENO);
+            execlp("nghttpd", "nghttpd", "-d", served.c_str(), to_string(port).c_str(), key.c_str(), certificate.c_str(),
+                   (char *)NULL);
+            _exit(127);
+        }
+        if (!waitForPort(port))
+        {
+            fprintf(stderr, "nghttpd did not start; pass the URL of a small file on an HTTP/2 server\n");
+            kill(server, SIGTERM);
+            waitpid(server, NULL, 0);
+            filesystem::remove_all(served);
+            return 1;
+        }
+        config.url = "https://127.0.0.1:" + to_string(port) + "/small.bin";
+    }
+
+    struct Scenario
+    {
+        EngineMode mode;
+        size_t threads;
+        const char *name;
+    };
+    // The pool size matches the CLI's DownloadManager(5)
+    for (Scenario scenario : {Scenario{EngineMode::ThreadPerTransfer, 5, "thread_per_transfer"},
+                              Scenario{EngineMode::EventLoop, 2, "event_loop"},
+                              Scenario{EngineMode::Multiplexed, 2, "multiplexed"}})
+    {
+        filesystem::create_directories(directory);
+        pid_t child = fork();
+        if (child == 0)
+        {
+            runScenario(config, scenario.mode, scenario.threads, scenario.name, directory);
+            _exit(0);
+        }
+        waitpid(child, NULL, 0);
+        filesystem::remove_all(directory);
+    }
+
+    if (server > 0)
+    {
+        kill(server, SIGTERM);
+        waitpid(server, NULL, 0);
+        filesystem::remove_all(served);
+    }
+    return 0;
+}
@@ -0,0 +1,124 @@
+// progress_benchmark.cpp
+// Cost of one progress callback with 1..16 transfer threads calling it at
+// once. "legacy" replays the old callback body (URL copy, filename substring,
+// a process-wide mutex and stream output on every 10%); "published" is
+// DownloadTask::onProgress, which only stores counters for the reporter.
+//
+// Usage: progress_benchmark [calls per thread]
+
+#include "DownloadTask.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ostream>
+#include <thread>
+
+using namespace std;
+
+// Stream that formats but discards, so the terminal is not what gets measured
+class NullBuffer : public streambuf
+{
+protected:
+    int overflow(int c) override { return c; }
+    streamsize xsputn(const char *, streamsize count) override { return count; }
+};
+
+static NullBuffer nullBuffer;
+static ostream nullStream(&nullBuffer);
+static mutex legacyMutex;
+
+static int legacyCallback(DownloadTask *task, curl_off_t dlnow, curl_off_t dltotal)
+{
+    if (task->onProgress())
+    {
+        return 1;
+    }
+    double progress = static_cast<double>(dlnow) / static_cast<double>(dltotal);
+    task->updateProgress(progress);
+
+    string url = task->getUrl();
+    string filename = url.substr(url.find_last_of('/') + 1);
+
+    lock_guard<mutex> lock(legacyMutex);
+    int percentage = static_cast<int>(progress * 100);
+    static int last_percentage = -1;
+    if (percentage != last_percentage && (percentage % 10 == 0 || percentage == 100))
+    {
+        nullStream << "[" << filename << "] " << percentage << "% downloaded ("
+                   << dlnow / 1024 << " KB / " << dltotal / 1024 << " KB)" << endl;
+        last_percentage = percentage;
+    }
+    return 0;
+}
+
+static double runCallbacks(bool legacy, int threads, long long calls)
+{
+    TransferOptions options;
+    vector<unique_ptr<DownloadTask>> tasks;
+    for (int i = 0; i < threads; ++i)
+    {
+        // One task per thread, as with real transfers; never started, so no I/O happens
+        string url = "http://127.0.0.1/bench/file" + to_string(i) + ".bin";
+        tasks.emplace_back(new DownloadTask(url, "/dev/null", options, NULL, NULL, NULL));
+    }
+
+    atomic<int> ready(0);
+    atomic<bool> go(false);
+    vector<thread> workers;
+    vector<double> seconds(threads);
+    for (int i = 0; i < threads; ++i)
+    {
+        workers.emplace_back([&, i]()
+                             {
+            DownloadTask *task = tasks[i].get();
+            ++ready;
+            while (!go)
+            {
+                this_thread::yield();
+            }
+            auto started = chrono::steady_clock::now();
+            for (long long call = 0; call < calls; ++call)
+            {
+                if (legacy)
+                {
+                    legacyCallback(task, call, calls);
+                }
+                else
+                {
+                    task->onProgress();
+                }
+            }
+            seconds[i] = chrono::duration<double>(chrono::steady_clock::now() - started).count(); });
+    }
+    while (ready < threads)
+    {
+        this_thread::yield();
+    }
+    go = true;
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+
+    double total = 0;
+    for (double value : seconds)
+    {
+        total += value;
+    }
+    return total / threads / calls * 1e9;
+}
+
+int main(int argc, char **argv)
+{
+    long long calls = (argc > 1) ? strtoll(argv[1], NULL, 10) : 2000000;
+
+    for (int threads : {1, 4, 16})
+    {
+        double legacy = runCallbacks(true, threads, calls);
+        double published = runCallbacks(false, threads, calls);
+        printf("{\"threads\": %d, \"calls_per_thread\": %lld, \"legacy_ns_per_call\": %.1f, "
+               "\"published_ns_per_call\": %.1f, \"speedup\": %.2f}\n",
+               threads, calls, legacy, published, legacy / published);
+    }
+    return 0;
+}
@@ -0,0 +1,103 @@
+// queue_benchmark.cpp
+// Contention micro-benchmark for MpmcQueue: enqueue latency (time inside
+// push) and end-to-end dequeue latency with 1..64 producers and consumers.
+//
+// Usage: queue_benchmark [items per run] [queue capacity]
+
+#include "MpmcQueue.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <cstdint>
+
+using namespace std;
+
+static uint64_t nowNanos()
+{
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static uint64_t percentile(vector<uint64_t> &samples, double fraction)
+{
+    if (samples.empty())
+    {
+        return 0;
+    }
+    size_t index = static_cast<size_t>(fraction * (samples.size() - 1));
+    nth_element(samples.begin(), samples.begin() + index, samples.end());
+    return samples[index];
+}
+
+static void runContention(int threads, size_t items, size_t capacity)
+{
+    MpmcQueue<uint64_t> queue(capacity);
+    size_t perProducer = items / threads;
+    size_t total = perProducer * threads;
+    vector<vector<uint64_t>> enqueueSamples(threads);
+    vector<vector<uint64_t>> dequeueSamples(threads);
+    atomic<size_t> consumed(0);
+    vector<thread> workers;
+
+    uint64_t started = nowNanos();
+    for (int p = 0; p < threads; ++p)
+    {
+        workers.emplace_back([&, p]()
+                             {
+            enqueueSamples[p].reserve(perProducer);
+            for (size_t i = 0; i < perProducer; ++i)
+            {
+                uint64_t before = nowNanos();
+                queue.push(before); // The payload is the enqueue timestamp
+                enqueueSamples[p].push_back(nowNanos() - before);
+            } });
+    }
+    for (int c = 0; c < threads; ++c)
+    {
+        workers.emplace_back([&, c]()
+                             {
+            uint64_t stamp;
+            while (queue.pop(stamp))
+            {
+                dequeueSamples[c].push_back(nowNanos() - stamp);
+                if (consumed.fetch_add(1) + 1 == total)
+                {
+                    queue.close(); // Last item: release the other parked consumers
+                }
+            } });
+    }
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+    double seconds = (nowNanos() - started) / 1e9;
+
+    vector<uint64_t> enqueueAll;
+    vector<uint64_t> dequeueAll;
+    for (int i = 0; i < threads; ++i)
+    {
+        enqueueAll.insert(enqueueAll.end(), enqueueSamples[i].begin(), enqueueSamples[i].end());
+        dequeueAll.insert(dequeueAll.end(), dequeueSamples[i].begin(), dequeueSamples[i].end());
+    }
+
+    printf("{\"producers\": %d, \"consumers\": %d, \"items\": %zu, \"ops_per_sec\": %.0f, "
+           "\"enqueue_p50_ns\": %llu, \"enqueue_p99_ns\": %llu, "
+           "\"dequeue_p50_ns\": %llu, \"dequeue_p99_ns\": %llu}\n",
+           threads, threads, total, total / seconds,
+           (unsigned long long)percentile(enqueueAll, 0.50), (unsigned long long)percentile(enqueueAll, 0.99),
+           (unsigned long long)percentile(dequeueAll, 0.50), (unsigned long long)percentile(dequeueAll, 0.99));
+    fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+    size_t items = (argc > 1) ? strtoull(argv[1], NULL, 10) : 1000000;
+    size_t capacity = (argc > 2) ? strtoull(argv[2], NULL, 10) : 1024;
+
+    for (int threads : {1, 2, 4, 8, 16, 32, 64})
+    {
+        runContention(threads, items, capacity);
+    }
+    return 0;
+}
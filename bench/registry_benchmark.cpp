@@ -0,0 +1,175 @@
+// registry_benchmark.cpp
+// Task lookups under churn: reader threads look up random tasks and read
+// their status while one writer keeps adding and removing tasks. Compares
+// the sharded TaskRegistry with the former single mutex around a map keyed
+// by URL, and times "all failed tasks" from the status index against a scan.
+//
+// Usage: registry_benchmark [tasks] [milliseconds per run]
+
+#include "TaskRegistry.hpp"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <thread>
+
+using namespace std;
+
+// What DownloadManager used before the registry
+class LockedMap
+{
+private:
+    unordered_map<string, shared_ptr<DownloadTask>> tasks;
+    mutex taskMutex;
+
+public:
+    void add(const shared_ptr<DownloadTask> &task)
+    {
+        lock_guard<mutex> lock(taskMutex);
+        tasks[task->getUrl()] = task;
+    }
+    void remove(const string &url)
+    {
+        lock_guard<mutex> lock(taskMutex);
+        tasks.erase(url);
+    }
+    DownloadStatus status(const string &url)
+    {
+        lock_guard<mutex> lock(taskMutex);
+        auto task = tasks.find(url);
+        return (task != tasks.end()) ? task->second->getStatus() : DownloadStatus::Completed;
+    }
+    size_t countFailed()
+    {
+        lock_guard<mutex> lock(taskMutex);
+        size_t failed = 0;
+        for (const auto &task : tasks)
+        {
+            failed += task.second->getStatus() == DownloadStatus::Failed;
+        }
+        return failed;
+    }
+};
+
+static string urlOf(size_t index)
+{
+    return "http://127.0.0.1/bench/file" + to_string(index) + ".bin";
+}
+
+static shared_ptr<DownloadTask> makeTask(size_t index)
+{
+    return make_shared<DownloadTask>(urlOf(index), "/dev/null");
+}
+
+// Runs readers against a writer for the given time; returns lookups per second
+template <typename Lookup, typename Churn>
+static double runLookups(int readers, chrono::milliseconds duration, Lookup lookup, Churn churn)
+{
+    atomic<bool> stop(false);
+    vector<unsigned long long> done(readers);
+    vector<thread> threads;
+    for (int i = 0; i < readers; ++i)
+    {
+        threads.emplace_back([&, i]()
+                             {
+            mt19937_64 random(i + 1);
+            unsigned long long count = 0;
+            while (!stop.load(memory_order_relaxed))
+            {
+                lookup(random);
+                ++count;
+            }
+            done[i] = count; });
+    }
+    thread writer([&]()
+                  {
+        size_t round = 0;
+        while (!stop.load(memory_order_relaxed))
+        {
+            churn(round++);
+        } });
+
+    auto started = chrono::steady_clock::now();
+    this_thread::sleep_for(duration);
+    stop = true;
+    for (auto &reader : threads)
+    {
+        reader.join();
+    }
+    writer.join();
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+
+    unsigned long long total = 0;
+    for (unsigned long long count : done)
+    {
+        total += count;
+    }
+    return total / seconds;
+}
+
+int main(int argc, char **argv)
+{
+    size_t taskCount = (argc > 1) ? strtoull(argv[1], NULL, 10) : 100000;
+    chrono::milliseconds duration((argc > 2) ? atoi(argv[2]) : 1000);
+
+    TaskRegistry registry;
+    LockedMap locked;
+    vector<TaskId> ids;
+    vector<string> urls;
+    for (size_t i = 0; i < taskCount; ++i)
+    {
+        urls.push_back(urlOf(i));
+        auto task = makeTask(i);
+        if (i % 100 == 0)
+        {
+            task->cancel(); // 1% failed, for the status query
+        }
+        ids.push_back(registry.add(task));
+        locked.add(task);
+    }
+
+    // Churn touches tasks beyond the looked-up range so lookups always hit
+    vector<shared_ptr<DownloadTask>> spare;
+    for (size_t i = 0; i < 1024; ++i)
+    {
+        spare.push_back(makeTask(taskCount + i));
+    }
+
+    for (int readers : {1, 4, 16})
+    {
+        double sharded = runLookups(
+            readers, duration,
+            [&](mt19937_64 &random)
+            {
+                auto task = registry.find(ids[random() % ids.size()]);
+                return task ? task->getStatus() : DownloadStatus::Completed;
+            },
+            [&](size_t round)
+            {
+                TaskId id = registry.add(spare[round % spare.size()]);
+                registry.remove(id);
+            });
+        double single = runLookups(
+            readers, duration,
+            [&](mt19937_64 &random)
+            { return locked.status(urls[random() % urls.size()]); },
+            [&](size_t round)
+            {
+                locked.add(spare[round % spare.size()]);
+                locked.remove(spare[round % spare.size()]->getUrl());
+            });
+        printf("{\"readers\": %d, \"tasks\": %zu, \"locked_map_lookups_per_sec\": %.0f, "
+               "\"registry_lookups_per_sec\": %.0f, \"speedup\": %.2f}\n",
+               readers, taskCount, single, sharded, sharded / single);
+    }
+
+    auto started = chrono::steady_clock::now();
+    size_t scanned = locked.countFailed();
+    double scanMs = chrono::duration<double, milli>(chrono::steady_clock::now() - started).count();
+    started = chrono::steady_clock::now();
+    size_t indexed = registry.withStatus(DownloadStatus::Failed).size();
+    double indexMs = chrono::duration<double, milli>(chrono::steady_clock::now() - started).count();
+    printf("{\"query\": \"failed\", \"tasks\": %zu, \"matches\": %zu, \"scan_ms\": %.3f, \"index_ms\": %.3f, \"index_matches\": %zu}\n",
+           taskCount, scanned, scanMs, indexMs, indexed);
+    return 0;
+}
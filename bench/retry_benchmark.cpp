@@ -0,0 +1,145 @@
+// retry_benchmark.cpp
+// What does a dead mirror cost the rest of the queue? Some downloads point
+// at a host that accepts connections and closes them at once, the others at
+// a healthy loopback server, all sharing one small pool. "flat" retries every
+// failure after about 2 s without end and without a breaker, like the old
+// clearTasks loop; "policy" uses the default RetrySettings. Reported: how
+// many requests reached the dead host within the window, and how long the
+// healthy downloads took.
+//
+// Usage: retry_benchmark [dead downloads] [healthy files] [bytes per file] [pool threads] [window seconds]
+
+#include "DownloadManager.hpp"
+#include "LoopbackServer.hpp"
+#include <cstdio>
+#include <filesystem>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using namespace std;
+
+// Accepts and hangs up, counting every connection
+class DeadHost
+{
+private:
+    int listener;
+    int port;
+    atomic<bool> running;
+    atomic<long long> connections;
+    thread worker;
+
+    void serve()
+    {
+        while (running)
+        {
+            pollfd ready = {listener, POLLIN, 0};
+            if (poll(&ready, 1, 50) > 0)
+            {
+                int client = accept(listener, NULL, NULL);
+                if (client >= 0)
+                {
+                    ++connections;
+                    close(client);
+                }
+            }
+        }
+    }
+
+public:
+    DeadHost() : running(true), connections(0)
+    {
+        listener = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address = {};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        bind(listener, reinterpret_cast<sockaddr *>(&address), sizeof(address));
+        listen(listener, 128);
+        socklen_t length = sizeof(address);
+        getsockname(listener, reinterpret_cast<sockaddr *>(&address), &length);
+        port = ntohs(address.sin_port);
+        worker = thread(&DeadHost::serve, this);
+    }
+
+    ~DeadHost()
+    {
+        running = false;
+        worker.join();
+        close(listener);
+    }
+
+    string url(int id) const
+    {
+        return "http://127.0.0.1:" + to_string(port) + "/file" + to_string(id);
+    }
+
+    long long count() const
+    {
+        return connections.load();
+    }
+};
+
+static void runMode(bool policy, const LoopbackServer &server, int dead, int files, long long fileSize, size_t threads,
+                    int window)
+{
+    streambuf *original = cout.rdbuf(NULL); // Keep per-task logging out of the results
+    string directory = filesystem::temp_directory_path().string() + "/retry_bench";
+    filesystem::create_directories(directory);
+
+    DeadHost mirror;
+    double healthySeconds;
+    long long deadRequests;
+    {
+        DownloadManager manager(threads);
+        manager.setSegmentsPerDownload(1);
+        if (!policy)
+        {
+            RetrySettings flat;
+            flat.maxAttempts = 1000000;
+            flat.baseDelay = chrono::milliseconds(2000);
+            flat.maxDelay = chrono::milliseconds(2000);
+            flat.breakerThreshold = 0;
+            manager.setRetrySettings(flat);
+        }
+
+        for (int i = 0; i < dead; ++i)
+        {
+            manager.addDownload(mirror.url(i), directory + "/dead" + to_string(i));
+        }
+        vector<TaskId> healthy;
+        for (int i = 0; i < files; ++i)
+        {
+            healthy.push_back(manager.addDownload(server.url(fileSize, i), directory + "/file" + to_string(i)).id);
+        }
+
+        auto started = chrono::steady_clock::now();
+        manager.startDownloads();
+        manager.waitAll(healthy);
+        healthySeconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+        this_thread::sleep_until(started + chrono::seconds(window));
+        deadRequests = mirror.count();
+    }
+    filesystem::remove_all(directory);
+    cout.rdbuf(original);
+
+    printf("{\"mode\": \"%s\", \"dead_downloads\": %d, \"window_sec\": %d, \"dead_host_requests\": %lld, "
+           "\"healthy_files\": %d, \"healthy_makespan_sec\": %.3f}\n",
+           policy ? "policy" : "flat", dead, window, deadRequests, files, healthySeconds);
+}
+
+int main(int argc, char **argv)
+{
+    int dead = (argc > 1) ? atoi(argv[1]) : 50;
+    int files = (argc > 2) ? atoi(argv[2]) : 200;
+    long long fileSize = (argc > 3) ? atoll(argv[3]) : 256 * 1024;
+    size_t threads = (argc > 4) ? atoi(argv[4]) : 4;
+    int window = (argc > 5) ? atoi(argv[5]) : 30;
+
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    LoopbackServer server;
+    runMode(false, server, dead, files, fileSize, threads, window);
+    runMode(true, server, dead, files, fileSize, threads, window);
+    curl_global_cleanup();
+    return 0;
+}
@@ -0,0 +1,132 @@
+// trace_benchmark.cpp
+// What tracing costs. First the recorder alone: nanoseconds per event with
+// 1, 4 and 16 threads recording at once, against the check a disabled
+// recorder costs. Then a batch of small files from a loopback server with
+// tracing off and on: files/sec, events kept and the size and time of the
+// Chrome trace dump.
+//
+// Usage: trace_benchmark [events per thread] [files] [bytes per file] [pool threads]
+
+#include "DownloadManager.hpp"
+#include "LoopbackServer.hpp"
+#include <cstdio>
+#include <filesystem>
+
+using namespace std;
+
+static double runRecorder(bool enabled, int threads, long long events)
+{
+    TraceRecorder trace;
+    if (enabled)
+    {
+        trace.start(65536);
+    }
+
+    atomic<int> ready(0);
+    atomic<bool> go(false);
+    vector<thread> workers;
+    vector<double> seconds(threads);
+    for (int i = 0; i < threads; ++i)
+    {
+        workers.emplace_back([&, i]()
+                             {
+            ++ready;
+            while (!go)
+            {
+                this_thread::yield();
+            }
+            auto started = chrono::steady_clock::now();
+            for (long long event = 0; event < events; ++event)
+            {
+                // The pattern of the instrumented code: check, then read the clock and record
+                if (trace.enabled())
+                {
+                    long long now = trace.now();
+                    trace.span("write", "disk", i + 1, TraceRecorder::THREAD, now, now, 4096);
+                }
+            }
+            seconds[i] = chrono::duration<double>(chrono::steady_clock::now() - started).count(); });
+    }
+    while (ready < threads)
+    {
+        this_thread::yield();
+    }
+    go = true;
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+
+    double total = 0;
+    for (double value : seconds)
+    {
+        total += value;
+    }
+    return total / threads / events * 1e9;
+}
+
+static void runDownloads(bool traced, const LoopbackServer &server, int files, long long fileSize, size_t threads)
+{
+    streambuf *original = cout.rdbuf(NULL); // Keep per-task logging out of the results
+    string directory = filesystem::temp_directory_path().string() + "/trace_bench";
+    filesystem::create_directories(directory);
+    string path = directory + "/trace.json";
+
+    double seconds;
+    double dumpMs = 0;
+    long long traceBytes = 0;
+    {
+        DownloadManager manager(threads);
+        manager.setSegmentsPerDownload(1);
+        if (traced)
+        {
+            manager.startTrace();
+        }
+        for (int i = 0; i < files; ++i)
+        {
+            manager.addDownload(server.url(fileSize, i), directory + "/file" + to_string(i));
+        }
+        auto started = chrono::steady_clock::now();
+        manager.startDownloads();
+        manager.waitAll();
+        seconds = chrono::duration<double>(chrono::steady_clock::now() - started).count();
+
+        if (traced)
+        {
+            auto dumped = chrono::steady_clock::now();
+            manager.writeTrace(path);
+            dumpMs = chrono::duration<double, milli>(chrono::steady_clock::now() - dumped).count();
+            traceBytes = static_cast<long long>(filesystem::file_size(path));
+        }
+    }
+    filesystem::remove_all(directory);
+    cout.rdbuf(original);
+
+    printf("{\"tracing\": %s, \"files\": %d, \"seconds\": %.3f, \"files_per_sec\": %.1f, \"trace_bytes\": %lld, "
+           "\"dump_ms\": %.1f}\n",
+           traced ? "true" : "false", files, seconds, files / seconds, traceBytes, dumpMs);
+}
+
+int main(int argc, char **argv)
+{
+    long long events = (argc > 1) ? strtoll(argv[1], NULL, 10) : 5000000;
+    int files = (argc > 2) ? atoi(argv[2]) : 2000;
+    long long fileSize = (argc > 3) ? atoll(argv[3]) : 64 * 1024;
+    size_t threads = (argc > 4) ? atoi(argv[4]) : 8;
+
+    for (int count : {1, 4, 16})
+    {
+        double off = runRecorder(false, count, events);
+        double on = runRecorder(true, count, events);
+        printf("{\"threads\": %d, \"events_per_thread\": %lld, \"disabled_ns_per_event\": %.1f, "
+               "\"enabled_ns_per_event\": %.1f}\n",
+               count, events, off, on);
+    }
+
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    LoopbackServer server;
+    runDownloads(false, server, files, fileSize, threads);
+    runDownloads(true, server, files, fileSize, threads);
+    curl_global_cleanup();
+    return 0;
+}
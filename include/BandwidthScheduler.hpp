@@ -0,0 +1,83 @@
+// BandwidthScheduler.hpp
+#ifndef BANDWIDTHSCHEDULER_HPP
+#define BANDWIDTHSCHEDULER_HPP
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+
+using namespace std;
+
+enum class TransferPriority
+{
+    Low,
+    Normal,
+    High
+};
+
+// Hierarchical token buckets: a global rate is split between the priority
+// classes that currently have traffic in proportion to their weights, a class
+// past its share may borrow whatever the others leave unused, and every task
+// may have its own cap below that. Write callbacks ask for bytes
+// before accepting them; a refused transfer is paused and woken by a timer
+// on the thread that drives it.
+class BandwidthScheduler
+{
+public:
+    struct Bucket
+    {
+        long long rate; // Bytes per second, 0 = unlimited
+        double tokens;  // May go negative: a chunk is never split
+        chrono::steady_clock::time_point refilled;
+
+        Bucket() : rate(0), tokens(0) {}
+    };
+
+    // Per-task state, owned by the task and only touched under the scheduler lock
+    struct Flow
+    {
+        TransferPriority priority;
+        Bucket bucket;
+
+        Flow() : priority(TransferPriority::Normal) {}
+    };
+
+private:
+    static const int CLASS_COUNT = 3;
+
+    struct PriorityClass
+    {
+        unsigned weight;
+        Bucket bucket;
+        chrono::steady_clock::time_point lastDemand;
+    };
+
+    mutex schedulerMutex;
+    long long globalRate;
+    Bucket global; // Charged by every class; positive only when some share goes unused
+    PriorityClass classes[CLASS_COUNT];
+    atomic<size_t> limits; // Global cap plus capped flows; zero skips the lock entirely
+
+    void refill(Bucket &bucket, chrono::steady_clock::time_point now);
+    void splitGlobalRate(chrono::steady_clock::time_point now);
+
+public:
+    BandwidthScheduler();
+
+    void setGlobalRate(long long bytesPerSecond);
+    void setClassWeight(TransferPriority priority, unsigned weight);
+    void setFlowRate(Flow &flow, long long bytesPerSecond);
+    void setFlowPriority(Flow &flow, TransferPriority priority);
+    void removeFlow(Flow &flow);
+
+    // 0 when the bytes may be accepted now, otherwise microseconds to wait
+    long long request(Flow &flow, size_t bytes);
+
+    // Wake-ups of throttled transfers, kept per driving thread
+    static void wakeAfter(long long micros, const void *owner, void (*wake)(void *), void *context);
+    static void cancelWakeups(const void *owner);
+    static int nextWakeupMs(int limitMs); // Poll timeout that does not oversleep a wake-up
+    static void runDueWakeups();
+};
+
+#endif // BANDWIDTHSCHEDULER_HPP
@@ -0,0 +1,66 @@
+// BufferPool.hpp
+#ifndef BUFFERPOOL_HPP
+#define BUFFERPOOL_HPP
+
+#include <vector>
+#include <mutex>
+#include <atomic>
+
+using namespace std;
+
+struct BufferPoolStats
+{
+    size_t bufferSize;
+    size_t buffers;    // In the slab, 0 until the first buffer is taken
+    size_t inUse;
+    size_t peakInUse;
+    double utilization; // inUse / buffers
+    unsigned long long acquired;
+    unsigned long long stalls; // Times a range found the pool empty and paused
+    double stallSeconds;       // Time ranges spent paused waiting for a buffer
+};
+
+// Write buffers of every transfer of a manager, carved out of one slab that
+// is allocated once, on first use, and sized by the memory limit. A range
+// borrows a buffer while it gathers callback data and gives it back once the
+// data is on its way to the file; when none is free the transfer pauses its
+// socket instead of allocating, so a fast network cannot outgrow a slow disk.
+// Taking and returning a buffer is a short lock, once per buffer filled.
+class BufferPool
+{
+private:
+    mutex slabMutex;
+    atomic<bool> allocated;
+    char *slab;
+    size_t bufferSize;
+    atomic<long long> limit;
+    size_t count;
+    mutex freeMutex;
+    vector<int> freeBuffers; // A stack: the buffer given back last, still in cache and backed, goes out first
+    atomic<size_t> inUse;
+    atomic<size_t> peakInUse;
+    atomic<unsigned long long> acquired;
+    atomic<unsigned long long> stalls;
+    atomic<unsigned long long> stallMicros;
+
+    bool allocate();
+
+public:
+    static const size_t ALIGNMENT = 4096; // A page: whole cache lines, and what O_DIRECT needs
+    static const long long RETRY_MICROS = 2000; // Pause of a range that found the pool empty
+
+    BufferPool(size_t bufferSize = 1024 * 1024, long long limit = 256LL * 1024 * 1024);
+    ~BufferPool();
+
+    // Only before the slab exists; false once it does. A limit of 0 disables the pool
+    bool configure(size_t bufferSize, long long limit);
+    bool enabled() const;
+    long long getLimit() const;
+    size_t getBufferSize() const;
+    char *acquire(int &index); // NULL while every buffer is out
+    void release(int index);
+    void recordStall(long long micros); // A range got its buffer after waiting this long
+    BufferPoolStats getStats() const;
+};
+
+#endif // BUFFERPOOL_HPP
@@ -0,0 +1,55 @@
+// Checksum.hpp
+#ifndef CHECKSUM_HPP
+#define CHECKSUM_HPP
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+
+using namespace std;
+
+// CRC32C (Castagnoli). Uses the SSE4.2 / ARMv8 CRC instructions when the CPU
+// has them. CRCs of neighbouring ranges combine into the CRC of the whole
+// without touching the data again.
+class Crc32c
+{
+public:
+    static uint32_t update(uint32_t crc, const void *data, size_t length); // Start from 0
+    static uint32_t combine(uint32_t first, uint32_t second, long long secondLength); // CRC of first + second
+    static bool accelerated();
+};
+
+// Streaming SHA-256, through the SHA extensions (SHA-NI) when the CPU has them
+class Sha256
+{
+private:
+    uint32_t state[8];
+    unsigned char block[64];
+    size_t blockUsed;
+    unsigned long long length;
+
+public:
+    Sha256();
+    void reset();
+    void update(const void *data, size_t length);
+    string finalHex(); // Lowercase hex digest; reset() before hashing again
+    static bool accelerated();
+};
+
+// Turns hardware paths on or off for the whole process; false forces the portable code (benchmarks)
+void setChecksumAcceleration(bool enabled);
+
+// Digest a download must match, as given in a manifest, a .sha256 sidecar or setDownloadChecksum()
+struct ExpectedDigest
+{
+    string sha256; // Lowercase hex, empty when not given
+    bool hasCrc32c;
+    uint32_t crc32c;
+
+    ExpectedDigest() : hasCrc32c(false), crc32c(0) {}
+    bool empty() const { return sha256.empty() && !hasCrc32c; }
+    // "sha256:<64 hex>", "crc32c:<8 hex>" or the bare hex of either; false when it is neither
+    static bool parse(const string &text, ExpectedDigest &digest);
+};
+
+#endif // CHECKSUM_HPP
@@ -0,0 +1,90 @@
+// ConcurrencyController.hpp
+#ifndef CONCURRENCYCONTROLLER_HPP
+#define CONCURRENCYCONTROLLER_HPP
+
+#include <string>
+#include <deque>
+#include <vector>
+#include <mutex>
+
+using namespace std;
+
+// One step of the controller, kept for getStats()
+struct ConcurrencyDecision
+{
+    double atSeconds; // Since the controller was created
+    size_t limit;     // Connections allowed after the decision
+    double goodput;   // Bytes per second written during the sample
+    double latencyMs; // Mean time to first byte of requests finished during the sample, 0 = none
+    string reason;
+};
+
+struct ConcurrencyStats
+{
+    bool enabled;
+    size_t limit;     // Connections the manager may open
+    size_t transfers; // Files allowed to run at once
+    size_t segments;  // Ranges per newly started file
+    size_t minLimit;
+    size_t maxLimit;
+    double goodput;
+    double latencyMs;
+    double baseLatencyMs; // Lowest recent latency, the uncongested reference
+    unsigned long long samples;
+    unsigned long long increases;
+    unsigned long long decreases;
+    vector<ConcurrencyDecision> recent; // Oldest first
+};
+
+// AIMD search for the throughput knee. Once per interval the manager feeds
+// it the bytes delivered and the mean time to first byte from the transfer
+// metrics. While more connections keep raising goodput the
+// limit grows (doubling until the first knee, then one at a time); when
+// goodput stops improving it steps back, holds, and then probes one below,
+// giving up connections as long as goodput stays. When goodput falls or
+// latency climbs well above its baseline the limit is cut by a quarter.
+class ConcurrencyController
+{
+private:
+    enum class Action
+    {
+        Hold,
+        Increase,
+        Decrease, // Multiplicative cut on overload
+        ProbeDown // One connection less, kept if goodput holds
+    };
+
+    mutable mutex controllerMutex;
+    size_t limit;
+    size_t minLimit;
+    size_t maxLimit;
+    size_t transfers;
+    size_t segments;
+    bool slowStart;
+    bool probeDown; // Next probe from a hold goes below the limit
+    Action lastAction;
+    int holdSamples;
+    double lastGoodput;
+    double probeReference; // Goodput before the current run of downward probes
+    double lastLatencyMs;
+    double baseLatencyMs;
+    unsigned long long samples;
+    unsigned long long increases;
+    unsigned long long decreases;
+    deque<ConcurrencyDecision> recent;
+    double created;
+
+    void decide(Action action, size_t newLimit, double goodput, double latencyMs, const string &reason);
+
+public:
+    ConcurrencyController(size_t initial, size_t minLimit, size_t maxLimit);
+
+    // latencyMs: 0 when no request finished; saturated: the limit is what keeps files waiting
+    size_t sample(double seconds, unsigned long long bytes, double latencyMs, bool saturated);
+    size_t getLimit() const;
+    void setBounds(size_t minLimit, size_t maxLimit);
+    void setPlan(size_t transfers, size_t segments); // How the manager split the limit, for getStats()
+    ConcurrencyStats getStats() const;
+};
+
+#endif // CONCURRENCYCONTROLLER_HPP
@@ -0,0 +1,110 @@
+// ContentCache.hpp
+#ifndef CONTENTCACHE_HPP
+#define CONTENTCACHE_HPP
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+
+using namespace std;
+
+// What the cache knows about one URL
+struct CacheEntry
+{
+    string url;
+    string etag;         // Validators the copy was stored with; at least one is set
+    string lastModified;
+    long long size;
+    string sha256;       // Hex; names the blob
+};
+
+struct CacheStats
+{
+    size_t entries; // URLs with a cached copy
+    size_t blobs;   // Distinct contents
+    unsigned long long lookups;
+    unsigned long long hits;        // Lookups that found an intact copy to revalidate
+    unsigned long long revalidated; // 304 answers served from the cache, no body transferred
+    unsigned long long stored;
+    unsigned long long deduplicated; // Stored files whose content was already cached under another URL
+    unsigned long long revalidatedBytes;
+    unsigned long long deduplicatedBytes;
+};
+
+// Local copies of finished downloads, keyed by URL and stored once per
+// content. Blobs live in "<dir>/blobs/<ab>/<sha256>"; "<dir>/index" is an
+// append-only log of "url etag last-modified size sha256 stamp" records,
+// tab separated, where a later record of a URL replaces the earlier ones. In
+// memory only two open-addressing tables are kept: URL hash to the offset of
+// its record, and blob to its modification stamp, 16 bytes a slot. A lookup
+// is one probe and one record read, so millions of URLs cost tens of
+// megabytes and no string per entry. The log is compacted on open once most
+// records are dead. Copies are made by reflink, else hard link, else a plain
+// copy; with hard links, a destination edited in place changes the blob too,
+// which the stamp check catches on the next lookup.
+class ContentCache
+{
+private:
+    struct Slot
+    {
+        uint64_t key;   // 0 = empty
+        uint64_t value; // Record offset or blob stamp
+    };
+
+    mutable mutex cacheMutex;
+    string directory; // Empty while closed
+    fstream index;    // Reads records at any offset; writes go to the end
+    char recordBuffer[512];
+    uint64_t indexEnd;
+    vector<Slot> urls;
+    size_t urlCount;  // Live URLs
+    vector<Slot> blobs;
+    size_t blobCount;
+    unsigned long long records; // In the log, live or not
+    atomic<unsigned long long> lookups;
+    atomic<unsigned long long> hits;
+    atomic<unsigned long long> revalidated;
+    atomic<unsigned long long> stored;
+    atomic<unsigned long long> deduplicated;
+    atomic<unsigned long long> revalidatedBytes;
+    atomic<unsigned long long> deduplicatedBytes;
+
+    static uint64_t urlKey(const string &url);
+    static uint64_t blobKey(const string &sha256);
+    static Slot *findSlot(vector<Slot> &table, uint64_t key); // Its slot, or the empty one it would take
+    static void put(vector<Slot> &table, size_t &count, uint64_t key, uint64_t value);
+    static void erase(vector<Slot> &table, size_t &count, uint64_t key);
+    static bool parse(const string &line, CacheEntry &entry, long long &stamp);
+    static bool stampOf(const string &path, long long size, long long &stamp); // False when missing or of another size
+    string blobPath(const string &sha256) const;
+    bool readRecord(uint64_t offset, CacheEntry &entry, long long &stamp);
+    bool append(const CacheEntry &entry, long long stamp, uint64_t &offset);
+    bool blobIntact(const string &sha256, long long size);
+    bool scan(const string &path, bool &terminated);
+    bool load();
+    bool compact(const string &path);
+
+public:
+    ContentCache();
+
+    // Opens or creates the cache in directory and loads its index; empty closes it
+    bool open(const string &directory);
+    bool enabled() const;
+    bool find(const string &url, CacheEntry &entry); // Index only
+    bool lookup(const string &url, CacheEntry &entry); // An entry whose blob is still intact
+    // The server answered 304: destination becomes the cached copy, replaced atomically
+    bool materialize(const CacheEntry &entry, const string &destination);
+    // A completed download with validators; when its content is already cached, destination is
+    // replaced by a copy of the blob so both share storage
+    bool store(const CacheEntry &entry, const string &path);
+    void forget(const string &url);
+    CacheStats getStats() const;
+
+    // Reflink, else hard link, else copy; to is replaced
+    static bool linkFile(const string &from, const string &to);
+};
+
+#endif // CONTENTCACHE_HPP
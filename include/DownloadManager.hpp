@@ -3,29 +3,183 @@
 #define DOWNLOADMANAGER_HPP
 
 #include "ThreadPool.hpp"
+#include "TransferEngine.hpp"
+#include "ConcurrencyController.hpp"
+#include "ProgressReporter.hpp"
+#include "TaskRegistry.hpp"
+#include "ManifestReader.hpp"
+#include "RetryPolicy.hpp"
+#include "TimerWheel.hpp"
 #include <string>
-#include <unordered_map>
+#include <condition_variable>
 
 using namespace std;
 
+// Returned by addDownload: the task's ID and its first outcome
+struct DownloadHandle
+{
+    TaskId id;
+    shared_future<DownloadResult> result; // Ready once the download completed, failed for good or was cancelled
+
+    operator TaskId() const { return id; }
+};
+
+// How transfers are executed once started
+enum class EngineMode
+{
+    ThreadPerTransfer, // Each worker thread blocks on one download
+    EventLoop,         // A few curl multi loops drive all downloads
+    Multiplexed        // Event loops with files of one origin as HTTP/2 streams on one connection
+};
+
 class DownloadManager
 {
 private:
+    EngineMode mode;
+    HandlePool handles; // Declared before the engines so they outlive every transfer
+    BandwidthScheduler bandwidth;
+    TransferMetrics metrics;
+    TraceRecorder trace; // Before the engines and tasks that record into it
+    BufferPool buffers;  // Before the tasks that borrow from it
+    ContentCache cache;  // Before the tasks that store into it
+    JournalSyncer syncer; // Before the tasks that hand it checkpoints
+    TaskRegistry tasks; // Before the engines: tasks report status changes to it until they stop
+    mutex completionMutex;
+    condition_variable completionWake; // Notified on every status change
+    CompletionCallback completionCallback;
+    struct CompletionBatch
+    {
+        vector<TaskId> remaining;
+        vector<DownloadResult> results;
+        function<void(const vector<DownloadResult> &)> callback;
+    };
+    vector<CompletionBatch> batches;
+    unordered_map<TaskId, TimerWheel::TimerId> retryTimers; // Failed tasks waiting for a retry; guarded by completionMutex
+    RetryPolicy retryPolicy;
+    TimerWheel timers; // Retry backoff and breaker cool-downs; stopped first in the destructor
+    ConcurrencyController concurrency;
     ThreadPool threadPool;
-    unordered_map<string, shared_ptr<DownloadTask>> tasks;
-    mutex taskMutex;
+    TransferEngine engine;
+    mutex taskMutex; // Guards options and adaptiveLimit
+    TransferOptions options;
+    thread controlThread;
+    mutex controlMutex;
+    condition_variable controlWake;
+    bool controlRunning;
+    size_t adaptiveLimit; // Connections granted by the controller, 0 while it is off
+    chrono::milliseconds controlInterval;
+    unique_ptr<ProgressReporter> reporter; // Last, so it stops before the tasks it samples go away
+
+    void dispatch(const shared_ptr<DownloadTask> &task);
+    void dispatchAll(const vector<shared_ptr<DownloadTask>> &batch); // Starts what can start, one hand-over
+    vector<shared_ptr<DownloadTask>> tasksFor(const string &url); // Reports unknown URLs
+    shared_ptr<DownloadTask> taskFor(TaskId id);
+    void controlLoop();
+    size_t startedFiles();
+    size_t segmentCeiling();
+    size_t applyLimit(size_t limit, size_t files); // Returns the files allowed to run
+    void stopControl();
+    void statusChanged(const shared_ptr<DownloadTask> &task, DownloadStatus status);
+    bool settle(const shared_ptr<DownloadTask> &task, const DownloadResult &result); // False while a retry follows
+    void release(const vector<TaskId> &ids); // Dispatch held tasks again
+    bool admit(const shared_ptr<DownloadTask> &task);
+    void retryDue(TaskId id);
+    void cancelRetry(TaskId id); // Started by hand before its retry was due
+    void cooldownEnded(const string &origin);
+    bool isFinished(TaskId id);
+    bool isFinished(const shared_ptr<DownloadTask> &task); // NULL: removed by the cleanup, so completed
+    template <typename Predicate>
+    bool waitUntil(Predicate done, chrono::milliseconds timeout);
 
 public:
-    DownloadManager(size_t threadCount);
+    DownloadManager(size_t threadCount, EngineMode mode = EngineMode::ThreadPerTransfer);
+    ~DownloadManager();
+    void setSegmentsPerDownload(size_t segments);
+    void setWriteBufferSize(size_t bytes); // Also the size of the pool's buffers, until the pool is first used
+    // Write buffers of all downloads together (256 MB by default); a transfer that finds none free pauses until
+    // one comes back. Fixed once the first download writes; 0 gives every range its own heap buffer
+    void setBufferPoolLimit(long long bytes);
+    BufferPoolStats getBufferPoolStats();
+    // Keep completed downloads that have an ETag or Last-Modified in directory (empty turns the cache off);
+    // later downloads of the URL revalidate with the server and take the cached copy on 304, and identical
+    // content under different URLs is stored once. False when the directory or its index cannot be used
+    bool setCacheDirectory(const string &directory);
+    CacheStats getCacheStats();
+    void setDirectIoThreshold(long long bytes);
+    void setMappedWriteThreshold(long long bytes); // Files of known size this large are written through mmap, 0 = never
+    void setDispatchPolicy(DispatchPolicy policy); // Thread-pool mode: how workers pick started files
+    // Curl handles and destination files all running downloads hold at once; a download waits for both
+    // before it starts. 0 = unlimited; by default half and an eighth of the descriptor limit
+    void setHandleLimits(size_t curlHandles, size_t openFiles);
+    void setMaxConnectionsPerHost(size_t connections); // Thread-pool mode: segments open per origin
+    void setHostConnectionLimit(const string &origin, size_t connections);
+    void setStreamsPerOrigin(size_t streams); // Multiplexed mode: files in flight per origin
+    void setOriginStreamLimit(const string &origin, size_t streams);
+    void setHttp2PriorKnowledge(bool enabled); // Use HTTP/2 on http:// origins without negotiation
+    void setGlobalRateLimit(long long bytesPerSecond); // 0 = unlimited; all limits apply immediately
+    void setPriorityWeight(TransferPriority priority, unsigned weight);
+    void setDownloadRateLimit(const string &url, long long bytesPerSecond);
+    void setDownloadPriority(const string &url, TransferPriority priority);
+    // Verify the file against "sha256:<hex>" or "crc32c:<hex>" from its next start on; empty turns it off
+    void setDownloadChecksum(const string &url, const string &digest);
+    void setSidecarChecksums(bool enabled); // Downloads without a digest fetch "<url>.sha256" and verify against it
+    // Failed downloads are retried with backoff unless the error is permanent; hosts that keep failing
+    // are paused by a circuit breaker until a test download succeeds
+    void setRetrySettings(const RetrySettings &settings);
+    RetrySettings getRetrySettings();
+    BreakerState getHostState(const string &origin); // scheme://host:port
+    // Tune active transfers (thread-pool mode) and segments per new file from measured goodput;
+    // the configured segment count becomes the ceiling
+    void setAdaptiveConcurrency(bool enabled, size_t maxConnections = 64, int sampleMs = 1000);
+    ConcurrencyStats getConcurrencyStats();
+    MetricsSnapshot getMetrics();                  // Aggregates, queue gauges and every task
+    string getMetricsJson();
+    string getMetricsPrometheus();                 // Text exposition format
+    bool writeMetricsFile(const string &path);     // Prometheus text, replaced atomically (node_exporter textfile)
+    // Opt-in timeline of queueing, dispatch, idle workers, curl phases, disk writes and status changes; every
+    // thread keeps its latest eventsPerThread events. writeTrace() saves Chrome trace JSON for Perfetto,
+    // also while tracing
+    void startTrace(size_t eventsPerThread = 65536);
+    void stopTrace();
+    bool writeTrace(const string &path);
+    vector<ProgressSample> getProgress();          // Downloading and paused tasks, published counters only
+    void setProgressReporting(bool enabled, int intervalMs = 1000); // Prints progress from a background thread
     void startDownloads();
-    void addDownload(const string &url, const string &destinationPath);
+    // The same URL may be added again; the callback runs on the finishing thread after every completion,
+    // cancellation or failure that is not retried, and must not pause, resume or cancel that same task
+    DownloadHandle addDownload(const string &url, const string &destinationPath,
+                               const CompletionCallback &onComplete = CompletionCallback());
+    void setCompletionCallback(const CompletionCallback &callback); // Same, for every task of the manager
+    // Streams a manifest (see ManifestReader) and registers its entries batch by batch; with start, each batch
+    // is handed to the workers as soon as it is parsed. Entries without a destination, or with a relative one,
+    // are placed in directory.
+    ManifestStats addManifest(const string &path, const string &directory = ".", bool start = true,
+                              size_t batchSize = 4096);
+    // Called once when every listed task has completed or failed (at once if they already have); an ID that
+    // was never issued is reported as Failed with DownloadTask::UNKNOWN_TASK
+    void whenAllComplete(const vector<TaskId> &ids, const function<void(const vector<DownloadResult> &)> &callback);
+    // By URL: applies to every task of that URL; by ID: to exactly one
     void startDownload(const string &url);
+    void startDownload(TaskId id);
     void pauseDownload(const string &url);
+    void pauseDownload(TaskId id);
     void resumeDownload(const string &url);
+    void resumeDownload(TaskId id);
     void cancelDownload(const string &url);
-    DownloadStatus getDownloadStatus(const string &url);
-    void waitForCompletion();
-    void clearTasks();
+    void cancelDownload(TaskId id);
+    DownloadStatus getDownloadStatus(const string &url); // Of the newest task for the URL
+    DownloadStatus getDownloadStatus(TaskId id); // Failed for an ID that was never issued
+    vector<TaskId> findDownloads(const string &url);   // Oldest first
+    vector<TaskId> getDownloadsWithStatus(DownloadStatus status); // From the status index, no scan
+    size_t getDownloadCount();
+    // Block until the tasks completed, failed for good or were cancelled; false or 0 when the timeout passed first.
+    // waitAll(ids) returns false at once when an ID was never issued; waitAny ignores such IDs and returns 0 at
+    // once when none is left
+    bool waitAll(chrono::milliseconds timeout = chrono::milliseconds::max()); // Nothing starting, downloading or waiting to retry
+    bool waitAll(const vector<TaskId> &ids, chrono::milliseconds timeout = chrono::milliseconds::max());
+    TaskId waitAny(const vector<TaskId> &ids, chrono::milliseconds timeout = chrono::milliseconds::max());
+    void waitForCompletion(); // waitAll()
+    void clearTasks(); // Drops completed tasks; failed ones are retried by the retry policy
 };
 
-#endif // DOWNLOADMANAGER_HPP
\ No newline at end of file
+#endif // DOWNLOADMANAGER_HPP
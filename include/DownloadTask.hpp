@@ -6,7 +6,20 @@
 #include <atomic>
 #include <thread>
 #include <chrono>
+#include <vector>
+#include <future>
+#include <memory>
+#include <functional>
 #include "FileWritter.hpp"
+#include "ProgressJournal.hpp"
+#include "HandlePool.hpp"
+#include "BandwidthScheduler.hpp"
+#include "TransferMetrics.hpp"
+#include "Checksum.hpp"
+#include "TraceRecorder.hpp"
+#include "BufferPool.hpp"
+#include "ContentCache.hpp"
+#include "JournalSyncer.hpp"
 #include <curl/curl.h>
 #include <iostream>
 #include <mutex>
@@ -20,7 +33,71 @@ enum class DownloadStatus
     Downloading,
     Paused,
     Completed,
-    Failed
+    Failed,
+    Cancelled // Stopped by the user; never retried on its own
+};
+
+class DownloadTask;
+class TaskRegistry;
+
+typedef unsigned long long TaskId; // Assigned by the TaskRegistry, 0 = not registered
+
+// Outcome of a download once it completed, failed or was cancelled
+struct DownloadResult
+{
+    TaskId id;
+    string url;
+    string destination;
+    DownloadStatus status; // Completed, Failed or Cancelled
+    int error;             // CURLcode of the failure or a DownloadTask error, 0 on success or when cancelled
+    curl_off_t size;       // -1 when the server never told
+    long httpStatus;       // HTTP error response (4xx/5xx) behind the failure, 0 when there was none
+    long long retryAfter;  // Seconds the server asked to wait (Retry-After), 0 when not given
+};
+
+typedef function<void(const DownloadResult &)> CompletionCallback;
+
+// Tuning applied to every task created by the manager
+struct TransferOptions
+{
+    size_t segmentCount;         // Parallel ranges per file when the server allows it
+    size_t writeBufferSize;      // Bytes gathered per range before one write call
+    long long directIoThreshold; // Files at least this large use O_DIRECT, 0 = never
+    long long mappedThreshold;   // Files at least this large are written through mmap, 0 = never
+    bool multiplex;              // Prefer HTTP/2 and wait for a shared connection instead of opening one
+    bool http2PriorKnowledge;    // Speak HTTP/2 to http:// URLs without an Upgrade round trip
+    bool fetchSidecar;           // Without a digest, fetch "<url>.sha256" alongside the probe and verify against it
+
+    TransferOptions()
+        : segmentCount(1), writeBufferSize(1024 * 1024), directIoThreshold(0), mappedThreshold(0), multiplex(false), http2PriorKnowledge(false),
+          fetchSidecar(false) {}
+};
+
+// Headers seen while probing the server
+struct ProbeResult
+{
+    long responseCode;
+    curl_off_t size;
+    bool acceptsRanges;
+    string etag;
+    string lastModified;
+    string body;      // Whole response of a small file whose server ignored the range
+    bool bodyRefused; // A larger 200 body was cut off to be fetched again
+};
+
+// One byte range of a file, fetched by its own curl handle
+struct DownloadSegment
+{
+    DownloadTask *task;
+    CURL *handle;
+    curl_off_t begin;    // Offset of the first byte in the file
+    curl_off_t end;      // Offset of the last byte, -1 when the size is unknown
+    curl_off_t received; // Bytes already written for this range
+    bool verified;       // Response code checked for the current attempt
+    bool crcKnown;       // crc covers every received byte (not true for ranges adopted from a journal)
+    uint32_t crc;        // CRC32C of the received bytes, while the task is verifying
+    FileWriter *writer;  // File of the task, owned by its transfer state
+    WriteBuffer buffer;  // Data accepted from curl but not yet written
 };
 
 class DownloadTask
@@ -30,23 +107,181 @@ private:
     string destinationPath;
     atomic<DownloadStatus> status; // Make atomic for thread safety
     atomic<float> progress; // Make atomic for thread safety
+    TransferOptions options;
+    atomic<curl_off_t> totalSize;
+    atomic<curl_off_t> receivedBytes; // Published by the transfer thread for readers elsewhere
+    mutable atomic<const string *> origin; // Interned on first use
+
+    // Everything only a started transfer needs. Created when the task is
+    // attached and dropped once it completes or fails, so a queued task holds
+    // no writer, journal, ranges or handles. Transfer thread only.
+    struct Transfer
+    {
+        FileWriter writer;
+        ProgressJournal journal;
+        vector<DownloadSegment> segments;
+        ProbeResult probeResult;
+        CURL *curlHandle; // Probe and first range; taken from the pool when the task starts
+        bool probing;
+        size_t activeHandles;
+        CURLcode failure;
+        long httpStatus;       // First 4xx/5xx answer of this attempt
+        curl_off_t retryAfter; // Its Retry-After, in seconds
+        bool rangesSupported;
+        chrono::steady_clock::time_point lastCheckpoint;
+        chrono::steady_clock::time_point rateSampledAt;
+        long long rateBytes;
+
+        // Verification: ranges keep their own CRC32C, and the SHA-256 follows the
+        // file from byte zero for as long as the bytes at its cursor are the ones arriving
+        bool verifying; // Hash what arrives; false when there is nothing to check against
+        bool hashSha;
+        ExpectedDigest expected;
+        Sha256 sha;            // Over [0, hashedUpTo)
+        curl_off_t hashedUpTo;
+        CURL *sidecarHandle;   // "<url>.sha256" request in flight, NULL otherwise
+        string sidecarBody;
+        bool checksumFailed;
+        bool sizeMismatch; // The server's size is not the one the task expects
+        string contentSha; // Hex digest once finalized
 
-    CURL *curlHandle;
+        // Content cache: the copy the probe revalidates, and whether the file goes into the cache
+        bool caching;            // Also keeps the SHA-256 running
+        CacheEntry cached;       // url empty when there is no copy
+        curl_slist *conditions;  // If-None-Match / If-Modified-Since of the probe, NULL once it finished
+        bool fromCache;          // The server answered 304 and the destination is the cached copy
+
+        Transfer(const string &destination, const TransferOptions &options);
+        ~Transfer();
+    };
+    unique_ptr<Transfer> transfer; // Kept while paused, so resume continues the ranges; only the driver touches it
+    // Multi handle driving the transfer, NULL when idle. Set only by the driver, after attach() claimed the
+    // task; other threads read it instead of transfer, which may be replaced under them
+    atomic<CURLM *> multi;
+
+    HandlePool *handlePool; // NULL: private handles that are destroyed after use
+    size_t slotHandles;     // Handles reserved in handlePool by the driver, 0 while the task holds no slot
+    BandwidthScheduler *scheduler; // NULL: never throttled
+    BandwidthScheduler::Flow flow;
+    TransferMetrics *metrics; // NULL: nothing is recorded
+    TraceRecorder *trace;     // NULL: never traced
+    BufferPool *buffers;      // NULL: write buffers come from the heap
+    ContentCache *cache;      // NULL: nothing is cached or revalidated
+    JournalSyncer *syncer;    // NULL: periodic checkpoints sync on the transfer thread
+    TaskRegistry *registry;   // Told about status changes, NULL when not registered
+    TaskId id;
+    string checksum;       // Expected digest as given, empty = not verified; guarded by statsMutex
+    long long expectedSize; // Bytes the file must have, -1 = not checked
+    bool pausedByCallback; // Transfer was torn down because of a pause
+    bool pausedDetached;   // Paused with no connection; resume must re-dispatch
+    bool resumeRequested;  // Next attach continues the kept segments
+    mutex stateMutex;      // Orders pause/resume against the end of a transfer
+
+    // Statistics; the counters written on the transfer thread are atomics for getStats()
+    atomic<long long> deliveredBytes;
+    atomic<long long> firstByteMicros;
+    atomic<double> rate;
+    mutex statsMutex; // Status bookkeeping below
+    chrono::steady_clock::time_point statusSince;
+    long long statusMicros[TransferMetrics::STATUS_COUNT];
+    long long queueWaitMicros;
+    unsigned retries;
+    int lastError;
+    long lastHttpStatus;
+    long long lastRetryAfter;
+
+    // Completion; the callback runs on the thread that finished the task
+    unique_ptr<promise<DownloadResult>> completion; // Made by the first getFuture(), guarded by statsMutex
+    shared_future<DownloadResult> completionFuture;
+    bool completionSet; // Guarded by statsMutex
+    DownloadStatus completedAs; // First outcome, once completionSet
+    bool awaitingRetry; // Failed with a retry scheduled, so not an outcome yet; guarded by statsMutex
+    CompletionCallback completionCallback;
+
+    void configureHandle(CURL *handle);
+    bool checkProbe(CURLcode result);
+    void setStatus(DownloadStatus next);
+    void sampleRate();
+    void publishProgress();
+    curl_off_t countReceived() const;
+    void recordTransition(DownloadStatus from, DownloadStatus to);
+    void traceRequest(CURL *handle, CURLcode result);
+    void complete(DownloadStatus outcome);
+    DownloadResult makeResult(DownloadStatus outcome, int error) const;
+    bool noteHttpError(CURL *handle);
+    void planSegments(bool acceptsRanges);
+    bool storeProbeBody();
+    void revalidateWithCache();
+    bool useCached();
+    bool adoptJournal();
+    void addSegments();
+    void detachSegments();
+    void finish();
+    void releaseHandles();
+    CURL *acquireHandle();
+    void returnHandle(CURL *handle);
+    bool flushSegments();
+    void startSidecar();
+    void sidecarDone(CURLcode result);
+    bool verifyDownload();
+    string contentHash();
 
 public:
-    FileWriter *writer;
-    DownloadTask(const string &url, const string &destination);
+    static const int CHECKSUM_MISMATCH = -1; // DownloadResult::error when the file did not match its digest
+    static const int HOST_UNAVAILABLE = -2;  // Refused by the host's open circuit breaker, no request was sent
+    static const int SIZE_MISMATCH = -3;     // The server's file is not the size the manifest gave
+    static const int UNKNOWN_TASK = -4;      // Reported for an ID the manager never issued
+
+    DownloadTask(const string &url, const string &destination, const TransferOptions &options = TransferOptions(),
+                 HandlePool *handlePool = NULL, BandwidthScheduler *scheduler = NULL,
+                 TransferMetrics *metrics = NULL, TraceRecorder *trace = NULL, BufferPool *buffers = NULL,
+                 ContentCache *cache = NULL, JournalSyncer *syncer = NULL);
     ~DownloadTask();
     bool getStartCommand() const;
-    string getUrl() const;
-    void setStartCommand();
+    const string &getUrl() const;
+    TaskId getId() const;
+    void setRegistry(TaskRegistry *registry, TaskId id); // Once, before the task is shared
+    void setCompletionCallback(const CompletionCallback &callback); // Before the task is shared; runs on every finish
+    shared_future<DownloadResult> getFuture(); // Set when the task first completes, fails for good or is cancelled
+    // From the status listener, before the failure is reported: a retry follows, so callbacks and the future wait
+    void setAwaitingRetry(bool waiting);
+    bool isAwaitingRetry();
+    DownloadResult getResult();
+    const string &getOrigin() const; // scheme://host:port, the unit that shares a connection; interned
+    size_t getMaxConnections() const; // Connections the task may open at once (its segment count)
+    void setSegmentCount(size_t count);  // Only before the task is dispatched
+    // "sha256:<hex>", "crc32c:<hex>" or the bare hex of either; checked from the next start on. False if unparseable
+    bool setChecksum(const string &digest);
+    void setExpectedSize(long long bytes); // Only before the task is dispatched; -1 = any size
+    void hashReceived(DownloadSegment &segment, const char *data, size_t bytes); // Write callback, before received moves
+    bool setStartCommand(); // True when the task moved to Starting (from Pending, Failed or Cancelled)
+    void reject(int error); // Fails a Starting task that was never handed to a worker
     void start();
+    // Reserve the curl handles and the open file the next attach needs; false when none are free and
+    // wait is false. The driver holds the slot until the task leaves it
+    bool takeSlot(bool wait);
+    void releaseSlot();
+    bool attach(CURLM *multiHandle);
+    void onHandleDone(CURL *handle, CURLcode result);
+    bool isAttached(CURLM *multiHandle) const; // Still driven from multiHandle
     void pause();
-    void resume();
-    void cancel();
+    bool resume(); // True when the task must be dispatched again
+    bool shouldStop();
+    void checkpoint(bool force = false); // Forced: blocks until the file and journal are durable
+    void cancel(); // Moves to Cancelled; the file and journal stay so a later start can continue
+    void setRateLimit(long long bytesPerSecond); // 0 removes the cap; applies to running transfers
+    void setPriority(TransferPriority priority);
+    long long requestBandwidth(size_t bytes);    // 0 or microseconds to wait before taking the bytes
+    void reportDelivered(size_t bytes);
+    void recordEvent(TransferMetrics::Counter counter); // Throttled or WriteStalls
+    bool onProgress(); // Progress callback body, no locks or allocations; true aborts the transfer
+    TaskStats getStats();
     DownloadStatus getStatus() const;
     float getProgress() const;
     void updateProgress(float newProgress); // Add this method
+    curl_off_t getTotalSize() const;     // -1 until the probe answered
+    curl_off_t getReceivedBytes() const; // File bytes on disk as of the last progress callback
+    static string errorText(int error);  // CURLcode or one of the DownloadTask errors above
 };
 
-#endif // DOWNLOADTASK_HPP
\ No newline at end of file
+#endif // DOWNLOADTASK_HPP
@@ -2,21 +2,109 @@
 #ifndef FILEWRITER_HPP
 #define FILEWRITER_HPP
 
-#include <fstream>
 #include <string>
+#include <mutex>
+#include <atomic>
 
 using namespace std;
 
+class UringBackend;
+class BufferPool;
+class TraceRecorder;
+
+// Staging area for one byte range: callback data is gathered here and written
+// with a single call once it fills up
+struct WriteBuffer
+{
+    char *data;
+    size_t capacity;
+    size_t used;
+    long long offset; // File offset of data[0]
+    int poolIndex;    // Slot in the io_uring or the manager's buffer pool, -1 for heap memory
+    bool mapped;      // data is a window of the mapped file, offset its file offset
+    long long remaining;    // Bytes the range still expects, -1 when unknown
+    long long stalledSince; // Microseconds (steady clock) since the pool was first found empty, 0 = not waiting
+
+    WriteBuffer() : data(NULL), capacity(0), used(0), offset(0), poolIndex(-1), mapped(false), remaining(-1), stalledSince(0) {}
+};
+
 class FileWriter
 {
 private:
-    ofstream fileStream;
+    string path;
+#ifdef _WIN32
+    void *fileHandle;
+#else
+    int fileDescriptor;
+    int directDescriptor; // Same file opened with O_DIRECT, -1 when unused
+    int mapDescriptor;    // Same file opened read-write for mapped windows, -1 when the file is not mapped
+    long long mappedSize; // Preallocated size the windows may cover
+
+    int appendMapped(WriteBuffer &buffer, long long offset, const char *data, int size);
+    bool mapWindow(WriteBuffer &buffer, long long offset);
+    void unmapWindow(WriteBuffer &buffer);
+#endif
+    long long position; // Next offset used by sequential write()
+    mutex positionMutex;
+    size_t bufferSize;
+    long long directIoThreshold;
+    long long mappedThreshold;
+    atomic<unsigned long long> writeCalls;
+    atomic<unsigned long long> bytesWritten;
+    BufferPool *pool;            // NULL: buffers come from the heap
+    TraceRecorder *trace;        // NULL: writes are not traced
+    unsigned long long traceTask; // TaskId the writes are recorded for
+
+    void returnToPool(WriteBuffer &buffer); // Keeps offset, capacity and remaining for the next callback
+#ifdef DM_WITH_IO_URING
+    UringBackend *backend; // Ring of the thread that opened the file, NULL for synchronous writes
+    int inFlight;
+    bool asyncFailed;
+
+    int appendAsync(WriteBuffer &buffer, long long offset, const char *data, int size);
+    bool submit(WriteBuffer &buffer);
+    void drain();
+#endif
 
 public:
+    static const size_t ALIGNMENT = 4096; // Buffer, offset and length unit for O_DIRECT
+    static const int WRITE_STALLED = -1;  // append() could not take the data yet, retry after the wake callback
+    static const int POOL_EXHAUSTED = -2; // append() found no free pool buffer, retry after a short pause
+    static const int MAX_IN_FLIGHT = 8;   // Asynchronous writes one file may have queued
+    static const size_t MAP_WINDOW = 64 * 1024 * 1024; // File bytes one range keeps mapped at a time
+
     FileWriter(const string &filePath);
     ~FileWriter();
+    void setBufferSize(size_t bytes);
+    void setDirectIoThreshold(long long bytes); // 0 keeps every write in the page cache
+    void setMappedThreshold(long long bytes);   // Preallocated files this large are written through mmap, 0 = never
+    void setBufferPool(BufferPool *buffers); // Borrow write buffers from it instead of the heap; NULL or disabled = heap
+    void setTrace(TraceRecorder *recorder, unsigned long long task); // Write batches and syncs become spans
+    bool open(bool truncate = true); // Keeps existing bytes when truncate is false
+    bool isOpen() const;
+    bool preallocate(long long size);
     int write(char *data, int size);
+    int writeAt(long long offset, const char *data, int size); // Positional write, safe from several segments
+    void prepare(WriteBuffer &buffer, long long expectedBytes); // Size a buffer for a range, -1 if unknown
+    int append(WriteBuffer &buffer, long long offset, const char *data, int size);
+    bool flush(WriteBuffer &buffer);
+    void release(WriteBuffer &buffer);
+    bool sync();
+    // First offset of [begin, end) whose bytes are still buffered or queued, end when every byte reached the file
+    long long writtenUpTo(const WriteBuffer &buffer, long long begin, long long end);
+    int duplicateDescriptor(); // -1 when closed, or where descriptors cannot be synced elsewhere (Windows)
+    static bool syncDescriptor(int descriptor); // As sync(), for a duplicate
+    static void closeDescriptor(int descriptor);
     void close();
+    unsigned long long getWriteCalls() const;
+    unsigned long long getBytesWritten() const;
+
+    // Asynchronous completion hooks; no-ops unless built with io_uring
+    void waitForBuffer(void (*wake)(void *), void *context);
+    void cancelWaits();
+    void asyncWriteFinished(bool ok);
+    static int completionDescriptor(); // Poll this for readability, -1 when writes are synchronous
+    static void processCompletions();  // Call from the thread that drives the transfers
 };
 
-#endif // FILEWRITER_HPP
\ No newline at end of file
+#endif // FILEWRITER_HPP
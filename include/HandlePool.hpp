@@ -0,0 +1,56 @@
+// HandlePool.hpp
+#ifndef HANDLEPOOL_HPP
+#define HANDLEPOOL_HPP
+
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <curl/curl.h>
+
+using namespace std;
+
+// Curl state shared by every task of a manager: one CURLSH holds the DNS
+// cache and TLS sessions, and finished easy handles are reset and handed to
+// the next transfer instead of being destroyed, keeping their connections
+// for the thread that drives them. The pool
+// also bounds what running transfers hold: a transfer reserves its handles
+// and one open file before it starts and returns them when it stops, so a
+// large batch waits for a slot instead of running out of descriptors.
+class HandlePool
+{
+private:
+    CURLSH *share;
+    mutex shareLocks[CURL_LOCK_DATA_LAST]; // One per kind of shared data
+    mutex poolMutex;
+    vector<CURL *> idle;
+    size_t maxIdle;
+    size_t maxHandles;      // Reserved by running transfers at once, 0 = unlimited; guarded by poolMutex
+    size_t maxFiles;        // Destination files open at once, 0 = unlimited
+    size_t reservedHandles;
+    size_t openFiles;
+    bool waiting;           // A reservation failed since the last release
+    condition_variable slotFreed;
+    function<void()> releaseListener;
+
+    static void lockShare(CURL *handle, curl_lock_data data, curl_lock_access access, void *pool);
+    static void unlockShare(CURL *handle, curl_lock_data data, void *pool);
+    bool fits(size_t handles) const;
+
+public:
+    HandlePool(size_t maxIdle = 256); // Limits start from the descriptor limit: half for handles, an eighth for files
+    ~HandlePool();
+    CURL *acquire(); // NULL if curl cannot create a handle
+    void release(CURL *handle);
+
+    void setLimits(size_t handles, size_t files); // 0 = unlimited; reservations already made are kept
+    // Handles and one file for a starting transfer, false when they are not free. A transfer
+    // that needs more handles than the limit runs once no other holds any
+    bool tryReserve(size_t handles);
+    void reserve(size_t handles); // Waits until tryReserve() would succeed
+    void unreserve(size_t handles);
+    // Runs after a release that a failed tryReserve() may be waiting for, outside the pool's lock
+    void setReleaseListener(const function<void()> &listener);
+};
+
+#endif // HANDLEPOOL_HPP
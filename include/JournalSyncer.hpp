@@ -0,0 +1,47 @@
+// JournalSyncer.hpp
+#ifndef JOURNALSYNCER_HPP
+#define JOURNALSYNCER_HPP
+
+#include "ProgressJournal.hpp"
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+using namespace std;
+
+// Makes periodic checkpoints durable away from the transfer threads, so an
+// event loop never waits on fdatasync. A checkpoint is a duplicate of the
+// file's descriptor and a copy of the journal that claims only bytes
+// already handed to the file; the thread syncs the file, then saves the
+// journal. A newer checkpoint of the same transfer replaces one still
+// queued. The thread is only started by the first submit().
+class JournalSyncer
+{
+private:
+    struct Job
+    {
+        const void *owner;  // Transfer the checkpoint belongs to
+        int fileDescriptor; // Duplicate, closed once synced
+        ProgressJournal journal;
+    };
+
+    deque<Job> jobs;
+    const void *syncing; // Owner of the job being synced, NULL when idle
+    mutex queueMutex;
+    condition_variable wake;     // A job was queued, or stop()
+    condition_variable finished; // A job was synced
+    thread worker;
+    bool running;
+
+    void run();
+
+public:
+    JournalSyncer();
+    ~JournalSyncer();
+    void submit(const void *owner, int fileDescriptor, const ProgressJournal &journal); // Takes the descriptor
+    void wait(const void *owner); // Until nothing of owner is queued or syncing
+    void stop(); // Finishes the queued checkpoints
+};
+
+#endif // JOURNALSYNCER_HPP
@@ -0,0 +1,56 @@
+// ManifestReader.hpp
+#ifndef MANIFESTREADER_HPP
+#define MANIFESTREADER_HPP
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include "BandwidthScheduler.hpp"
+
+using namespace std;
+
+// One download listed in a manifest
+struct ManifestEntry
+{
+    string url;
+    string destination;       // Empty: named after the URL
+    long long size;           // Expected bytes, -1 when not given
+    string hash;              // Expected digest ("sha256:<hex>", "crc32c:<hex>" or bare hex), empty when not given
+    TransferPriority priority;
+};
+
+struct ManifestStats
+{
+    unsigned long long lines;
+    unsigned long long entries;
+    unsigned long long malformed; // Lines skipped because they could not be parsed
+    unsigned long long bytes;     // Read from the file so far
+};
+
+// Streams a manifest in fixed-size chunks, so memory stays flat however many
+// lines it has. Two line formats can be mixed:
+//   plain:      <url> [destination]
+//   JSON lines: {"url": "...", "destination": "...", "size": 123, "sha256": "...", "priority": "high"}
+// A digest may also be given as "crc32c"; one that cannot be parsed makes the line malformed.
+// Blank lines and lines starting with '#' are ignored.
+class ManifestReader
+{
+private:
+    ifstream file;
+    vector<char> chunk;
+    size_t begin; // Unparsed bytes are chunk[begin, end)
+    size_t end;
+    bool eof;
+    ManifestStats stats;
+
+    bool fill();
+
+public:
+    explicit ManifestReader(const string &path, size_t chunkSize = 1024 * 1024);
+    bool isOpen() const;
+    size_t next(vector<ManifestEntry> &entries, size_t maxEntries); // Refills entries; 0 at the end
+    const ManifestStats &getStats() const;
+    static bool parseLine(const char *line, const char *lineEnd, ManifestEntry &entry); // False when malformed
+};
+
+#endif // MANIFESTREADER_HPP
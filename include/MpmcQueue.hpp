@@ -0,0 +1,261 @@
+// MpmcQueue.hpp
+#ifndef MPMCQUEUE_HPP
+#define MPMCQUEUE_HPP
+
+#include <atomic>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+#include <cstddef>
+
+using namespace std;
+
+// Bounded multi-producer / multi-consumer ring (Vyukov's sequence-number
+// design). tryPush/tryPop never lock; push/pop spin briefly and then park on
+// a condition variable until the other side makes room or data.
+template <typename T>
+class MpmcQueue
+{
+private:
+    struct alignas(64) Cell
+    {
+        atomic<size_t> sequence;
+        T value;
+    };
+
+    vector<Cell> cells;
+    size_t mask;
+    alignas(64) atomic<size_t> head; // Next slot to pop
+    alignas(64) atomic<size_t> tail; // Next slot to push
+    alignas(64) atomic<int> waitingConsumers;
+    atomic<int> waitingProducers;
+    atomic<bool> closed;
+    mutex parkMutex;
+    condition_variable notEmpty;
+    condition_variable notFull;
+
+    static const int SPIN_LIMIT = 64;
+
+    static size_t roundUp(size_t capacity)
+    {
+        size_t size = 2;
+        while (size < capacity)
+        {
+            size <<= 1;
+        }
+        return size;
+    }
+
+    void wakeConsumer()
+    {
+        atomic_thread_fence(memory_order_seq_cst);
+        if (waitingConsumers.load(memory_order_relaxed) > 0)
+        {
+            lock_guard<mutex> lock(parkMutex);
+            notEmpty.notify_one();
+        }
+    }
+
+    void wakeProducer()
+    {
+        atomic_thread_fence(memory_order_seq_cst);
+        if (waitingProducers.load(memory_order_relaxed) > 0)
+        {
+            lock_guard<mutex> lock(parkMutex);
+            notFull.notify_one();
+        }
+    }
+
+    bool enqueue(T &value)
+    {
+        size_t position = tail.load(memory_order_relaxed);
+        while (true)
+        {
+            Cell &cell = cells[position & mask];
+            size_t sequence = cell.sequence.load(memory_order_acquire);
+            intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+            if (difference == 0)
+            {
+                if (tail.compare_exchange_weak(position, position + 1, memory_order_relaxed))
+                {
+                    cell.value = move(value);
+                    cell.sequence.store(position + 1, memory_order_release);
+                    return true;
+                }
+            }
+            else if (difference < 0)
+            {
+                return false; // Full
+            }
+            else
+            {
+                position = tail.load(memory_order_relaxed);
+            }
+        }
+    }
+
+    bool dequeue(T &value)
+    {
+        size_t position = head.load(memory_order_relaxed);
+        while (true)
+        {
+            Cell &cell = cells[position & mask];
+            size_t sequence = cell.sequence.load(memory_order_acquire);
+            intptr_t difference = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position + 1);
+            if (difference == 0)
+            {
+                if (head.compare_exchange_weak(position, position + 1, memory_order_relaxed))
+                {
+                    value = move(cell.value);
+                    cell.value = T();
+                    cell.sequence.store(position + mask + 1, memory_order_release);
+                    return true;
+                }
+            }
+            else if (difference < 0)
+            {
+                return false; // Empty
+            }
+            else
+            {
+                position = head.load(memory_order_relaxed);
+            }
+        }
+    }
+
+public:
+    explicit MpmcQueue(size_t capacity)
+        : cells(roundUp(capacity)), mask(cells.size() - 1), head(0), tail(0),
+          waitingConsumers(0), waitingProducers(0), closed(false)
+    {
+        for (size_t i = 0; i < cells.size(); ++i)
+        {
+            cells[i].sequence.store(i, memory_order_relaxed);
+        }
+    }
+
+    MpmcQueue(const MpmcQueue &) = delete;
+    MpmcQueue &operator=(const MpmcQueue &) = delete;
+
+    bool tryPush(T value)
+    {
+        if (!enqueue(value))
+        {
+            return false;
+        }
+        wakeConsumer();
+        return true;
+    }
+
+    bool tryPop(T &value)
+    {
+        if (!dequeue(value))
+        {
+            return false;
+        }
+        wakeProducer();
+        return true;
+    }
+
+    // Blocks while the ring is full; returns false once the queue is closed
+    bool push(T value)
+    {
+        for (int spin = 0; spin < SPIN_LIMIT; ++spin)
+        {
+            if (closed.load(memory_order_relaxed))
+            {
+                return false;
+            }
+            if (enqueue(value))
+            {
+                wakeConsumer();
+                return true;
+            }
+        }
+
+        unique_lock<mutex> lock(parkMutex);
+        while (true)
+        {
+            waitingProducers.fetch_add(1, memory_order_relaxed);
+            atomic_thread_fence(memory_order_seq_cst);
+            if (closed.load(memory_order_relaxed))
+            {
+                waitingProducers.fetch_sub(1, memory_order_relaxed);
+                return false;
+            }
+            if (enqueue(value))
+            {
+                waitingProducers.fetch_sub(1, memory_order_relaxed);
+                atomic_thread_fence(memory_order_seq_cst);
+                if (waitingConsumers.load(memory_order_relaxed) > 0)
+                {
+                    notEmpty.notify_one(); // parkMutex is already held here
+                }
+                return true;
+            }
+            notFull.wait(lock);
+            waitingProducers.fetch_sub(1, memory_order_relaxed);
+        }
+    }
+
+    // Blocks while the ring is empty; returns false once the queue is closed
+    bool pop(T &value)
+    {
+        for (int spin = 0; spin < SPIN_LIMIT; ++spin)
+        {
+            if (closed.load(memory_order_relaxed))
+            {
+                return false;
+            }
+            if (tryPop(value))
+            {
+                return true;
+            }
+        }
+
+        unique_lock<mutex> lock(parkMutex);
+        while (true)
+        {
+            waitingConsumers.fetch_add(1, memory_order_relaxed);
+            atomic_thread_fence(memory_order_seq_cst);
+            if (closed.load(memory_order_relaxed))
+            {
+                waitingConsumers.fetch_sub(1, memory_order_relaxed);
+                return false;
+            }
+            if (dequeue(value))
+            {
+                waitingConsumers.fetch_sub(1, memory_order_relaxed);
+                atomic_thread_fence(memory_order_seq_cst);
+                if (waitingProducers.load(memory_order_relaxed) > 0)
+                {
+                    notFull.notify_one(); // parkMutex is already held here
+                }
+                return true;
+            }
+            notEmpty.wait(lock);
+            waitingConsumers.fetch_sub(1, memory_order_relaxed);
+        }
+    }
+
+    // Wakes every parked thread; later push/pop calls return false
+    void close()
+    {
+        closed.store(true);
+        lock_guard<mutex> lock(parkMutex);
+        notEmpty.notify_all();
+        notFull.notify_all();
+    }
+
+    bool isEmpty() const
+    {
+        return head.load(memory_order_acquire) >= tail.load(memory_order_acquire);
+    }
+
+    size_t capacity() const
+    {
+        return cells.size();
+    }
+};
+
+#endif // MPMCQUEUE_HPP
@@ -0,0 +1,39 @@
+// ProgressJournal.hpp
+#ifndef PROGRESSJOURNAL_HPP
+#define PROGRESSJOURNAL_HPP
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Bytes [begin, begin + done) of the range [begin, end] are on disk
+struct JournalRange
+{
+    long long begin;
+    long long end;
+    long long done;
+};
+
+// Sidecar file ("<destination>.journal") that survives a crash or restart and
+// tells the next attempt which ranges are already downloaded
+class ProgressJournal
+{
+private:
+    string path;
+
+public:
+    string url;
+    long long totalSize;
+    string etag;
+    string lastModified;
+    vector<JournalRange> ranges;
+
+    ProgressJournal(const string &destinationPath);
+    bool load();
+    bool save() const;
+    void remove() const;
+    bool matches(const string &remoteEtag, const string &remoteLastModified, long long remoteSize) const;
+};
+
+#endif // PROGRESSJOURNAL_HPP
@@ -0,0 +1,62 @@
+// ProgressReporter.hpp
+#ifndef PROGRESSREPORTER_HPP
+#define PROGRESSREPORTER_HPP
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <iostream>
+#include <curl/curl.h>
+
+using namespace std;
+
+enum class DownloadStatus;
+
+// Published counters of one task at the moment of sampling
+struct ProgressSample
+{
+    unsigned long long id; // TaskId
+    string url;
+    DownloadStatus status;
+    curl_off_t bytes; // On disk
+    curl_off_t total; // -1 while unknown
+};
+
+// Samples the tasks' progress counters at a fixed rate on its own thread and
+// prints one combined view with speed and ETA, so the transfer threads never
+// format, allocate or lock for progress output
+class ProgressReporter
+{
+private:
+    struct Track
+    {
+        curl_off_t bytes;
+        double speed; // Bytes per second, smoothed
+    };
+
+    function<vector<ProgressSample>()> source;
+    ostream &out;
+    chrono::milliseconds interval;
+    thread worker;
+    mutex reporterMutex;
+    condition_variable wake;
+    bool running;
+    unordered_map<unsigned long long, Track> tracks; // By task ID
+    chrono::steady_clock::time_point lastSample;
+
+    void run();
+
+public:
+    ProgressReporter(function<vector<ProgressSample>()> source, ostream &out = cout);
+    ~ProgressReporter();
+    void start(chrono::milliseconds interval);
+    void stop();
+    string render(const vector<ProgressSample> &samples); // One frame; empty when nothing is downloading
+};
+
+#endif // PROGRESSREPORTER_HPP
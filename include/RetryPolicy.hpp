@@ -0,0 +1,118 @@
+// RetryPolicy.hpp
+#ifndef RETRYPOLICY_HPP
+#define RETRYPOLICY_HPP
+
+#include "DownloadTask.hpp"
+#include <string>
+#include <vector>
+#include <deque>
+#include <random>
+#include <unordered_map>
+
+using namespace std;
+
+// Why a download failed, as far as retrying it is concerned
+enum class FailureClass
+{
+    Transient, // Network errors, timeouts, 5xx, 408, short or corrupt data: retried with backoff
+    Throttled, // 429 or 503: retried no sooner than the server's Retry-After
+    Permanent, // Other 4xx, malformed URLs, TLS verification: retrying would not help
+    Cancelled  // Stopped by the user
+};
+
+// Circuit breaker of one origin
+enum class BreakerState
+{
+    Closed,   // Healthy, dispatch runs freely
+    Open,     // Unhealthy, downloads for the host fail at once until the cool-down ends
+    HalfOpen  // Cool-down over, one download tests the host while the others wait
+};
+
+// What dispatch does with a started download
+enum class Admission
+{
+    Run,
+    Hold,  // Wait for the test download of the host
+    Reject // Fail now with DownloadTask::HOST_UNAVAILABLE, which counts as an attempt
+};
+
+struct RetrySettings
+{
+    unsigned maxAttempts;                    // Retries after the first failure, 0 = never retry
+    chrono::milliseconds baseDelay;          // Backoff before the first retry; doubles with every further one
+    chrono::milliseconds maxDelay;           // Cap of the backoff
+    chrono::milliseconds maxRetryAfter;      // Longer Retry-After values are cut to this
+    unsigned breakerThreshold;               // Host failures in a row that open its breaker, 0 = no breakers
+    chrono::milliseconds breakerCooldown;    // First open period; doubles each time the test download fails
+    chrono::milliseconds maxBreakerCooldown;
+
+    RetrySettings()
+        : maxAttempts(5), baseDelay(1000), maxDelay(60000), maxRetryAfter(600000), breakerThreshold(5),
+          breakerCooldown(10000), maxBreakerCooldown(300000) {}
+};
+
+// What to do about one failure
+struct RetryDecision
+{
+    FailureClass failure;
+    bool retry;
+    unsigned attempt;                 // Of the retry about to be scheduled, 1 for the first
+    chrono::milliseconds delay;       // Before the retry starts
+    bool breakerOpened;               // This failure opened the host's breaker
+    chrono::milliseconds breakerOpenFor;
+    vector<TaskId> released;          // Held tasks to dispatch again
+};
+
+// Classifies failed downloads and plans their retries: capped exponential
+// backoff with jitter (half the window fixed, half random, so failures that
+// happened together do not come back together), at least as long as a
+// Retry-After. Also keeps one circuit breaker per origin: enough host
+// failures in a row open it, and while it is open admit() rejects the
+// host's downloads before they take a worker slot or send a request; their
+// retries are timed for the end of the cool-down. Then one test download
+// goes through while the rest are held; its success closes the breaker and
+// releases them, its failure reopens it for twice as long.
+// The caller owns the timers: it schedules the retries and the end of every
+// open period and reports back through the methods below.
+class RetryPolicy
+{
+private:
+    struct Breaker
+    {
+        BreakerState state;
+        unsigned failures;             // In a row, while closed
+        chrono::milliseconds cooldown; // Of the current or last open period
+        chrono::steady_clock::time_point openUntil;
+        TaskId trial;                  // Test download while half open, 0 = none yet
+        deque<TaskId> held;            // Started downloads waiting for the test download
+
+        Breaker() : state(BreakerState::Closed), failures(0), cooldown(0), trial(0) {}
+    };
+
+    mutable mutex policyMutex;
+    RetrySettings settings;
+    unordered_map<TaskId, unsigned> attempts; // Retries so far, of tasks that failed and were not given up
+    unordered_map<string, Breaker> breakers;
+    atomic<size_t> tracked;   // Entries in attempts plus breakers that are not closed with a clean record
+    atomic<size_t> unhealthy; // Breakers that are not closed; admit() takes no lock while 0
+    minstd_rand random;
+
+    static bool blamesHost(FailureClass failure, const DownloadResult &result);
+    chrono::milliseconds backoff(unsigned attempt);
+    void open(Breaker &breaker, chrono::milliseconds atLeast, RetryDecision &decision);
+    void update(Breaker &breaker, BreakerState state, unsigned failures); // Keeps tracked and unhealthy right
+
+public:
+    RetryPolicy();
+    void setSettings(const RetrySettings &settings);
+    RetrySettings getSettings() const;
+    static FailureClass classify(const DownloadResult &result);
+    RetryDecision onFailure(const string &origin, const DownloadResult &result);
+    vector<TaskId> onSuccess(TaskId id, const string &origin); // Tasks to dispatch again when this closed a breaker
+    vector<TaskId> forget(TaskId id, const string &origin);    // Cancelled or given up; may free a half-open host
+    Admission admit(TaskId id, const string &origin);
+    void endCooldown(const string &origin);                    // Open to half open
+    BreakerState getState(const string &origin) const;
+};
+
+#endif // RETRYPOLICY_HPP
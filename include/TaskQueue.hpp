@@ -2,23 +2,87 @@
 #ifndef TASKQUEUE_HPP
 #define TASKQUEUE_HPP
 
-#include <queue>
-#include <mutex>
 #include <memory>
+#include <deque>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <condition_variable>
+#include "MpmcQueue.hpp"
 #include "DownloadTask.hpp"
 
 using namespace std;
 
+// How workers choose among started tasks
+enum class DispatchPolicy
+{
+    Fifo,   // One queue in start order, no per-host limits
+    PerHost // Round-robin over per-origin queues with a connection cap per host
+};
+
+// Ready queue of the thread pool: only tasks that were started are pushed here,
+// and workers park inside getNextTask() until one they may run arrives.
+// Producers hand tasks over through a lock-free ring; workers sort them into
+// per-origin queues, serve the hosts assigned to them round-robin and, with
+// nothing eligible at home, steal from the host with the longest backlog.
+// Everything past the ring, dequeueing included, runs under scheduleMutex:
+// host caps and the active limit are checked and charged in one step.
 class TaskQueue
 {
 private:
-    queue<shared_ptr<DownloadTask>> queue;
-    mutex mutex;
+    struct HostQueue
+    {
+        deque<shared_ptr<DownloadTask>> pending;
+        size_t connections; // Held by running tasks of this host
+        size_t home;        // Worker whose rotation serves this host
+        bool scheduled;     // Listed in the home rotation
+
+        HostQueue() : connections(0), home(0), scheduled(false) {}
+    };
+
+    struct Running
+    {
+        string host;
+        size_t connections;
+    };
+
+    MpmcQueue<shared_ptr<DownloadTask>> incoming;
+    mutex scheduleMutex;
+    condition_variable workAvailable;
+    atomic<int> sleepingWorkers;
+    atomic<bool> closed;
+    DispatchPolicy policy;
+    size_t connectionsPerHost;
+    size_t activeLimit; // Tasks handed out and not yet finished, across all hosts
+    unordered_map<string, size_t> hostLimits;
+    unordered_map<string, HostQueue> hosts;
+    vector<deque<string>> rotations; // Per worker: its hosts that have tasks waiting
+    unordered_multimap<DownloadTask *, Running> running;
+    size_t queued;
+
+    string hostOf(const DownloadTask &task) const;
+    size_t limitFor(const string &host) const;
+    bool eligible(const string &host, const HostQueue &queue) const;
+    void place(const shared_ptr<DownloadTask> &task);
+    void sortIncoming();
+    shared_ptr<DownloadTask> takeFrom(const string &host, HostQueue &queue);
+    shared_ptr<DownloadTask> pick(size_t worker);
+    void forgetIfIdle(const string &host);
 
 public:
+    TaskQueue(size_t capacity = 1024, size_t workers = 1);
     void addTask(const shared_ptr<DownloadTask> &task);
-    shared_ptr<DownloadTask> getNextTask();
+    void addTasks(const vector<shared_ptr<DownloadTask>> &tasks); // One lock for the whole batch, order kept
+    shared_ptr<DownloadTask> getNextTask(size_t worker = 0); // nullptr once the queue is closed
+    void taskFinished(const shared_ptr<DownloadTask> &task); // Frees the task's connections to its host
+    void setPolicy(DispatchPolicy newPolicy);
+    void setConnectionsPerHost(size_t connections);
+    void setHostConnectionLimit(const string &origin, size_t connections);
+    void setActiveLimit(size_t tasks); // 0 = no limit
+    size_t pendingCount();
+    size_t runningCount();
     bool isEmpty();
+    void close();
 };
 
-#endif // TASKQUEUE_HPP
\ No newline at end of file
+#endif // TASKQUEUE_HPP
@@ -0,0 +1,82 @@
+// TaskRegistry.hpp
+#ifndef TASKREGISTRY_HPP
+#define TASKREGISTRY_HPP
+
+#include "DownloadTask.hpp"
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
+#include <shared_mutex>
+
+using namespace std;
+
+// Every task of a manager by numeric ID, with indexes by URL and by status.
+// IDs and URLs each map to one of SHARD_COUNT shards behind its own
+// reader/writer lock: lookups run in parallel and only wait for a writer of
+// the same shard, which holds it for a single insert, erase or index update.
+// Tasks report their own status changes, so the status sets stay exact and
+// "all failed" or "all active" is answered without looking at other tasks.
+class TaskRegistry
+{
+public:
+    static const size_t SHARD_COUNT = 64;
+
+    // Called after the index moved a task, outside the shard lock, on the thread that changed the status
+    typedef function<void(const shared_ptr<DownloadTask> &task, DownloadStatus status)> Listener;
+
+private:
+    struct Entry
+    {
+        shared_ptr<DownloadTask> task;
+        DownloadStatus indexed; // Status set the ID is filed under
+    };
+
+    struct alignas(64) Shard
+    {
+        mutable shared_mutex shardMutex;
+        unordered_map<TaskId, Entry> tasks;
+        unordered_set<TaskId> byStatus[TransferMetrics::STATUS_COUNT];
+    };
+
+    // Keys view the URL string of the task itself, which outlives its entry here
+    struct alignas(64) UrlShard
+    {
+        mutable shared_mutex shardMutex;
+        unordered_multimap<string_view, TaskId> ids;
+    };
+
+    Shard shards[SHARD_COUNT];
+    UrlShard urlShards[SHARD_COUNT];
+    atomic<TaskId> nextId;
+    atomic<size_t> count;
+    Listener listener;
+
+    Shard &shardFor(TaskId id) { return shards[id % SHARD_COUNT]; }
+    const Shard &shardFor(TaskId id) const { return shards[id % SHARD_COUNT]; }
+    UrlShard &urlShardFor(string_view url) { return urlShards[hash<string_view>()(url) % SHARD_COUNT]; }
+    const UrlShard &urlShardFor(string_view url) const { return urlShards[hash<string_view>()(url) % SHARD_COUNT]; }
+
+public:
+    TaskRegistry();
+    void setListener(const Listener &listener); // Before the first add
+    TaskId add(const shared_ptr<DownloadTask> &task); // IDs start at 1 and are never reused
+    TaskId addBatch(const vector<shared_ptr<DownloadTask>> &batch); // Consecutive IDs, returns the first
+    bool remove(TaskId id);
+    shared_ptr<DownloadTask> find(TaskId id) const; // NULL once removed
+    bool issued(TaskId id) const; // Handed out by add() or addBatch(), removed since or not
+    vector<TaskId> findByUrl(const string &url) const; // Oldest first
+    vector<TaskId> withStatus(DownloadStatus status) const;
+    vector<shared_ptr<DownloadTask>> tasksWithStatus(DownloadStatus status) const;
+    size_t countWithStatus(DownloadStatus status) const;
+    size_t size() const;
+    // Visits every task, holding one shard's read lock at a time; the visitor must not call back into the registry
+    void forEach(const function<void(TaskId, const shared_ptr<DownloadTask> &)> &visit) const;
+    void statusChanged(TaskId id); // Called by the task after each transition
+};
+
+#endif // TASKREGISTRY_HPP
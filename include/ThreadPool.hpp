@@ -5,8 +5,10 @@
 #include <vector>
 #include <thread>
 #include <atomic>
+#include <mutex>
 #include <functional>
 #include "TaskQueue.hpp"
+#include "TraceRecorder.hpp"
 
 using namespace std;
 
@@ -14,15 +16,24 @@ class ThreadPool
 {
 private:
     vector<thread> workers;
+    mutex workersMutex;
     TaskQueue taskQueue;
     atomic<bool> stopFlag;
+    TraceRecorder *trace; // NULL: workers are not traced
 
-    void workerFunction();
+    void workerFunction(size_t index);
 
 public:
-    ThreadPool(size_t threads);
+    ThreadPool(size_t threads, TraceRecorder *trace = NULL);
     ~ThreadPool();
     void enqueueTask(const shared_ptr<DownloadTask> &task);
+    void enqueueTasks(const vector<shared_ptr<DownloadTask>> &tasks);
+    void setDispatchPolicy(DispatchPolicy policy);
+    void setConnectionsPerHost(size_t connections);
+    void setHostConnectionLimit(const string &origin, size_t connections);
+    void setActiveLimit(size_t transfers); // Adds workers when the limit exceeds them, 0 = no limit
+    size_t queuedTasks();
+    size_t runningTasks();
     void shutdown();
 };
 
@@ -0,0 +1,67 @@
+// TimerWheel.hpp
+#ifndef TIMERWHEEL_HPP
+#define TIMERWHEEL_HPP
+
+#include <list>
+#include <vector>
+#include <unordered_map>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+
+using namespace std;
+
+// Hashed timing wheel for delayed callbacks such as retry backoff and
+// circuit-breaker cool-downs. A timer lands in the slot of the tick it is
+// due in and waits out whole turns of the wheel in its rounds count, so
+// schedule() and cancel() are O(1) however many timers there are. The
+// thread sleeps until the next tick whose slot holds a timer, and
+// indefinitely while none is scheduled; it is only started by the first
+// schedule(). Callbacks run on that thread, outside the lock, and may
+// schedule or cancel timers themselves.
+class TimerWheel
+{
+public:
+    typedef unsigned long long TimerId; // 0 is never used
+    typedef function<void()> Callback;
+
+private:
+    struct Timer
+    {
+        TimerId id;
+        unsigned long long rounds; // Turns of the wheel still to wait
+        Callback callback;
+    };
+
+    struct Location
+    {
+        size_t slot;
+        list<Timer>::iterator timer;
+    };
+
+    chrono::steady_clock::duration tick;
+    chrono::steady_clock::time_point origin;
+    vector<list<Timer>> slots;
+    unordered_map<TimerId, Location> locations;
+    unsigned long long currentTick; // Last tick whose slot was expired
+    TimerId nextId;
+    mutex wheelMutex;
+    condition_variable wake;
+    thread worker;
+    bool running;
+
+    unsigned long long tickAt(chrono::steady_clock::time_point when) const;
+    void run();
+
+public:
+    explicit TimerWheel(chrono::milliseconds tick = chrono::milliseconds(50), size_t slotCount = 512);
+    ~TimerWheel();
+    TimerId schedule(chrono::milliseconds delay, const Callback &callback); // Rounded up to whole ticks
+    bool cancel(TimerId id); // False when it already fired or was cancelled
+    size_t pending();
+    void stop(); // Drops the timers that have not fired; waits for a running callback
+};
+
+#endif // TIMERWHEEL_HPP
@@ -0,0 +1,120 @@
+// TraceRecorder.hpp
+#ifndef TRACERECORDER_HPP
+#define TRACERECORDER_HPP
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <functional>
+
+using namespace std;
+
+// One span or instant; names and categories are string literals
+struct TraceEvent
+{
+    const char *name;
+    const char *category;
+    unsigned long long task; // TaskId, 0 = none
+    int lane;                // TraceRecorder::THREAD, LIFECYCLE, a request lane or SIDECAR
+    long long start;         // Microseconds since the recorder was created
+    long long duration;      // Microseconds, -1 for an instant
+    long long value;         // Bytes; tasks for "dispatch", ms for "retry", the code for errors; -1 = none
+};
+
+// Opt-in timeline of where the time of a batch goes: queueing, dispatch,
+// idle workers, the curl phases of every request, disk writes and status
+// changes. Each thread that records gets its own ring of the latest events
+// and is its only writer, so recording is a relaxed load while tracing is
+// off and a few relaxed stores into memory nobody else writes while it is on.
+// Every slot carries the sequence number of its event, set after the fields,
+// so toJson() copies the rings while they are written and drops the slots
+// that changed under it. A thread keeps one ring per recorder and resets it
+// for the next session. The output is Chrome trace JSON: threads are
+// one process, every task gets a status track and one track per request
+// lane in another, and Perfetto or chrome://tracing load it as is.
+class TraceRecorder
+{
+public:
+    static const int THREAD = -1;   // Track of the thread that recorded the event
+    static const int LIFECYCLE = 0; // Status track of the task
+    static const int SIDECAR = 31;  // "<url>.sha256" request of the task
+    static const int LANES = 32;    // Per task; request lanes are 1 to SIDECAR - 1
+
+    static int requestLane(size_t segment) // Probe and first range share lane 1
+    {
+        return 1 + static_cast<int>(segment % (SIDECAR - 1));
+    }
+
+private:
+    // A TraceEvent in atomics, read by toJson() while its thread may be rewriting it
+    struct Slot
+    {
+        atomic<unsigned long long> sequence; // Index of the event + 1, 0 while empty or being written
+        atomic<const char *> name;
+        atomic<const char *> category;
+        atomic<unsigned long long> task;
+        atomic<int> lane;
+        atomic<long long> start;
+        atomic<long long> duration;
+        atomic<long long> value;
+
+        Slot() : sequence(0), name(NULL), category(NULL), task(0), lane(0), start(0), duration(0), value(0) {}
+    };
+
+    struct alignas(64) Ring
+    {
+        unique_ptr<Slot[]> slots;
+        size_t size;
+        atomic<unsigned long long> written; // Events ever recorded; the next slot is written & (size - 1)
+        unsigned long long generation; // Changed by the owning thread under ringsMutex
+        int thread;   // Ordinal of the recording thread
+        string label; // Its name, e.g. "worker"
+
+        Ring(size_t capacity, unsigned long long generation, int thread, const string &label)
+            : slots(new Slot[capacity]), size(capacity), written(0), generation(generation), thread(thread), label(label) {}
+    };
+
+    unsigned long long id; // Keys the per-thread ring cache; never reused
+    chrono::steady_clock::time_point created;
+    atomic<bool> recording;
+    atomic<unsigned long long> generation; // Bumped by start(); rings of older sessions are not written or dumped
+    atomic<size_t> capacity;
+    mutex ringsMutex;
+    vector<unique_ptr<Ring>> rings; // One per thread that recorded, kept until destruction: the thread may be writing to it
+
+    Ring &local();
+
+public:
+    TraceRecorder();
+
+    void start(size_t eventsPerThread); // Begins a new session, dropping the events of the last one; rounded up to a power of two
+    void stop();                        // Keeps the events for toJson()
+    bool enabled() const
+    {
+        return recording.load(memory_order_relaxed);
+    }
+    long long now() const; // Microseconds since creation, the time base of every event
+    long long toMicros(chrono::steady_clock::time_point time) const;
+
+    void record(const char *name, const char *category, unsigned long long task, int lane, long long start,
+                long long duration, long long value = -1);
+    void span(const char *name, const char *category, unsigned long long task, int lane, long long start,
+              long long end, long long value = -1)
+    {
+        record(name, category, task, lane, start, (end > start) ? end - start : 0, value);
+    }
+    void instant(const char *name, const char *category, unsigned long long task, int lane, long long value = -1)
+    {
+        record(name, category, task, lane, now(), -1, value);
+    }
+
+    static void nameThread(const char *label); // Names the calling thread's track, e.g. "worker"
+
+    // label gives the task tracks a name, e.g. the file name; empty falls back to the ID
+    string toJson(const function<string(unsigned long long)> &label);
+};
+
+#endif // TRACERECORDER_HPP
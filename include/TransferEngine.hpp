@@ -0,0 +1,91 @@
+// TransferEngine.hpp
+#ifndef TRANSFERENGINE_HPP
+#define TRANSFERENGINE_HPP
+
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <chrono>
+#include <unordered_map>
+#include <deque>
+#include "DownloadTask.hpp"
+
+using namespace std;
+
+// Event-driven alternative to ThreadPool: a few loop threads each own a curl
+// multi handle and drive any number of transfers without blocking on them
+class TransferEngine
+{
+private:
+    // Transfers of one origin in multiplexed mode: streams open on its connection and files waiting for one
+    struct OriginQueue
+    {
+        size_t active;
+        deque<shared_ptr<DownloadTask>> waiting;
+
+        OriginQueue() : active(0) {}
+    };
+
+    struct EventLoop
+    {
+        thread worker;
+        CURLM *multi;
+        mutex inboxMutex;
+        vector<shared_ptr<DownloadTask>> inbox; // Submitted, not yet attached
+        unordered_map<DownloadTask *, shared_ptr<DownloadTask>> active;
+        deque<shared_ptr<DownloadTask>> backlog; // Admitted in order once the loop cap and a handle slot allow
+        unordered_map<string, OriginQueue> origins; // Multiplexed mode only
+        unordered_map<DownloadTask *, string> originOf;
+        atomic<size_t> load;
+#ifdef __linux__
+        int epollFd;
+        int wakeFd;
+        bool timerArmed;
+        chrono::steady_clock::time_point deadline;
+#endif
+    };
+
+    vector<unique_ptr<EventLoop>> loops;
+    atomic<bool> stopFlag;
+    bool multiplex;
+    atomic<size_t> loopLimit; // Files attached at once per loop
+    mutex limitMutex;
+    size_t streamsPerOrigin;
+    unordered_map<string, size_t> originLimits;
+    TraceRecorder *trace; // NULL: loops are not traced
+
+    size_t pickLoop(const DownloadTask &task, const vector<size_t> &added); // added: not yet counted in load
+    void loopFunction(EventLoop *loop);
+    void attachSubmitted(EventLoop *loop);
+    bool admit(EventLoop *loop, const shared_ptr<DownloadTask> &task, bool fromBacklog = false);
+    void park(EventLoop *loop, const shared_ptr<DownloadTask> &task, bool front);
+    void retire(EventLoop *loop, DownloadTask *task);
+    void drainBacklog(EventLoop *loop);
+    size_t streamLimit(const string &origin);
+    void processCompletions(EventLoop *loop);
+    void wake(EventLoop *loop);
+#ifdef __linux__
+    static int socketCallback(CURL *easy, curl_socket_t socket, int what, void *userp, void *socketp);
+    static int timerCallback(CURLM *multi, long timeoutMs, void *userp);
+#endif
+
+public:
+    static const size_t DEFAULT_LOOP_LIMIT = 128; // Files attached at once per loop until setActiveLimit()
+
+    // With multiplex every origin is pinned to one loop so its files share one HTTP/2 connection
+    TransferEngine(size_t loopCount, bool multiplex = false, TraceRecorder *trace = NULL);
+    ~TransferEngine();
+    void submit(const shared_ptr<DownloadTask> &task);
+    void submitAll(const vector<shared_ptr<DownloadTask>> &tasks); // One inbox lock and wake-up per loop
+    void setStreamsPerOrigin(size_t streams);
+    void setOriginStreamLimit(const string &origin, size_t streams); // origin as scheme://host:port
+    // Files attached at once over all loops, the rest wait in submission order; 0 restores the default
+    void setActiveLimit(size_t transfers);
+    void slotsReleased(); // A handle or file slot came free: loops retry their backlog
+    size_t activeTransfers() const;
+    void shutdown();
+};
+
+#endif // TRANSFERENGINE_HPP
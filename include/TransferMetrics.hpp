@@ -0,0 +1,158 @@
+// TransferMetrics.hpp
+#ifndef TRANSFERMETRICS_HPP
+#define TRANSFERMETRICS_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <curl/curl.h>
+
+using namespace std;
+
+enum class DownloadStatus;
+
+struct HistogramSnapshot
+{
+    vector<double> bounds;             // Upper bounds in seconds; the last bucket is +Inf
+    vector<unsigned long long> counts; // Per bucket, bounds.size() + 1 entries
+    double sum;                        // Seconds
+    unsigned long long count;
+};
+
+// Per-task view, taken from the task's own counters
+struct TaskStats
+{
+    unsigned long long id; // TaskId
+    string url;
+    DownloadStatus status;
+    long long bytes;           // Received over the network, restarts included
+    long long totalSize;       // -1 until known
+    double throughput;         // Bytes per second over the last half second, 0 unless downloading
+    double averageThroughput;  // bytes / seconds spent downloading
+    double firstByteMs;        // First request of the latest attempt, 0 = none yet
+    double queueWaitMs;        // Last wait between start and a worker picking the task up
+    double statusSeconds[7];   // Indexed by DownloadStatus
+    unsigned retries;
+    int lastError;             // CURLcode of the last failed attempt, 0 = none
+};
+
+struct MetricsSnapshot
+{
+    double uptimeSeconds;
+    unsigned long long bytes;
+    unsigned long long requests;
+    unsigned long long started;
+    unsigned long long completed;
+    unsigned long long failed;
+    unsigned long long cancelled;
+    unsigned long long retries;
+    unsigned long long throttled;   // Transfers paused by the bandwidth scheduler
+    unsigned long long writeStalls; // Transfers paused because the disk was behind
+    double throughput;              // Sum over the downloading tasks
+    double averageThroughput;       // bytes / uptime
+    double statusSeconds[7];        // Finished stays in each DownloadStatus, summed over tasks
+    map<int, unsigned long long> errors; // Failed requests by CURLcode
+    HistogramSnapshot firstByte;
+    HistogramSnapshot queueWait;
+    HistogramSnapshot transferTime;
+    size_t queued;      // Started, waiting for a worker (thread-pool mode)
+    size_t running;     // Handed to a worker or an event loop
+    size_t concurrency; // Connection limit of the adaptive controller, 0 when it is off
+    size_t bufferPoolBytes;        // Write buffer slab, 0 until allocated or with the pool off
+    size_t bufferPoolUsedBytes;    // Lent to ranges right now
+    double bufferPoolStallSeconds; // Time ranges spent paused waiting for a buffer
+    unsigned long long cacheRevalidated;   // Downloads answered 304 and served from the content cache
+    unsigned long long cacheBytesSaved;    // Bodies not transferred plus duplicate content not stored again
+    vector<TaskStats> tasks;
+};
+
+// Counters and histograms shared by every task of a manager. Each thread
+// that drives transfers gets its own shard and is its only writer, so the
+// hot path is a plain load and store on a cache line nobody else touches;
+// readers add the shards up.
+class TransferMetrics
+{
+public:
+    enum Counter
+    {
+        Bytes,
+        Requests,
+        Started,
+        Completed,
+        Failed,
+        Cancelled,
+        Retries,
+        Throttled,
+        WriteStalls,
+        COUNTER_COUNT
+    };
+
+    enum Histogram
+    {
+        FirstByte,
+        QueueWait,
+        TransferTime,
+        HISTOGRAM_COUNT
+    };
+
+    static const int STATUS_COUNT = 7;
+    static const int BUCKET_COUNT = 17;
+
+    // Totals without the histogram buckets, cheap enough to poll
+    struct Totals
+    {
+        unsigned long long counters[COUNTER_COUNT];
+        unsigned long long sums[HISTOGRAM_COUNT];   // Microseconds
+        unsigned long long counts[HISTOGRAM_COUNT];
+    };
+
+private:
+    struct alignas(64) Shard
+    {
+        atomic<unsigned long long> counters[COUNTER_COUNT];
+        atomic<unsigned long long> errors[CURL_LAST];
+        atomic<unsigned long long> statusMicros[STATUS_COUNT];
+        atomic<unsigned long long> buckets[HISTOGRAM_COUNT][BUCKET_COUNT + 1];
+        atomic<unsigned long long> sums[HISTOGRAM_COUNT];
+
+        Shard();
+    };
+
+    static const long long BUCKET_MICROS[BUCKET_COUNT];
+
+    unsigned long long id; // Keys the per-thread shard cache; never reused
+    chrono::steady_clock::time_point created;
+    mutex shardsMutex;
+    vector<unique_ptr<Shard>> shards;
+
+    Shard &local();
+    static void bump(atomic<unsigned long long> &value, unsigned long long amount)
+    {
+        value.store(value.load(memory_order_relaxed) + amount, memory_order_relaxed);
+    }
+    HistogramSnapshot histogram(Histogram which);
+
+public:
+    TransferMetrics();
+
+    void add(Counter counter, unsigned long long amount = 1)
+    {
+        bump(local().counters[counter], amount);
+    }
+    void observe(Histogram histogram, long long micros);
+    void recordRequest(CURLcode result, long long firstByteMicros);
+    void recordStatusTime(int status, long long micros);
+
+    Totals totals();
+    MetricsSnapshot snapshot(); // Everything but the gauges and tasks, which the manager fills in
+
+    static string toJson(const MetricsSnapshot &snapshot);
+    static string toPrometheus(const MetricsSnapshot &snapshot);
+    static string jsonString(const string &text); // Quoted, with quotes, backslashes and control characters escaped
+};
+
+#endif // TRANSFERMETRICS_HPP
@@ -0,0 +1,87 @@
+// UringBackend.hpp
+#ifndef URINGBACKEND_HPP
+#define URINGBACKEND_HPP
+
+#include <vector>
+#include <cstddef>
+#include <sys/uio.h>
+
+using namespace std;
+
+class FileWriter;
+
+// Per-thread io_uring used by FileWriter when built with ENABLE_IO_URING.
+// Writes are submitted from a pool of registered buffers and completed
+// asynchronously; when the pool runs dry the caller is told to stall and is
+// woken through its callback once buffers come back.
+class UringBackend
+{
+private:
+    struct InFlightWrite
+    {
+        FileWriter *owner;
+        int fileDescriptor;
+        long long offset;
+        size_t length;
+    };
+
+    struct Waiter
+    {
+        FileWriter *owner;
+        void (*wake)(void *);
+        void *context;
+    };
+
+    int ringFd;
+    int eventFd;
+    bool fixedBuffers; // Pool registered with the kernel (IORING_OP_WRITE_FIXED)
+
+    // Mapped ring state
+    void *sqRing;
+    void *cqRing;
+    size_t sqRingSize;
+    size_t cqRingSize;
+    void *sqeMemory;
+    size_t sqeMemorySize;
+    unsigned *sqHead;
+    unsigned *sqTail;
+    unsigned *sqMask;
+    unsigned *sqArray;
+    unsigned *cqHead;
+    unsigned *cqTail;
+    unsigned *cqMask;
+    void *cqes;
+
+    char *poolMemory;
+    size_t bufferSize;
+    vector<iovec> buffers;
+    vector<int> freeBuffers;
+    vector<InFlightWrite> inFlight; // Indexed by buffer
+    int writesInFlight;             // Submitted and not yet completed
+    vector<Waiter> waiters;
+
+    UringBackend(unsigned bufferCount, size_t bufferSize);
+    bool setup(unsigned entries);
+    void complete(int index, int result);
+
+public:
+    ~UringBackend();
+
+    // Backend of the calling thread, created on first use; NULL if io_uring is unavailable
+    static UringBackend *current();
+
+    int completionDescriptor() const;
+    size_t getBufferSize() const;
+    bool hasFreeBuffer() const;
+    bool hasWritesInFlight() const; // False when no completion is coming to wake a waiter
+    char *acquireBuffer(int &index);
+    void releaseBuffer(int index);
+    bool submitWrite(FileWriter *owner, int fileDescriptor, int index, size_t length, long long offset);
+    long long firstPending(FileWriter *owner, long long begin, long long end) const; // Lowest queued offset of owner in [begin, end), else end
+    void reap(bool wait);
+    void waitForBuffer(FileWriter *owner, void (*wake)(void *), void *context);
+    void cancelWaits(FileWriter *owner);
+    void service();
+};
+
+#endif // URINGBACKEND_HPP
@@ -19,6 +19,8 @@ public:
     DownloadApplication() : stopFlag(false), manager(5)
     {
         curl_global_init(CURL_GLOBAL_DEFAULT);
+        manager.setAdaptiveConcurrency(true); // Grows or shrinks the pool toward the link's throughput knee
+        manager.setProgressReporting(true);   // One combined progress view per second, printed off the transfer threads
 
         // Run the cleanup thread in background
         t2 = thread(&DownloadApplication::usualCleanup, this);
@@ -143,6 +145,15 @@ public:
         manager.addDownload(url, url.substr(url.find_last_of('/') + 1));
     }
 
+    void importManifest()
+    {
+        string path;
+        cout << "Enter the manifest path: ";
+        cin >> path;
+        // Entries start as they are read; they are not added to the numbered list
+        manager.addManifest(path);
+    }
+
     void CLITest()
     {
         string url;
@@ -179,6 +190,9 @@ public:
                 cancelDownload();
                 break;
             case 8:
+                importManifest();
+                break;
+            case 9:
                 stopFlag = true;
                 return;
             default:
@@ -211,6 +225,8 @@ private:
             return "Completed";
         case DownloadStatus::Failed:
             return "Failed";
+        case DownloadStatus::Cancelled:
+            return "Cancelled";
         // Add other cases as needed
         default:
             return "Unknown";
@@ -246,7 +262,7 @@ private:
     {
         while (!stopFlag)
         {
-            // clear the downloaded or failed tasks
+            // clear the downloaded tasks; failed ones are retried by the manager
             this_thread::sleep_for(chrono::seconds(2)); // Check every 2 seconds
             manager.clearTasks();
         }
@@ -262,7 +278,8 @@ private:
         cout << "5. Pause a download\n";
         cout << "6. Resume a download\n";
         cout << "7. Cancel a download\n";
-        cout << "8. Exit\n";
+        cout << "8. Import a manifest\n";
+        cout << "9. Exit\n";
         cout << "======================================\n";
         cout << "Enter your choice: ";
     }
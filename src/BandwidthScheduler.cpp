@@ -0,0 +1,252 @@
+#define _HAS_STD_BYTE 0  // Fix Windows SDK byte conflict
+
+// BandwidthScheduler.cpp
+#include "BandwidthScheduler.hpp"
+#include <vector>
+
+using namespace std;
+
+// A class counts as competing for this long after its last request
+static const chrono::seconds CLASS_ACTIVE_WINDOW(1);
+// Buckets hold at most this much time worth of tokens (and at least one curl chunk)
+static const double BURST_SECONDS = 0.05;
+static const double MIN_BURST_BYTES = 64 * 1024;
+
+struct Wakeup
+{
+    chrono::steady_clock::time_point due;
+    const void *owner;
+    void (*wake)(void *);
+    void *context;
+};
+
+// Only the thread that drives a transfer may unpause it
+static thread_local vector<Wakeup> wakeups;
+
+BandwidthScheduler::BandwidthScheduler() : globalRate(0), limits(0)
+{
+    const unsigned weights[CLASS_COUNT] = {1, 4, 16};
+    for (int i = 0; i < CLASS_COUNT; ++i)
+    {
+        classes[i].weight = weights[i];
+    }
+}
+
+void BandwidthScheduler::refill(Bucket &bucket, chrono::steady_clock::time_point now)
+{
+    if (bucket.refilled.time_since_epoch().count() == 0)
+    {
+        bucket.refilled = now;
+        return;
+    }
+    double elapsed = chrono::duration<double>(now - bucket.refilled).count();
+    bucket.refilled = now;
+    double burst = bucket.rate * BURST_SECONDS;
+    if (burst < MIN_BURST_BYTES)
+    {
+        burst = MIN_BURST_BYTES;
+    }
+    bucket.tokens += bucket.rate * elapsed;
+    if (bucket.tokens > burst)
+    {
+        bucket.tokens = burst;
+    }
+}
+
+// Classes without recent traffic give their share to the others
+void BandwidthScheduler::splitGlobalRate(chrono::steady_clock::time_point now)
+{
+    unsigned totalWeight = 0;
+    for (auto &priorityClass : classes)
+    {
+        if (now - priorityClass.lastDemand < CLASS_ACTIVE_WINDOW)
+        {
+            totalWeight += priorityClass.weight;
+        }
+    }
+    for (auto &priorityClass : classes)
+    {
+        bool active = now - priorityClass.lastDemand < CLASS_ACTIVE_WINDOW;
+        long long rate = (active && totalWeight > 0) ? globalRate * priorityClass.weight / totalWeight : 0;
+        refill(priorityClass.bucket, now); // Settle tokens at the old rate first
+        priorityClass.bucket.rate = (rate > 0) ? rate : 1;
+    }
+}
+
+void BandwidthScheduler::setGlobalRate(long long bytesPerSecond)
+{
+    lock_guard<mutex> lock(schedulerMutex);
+    long long rate = (bytesPerSecond > 0) ? bytesPerSecond : 0;
+    if ((globalRate > 0) != (rate > 0))
+    {
+        (rate > 0) ? ++limits : --limits;
+    }
+    refill(global, chrono::steady_clock::now());
+    globalRate = rate;
+    global.rate = rate;
+}
+
+void BandwidthScheduler::setClassWeight(TransferPriority priority, unsigned weight)
+{
+    lock_guard<mutex> lock(schedulerMutex);
+    classes[static_cast<int>(priority)].weight = (weight > 0) ? weight : 1;
+}
+
+void BandwidthScheduler::setFlowRate(Flow &flow, long long bytesPerSecond)
+{
+    lock_guard<mutex> lock(schedulerMutex);
+    long long rate = (bytesPerSecond > 0) ? bytesPerSecond : 0;
+    if ((flow.bucket.rate > 0) != (rate > 0))
+    {
+        (rate > 0) ? ++limits : --limits;
+    }
+    refill(flow.bucket, chrono::steady_clock::now());
+    flow.bucket.rate = rate;
+}
+
+void BandwidthScheduler::setFlowPriority(Flow &flow, TransferPriority priority)
+{
+    lock_guard<mutex> lock(schedulerMutex);
+    flow.priority = priority;
+}
+
+void BandwidthScheduler::removeFlow(Flow &flow)
+{
+    lock_guard<mutex> lock(schedulerMutex);
+    if (flow.bucket.rate > 0)
+    {
+        --limits;
+        flow.bucket.rate = 0;
+    }
+}
+
+long long BandwidthScheduler::request(Flow &flow, size_t bytes)
+{
+    if (limits.load(memory_order_relaxed) == 0)
+    {
+        return 0;
+    }
+
+    lock_guard<mutex> lock(schedulerMutex);
+    auto now = chrono::steady_clock::now();
+    double waitSeconds = 0;
+
+    if (flow.bucket.rate > 0)
+    {
+        refill(flow.bucket, now);
+        if (flow.bucket.tokens < 0)
+        {
+            waitSeconds = -flow.bucket.tokens / flow.bucket.rate;
+        }
+    }
+
+    PriorityClass *priorityClass = NULL;
+    bool borrowing = false;
+    if (globalRate > 0)
+    {
+        priorityClass = &classes[static_cast<int>(flow.priority)];
+        priorityClass->lastDemand = now;
+        splitGlobalRate(now);
+        refill(global, now);
+
+        // Past its own share a class may still use bandwidth the other classes leave idle
+        if (priorityClass->bucket.tokens < 0)
+        {
+            borrowing = global.tokens > 0;
+            double classWait = -priorityClass->bucket.tokens / priorityClass->bucket.rate;
+            double globalWait = -global.tokens / global.rate;
+            double shortest = (globalWait < classWait) ? globalWait : classWait;
+            if (!borrowing && shortest > waitSeconds)
+            {
+                waitSeconds = shortest;
+            }
+        }
+    }
+
+    if (waitSeconds > 0)
+    {
+        long long micros = static_cast<long long>(waitSeconds * 1e6);
+        return (micros < 1000) ? 1000 : micros;
+    }
+
+    // In credit everywhere: take the whole chunk even if that runs the buckets into debt
+    if (flow.bucket.rate > 0)
+    {
+        flow.bucket.tokens -= static_cast<double>(bytes);
+    }
+    if (priorityClass)
+    {
+        // Borrowed bytes are not held against the class once the others are busy again
+        if (!borrowing)
+        {
+            priorityClass->bucket.tokens -= static_cast<double>(bytes);
+        }
+        global.tokens -= static_cast<double>(bytes);
+    }
+    return 0;
+}
+
+void BandwidthScheduler::wakeAfter(long long micros, const void *owner, void (*wake)(void *), void *context)
+{
+    wakeups.push_back({chrono::steady_clock::now() + chrono::microseconds(micros), owner, wake, context});
+}
+
+void BandwidthScheduler::cancelWakeups(const void *owner)
+{
+    for (size_t i = 0; i < wakeups.size();)
+    {
+        if (wakeups[i].owner == owner)
+        {
+            wakeups[i] = wakeups.back();
+            wakeups.pop_back();
+        }
+        else
+        {
+            ++i;
+        }
+    }
+}
+
+int BandwidthScheduler::nextWakeupMs(int limitMs)
+{
+    auto now = chrono::steady_clock::now();
+    int timeout = limitMs;
+    for (const auto &wakeup : wakeups)
+    {
+        auto remaining = chrono::duration_cast<chrono::milliseconds>(wakeup.due - now).count() + 1;
+        if (remaining < timeout)
+        {
+            timeout = (remaining > 0) ? static_cast<int>(remaining) : 0;
+        }
+    }
+    return timeout;
+}
+
+void BandwidthScheduler::runDueWakeups()
+{
+    if (wakeups.empty())
+    {
+        return;
+    }
+
+    // A woken transfer may be refused again and re-register, so collect first
+    auto now = chrono::steady_clock::now();
+    vector<Wakeup> due;
+    for (size_t i = 0; i < wakeups.size();)
+    {
+        if (wakeups[i].due <= now)
+        {
+            due.push_back(wakeups[i]);
+            wakeups[i] = wakeups.back();
+            wakeups.pop_back();
+        }
+        else
+        {
+            ++i;
+        }
+    }
+    for (auto &wakeup : due)
+    {
+        wakeup.wake(wakeup.context);
+    }
+}
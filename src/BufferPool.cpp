@@ -0,0 +1,148 @@
+#define _HAS_STD_BYTE 0  // Fix Windows SDK byte conflict
+
+// BufferPool.cpp
+#include "BufferPool.hpp"
+#include <iostream>
+#include <cstdlib>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+using namespace std;
+
+BufferPool::BufferPool(size_t bufferSize, long long limit)
+    : allocated(false), slab(NULL), bufferSize(bufferSize), limit(limit), count(0), inUse(0), peakInUse(0), acquired(0),
+      stalls(0), stallMicros(0)
+{
+}
+
+BufferPool::~BufferPool()
+{
+    if (slab)
+    {
+#ifdef _WIN32
+        _aligned_free(slab);
+#else
+        free(slab);
+#endif
+    }
+}
+
+bool BufferPool::configure(size_t bufferSize, long long limit)
+{
+    lock_guard<mutex> lock(slabMutex);
+    if (allocated)
+    {
+        return false;
+    }
+    this->bufferSize = (bufferSize + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    if (this->bufferSize == 0)
+    {
+        this->bufferSize = ALIGNMENT;
+    }
+    this->limit = limit;
+    return true;
+}
+
+bool BufferPool::enabled() const
+{
+    return limit > 0;
+}
+
+long long BufferPool::getLimit() const
+{
+    return limit;
+}
+
+size_t BufferPool::getBufferSize() const
+{
+    return bufferSize;
+}
+
+// One block for every buffer; pages are only backed once a buffer is first written
+bool BufferPool::allocate()
+{
+    lock_guard<mutex> lock(slabMutex);
+    if (allocated)
+    {
+        return slab != NULL;
+    }
+    count = static_cast<size_t>(limit / static_cast<long long>(bufferSize));
+    if (count == 0)
+    {
+        count = 1; // A limit below one buffer still lets ranges take turns
+    }
+#ifdef _WIN32
+    slab = static_cast<char *>(_aligned_malloc(count * bufferSize, ALIGNMENT));
+#else
+    void *memory = NULL;
+    slab = (posix_memalign(&memory, ALIGNMENT, count * bufferSize) == 0) ? static_cast<char *>(memory) : NULL;
+#endif
+    if (!slab)
+    {
+        cerr << "Failed to allocate " << count * bufferSize << " bytes of write buffers, using the heap" << endl;
+        count = 0;
+        limit = 0; // Writers see the pool disabled and allocate their own buffers
+    }
+    lock_guard<mutex> freeLock(freeMutex);
+    freeBuffers.reserve(count);
+    for (size_t i = count; i > 0; --i)
+    {
+        freeBuffers.push_back(static_cast<int>(i - 1));
+    }
+    allocated.store(true, memory_order_release);
+    return slab != NULL;
+}
+
+char *BufferPool::acquire(int &index)
+{
+    if (!allocated.load(memory_order_acquire) && !allocate())
+    {
+        return NULL;
+    }
+    {
+        lock_guard<mutex> lock(freeMutex);
+        if (freeBuffers.empty())
+        {
+            ++stalls;
+            return NULL;
+        }
+        index = freeBuffers.back();
+        freeBuffers.pop_back();
+    }
+    ++acquired;
+    size_t used = ++inUse;
+    size_t peak = peakInUse.load(memory_order_relaxed);
+    while (used > peak && !peakInUse.compare_exchange_weak(peak, used, memory_order_relaxed))
+    {
+    }
+    return slab + static_cast<size_t>(index) * bufferSize;
+}
+
+void BufferPool::release(int index)
+{
+    lock_guard<mutex> lock(freeMutex);
+    freeBuffers.push_back(index);
+    --inUse;
+}
+
+void BufferPool::recordStall(long long micros)
+{
+    stallMicros += static_cast<unsigned long long>(micros);
+}
+
+BufferPoolStats BufferPool::getStats() const
+{
+    BufferPoolStats stats;
+    bool ready = allocated.load(memory_order_acquire);
+    stats.bufferSize = bufferSize;
+    stats.buffers = ready ? count : 0;
+    stats.inUse = inUse;
+    stats.peakInUse = peakInUse;
+    stats.utilization = stats.buffers > 0 ? static_cast<double>(stats.inUse) / stats.buffers : 0;
+    stats.acquired = acquired;
+    stats.stalls = stalls;
+    stats.stallSeconds = stallMicros / 1e6;
+    return stats;
+}
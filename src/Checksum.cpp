@@ -0,0 +1,469 @@
+#define _HAS_STD_BYTE 0  // Fix Windows SDK byte conflict
+
+// Checksum.cpp
+#include "Checksum.hpp"
+#include <atomic>
+#include <cctype>
+#include <cstring>
+#include <cstdlib>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define DM_X86_INTRINSICS
+#include <immintrin.h>
+#include <cpuid.h>
+#define DM_TARGET(features) __attribute__((target(features)))
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define DM_X86_INTRINSICS
+#include <immintrin.h>
+#include <intrin.h>
+#define DM_TARGET(features)
+#endif
+
+#if defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#endif
+
+using namespace std;
+
+static atomic<bool> accelerationEnabled(true);
+
+void setChecksumAcceleration(bool enabled)
+{
+    accelerationEnabled = enabled;
+}
+
+struct CpuFeatures
+{
+    bool crc32c; // SSE4.2 (x86) or the ARMv8 CRC extension
+    bool sha256; // SHA-NI with the SSSE3 / SSE4.1 shuffles it needs
+};
+
+static CpuFeatures detectCpu()
+{
+    CpuFeatures features = {false, false};
+#if defined(DM_X86_INTRINSICS)
+    unsigned int leaf1[4] = {0, 0, 0, 0};
+    unsigned int leaf7[4] = {0, 0, 0, 0};
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+    __cpuid(info, 1);
+    for (int i = 0; i < 4; ++i)
+    {
+        leaf1[i] = static_cast<unsigned int>(info[i]);
+    }
+    if (maxLeaf >= 7)
+    {
+        __cpuidex(info, 7, 0);
+        for (int i = 0; i < 4; ++i)
+        {
+            leaf7[i] = static_cast<unsigned int>(info[i]);
+        }
+    }
+#else
+    __get_cpuid(1, &leaf1[0], &leaf1[1], &leaf1[2], &leaf1[3]);
+    __get_cpuid_count(7, 0, &leaf7[0], &leaf7[1], &leaf7[2], &leaf7[3]);
+#endif
+    bool ssse3 = (leaf1[2] >> 9) & 1;
+    bool sse41 = (leaf1[2] >> 19) & 1;
+    features.crc32c = (leaf1[2] >> 20) & 1;
+    features.sha256 = ssse3 && sse41 && ((leaf7[1] >> 29) & 1);
+#elif defined(__ARM_FEATURE_CRC32)
+    features.crc32c = true;
+#endif
+    return features;
+}
+
+static const CpuFeatures &cpu()
+{
+    static const CpuFeatures features = detectCpu();
+    return features;
+}
+
+// ---- CRC32C ----
+
+static const uint32_t CRC32C_POLY = 0x82F63B78; // Reflected Castagnoli polynomial
+
+static uint32_t crc32cPortable(uint32_t crc, const unsigned char *data, size_t length)
+{
+    struct Table
+    {
+        uint32_t entries[256];
+        Table()
+        {
+            for (uint32_t i = 0; i < 256; ++i)
+            {
+                uint32_t value = i;
+                for (int bit = 0; bit < 8; ++bit)
+                {
+                    value = (value & 1) ? (value >> 1) ^ CRC32C_POLY : value >> 1;
+                }
+                entries[i] = value;
+            }
+        }
+    };
+    static const Table table;
+    while (length--)
+    {
+        crc = table.entries[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#if defined(DM_X86_INTRINSICS)
+DM_TARGET("sse4.2")
+static uint32_t crc32cHardware(uint32_t crc, const unsigned char *data, size_t length)
+{
+    while (length > 0 && (reinterpret_cast<uintptr_t>(data) & 7) != 0)
+    {
+        crc = _mm_crc32_u8(crc, *data++);
+        --length;
+    }
+#if defined(__x86_64__) || defined(_M_X64)
+    uint64_t wide = crc;
+    for (; length >= 8; length -= 8, data += 8)
+    {
+        uint64_t word;
+        memcpy(&word, data, 8);
+        wide = _mm_crc32_u64(wide, word);
+    }
+    crc = static_cast<uint32_t>(wide);
+#endif
+    for (; length >= 4; length -= 4, data += 4)
+    {
+        uint32_t word;
+        memcpy(&word, data, 4);
+        crc = _mm_crc32_u32(crc, word);
+    }
+    while (length--)
+    {
+        crc = _mm_crc32_u8(crc, *data++);
+    }
+    return crc;
+}
+#elif defined(__ARM_FEATURE_CRC32)
+static uint32_t crc32cHardware(uint32_t crc, const unsigned char *data, size_t length)
+{
+    for (; length >= 8; length -= 8, data += 8)
+    {
+        uint64_t word;
+        memcpy(&word, data, 8);
+        crc = __crc32cd(crc, word);
+    }
+    while (length--)
+    {
+        crc = __crc32cb(crc, *data++);
+    }
+    return crc;
+}
+#endif
+
+bool Crc32c::accelerated()
+{
+    return cpu().crc32c && accelerationEnabled.load(memory_order_relaxed);
+}
+
+uint32_t Crc32c::update(uint32_t crc, const void *data, size_t length)
+{
+    const unsigned char *bytes = static_cast<const unsigned char *>(data);
+    crc = ~crc;
+#if defined(DM_X86_INTRINSICS) || defined(__ARM_FEATURE_CRC32)
+    if (accelerated())
+    {
+        return ~crc32cHardware(crc, bytes, length);
+    }
+#endif
+    return ~crc32cPortable(crc, bytes, length);
+}
+
+// a * b modulo the polynomial, both as reflected bit strings (zlib's multmodp)
+static uint32_t multiplyModP(uint32_t a, uint32_t b)
+{
+    uint32_t product = 0;
+    for (uint32_t mask = 1u << 31; mask != 0; mask >>= 1)
+    {
+        if (a & mask)
+        {
+            product ^= b;
+            if ((a & (mask - 1)) == 0)
+            {
+                break;
+            }
+        }
+        b = (b & 1) ? (b >> 1) ^ CRC32C_POLY : b >> 1;
+    }
+    return product;
+}
+
+uint32_t Crc32c::combine(uint32_t first, uint32_t second, long long secondLength)
+{
+    // x^(2^k) mod p for every bit of the length in bits
+    struct Powers
+    {
+        uint32_t entries[64];
+        Powers()
+        {
+            entries[0] = 1u << 30; // x^1
+            for (int k = 1; k < 64; ++k)
+            {
+                entries[k] = multiplyModP(entries[k - 1], entries[k - 1]);
+            }
+        }
+    };
+    static const Powers powers;
+
+    // Shift the first CRC past secondLength zero bytes, then add the second
+    uint32_t shift = 1u << 31; // x^0
+    unsigned long long bytes = secondLength > 0 ? static_cast<unsigned long long>(secondLength) : 0;
+    for (int k = 3; bytes != 0; bytes >>= 1, ++k)
+    {
+        if (bytes & 1)
+        {
+            shift = multiplyModP(powers.entries[k], shift);
+        }
+    }
+    return multiplyModP(shift, first) ^ second;
+}
+
+// ---- SHA-256 ----
+
+static const uint32_t K256[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+static inline uint32_t rotateRight(uint32_t value, int bits)
+{
+    return (value >> bits) | (value << (32 - bits));
+}
+
+static void sha256Portable(uint32_t state[8], const unsigned char *data, size_t blocks)
+{
+    for (; blocks > 0; --blocks, data += 64)
+    {
+        uint32_t w[64];
+        for (int i = 0; i < 16; ++i)
+        {
+            w[i] = (uint32_t(data[4 * i]) << 24) | (uint32_t(data[4 * i + 1]) << 16) |
+                   (uint32_t(data[4 * i + 2]) << 8) | uint32_t(data[4 * i + 3]);
+        }
+        for (int i = 16; i < 64; ++i)
+        {
+            uint32_t s0 = rotateRight(w[i - 15], 7) ^ rotateRight(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotateRight(w[i - 2], 17) ^ rotateRight(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 64; ++i)
+        {
+            uint32_t t1 = h + (rotateRight(e, 6) ^ rotateRight(e, 11) ^ rotateRight(e, 25)) + ((e & f) ^ (~e & g)) +
+                          K256[i] + w[i];
+            uint32_t t2 = (rotateRight(a, 2) ^ rotateRight(a, 13) ^ rotateRight(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+}
+
+#if defined(DM_X86_INTRINSICS)
+// Four rounds per step with the message schedule kept in four registers
+DM_TARGET("sha,ssse3,sse4.1")
+static void sha256Hardware(uint32_t state[8], const unsigned char *data, size_t blocks)
+{
+    const __m128i byteSwap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    // The instructions want the state as ABEF / CDGH
+    __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(&state[0])), 0xB1);
+    __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(&state[4])), 0x1B);
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+    for (; blocks > 0; --blocks, data += 64)
+    {
+        __m128i abefSaved = state0;
+        __m128i cdghSaved = state1;
+        __m128i w[4];
+        for (int i = 0; i < 4; ++i)
+        {
+            w[i] = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(data + 16 * i)), byteSwap);
+        }
+
+        for (int step = 0; step < 16; ++step)
+        {
+            __m128i &current = w[step & 3];
+            __m128i message = _mm_add_epi32(current, _mm_loadu_si128(reinterpret_cast<const __m128i *>(&K256[4 * step])));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, message);
+            if (step >= 3 && step <= 14)
+            {
+                __m128i &next = w[(step + 1) & 3];
+                next = _mm_add_epi32(next, _mm_alignr_epi8(current, w[(step + 3) & 3], 4));
+                next = _mm_sha256msg2_epu32(next, current);
+            }
+            message = _mm_shuffle_epi32(message, 0x0E);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, message);
+            if (step >= 1 && step <= 12)
+            {
+                __m128i &previous = w[(step + 3) & 3];
+                previous = _mm_sha256msg1_epu32(previous, current);
+            }
+        }
+
+        state0 = _mm_add_epi32(state0, abefSaved);
+        state1 = _mm_add_epi32(state1, cdghSaved);
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1B);
+    state1 = _mm_shuffle_epi32(state1, 0xB1);
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);
+    state1 = _mm_alignr_epi8(state1, tmp, 8);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(&state[0]), state0);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(&state[4]), state1);
+}
+#endif
+
+static void sha256Blocks(uint32_t state[8], const unsigned char *data, size_t blocks)
+{
+#if defined(DM_X86_INTRINSICS)
+    if (Sha256::accelerated())
+    {
+        sha256Hardware(state, data, blocks);
+        return;
+    }
+#endif
+    sha256Portable(state, data, blocks);
+}
+
+bool Sha256::accelerated()
+{
+    return cpu().sha256 && accelerationEnabled.load(memory_order_relaxed);
+}
+
+Sha256::Sha256()
+{
+    reset();
+}
+
+void Sha256::reset()
+{
+    static const uint32_t initial[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                        0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    memcpy(state, initial, sizeof(state));
+    blockUsed = 0;
+    length = 0;
+}
+
+void Sha256::update(const void *data, size_t bytes)
+{
+    const unsigned char *input = static_cast<const unsigned char *>(data);
+    length += bytes;
+    if (blockUsed > 0)
+    {
+        size_t take = (bytes < 64 - blockUsed) ? bytes : 64 - blockUsed;
+        memcpy(block + blockUsed, input, take);
+        blockUsed += take;
+        input += take;
+        bytes -= take;
+        if (blockUsed < 64)
+        {
+            return;
+        }
+        sha256Blocks(state, block, 1);
+        blockUsed = 0;
+    }
+    if (bytes >= 64)
+    {
+        sha256Blocks(state, input, bytes / 64);
+        input += bytes / 64 * 64;
+        bytes %= 64;
+    }
+    memcpy(block, input, bytes);
+    blockUsed = bytes;
+}
+
+string Sha256::finalHex()
+{
+    unsigned long long bits = length * 8;
+    block[blockUsed++] = 0x80;
+    if (blockUsed > 56)
+    {
+        memset(block + blockUsed, 0, 64 - blockUsed);
+        sha256Blocks(state, block, 1);
+        blockUsed = 0;
+    }
+    memset(block + blockUsed, 0, 56 - blockUsed);
+    for (int i = 0; i < 8; ++i)
+    {
+        block[63 - i] = static_cast<unsigned char>(bits >> (8 * i));
+    }
+    sha256Blocks(state, block, 1);
+
+    static const char digits[] = "0123456789abcdef";
+    string hex(64, '0');
+    for (int i = 0; i < 32; ++i)
+    {
+        unsigned char byte = static_cast<unsigned char>(state[i / 4] >> (24 - 8 * (i % 4)));
+        hex[2 * i] = digits[byte >> 4];
+        hex[2 * i + 1] = digits[byte & 0xF];
+    }
+    return hex;
+}
+
+// ---- Expected digests ----
+
+bool ExpectedDigest::parse(const string &text, ExpectedDigest &digest)
+{
+    string value;
+    for (char c : text)
+    {
+        value += static_cast<char>(tolower(static_cast<unsigned char>(c)));
+    }
+    string kind;
+    size_t colon = value.find(':');
+    if (colon != string::npos)
+    {
+        kind = value.substr(0, colon);
+        value = value.substr(colon + 1);
+    }
+    for (char c : value)
+    {
+        if (!isxdigit(static_cast<unsigned char>(c)))
+        {
+            return false;
+        }
+    }
+
+    if ((kind.empty() || kind == "sha256" || kind == "sha-256") && value.size() == 64)
+    {
+        digest.sha256 = value;
+        return true;
+    }
+    if ((kind.empty() || kind == "crc32c") && value.size() == 8)
+    {
+        digest.hasCrc32c = true;
+        digest.crc32c = static_cast<uint32_t>(strtoul(value.c_str(), NULL, 16));
+        return true;
+    }
+    return false;
+}
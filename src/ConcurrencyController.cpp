@@ -0,0 +1,183 @@
+#define _HAS_STD_BYTE 0  // Fix Windows SDK byte conflict
+
+// ConcurrencyController.cpp
+#include "ConcurrencyController.hpp"
+#include <chrono>
+
+using namespace std;
+
+// Goodput must rise this much for a larger limit to count as a gain
+static const double GAIN_THRESHOLD = 0.05;
+// A drop this large is treated as overload
+static const double LOSS_THRESHOLD = 0.15;
+// Latency this many times the baseline means requests are queuing at the server
+static const double LATENCY_TOLERANCE = 2.0;
+// The baseline creeps up per sample so it follows a lasting change of route
+static const double BASE_LATENCY_DRIFT = 0.02;
+static const int HOLD_SAMPLES = 5;
+static const size_t HISTORY_SIZE = 64;
+
+static double nowSeconds()
+{
+    return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+ConcurrencyController::ConcurrencyController(size_t initial, size_t minLimit, size_t maxLimit)
+    : limit(initial), minLimit(minLimit > 0 ? minLimit : 1),
+      maxLimit(maxLimit), transfers(initial), segments(1), slowStart(true), probeDown(false), lastAction(Action::Hold),
+      holdSamples(0), lastGoodput(0), probeReference(0), lastLatencyMs(0), baseLatencyMs(0), samples(0), increases(0), decreases(0),
+      created(nowSeconds())
+{
+    if (this->maxLimit < this->minLimit)
+    {
+        this->maxLimit = this->minLimit;
+    }
+    limit = (limit < this->minLimit) ? this->minLimit : (limit > this->maxLimit ? this->maxLimit : limit);
+}
+
+void ConcurrencyController::decide(Action action, size_t newLimit, double goodput, double latencyMs, const string &reason)
+{
+    if (newLimit > limit)
+    {
+        ++increases;
+    }
+    else if (newLimit < limit)
+    {
+        ++decreases;
+    }
+    limit = newLimit;
+    lastAction = action;
+    lastGoodput = goodput;
+    lastLatencyMs = latencyMs;
+
+    recent.push_back(ConcurrencyDecision{nowSeconds() - created, limit, goodput, latencyMs, reason});
+    if (recent.size() > HISTORY_SIZE)
+    {
+        recent.pop_front();
+    }
+}
+
+size_t ConcurrencyController::sample(double seconds, unsigned long long bytes, double latencyMs, bool saturated)
+{
+    lock_guard<mutex> lock(controllerMutex);
+    double goodput = bytes / (seconds > 0.001 ? seconds : 0.001);
+    ++samples;
+
+    if (latencyMs > 0)
+    {
+        baseLatencyMs = (baseLatencyMs == 0 || latencyMs < baseLatencyMs) ? latencyMs : baseLatencyMs * (1 + BASE_LATENCY_DRIFT);
+    }
+
+    // With too little work, or other caps holding files back, the limit is not what bounds goodput
+    if (!saturated)
+    {
+        decide(Action::Hold, limit, goodput, latencyMs, "hold: limit not binding");
+        lastGoodput = 0; // Not comparable with a saturated sample
+        return limit;
+    }
+
+    bool measured = lastGoodput > 0;
+    bool improved = measured && goodput > lastGoodput * (1 + GAIN_THRESHOLD);
+    bool fell = measured && goodput < lastGoodput * (1 - LOSS_THRESHOLD);
+    bool queuing = latencyMs > 0 && latencyMs > baseLatencyMs * LATENCY_TOLERANCE;
+    size_t cut = limit * 3 / 4;
+    cut = (cut < minLimit) ? minLimit : (cut >= limit && limit > minLimit ? limit - 1 : cut);
+
+    if (queuing && !improved && limit > minLimit)
+    {
+        slowStart = false;
+        holdSamples = HOLD_SAMPLES;
+        decide(Action::Decrease, cut, goodput, latencyMs, "decrease: latency");
+    }
+    else if (fell && lastAction != Action::Decrease && lastAction != Action::ProbeDown && limit > minLimit)
+    {
+        slowStart = false;
+        holdSamples = HOLD_SAMPLES;
+        decide(Action::Decrease, cut, goodput, latencyMs, "decrease: goodput");
+    }
+    else if (lastAction == Action::Increase && measured && !improved)
+    {
+        // Past the knee: give the last step back, stay there for a while, then look below
+        size_t step = slowStart ? limit / 2 : 1;
+        size_t previous = (limit - step < minLimit) ? minLimit : limit - step;
+        slowStart = false;
+        probeDown = true;
+        holdSamples = HOLD_SAMPLES;
+        decide(Action::Hold, previous, goodput, latencyMs, "hold: knee");
+    }
+    else if (lastAction == Action::ProbeDown && measured && goodput < probeReference * (1 - GAIN_THRESHOLD))
+    {
+        // The connection given up was carrying its weight
+        probeDown = false;
+        holdSamples = HOLD_SAMPLES;
+        decide(Action::Hold, limit + 1, goodput, latencyMs, "hold: knee");
+    }
+    else if ((lastAction == Action::ProbeDown || (probeDown && holdSamples <= 0)) && limit > minLimit)
+    {
+        // Same goodput with fewer connections is better: keep going down
+        if (lastAction != Action::ProbeDown)
+        {
+            probeReference = goodput;
+        }
+        decide(Action::ProbeDown, limit - 1, goodput, latencyMs, "decrease: probe");
+    }
+    else if ((lastAction == Action::Increase || holdSamples <= 0) && limit < maxLimit)
+    {
+        size_t step = slowStart ? limit : 1;
+        size_t grown = (limit + step > maxLimit) ? maxLimit : limit + step;
+        probeDown = false;
+        decide(Action::Increase, grown, goodput, latencyMs, lastAction == Action::Increase ? "increase" : "increase: probe");
+    }
+    else
+    {
+        if (lastAction == Action::ProbeDown)
+        {
+            probeDown = false;
+            holdSamples = HOLD_SAMPLES;
+        }
+        --holdSamples;
+        decide(Action::Hold, limit, goodput, latencyMs, limit < maxLimit ? "hold" : "hold: at maximum");
+    }
+    return limit;
+}
+
+size_t ConcurrencyController::getLimit() const
+{
+    lock_guard<mutex> lock(controllerMutex);
+    return limit;
+}
+
+void ConcurrencyController::setBounds(size_t minLimit, size_t maxLimit)
+{
+    lock_guard<mutex> lock(controllerMutex);
+    this->minLimit = (minLimit > 0) ? minLimit : 1;
+    this->maxLimit = (maxLimit < this->minLimit) ? this->minLimit : maxLimit;
+    limit = (limit < this->minLimit) ? this->minLimit : (limit > this->maxLimit ? this->maxLimit : limit);
+}
+
+void ConcurrencyController::setPlan(size_t transfers, size_t segments)
+{
+    lock_guard<mutex> lock(controllerMutex);
+    this->transfers = transfers;
+    this->segments = segments;
+}
+
+ConcurrencyStats ConcurrencyController::getStats() const
+{
+    lock_guard<mutex> lock(controllerMutex);
+    ConcurrencyStats stats;
+    stats.enabled = true;
+    stats.limit = limit;
+    stats.transfers = transfers;
+    stats.segments = segments;
+    stats.minLimit = minLimit;
+    stats.maxLimit = maxLimit;
+    stats.goodput = recent.empty() ? 0 : recent.back().goodput;
+    stats.latencyMs = lastLatencyMs;
+    stats.baseLatencyMs = baseLatencyMs;
+    stats.samples = samples;
+    stats.increases = increases;
+    stats.decreases = decreases;
+    stats.recent.assign(recent.begin(), recent.end());
+    return stats;
+}
@@ -0,0 +1,542 @@
+#define _HAS_STD_BYTE 0  // Fix Windows SDK byte conflict
+
+// ContentCache.cpp
+#include "ContentCache.hpp"
+#include <iostream>
+#include <filesystem>
+#include <cstdlib>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#endif
+#ifdef __linux__
+#include <linux/fs.h> // FICLONE
+#endif
+
+using namespace std;
+
+static const char *CACHE_MAGIC = "dmcache 1";
+static const char *FORGOTTEN = "-"; // sha256 field of a record that removes its URL
+
+// Compaction only pays once the log is mostly dead records
+static const unsigned long long COMPACT_MIN_RECORDS = 1024;
+
+ContentCache::ContentCache()
+    : indexEnd(0), urlCount(0), blobCount(0), records(0), lookups(0), hits(0), revalidated(0), stored(0), deduplicated(0),
+      revalidatedBytes(0), deduplicatedBytes(0)
+{
+}
+
+// FNV-1a with a final mix, so the low bits that pick the slot depend on every byte
+uint64_t ContentCache::urlKey(const string &url)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (unsigned char c : url)
+    {
+        hash = (hash ^ c) * 1099511628211ULL;
+    }
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return hash ? hash : 1;
+}
+
+// The digest is already uniform: its first 16 hex digits are the key
+uint64_t ContentCache::blobKey(const string &sha256)
+{
+    uint64_t key = strtoull(sha256.substr(0, 16).c_str(), NULL, 16);
+    return key ? key : 1;
+}
+
+ContentCache::Slot *ContentCache::findSlot(vector<Slot> &table, uint64_t key)
+{
+    if (table.empty())
+    {
+        return NULL;
+    }
+    size_t mask = table.size() - 1;
+    size_t i = static_cast<size_t>(key) & mask;
+    while (table[i].key != 0 && table[i].key != key)
+    {
+        i = (i + 1) & mask;
+    }
+    return &table[i];
+}
+
+// Linear probing at most half full; the table doubles before it gets fuller
+void ContentCache::put(vector<Slot> &table, size_t &count, uint64_t key, uint64_t value)
+{
+    if ((count + 1) * 2 > table.size())
+    {
+        vector<Slot> old;
+        old.swap(table);
+        table.assign(old.empty() ? 1024 : old.size() * 2, Slot{0, 0});
+        for (const Slot &slot : old)
+        {
+            if (slot.key != 0)
+            {
+                *findSlot(table, slot.key) = slot;
+            }
+        }
+    }
+    Slot *slot = findSlot(table, key);
+    if (slot->key == 0)
+    {
+        ++count;
+    }
+    *slot = Slot{key, value};
+}
+
+// Backward-shift deletion: later slots of the probe run move up, so no tombstones build up
+void ContentCache::erase(vector<Slot> &table, size_t &count, uint64_t key)
+{
+    Slot *slot = findSlot(table, key);
+    if (!slot || slot->key == 0)
+    {
+        return;
+    }
+    size_t mask = table.size() - 1;
+    size_t hole = static_cast<size_t>(slot - table.data());
+    size_t next = hole;
+    while (true)
+    {
+        next = (next + 1) & mask;
+        if (table[next].key == 0)
+        {
+            break;
+        }
+        size_t home = static_cast<size_t>(table[next].key) & mask;
+        bool reachable = (hole <= next) ? (home <= hole || home > next) : (home <= hole && home > next);
+        if (reachable)
+        {
+            table[hole] = table[next];
+            hole = next;
+        }
+    }
+    table[hole] = Slot{0, 0};
+    --count;
+}
+
+bool ContentCache::parse(const string &line, CacheEntry &entry, long long &stamp)
+{
+    string fields[6];
+    size_t start = 0;
+    for (int i = 0; i < 6; ++i)
+    {
+        size_t tab = (i < 5) ? line.find('\t', start) : string::npos;
+        if (i < 5 && tab == string::npos)
+        {
+            return false;
+        }
+        fields[i] = line.substr(start, (tab == string::npos) ? string::npos : tab - start);
+        start = tab + 1;
+    }
+    char *end = NULL;
+    entry.url = fields[0];
+    entry.etag = fields[1];
+    entry.lastModified = fields[2];
+    entry.size = strtoll(fields[3].c_str(), &end, 10);
+    entry.sha256 = fields[4];
+    stamp = strtoll(fields[5].c_str(), NULL, 10);
+    return !entry.url.empty() && *end == '\0' && (entry.sha256.size() == 64 || entry.sha256 == FORGOTTEN);
+}
+
+// Modification time in the clock's own ticks; its epoch is the library's choice, so any value is valid
+bool ContentCache::stampOf(const string &path, long long size, long long &stamp)
+{
+    error_code error;
+    uintmax_t actual = filesystem::file_size(path, error);
+    if (error || static_cast<long long>(actual) != size)
+    {
+        return false;
+    }
+    auto written = filesystem::last_write_time(path, error);
+    stamp = static_cast<long long>(written.time_since_epoch().count());
+    return !error;
+}
+
+string ContentCache::blobPath(const string &sha256) const
+{
+    return (filesystem::path(directory) / "blobs" / sha256.substr(0, 2) / sha256).string();
+}
+
+bool ContentCache::readRecord(uint64_t offset, CacheEntry &entry, long long &stamp)
+{
+    string line;
+    index.clear();
+    index.seekg(static_cast<streamoff>(offset));
+    return getline(index, line) && parse(line, entry, stamp);
+}
+
+bool ContentCache::append(const CacheEntry &entry, long long stamp, uint64_t &offset)
+{
+    string line = entry.url + '\t' + entry.etag + '\t' + entry.lastModified + '\t' + to_string(entry.size) + '\t' +
+                  entry.sha256 + '\t' + to_string(stamp) + '\n';
+    index.clear();
+    index.seekp(0, ios::end);
+    if (!index.write(line.data(), line.size()) || !index.flush())
+    {
+        return false;
+    }
+    offset = indexEnd;
+    indexEnd += line.size();
+    ++records;
+    return true;
+}
+
+// The blob exists, has the size and has not been written since it was stored
+bool ContentCache::blobIntact(const string &sha256, long long size)
+{
+    Slot *slot = findSlot(blobs, blobKey(sha256));
+    long long stamp = 0;
+    return slot && slot->key != 0 && stampOf(blobPath(sha256), size, stamp) && stamp == static_cast<long long>(slot->value);
+}
+
+// Builds both tables in one pass over the log; a torn last record (a crash mid-append) is skipped
+bool ContentCache::scan(const string &path, bool &terminated)
+{
+    vector<Slot>().swap(urls);
+    vector<Slot>().swap(blobs);
+    urlCount = 0;
+    blobCount = 0;
+    records = 0;
+    ifstream in(path, ios::binary);
+    string line;
+    if (!getline(in, line) || line != CACHE_MAGIC)
+    {
+        return false;
+    }
+
+    uint64_t offset = line.size() + 1;
+    CacheEntry entry;
+    long long stamp = 0;
+    terminated = true;
+    while (getline(in, line))
+    {
+        terminated = !in.eof();
+        if (parse(line, entry, stamp) && terminated)
+        {
+            if (entry.sha256 == FORGOTTEN)
+            {
+                erase(urls, urlCount, urlKey(entry.url));
+            }
+            else
+            {
+                put(urls, urlCount, urlKey(entry.url), offset);
+                put(blobs, blobCount, blobKey(entry.sha256), static_cast<uint64_t>(stamp));
+            }
+        }
+        offset += line.size() + (terminated ? 1 : 0);
+        ++records;
+    }
+    indexEnd = offset;
+    return true;
+}
+
+bool ContentCache::load()
+{
+    string path = (filesystem::path(directory) / "index").string();
+    {
+        ifstream existing(path, ios::binary);
+        if (!existing.is_open())
+        {
+            ofstream created(path, ios::binary);
+            created << CACHE_MAGIC << '\n';
+            if (!created.flush())
+            {
+                return false;
+            }
+        }
+    }
+    bool terminated = true;
+    if (!scan(path, terminated))
+    {
+        cerr << "Not a content cache index: " << path << endl;
+        return false;
+    }
+    if (records > COMPACT_MIN_RECORDS && records > 2 * urlCount && compact(path) && !scan(path, terminated))
+    {
+        return false;
+    }
+
+    index.rdbuf()->pubsetbuf(recordBuffer, sizeof(recordBuffer)); // A lookup reads one short record at a random offset
+    index.open(path, ios::in | ios::out | ios::binary);
+    if (!index.is_open())
+    {
+        return false;
+    }
+    if (!terminated)
+    {
+        index.seekp(0, ios::end);
+        index.put('\n');
+        index.flush();
+        ++indexEnd;
+    }
+    return true;
+}
+
+// Writes the live record of every URL to a new log, in log order, and swaps it in
+bool ContentCache::compact(const string &path)
+{
+    string temporary = path + ".tmp";
+    error_code error;
+    {
+        ifstream in(path, ios::binary);
+        ofstream out(temporary, ios::binary | ios::trunc);
+        string line;
+        getline(in, line);
+        out << CACHE_MAGIC << '\n';
+        uint64_t offset = line.size() + 1;
+        CacheEntry entry;
+        long long stamp = 0;
+        while (getline(in, line))
+        {
+            Slot *slot = parse(line, entry, stamp) ? findSlot(urls, urlKey(entry.url)) : NULL;
+            if (slot && slot->key != 0 && slot->value == offset)
+            {
+                out << line << '\n';
+            }
+            offset += line.size() + 1;
+        }
+        if (!out.flush())
+        {
+            out.close();
+            filesystem::remove(temporary, error);
+            return false; // The old log stays in use
+        }
+    }
+    filesystem::rename(temporary, path, error);
+    return !error;
+}
+
+bool ContentCache::open(const string &directory)
+{
+    lock_guard<mutex> lock(cacheMutex);
+    if (index.is_open())
+    {
+        index.close();
+    }
+    this->directory.clear();
+    vector<Slot>().swap(urls);
+    vector<Slot>().swap(blobs);
+    urlCount = 0;
+    blobCount = 0;
+    records = 0;
+    indexEnd = 0;
+    if (directory.empty())
+    {
+        return true;
+    }
+
+    error_code error;
+    filesystem::create_directories(filesystem::path(directory) / "blobs", error);
+    this->directory = directory;
+    if (error || !load())
+    {
+        cerr << "Failed to open content cache: " << directory << endl;
+        index.close();
+        this->directory.clear();
+        return false;
+    }
+    return true;
+}
+
+bool ContentCache::enabled() const
+{
+    lock_guard<mutex> lock(cacheMutex);
+    return !directory.empty();
+}
+
+bool ContentCache::find(const string &url, CacheEntry &entry)
+{
+    lock_guard<mutex> lock(cacheMutex);
+    Slot *slot = findSlot(urls, urlKey(url));
+    long long stamp = 0;
+    return slot && slot->key != 0 && readRecord(slot->value, entry, stamp) && entry.url == url;
+}
+
+bool ContentCache::lookup(const string &url, CacheEntry &entry)
+{
+    ++lookups;
+    if (!find(url, entry))
+    {
+        return false;
+    }
+    lock_guard<mutex> lock(cacheMutex);
+    if (!blobIntact(entry.sha256, entry.size))
+    {
+        return false;
+    }
+    ++hits;
+    return true;
+}
+
+bool ContentCache::materialize(const CacheEntry &entry, const string &destination)
+{
+    string blob;
+    {
+        lock_guard<mutex> lock(cacheMutex);
+        blob = blobPath(entry.sha256);
+    }
+    string temporary = destination + ".cache";
+    error_code error;
+    if (!linkFile(blob, temporary))
+    {
+        filesystem::remove(temporary, error);
+        return false;
+    }
+    filesystem::rename(temporary, destination, error);
+    if (error)
+    {
+        filesystem::remove(temporary, error);
+        return false;
+    }
+    ++revalidated;
+    revalidatedBytes += static_cast<unsigned long long>(entry.size);
+    return true;
+}
+
+// Fields are tab separated and records end at a newline
+static bool storable(const string &field)
+{
+    return field.find_first_of("\t\r\n") == string::npos;
+}
+
+bool ContentCache::store(const CacheEntry &entry, const string &path)
+{
+    if ((entry.etag.empty() && entry.lastModified.empty()) || entry.sha256.size() != 64 || entry.size < 0 ||
+        entry.url.empty() || !storable(entry.url) || !storable(entry.etag) || !storable(entry.lastModified))
+    {
+        return false; // Nothing to revalidate with, or not representable in the log
+    }
+    lock_guard<mutex> lock(cacheMutex);
+    if (directory.empty())
+    {
+        return false;
+    }
+
+    string blob = blobPath(entry.sha256);
+    error_code error;
+    if (blobIntact(entry.sha256, entry.size))
+    {
+        // Known content: the destination becomes another copy of the blob instead of a second set of blocks
+        if (!filesystem::equivalent(blob, path, error))
+        {
+            string temporary = path + ".cache";
+            bool linked = linkFile(blob, temporary);
+            if (linked)
+            {
+                filesystem::rename(temporary, path, error);
+            }
+            if (!linked || error)
+            {
+                filesystem::remove(temporary, error);
+            }
+            else
+            {
+                ++deduplicated;
+                deduplicatedBytes += static_cast<unsigned long long>(entry.size);
+            }
+        }
+    }
+    else
+    {
+        string temporary = blob + ".tmp";
+        filesystem::create_directories(filesystem::path(blob).parent_path(), error);
+        bool linked = !error && linkFile(path, temporary);
+        if (linked)
+        {
+            filesystem::rename(temporary, blob, error);
+        }
+        if (!linked || error)
+        {
+            filesystem::remove(temporary, error);
+            return false;
+        }
+        long long stamp = 0;
+        if (!stampOf(blob, entry.size, stamp))
+        {
+            return false;
+        }
+        put(blobs, blobCount, blobKey(entry.sha256), static_cast<uint64_t>(stamp));
+    }
+
+    uint64_t offset = 0;
+    if (!append(entry, static_cast<long long>(findSlot(blobs, blobKey(entry.sha256))->value), offset))
+    {
+        return false;
+    }
+    put(urls, urlCount, urlKey(entry.url), offset);
+    ++stored;
+    return true;
+}
+
+void ContentCache::forget(const string &url)
+{
+    lock_guard<mutex> lock(cacheMutex);
+    Slot *slot = findSlot(urls, urlKey(url));
+    if (directory.empty() || !slot || slot->key == 0 || !storable(url))
+    {
+        return;
+    }
+    CacheEntry removal = {url, "", "", -1, FORGOTTEN};
+    uint64_t offset = 0;
+    if (append(removal, 0, offset))
+    {
+        erase(urls, urlCount, urlKey(url));
+    }
+}
+
+CacheStats ContentCache::getStats() const
+{
+    CacheStats stats;
+    {
+        lock_guard<mutex> lock(cacheMutex);
+        stats.entries = urlCount;
+        stats.blobs = blobCount;
+    }
+    stats.lookups = lookups;
+    stats.hits = hits;
+    stats.revalidated = revalidated;
+    stats.stored = stored;
+    stats.deduplicated = deduplicated;
+    stats.revalidatedBytes = revalidatedBytes;
+    stats.deduplicatedBytes = deduplicatedBytes;
+    return stats;
+}
+
+bool ContentCache::linkFile(const string &from, const string &to)
+{
+    error_code error;
+    filesystem::remove(to, error);
+#ifndef _WIN32
+#ifdef FICLONE
+    // Shares the blocks copy-on-write (btrfs, XFS): writing either file later leaves the other alone
+    int source = ::open(from.c_str(), O_RDONLY);
+    if (source >= 0)
+    {
+        int target = ::open(to.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+        bool cloned = target >= 0 && ioctl(target, FICLONE, source) == 0;
+        if (target >= 0)
+        {
+            ::close(target);
+        }
+        ::close(source);
+        if (cloned)
+        {
+            return true;
+        }
+        ::unlink(to.c_str());
+    }
+#endif
+    if (::link(from.c_str(), to.c_str()) == 0)
+    {
+        return true;
+    }
+#endif
+    // Other filesystems, and Windows, where a writer would truncate a hard-linked file in place
+    filesystem::copy_file(from, to, filesystem::copy_options::overwrite_existing, error);
+    return !error;
+}
@@ -2,131 +2,1008 @@
 
 // DownloadManager.cpp
 #include "DownloadManager.hpp"
+#include <algorithm>
+#include <fstream>
+#include <filesystem>
 
 using namespace std;
 
-DownloadManager::DownloadManager(size_t threadCount) : threadPool(threadCount) {}
+static string fileNameOf(const string &url)
+{
+    return url.substr(url.find_last_of('/') + 1);
+}
+
+DownloadManager::DownloadManager(size_t threadCount, EngineMode mode)
+    : mode(mode),
+      concurrency(threadCount * 4, 1, 64),
+      threadPool(mode == EngineMode::ThreadPerTransfer ? threadCount : 0, &trace),
+      engine(mode != EngineMode::ThreadPerTransfer ? threadCount : 0, mode == EngineMode::Multiplexed, &trace),
+      controlRunning(false), adaptiveLimit(0), controlInterval(1000)
+{
+    options.segmentCount = 4;
+    options.multiplex = mode == EngineMode::Multiplexed;
+    tasks.setListener([this](const shared_ptr<DownloadTask> &task, DownloadStatus status)
+                      { statusChanged(task, status); });
+    if (mode != EngineMode::ThreadPerTransfer)
+    {
+        handles.setReleaseListener([this] { engine.slotsReleased(); }); // Pool workers wait in the pool instead
+    }
+}
 
-void DownloadManager::addDownload(const string &url, const string &destinationPath)
+DownloadManager::~DownloadManager()
+{
+    timers.stop(); // No retry may dispatch into engines that are shutting down
+    setProgressReporting(false);
+    stopControl();
+}
+
+void DownloadManager::setSegmentsPerDownload(size_t segments)
 {
     lock_guard<mutex> lock(taskMutex);
-    auto task = make_shared<DownloadTask>(url, destinationPath);
-    tasks[url] = task;
-    threadPool.enqueueTask(task);
+    options.segmentCount = (segments > 0) ? segments : 1;
 }
 
-void DownloadManager::startDownloads()
+void DownloadManager::setWriteBufferSize(size_t bytes)
 {
     lock_guard<mutex> lock(taskMutex);
-    for (const auto &task : tasks)
+    options.writeBufferSize = bytes;
+    buffers.configure(bytes, buffers.getLimit());
+}
+
+void DownloadManager::setBufferPoolLimit(long long bytes)
+{
+    lock_guard<mutex> lock(taskMutex);
+    if (!buffers.configure(options.writeBufferSize, bytes))
     {
-        task.second->setStartCommand();
+        cerr << "Buffer pool already allocated, keeping its limit" << endl;
     }
 }
 
-void DownloadManager::startDownload(const string &url)
+BufferPoolStats DownloadManager::getBufferPoolStats()
+{
+    return buffers.getStats();
+}
+
+bool DownloadManager::setCacheDirectory(const string &directory)
+{
+    return cache.open(directory);
+}
+
+CacheStats DownloadManager::getCacheStats()
+{
+    return cache.getStats();
+}
+
+void DownloadManager::setDirectIoThreshold(long long bytes)
+{
+    lock_guard<mutex> lock(taskMutex);
+    options.directIoThreshold = bytes;
+}
+
+void DownloadManager::setMappedWriteThreshold(long long bytes)
+{
+    lock_guard<mutex> lock(taskMutex);
+    options.mappedThreshold = bytes;
+}
+
+void DownloadManager::setDispatchPolicy(DispatchPolicy policy)
+{
+    threadPool.setDispatchPolicy(policy);
+}
+
+void DownloadManager::setHandleLimits(size_t curlHandles, size_t openFiles)
+{
+    handles.setLimits(curlHandles, openFiles);
+    engine.slotsReleased();
+}
+
+void DownloadManager::setMaxConnectionsPerHost(size_t connections)
+{
+    threadPool.setConnectionsPerHost(connections);
+}
+
+void DownloadManager::setHostConnectionLimit(const string &origin, size_t connections)
+{
+    threadPool.setHostConnectionLimit(origin, connections);
+}
+
+void DownloadManager::setStreamsPerOrigin(size_t streams)
+{
+    engine.setStreamsPerOrigin(streams);
+}
+
+void DownloadManager::setOriginStreamLimit(const string &origin, size_t streams)
+{
+    engine.setOriginStreamLimit(origin, streams);
+}
+
+void DownloadManager::setHttp2PriorKnowledge(bool enabled)
+{
+    lock_guard<mutex> lock(taskMutex);
+    options.http2PriorKnowledge = enabled;
+}
+
+void DownloadManager::setSidecarChecksums(bool enabled)
 {
     lock_guard<mutex> lock(taskMutex);
-    if (tasks.find(url) != tasks.end())
+    options.fetchSidecar = enabled;
+}
+
+void DownloadManager::setRetrySettings(const RetrySettings &settings)
+{
+    retryPolicy.setSettings(settings);
+}
+
+RetrySettings DownloadManager::getRetrySettings()
+{
+    return retryPolicy.getSettings();
+}
+
+BreakerState DownloadManager::getHostState(const string &origin)
+{
+    return retryPolicy.getState(origin);
+}
+
+void DownloadManager::setGlobalRateLimit(long long bytesPerSecond)
+{
+    bandwidth.setGlobalRate(bytesPerSecond);
+}
+
+void DownloadManager::setPriorityWeight(TransferPriority priority, unsigned weight)
+{
+    bandwidth.setClassWeight(priority, weight);
+}
+
+void DownloadManager::setDownloadRateLimit(const string &url, long long bytesPerSecond)
+{
+    for (const auto &task : tasksFor(url))
     {
-        tasks[url]->setStartCommand();
+        task->setRateLimit(bytesPerSecond);
     }
-    else
+}
+
+void DownloadManager::setDownloadPriority(const string &url, TransferPriority priority)
+{
+    for (const auto &task : tasksFor(url))
     {
-        cout << "Url not in download queue" << endl;
+        task->setPriority(priority);
     }
 }
 
-void DownloadManager::pauseDownload(const string &url)
+void DownloadManager::setDownloadChecksum(const string &url, const string &digest)
 {
-    lock_guard<mutex> lock(taskMutex);
-    if (tasks.find(url) != tasks.end())
+    for (const auto &task : tasksFor(url))
+    {
+        if (!task->setChecksum(digest))
+        {
+            cout << "Invalid checksum: " << digest << endl;
+            return;
+        }
+    }
+}
+
+void DownloadManager::setAdaptiveConcurrency(bool enabled, size_t maxConnections, int sampleMs)
+{
+    stopControl();
+    if (!enabled)
     {
-        tasks[url]->pause();
+        lock_guard<mutex> lock(taskMutex);
+        adaptiveLimit = 0;
+        threadPool.setActiveLimit(0);
+        engine.setActiveLimit(0);
+        return;
     }
-    else
+
+    concurrency.setBounds(1, maxConnections);
     {
-        cout << "Url not in download queue" << endl;
+        lock_guard<mutex> lock(controlMutex);
+        controlInterval = chrono::milliseconds(sampleMs > 0 ? sampleMs : 1000);
+        controlRunning = true;
     }
+    controlThread = thread(&DownloadManager::controlLoop, this);
 }
 
-void DownloadManager::resumeDownload(const string &url)
+void DownloadManager::stopControl()
 {
-    lock_guard<mutex> lock(taskMutex);
-    if (tasks.find(url) != tasks.end())
     {
-        tasks[url]->resume();
+        lock_guard<mutex> lock(controlMutex);
+        controlRunning = false;
     }
-    else
+    controlWake.notify_all();
+    if (controlThread.joinable())
     {
-        cout << "Url not in download queue" << endl;
+        controlThread.join();
     }
 }
 
-void DownloadManager::cancelDownload(const string &url)
+// Feed the controller one sample per interval and split its limit into files and ranges
+void DownloadManager::controlLoop()
+{
+    auto last = chrono::steady_clock::now();
+    TransferMetrics::Totals previous = metrics.totals();
+    size_t transfers = applyLimit(concurrency.getLimit(), startedFiles());
+    unique_lock<mutex> lock(controlMutex);
+    while (controlRunning)
+    {
+        controlWake.wait_for(lock, controlInterval);
+        if (!controlRunning)
+        {
+            break;
+        }
+        auto now = chrono::steady_clock::now();
+        double seconds = chrono::duration<double>(now - last).count();
+        last = now;
+
+        // The limit only matters while it is what holds files back (and not e.g. the per-host caps)
+        bool saturated;
+        if (mode == EngineMode::ThreadPerTransfer)
+        {
+            saturated = threadPool.runningTasks() >= transfers && threadPool.queuedTasks() > 0;
+        }
+        else
+        {
+            saturated = startedFiles() * segmentCeiling() >= concurrency.getLimit();
+        }
+        TransferMetrics::Totals current = metrics.totals();
+        unsigned long long bytes = current.counters[TransferMetrics::Bytes] - previous.counters[TransferMetrics::Bytes];
+        unsigned long long requests = current.counts[TransferMetrics::FirstByte] - previous.counts[TransferMetrics::FirstByte];
+        unsigned long long micros = current.sums[TransferMetrics::FirstByte] - previous.sums[TransferMetrics::FirstByte];
+        previous = current;
+
+        size_t limit = concurrency.sample(seconds, bytes, requests ? micros / 1000.0 / requests : 0, saturated);
+        transfers = applyLimit(limit, startedFiles());
+    }
+}
+
+size_t DownloadManager::startedFiles()
+{
+    return (mode == EngineMode::ThreadPerTransfer) ? threadPool.queuedTasks() + threadPool.runningTasks()
+                                                   : engine.activeTransfers();
+}
+
+size_t DownloadManager::segmentCeiling()
 {
     lock_guard<mutex> lock(taskMutex);
-    if (tasks.find(url) != tasks.end())
+    return options.multiplex ? 1 : options.segmentCount;
+}
+
+// Few files get more ranges each; many files get one range each
+static size_t segmentsFor(size_t limit, size_t files, size_t ceiling)
+{
+    size_t segments = limit / (files > 0 ? files : 1);
+    return (segments < 1) ? 1 : (segments > ceiling ? ceiling : segments);
+}
+
+size_t DownloadManager::applyLimit(size_t limit, size_t files)
+{
+    size_t segments = segmentsFor(limit, files, segmentCeiling());
+    size_t transfers = (limit / segments > 0) ? limit / segments : 1;
+    if (mode == EngineMode::ThreadPerTransfer)
     {
-        tasks[url]->cancel();
+        threadPool.setActiveLimit(transfers);
     }
     else
     {
-        cout << "Url not in download queue" << endl;
+        engine.setActiveLimit(transfers);
     }
+    {
+        lock_guard<mutex> lock(taskMutex);
+        adaptiveLimit = limit;
+    }
+    concurrency.setPlan(transfers, segments);
+    return transfers;
 }
 
-DownloadStatus DownloadManager::getDownloadStatus(const string &url)
+ConcurrencyStats DownloadManager::getConcurrencyStats()
 {
-    lock_guard<mutex> lock(taskMutex);
-    if (tasks.find(url) != tasks.end())
+    ConcurrencyStats stats = concurrency.getStats();
+    lock_guard<mutex> lock(controlMutex);
+    stats.enabled = controlRunning;
+    return stats;
+}
+
+MetricsSnapshot DownloadManager::getMetrics()
+{
+    MetricsSnapshot snapshot = metrics.snapshot();
+    if (mode == EngineMode::ThreadPerTransfer)
     {
-        return tasks.at(url)->getStatus();
+        snapshot.queued = threadPool.queuedTasks();
+        snapshot.running = threadPool.runningTasks();
     }
     else
     {
-        return DownloadStatus::Completed;
+        snapshot.running = engine.activeTransfers();
     }
+    {
+        lock_guard<mutex> lock(controlMutex);
+        snapshot.concurrency = controlRunning ? concurrency.getLimit() : 0;
+    }
+    BufferPoolStats pool = buffers.getStats();
+    snapshot.bufferPoolBytes = pool.buffers * pool.bufferSize;
+    snapshot.bufferPoolUsedBytes = pool.inUse * pool.bufferSize;
+    snapshot.bufferPoolStallSeconds = pool.stallSeconds;
+    CacheStats cached = cache.getStats();
+    snapshot.cacheRevalidated = cached.revalidated;
+    snapshot.cacheBytesSaved = cached.revalidatedBytes + cached.deduplicatedBytes;
+
+    snapshot.tasks.reserve(tasks.size());
+    tasks.forEach([&snapshot](TaskId, const shared_ptr<DownloadTask> &task)
+                  {
+        snapshot.tasks.push_back(task->getStats());
+        snapshot.throughput += snapshot.tasks.back().throughput; });
+    return snapshot;
 }
 
-void DownloadManager::waitForCompletion()
+string DownloadManager::getMetricsJson()
 {
-    lock_guard<mutex> lock(taskMutex);
-    for (const auto &task : tasks)
+    return TransferMetrics::toJson(getMetrics());
+}
+
+string DownloadManager::getMetricsPrometheus()
+{
+    return TransferMetrics::toPrometheus(getMetrics());
+}
+
+bool DownloadManager::writeMetricsFile(const string &path)
+{
+    // Scrapers must never see a half-written file
+    string temporary = path + ".tmp";
     {
-        while (task.second->getStatus() == DownloadStatus::Downloading)
+        ofstream file(temporary, ios::trunc);
+        if (!file)
+        {
+            return false;
+        }
+        file << getMetricsPrometheus();
+        if (!file.flush())
         {
-            // Wait for completion
-            this_thread::sleep_for(chrono::milliseconds(100));
+            return false;
         }
     }
+    error_code error;
+    filesystem::rename(temporary, path, error); // Replaces the old file, also on Windows
+    return !error;
 }
 
-void DownloadManager::clearTasks()
+void DownloadManager::startTrace(size_t eventsPerThread)
 {
-    lock_guard<mutex> lock(taskMutex);
-    if (!(tasks.empty()))
+    trace.start(eventsPerThread);
+}
+
+void DownloadManager::stopTrace()
+{
+    trace.stop();
+}
+
+bool DownloadManager::writeTrace(const string &path)
+{
+    string json = trace.toJson([this](unsigned long long id)
+                               {
+        shared_ptr<DownloadTask> task = tasks.find(id);
+        return task ? fileNameOf(task->getUrl()) : string(); });
+    ofstream file(path, ios::trunc);
+    return file && (file << json).flush();
+}
+
+vector<ProgressSample> DownloadManager::getProgress()
+{
+    vector<ProgressSample> samples;
+    for (DownloadStatus status : {DownloadStatus::Downloading, DownloadStatus::Paused})
     {
-        auto it = tasks.begin();
-        while (it != tasks.end())
+        for (const auto &task : tasks.tasksWithStatus(status))
         {
-            if (it->second->getStatus() == DownloadStatus::Completed)
+            samples.push_back({task->getId(), task->getUrl(), task->getStatus(), task->getReceivedBytes(), task->getTotalSize()});
+        }
+    }
+    return samples;
+}
+
+void DownloadManager::setProgressReporting(bool enabled, int intervalMs)
+{
+    if (!enabled)
+    {
+        reporter.reset();
+        return;
+    }
+    if (!reporter)
+    {
+        reporter.reset(new ProgressReporter([this]()
+                                            { return getProgress(); }));
+    }
+    reporter->start(chrono::milliseconds(intervalMs > 0 ? intervalMs : 1000));
+}
+
+DownloadHandle DownloadManager::addDownload(const string &url, const string &destinationPath,
+                                            const CompletionCallback &onComplete)
+{
+    shared_ptr<DownloadTask> task;
+    {
+        lock_guard<mutex> lock(taskMutex);
+        task = make_shared<DownloadTask>(url, destinationPath, options, &handles, &bandwidth, &metrics, &trace, &buffers, &cache, &syncer);
+    }
+    task->setCompletionCallback(onComplete);
+    TaskId id = tasks.add(task); // Workers only see it once it is started
+    return {id, task->getFuture()};
+}
+
+ManifestStats DownloadManager::addManifest(const string &path, const string &directory, bool start, size_t batchSize)
+{
+    ManifestReader reader(path);
+    if (!reader.isOpen())
+    {
+        cout << "Cannot open manifest " << path << endl;
+        return reader.getStats();
+    }
+
+    vector<ManifestEntry> entries;
+    vector<shared_ptr<DownloadTask>> batch;
+    while (reader.next(entries, batchSize > 0 ? batchSize : 1) > 0)
+    {
+        TransferOptions batchOptions;
+        {
+            lock_guard<mutex> lock(taskMutex);
+            batchOptions = options;
+        }
+        batch.clear();
+        for (const auto &entry : entries)
+        {
+            filesystem::path destination(entry.destination);
+            if (entry.destination.empty())
             {
-                string filename = it->first.substr(it->first.find_last_of('/') + 1);
-                cout << "\n[CLEANUP] Removing completed task: " << filename << "\n";
-                it = tasks.erase(it);
+                string name = entry.url.substr(0, entry.url.find_first_of("?#"));
+                destination = name.substr(name.find_last_of('/') + 1);
             }
-            else if (it->second->getStatus() == DownloadStatus::Failed)
+            if (destination.is_relative())
             {
-                string filename = it->first.substr(it->first.find_last_of('/') + 1);
-                cout << "\n[RETRY] Re-queuing failed task: " << filename << "\n";
-                threadPool.enqueueTask(it->second);
-                ++it;
+                destination = filesystem::path(directory) / destination;
+            }
+            auto task = make_shared<DownloadTask>(entry.url, destination.string(), batchOptions, &handles, &bandwidth, &metrics, &trace, &buffers, &cache, &syncer);
+            if (entry.priority != TransferPriority::Normal)
+            {
+                task->setPriority(entry.priority);
+            }
+            task->setChecksum(entry.hash); // Checked by the reader
+            task->setExpectedSize(entry.size);
+
+            batch.push_back(task);
+        }
+        tasks.addBatch(batch);
+        if (start)
+        {
+            dispatchAll(batch);
+        }
+    }
+
+    const ManifestStats &stats = reader.getStats();
+    cout << "[MANIFEST] " << path << ": " << stats.entries << " downloads added";
+    if (stats.malformed > 0)
+    {
+        cout << ", " << stats.malformed << " malformed lines skipped";
+    }
+    cout << endl;
+    return stats;
+}
+
+void DownloadManager::setCompletionCallback(const CompletionCallback &callback)
+{
+    lock_guard<mutex> lock(completionMutex);
+    completionCallback = callback;
+}
+
+void DownloadManager::whenAllComplete(const vector<TaskId> &ids,
+                                      const function<void(const vector<DownloadResult> &)> &callback)
+{
+    CompletionBatch batch;
+    batch.callback = callback;
+    {
+        // A task finishing from here on reports under this lock, so each one lands on exactly one side
+        lock_guard<mutex> lock(completionMutex);
+        for (TaskId id : ids)
+        {
+            shared_ptr<DownloadTask> task = tasks.find(id);
+            if (!task)
+            {
+                // Removed by the cleanup, so completed, or never issued
+                batch.results.push_back(tasks.issued(id) ? DownloadResult{id, "", "", DownloadStatus::Completed, 0, -1, 0, 0}
+                                                         : DownloadResult{id, "", "", DownloadStatus::Failed, DownloadTask::UNKNOWN_TASK, -1, 0, 0});
+            }
+            else if (isFinished(task))
+            {
+                batch.results.push_back(task->getResult());
             }
             else
             {
-                ++it;
+                batch.remaining.push_back(id);
+            }
+        }
+        if (!batch.remaining.empty())
+        {
+            batches.push_back(move(batch));
+            return;
+        }
+    }
+    callback(batch.results);
+}
+
+// Registry listener, on the thread that changed the status
+void DownloadManager::statusChanged(const shared_ptr<DownloadTask> &task, DownloadStatus status)
+{
+    bool finished = status == DownloadStatus::Completed || status == DownloadStatus::Failed ||
+                    status == DownloadStatus::Cancelled;
+    DownloadResult result;
+    if (finished)
+    {
+        result = task->getResult();
+        result.status = status;
+        finished = settle(task, result);
+    }
+
+    CompletionCallback callback;
+    vector<CompletionBatch> ready;
+    {
+        lock_guard<mutex> lock(completionMutex);
+        if (finished)
+        {
+            callback = completionCallback;
+            for (auto batch = batches.begin(); batch != batches.end();)
+            {
+                auto waiting = find(batch->remaining.begin(), batch->remaining.end(), result.id);
+                if (waiting != batch->remaining.end())
+                {
+                    batch->remaining.erase(waiting);
+                    batch->results.push_back(result);
+                }
+                if (batch->remaining.empty())
+                {
+                    ready.push_back(move(*batch));
+                    batch = batches.erase(batch);
+                }
+                else
+                {
+                    ++batch;
+                }
             }
         }
     }
-}
\ No newline at end of file
+    completionWake.notify_all();
+
+    if (callback)
+    {
+        callback(result);
+    }
+    for (const auto &batch : ready)
+    {
+        batch.callback(batch.results);
+    }
+}
+
+// Feed an outcome to the retry policy; false when the failure is retried, so it is not an outcome yet
+bool DownloadManager::settle(const shared_ptr<DownloadTask> &task, const DownloadResult &result)
+{
+    const string &origin = task->getOrigin();
+    if (result.status == DownloadStatus::Completed)
+    {
+        release(retryPolicy.onSuccess(result.id, origin));
+        return true;
+    }
+    if (result.status == DownloadStatus::Cancelled)
+    {
+        release(retryPolicy.forget(result.id, origin));
+        return true;
+    }
+
+    RetryDecision decision = retryPolicy.onFailure(origin, result);
+    if (decision.breakerOpened)
+    {
+        cout << "\n[CIRCUIT OPEN] " << origin << " - host keeps failing, pausing its downloads for "
+             << decision.breakerOpenFor.count() / 1000.0 << " s\n";
+        timers.schedule(decision.breakerOpenFor, [this, origin]()
+                        { cooldownEnded(origin); });
+    }
+    release(decision.released);
+    if (!decision.retry)
+    {
+        string reason;
+        if (decision.failure == FailureClass::Permanent)
+        {
+            reason = "permanent error";
+            if (result.httpStatus > 0)
+            {
+                reason += " (HTTP " + to_string(result.httpStatus) + ")";
+            }
+        }
+        else
+        {
+            reason = "no retries left";
+        }
+        cout << "\n[GAVE UP] " << fileNameOf(result.url) << " - " << reason << "\n";
+
+        // An HTTP answer means the host itself is up
+        release(result.httpStatus > 0 ? retryPolicy.onSuccess(result.id, origin) : retryPolicy.forget(result.id, origin));
+        return true;
+    }
+
+    task->setAwaitingRetry(true);
+    cout << "\n[RETRY] " << fileNameOf(result.url) << " - attempt " << decision.attempt << " of "
+         << retryPolicy.getSettings().maxAttempts << " in " << decision.delay.count() / 1000.0 << " s\n";
+    TaskId id = result.id;
+    if (trace.enabled())
+    {
+        trace.instant("retry scheduled", "retry", id, TraceRecorder::LIFECYCLE, decision.delay.count());
+    }
+    lock_guard<mutex> lock(completionMutex);
+    retryTimers[id] = timers.schedule(decision.delay, [this, id]()
+                                      { retryDue(id); });
+    return false;
+}
+
+void DownloadManager::retryDue(TaskId id)
+{
+    shared_ptr<DownloadTask> task = tasks.find(id);
+    // Cancelled, restarted by hand or removed while it waited
+    bool started = task && task->getStatus() == DownloadStatus::Failed && task->setStartCommand();
+    {
+        lock_guard<mutex> lock(completionMutex);
+        retryTimers.erase(id);
+    }
+    completionWake.notify_all();
+    if (started)
+    {
+        dispatch(task);
+    }
+}
+
+void DownloadManager::cancelRetry(TaskId id)
+{
+    {
+        lock_guard<mutex> lock(completionMutex);
+        auto found = retryTimers.find(id);
+        if (found == retryTimers.end())
+        {
+            return;
+        }
+        timers.cancel(found->second);
+        retryTimers.erase(found);
+    }
+    completionWake.notify_all();
+}
+
+void DownloadManager::cooldownEnded(const string &origin)
+{
+    retryPolicy.endCooldown(origin);
+    cout << "\n[CIRCUIT HALF-OPEN] " << origin << " - letting one download test the host\n";
+}
+
+void DownloadManager::release(const vector<TaskId> &ids)
+{
+    for (TaskId id : ids)
+    {
+        shared_ptr<DownloadTask> task = tasks.find(id);
+        if (task && task->getStatus() == DownloadStatus::Starting)
+        {
+            dispatch(task); // Rejected again if the host's breaker reopened
+        }
+    }
+}
+
+// False when the host's breaker keeps the task from a worker: rejected while open, held behind the test download
+bool DownloadManager::admit(const shared_ptr<DownloadTask> &task)
+{
+    Admission admission = retryPolicy.admit(task->getId(), task->getOrigin());
+    if (admission == Admission::Reject)
+    {
+        task->reject(DownloadTask::HOST_UNAVAILABLE); // Its retry is planned for the end of the cool-down
+    }
+    return admission == Admission::Run;
+}
+
+vector<shared_ptr<DownloadTask>> DownloadManager::tasksFor(const string &url)
+{
+    vector<shared_ptr<DownloadTask>> found;
+    for (TaskId id : tasks.findByUrl(url))
+    {
+        shared_ptr<DownloadTask> task = tasks.find(id);
+        if (task)
+        {
+            found.push_back(task);
+        }
+    }
+    if (found.empty())
+    {
+        cout << "Url not in download queue" << endl;
+    }
+    return found;
+}
+
+shared_ptr<DownloadTask> DownloadManager::taskFor(TaskId id)
+{
+    shared_ptr<DownloadTask> task = tasks.find(id);
+    if (!task)
+    {
+        cout << "Task " << id << " not in download queue" << endl;
+    }
+    return task;
+}
+
+// Hand a task that just moved to Starting over to the active engine
+void DownloadManager::dispatch(const shared_ptr<DownloadTask> &task)
+{
+    if (!admit(task))
+    {
+        return;
+    }
+
+    size_t limit;
+    size_t ceiling;
+    {
+        lock_guard<mutex> lock(taskMutex);
+        limit = adaptiveLimit;
+        ceiling = options.segmentCount;
+    }
+    if (limit > 0)
+    {
+        task->setSegmentCount(segmentsFor(limit, startedFiles() + 1, ceiling));
+    }
+    if (trace.enabled())
+    {
+        trace.instant("enqueue", "dispatch", task->getId(), TraceRecorder::LIFECYCLE);
+    }
+    if (mode != EngineMode::ThreadPerTransfer)
+    {
+        engine.submit(task);
+    }
+    else
+    {
+        threadPool.enqueueTask(task);
+    }
+}
+
+void DownloadManager::dispatchAll(const vector<shared_ptr<DownloadTask>> &batch)
+{
+    vector<shared_ptr<DownloadTask>> started;
+    started.reserve(batch.size());
+    for (const auto &task : batch)
+    {
+        if (task->setStartCommand() && admit(task))
+        {
+            started.push_back(task);
+        }
+    }
+    if (started.empty())
+    {
+        return;
+    }
+
+    size_t limit;
+    size_t ceiling;
+    {
+        lock_guard<mutex> lock(taskMutex);
+        limit = adaptiveLimit;
+        ceiling = options.segmentCount;
+    }
+    if (limit > 0)
+    {
+        size_t segments = segmentsFor(limit, startedFiles() + started.size(), ceiling);
+        for (const auto &task : started)
+        {
+            task->setSegmentCount(segments);
+        }
+    }
+    if (trace.enabled())
+    {
+        for (const auto &task : started)
+        {
+            trace.instant("enqueue", "dispatch", task->getId(), TraceRecorder::LIFECYCLE);
+        }
+    }
+    if (mode != EngineMode::ThreadPerTransfer)
+    {
+        engine.submitAll(started);
+    }
+    else
+    {
+        threadPool.enqueueTasks(started);
+    }
+}
+
+void DownloadManager::startDownloads()
+{
+    // Only tasks that can start, found through the status index; failures with a retry coming keep their timer
+    dispatchAll(tasks.tasksWithStatus(DownloadStatus::Pending));
+    vector<shared_ptr<DownloadTask>> failed = tasks.tasksWithStatus(DownloadStatus::Failed);
+    failed.erase(remove_if(failed.begin(), failed.end(), [](const shared_ptr<DownloadTask> &task)
+                           { return task->isAwaitingRetry(); }),
+                 failed.end());
+    dispatchAll(failed);
+}
+
+void DownloadManager::startDownload(const string &url)
+{
+    for (const auto &task : tasksFor(url))
+    {
+        if (task->setStartCommand())
+        {
+            cancelRetry(task->getId());
+            dispatch(task);
+        }
+    }
+}
+
+void DownloadManager::startDownload(TaskId id)
+{
+    shared_ptr<DownloadTask> task = taskFor(id);
+    if (task && task->setStartCommand())
+    {
+        cancelRetry(id);
+        dispatch(task);
+    }
+}
+
+void DownloadManager::pauseDownload(const string &url)
+{
+    for (const auto &task : tasksFor(url))
+    {
+        task->pause();
+    }
+}
+
+void DownloadManager::pauseDownload(TaskId id)
+{
+    shared_ptr<DownloadTask> task = taskFor(id);
+    if (task)
+    {
+        task->pause();
+    }
+}
+
+void DownloadManager::resumeDownload(const string &url)
+{
+    for (const auto &task : tasksFor(url))
+    {
+        if (task->resume())
+        {
+            dispatch(task);
+        }
+    }
+}
+
+void DownloadManager::resumeDownload(TaskId id)
+{
+    shared_ptr<DownloadTask> task = taskFor(id);
+    if (task && task->resume())
+    {
+        dispatch(task);
+    }
+}
+
+void DownloadManager::cancelDownload(const string &url)
+{
+    for (const auto &task : tasksFor(url))
+    {
+        task->cancel();
+    }
+}
+
+void DownloadManager::cancelDownload(TaskId id)
+{
+    shared_ptr<DownloadTask> task = taskFor(id);
+    if (task)
+    {
+        task->cancel();
+    }
+}
+
+DownloadStatus DownloadManager::getDownloadStatus(const string &url)
+{
+    vector<TaskId> ids = tasks.findByUrl(url);
+    shared_ptr<DownloadTask> task = ids.empty() ? NULL : tasks.find(ids.back());
+    return task ? task->getStatus() : DownloadStatus::Completed; // Completed tasks are cleaned up
+}
+
+DownloadStatus DownloadManager::getDownloadStatus(TaskId id)
+{
+    shared_ptr<DownloadTask> task = tasks.find(id);
+    if (!task)
+    {
+        return tasks.issued(id) ? DownloadStatus::Completed : DownloadStatus::Failed; // Cleaned up, or never issued
+    }
+    return task->getStatus();
+}
+
+vector<TaskId> DownloadManager::findDownloads(const string &url)
+{
+    return tasks.findByUrl(url);
+}
+
+vector<TaskId> DownloadManager::getDownloadsWithStatus(DownloadStatus status)
+{
+    return tasks.withStatus(status);
+}
+
+size_t DownloadManager::getDownloadCount()
+{
+    return tasks.size();
+}
+
+bool DownloadManager::isFinished(TaskId id)
+{
+    shared_ptr<DownloadTask> task = tasks.find(id);
+    return (task || tasks.issued(id)) && isFinished(task); // An ID never issued never finishes
+}
+
+bool DownloadManager::isFinished(const shared_ptr<DownloadTask> &task)
+{
+    DownloadStatus status = task ? task->getStatus() : DownloadStatus::Completed; // Removed by the cleanup
+    return status == DownloadStatus::Completed || status == DownloadStatus::Cancelled ||
+           (status == DownloadStatus::Failed && !task->isAwaitingRetry());
+}
+
+// Wait on completionWake, which every status change notifies, until done() holds
+template <typename Predicate>
+bool DownloadManager::waitUntil(Predicate done, chrono::milliseconds timeout)
+{
+    unique_lock<mutex> lock(completionMutex);
+    if (timeout == chrono::milliseconds::max())
+    {
+        completionWake.wait(lock, done);
+        return true;
+    }
+    return completionWake.wait_for(lock, timeout, done);
+}
+
+bool DownloadManager::waitAll(chrono::milliseconds timeout)
+{
+    return waitUntil([this]()
+                     { return tasks.countWithStatus(DownloadStatus::Starting) == 0 &&
+                              tasks.countWithStatus(DownloadStatus::Downloading) == 0 && retryTimers.empty(); },
+                     timeout);
+}
+
+bool DownloadManager::waitAll(const vector<TaskId> &ids, chrono::milliseconds timeout)
+{
+    if (!all_of(ids.begin(), ids.end(), [this](TaskId id)
+                { return tasks.issued(id); }))
+    {
+        return false; // An unknown ID would never finish
+    }
+    return waitUntil([this, &ids]()
+                     { return all_of(ids.begin(), ids.end(), [this](TaskId id)
+                                     { return isFinished(id); }); },
+                     timeout);
+}
+
+TaskId DownloadManager::waitAny(const vector<TaskId> &ids, chrono::milliseconds timeout)
+{
+    if (none_of(ids.begin(), ids.end(), [this](TaskId id)
+                { return tasks.issued(id); }))
+    {
+        return 0; // Nothing that could finish, the empty list included
+    }
+    TaskId finished = 0;
+    waitUntil([this, &ids, &finished]()
+              {
+        auto found = find_if(ids.begin(), ids.end(), [this](TaskId id)
+                             { return isFinished(id); });
+        finished = (found != ids.end()) ? *found : 0;
+        return finished != 0; },
+              timeout);
+    return finished;
+}
+
+void DownloadManager::waitForCompletion()
+{
+    waitAll();
+}
+
+void DownloadManager::clearTasks()
+{
+    // Finished tasks come from the status index instead of a walk over every task
+    for (TaskId id : tasks.withStatus(DownloadStatus::Completed))
+    {
+        shared_ptr<DownloadTask> task = tasks.find(id);
+        if (task && task->getStatus() == DownloadStatus::Completed && tasks.remove(id))
+        {
+            cout << "\n[CLEANUP] Removing completed task: " << fileNameOf(task->getUrl()) << "\n";
+        }
+    }
+}
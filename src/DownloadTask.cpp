@@ -2,131 +2,1505 @@
 
 // DownloadTask.cpp
 #include "DownloadTask.hpp"
+#include "TaskRegistry.hpp"
 #include <fstream>
+#include <cstring>
+#include <cstdlib>
+#include <unordered_set>
+#include <sstream>
+#include <algorithm>
 
 using namespace std;
 
-static mutex progress_mutex;
+// Ranges smaller than this are not worth an extra connection
+static const curl_off_t MIN_SEGMENT_SIZE = 1024 * 1024;
+
+// How often the progress journal is synced to disk while downloading
+static const chrono::seconds CHECKPOINT_INTERVAL(2);
+// Window of the instantaneous throughput of a task
+static const chrono::milliseconds RATE_INTERVAL(500);
+
+// Span names of the status track, in DownloadStatus order; Starting is the wait for a worker
+static const char *TRACE_STATUS[TransferMetrics::STATUS_COUNT] = {
+    "starting", "pending", "downloading", "paused", "completed", "failed", "cancelled"};
+
+static bool headerStartsWith(const char *line, size_t length, const char *prefix)
+{
+    size_t prefixLength = strlen(prefix);
+#ifdef _WIN32
+    return length >= prefixLength && _strnicmp(line, prefix, prefixLength) == 0;
+#else
+    return length >= prefixLength && strncasecmp(line, prefix, prefixLength) == 0;
+#endif
+}
+
+static string headerValue(const string &line, size_t nameLength)
+{
+    size_t first = line.find_first_not_of(" \t", nameLength);
+    size_t last = line.find_last_not_of(" \t\r\n");
+    return (first == string::npos || last < first) ? "" : line.substr(first, last - first + 1);
+}
+
+// Collect size, range support and validators from the probe response headers
+static size_t probe_header(char *buffer, size_t size, size_t nitems, ProbeResult *result)
+{
+    size_t length = size * nitems;
+    string line(buffer, length);
+
+    if (headerStartsWith(buffer, length, "HTTP/"))
+    {
+        // New response (e.g. after a redirect), forget the previous one
+        result->responseCode = 0;
+        result->size = -1;
+        result->acceptsRanges = false;
+        result->etag.clear();
+        result->lastModified.clear();
+        size_t space = line.find(' ');
+        if (space != string::npos)
+        {
+            result->responseCode = strtol(line.c_str() + space + 1, NULL, 10);
+        }
+    }
+    else if (headerStartsWith(buffer, length, "Content-Range:"))
+    {
+        // Content-Range: bytes 0-0/<total>, or bytes */<total> on a 416
+        size_t slash = line.find('/');
+        if (slash != string::npos && line[slash + 1] != '*')
+        {
+            result->size = strtoll(line.c_str() + slash + 1, NULL, 10);
+            result->acceptsRanges = (result->responseCode == 206);
+        }
+    }
+    else if (headerStartsWith(buffer, length, "ETag:"))
+    {
+        result->etag = headerValue(line, strlen("ETag:"));
+    }
+    else if (headerStartsWith(buffer, length, "Last-Modified:"))
+    {
+        result->lastModified = headerValue(line, strlen("Last-Modified:"));
+    }
+    else if (headerStartsWith(buffer, length, "Content-Length:") && result->responseCode == 200)
+    {
+        result->size = strtoll(line.c_str() + strlen("Content-Length:"), NULL, 10);
+    }
+
+    return length;
+}
+
+// The probe only needs the headers; a 200 body is kept for small files and
+// aborted right away for anything larger
+static size_t probe_body(void *ptr, size_t size, size_t nmemb, ProbeResult *result)
+{
+    size_t bytes = size * nmemb;
+    if (result->responseCode == 206)
+    {
+        return bytes;
+    }
+
+    // A small body costs less than a second request, and cutting off a stream
+    // can leave a shared HTTP/2 connection unusable
+    if (result->size >= 0 && result->size <= MIN_SEGMENT_SIZE &&
+        result->body.size() + bytes <= static_cast<size_t>(MIN_SEGMENT_SIZE))
+    {
+        result->body.append(static_cast<char *>(ptr), bytes);
+        return bytes;
+    }
+    result->bodyRefused = true;
+    return 0;
+}
+
+// A checksum file is a line or a few; anything larger is not one
+static size_t sidecar_body(void *ptr, size_t size, size_t nmemb, string *body)
+{
+    size_t bytes = size * nmemb;
+    if (body->size() + bytes > 64 * 1024)
+    {
+        return 0;
+    }
+    body->append(static_cast<char *>(ptr), bytes);
+    return bytes;
+}
+
+// Wake callback for a segment that stalled on the write backend
+static void resume_segment(void *context)
+{
+    curl_easy_pause(static_cast<DownloadSegment *>(context)->handle, CURLPAUSE_CONT);
+}
 
 // Helper function to write data received from libcurl
-static size_t write_data(void *ptr, size_t size, size_t nmemb, DownloadTask *task)
+static size_t write_data(void *ptr, size_t size, size_t nmemb, DownloadSegment *segment)
 {
     size_t total_size = size * nmemb;
-    int written = task->writer->write(static_cast<char *>(ptr), total_size);
+    DownloadTask *task = segment->task;
+
+    if (segment->end >= 0)
+    {
+        // A ranged request must come back as 206 and stay inside its range
+        if (!segment->verified)
+        {
+            segment->verified = true;
+            long responseCode = 0;
+            curl_easy_getinfo(segment->handle, CURLINFO_RESPONSE_CODE, &responseCode);
+            if (responseCode != 206)
+            {
+                cerr << "Server ignored range request (HTTP " << responseCode << ")" << endl;
+                return 0;
+            }
+        }
+        if (segment->begin + segment->received + static_cast<curl_off_t>(total_size) > segment->end + 1)
+        {
+            cerr << "Server sent more data than requested for range" << endl;
+            return 0;
+        }
+    }
+
+    long long wait = task->requestBandwidth(total_size);
+    if (wait > 0)
+    {
+        // Over its share: stop reading this socket until the buckets refill
+        task->recordEvent(TransferMetrics::Throttled);
+        BandwidthScheduler::wakeAfter(wait, task, resume_segment, segment);
+        return CURL_WRITEFUNC_PAUSE;
+    }
+
+    int written = segment->writer->append(segment->buffer, segment->begin + segment->received, static_cast<char *>(ptr), total_size);
+    if (written == FileWriter::WRITE_STALLED)
+    {
+        // Disk is behind: stop reading this socket, curl delivers the same data again on unpause
+        task->recordEvent(TransferMetrics::WriteStalls);
+        segment->writer->waitForBuffer(resume_segment, segment);
+        return CURL_WRITEFUNC_PAUSE;
+    }
+    if (written == FileWriter::POOL_EXHAUSTED)
+    {
+        // Every write buffer of the manager is out: try again shortly rather than allocate
+        task->recordEvent(TransferMetrics::WriteStalls);
+        BandwidthScheduler::wakeAfter(BufferPool::RETRY_MICROS, task, resume_segment, segment);
+        return CURL_WRITEFUNC_PAUSE;
+    }
     
     // If write failed, return 0 to abort the transfer
     if (written != total_size)
     {
-        cerr << "Write failed! Expected " << total_size << " but wrote " << written << endl;
-        return 0;
+        cerr << "Write failed! Expected " << total_size << " but wrote " << written << endl;
+        return 0;
+    }
+
+    task->hashReceived(*segment, static_cast<char *>(ptr), written);
+    segment->received += written;
+    task->reportDelivered(written);
+    return written;
+}
+
+// Progress callback function (using new XFERINFO API)
+// Runs many times per second per range: it only publishes counters, a ProgressReporter renders them
+static int progress_callback(void *clientp, curl_off_t /*dltotal*/, curl_off_t /*dlnow*/, curl_off_t /*ultotal*/, curl_off_t /*ulnow*/)
+{
+    // Abort on pause or cancel, a pause resumes later from the bytes on disk
+    return static_cast<DownloadSegment *>(clientp)->task->onProgress() ? 1 : 0;
+}
+
+DownloadTask::DownloadTask(const string &url, const string &destination, const TransferOptions &options,
+                           HandlePool *handlePool, BandwidthScheduler *scheduler, TransferMetrics *metrics,
+                           TraceRecorder *trace, BufferPool *buffers, ContentCache *cache, JournalSyncer *syncer)
+    : url(url), destinationPath(destination), status(DownloadStatus::Pending), progress(0.0f),
+      options(options), totalSize(-1), receivedBytes(0), origin(NULL), multi(NULL), handlePool(handlePool), slotHandles(0), scheduler(scheduler),
+      metrics(metrics), trace(trace), buffers(buffers), cache(cache), syncer(syncer), registry(NULL), id(0), expectedSize(-1), pausedByCallback(false), pausedDetached(false), resumeRequested(false),
+      deliveredBytes(0), firstByteMicros(0), rate(0), statusSince(chrono::steady_clock::now()),
+      statusMicros(), queueWaitMicros(0), retries(0), lastError(0), lastHttpStatus(0), lastRetryAfter(0), completionSet(false),
+      completedAs(DownloadStatus::Pending), awaitingRetry(false)
+{
+    // A multiplexed file is one stream: its ranges would share the connection anyway
+    if (this->options.segmentCount == 0 || this->options.multiplex)
+    {
+        this->options.segmentCount = 1;
+    }
+}
+
+DownloadTask::Transfer::Transfer(const string &destination, const TransferOptions &options)
+    : writer(destination), journal(destination), probeResult(), curlHandle(NULL), probing(false),
+      activeHandles(0), failure(CURLE_OK), httpStatus(0), retryAfter(0), rangesSupported(false), rateBytes(0), verifying(false), hashSha(false),
+      hashedUpTo(0), sidecarHandle(NULL), checksumFailed(false), sizeMismatch(false), caching(false), cached(), conditions(NULL), fromCache(false)
+{
+    writer.setBufferSize(options.writeBufferSize);
+    writer.setDirectIoThreshold(options.directIoThreshold);
+    writer.setMappedThreshold(options.mappedThreshold);
+}
+
+DownloadTask::Transfer::~Transfer()
+{
+    curl_slist_free_all(conditions);
+}
+
+CURL *DownloadTask::acquireHandle()
+{
+    return handlePool ? handlePool->acquire() : curl_easy_init();
+}
+
+bool DownloadTask::takeSlot(bool wait)
+{
+    if (!handlePool || slotHandles > 0)
+    {
+        return true;
+    }
+    size_t handles = getMaxConnections() + (options.fetchSidecar ? 1 : 0);
+    if (wait)
+    {
+        handlePool->reserve(handles);
+    }
+    else if (!handlePool->tryReserve(handles))
+    {
+        return false;
+    }
+    slotHandles = handles;
+    return true;
+}
+
+void DownloadTask::releaseSlot()
+{
+    if (handlePool && slotHandles > 0)
+    {
+        handlePool->unreserve(slotHandles);
+        slotHandles = 0;
+    }
+}
+
+void DownloadTask::returnHandle(CURL *handle)
+{
+    if (!handle)
+    {
+        return;
+    }
+    if (handlePool)
+    {
+        handlePool->release(handle);
+    }
+    else
+    {
+        curl_easy_cleanup(handle);
+    }
+}
+
+void DownloadTask::configureHandle(CURL *handle)
+{
+    curl_easy_setopt(handle, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(handle, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(handle, CURLOPT_SSL_VERIFYPEER, 0L); // For HTTPS
+    curl_easy_setopt(handle, CURLOPT_SSL_VERIFYHOST, 0L);
+    curl_easy_setopt(handle, CURLOPT_USERAGENT, "Mozilla/5.0");
+    curl_easy_setopt(handle, CURLOPT_PRIVATE, this); // Lets a shared multi handle find the task
+    if (options.http2PriorKnowledge && url.compare(0, 7, "http://") == 0)
+    {
+        curl_easy_setopt(handle, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2_PRIOR_KNOWLEDGE);
+    }
+    else if (options.multiplex)
+    {
+        curl_easy_setopt(handle, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+    }
+    if (options.multiplex)
+    {
+        curl_easy_setopt(handle, CURLOPT_PIPEWAIT, 1L); // Queue on a connection that is still being set up
+    }
+}
+
+bool DownloadTask::checkProbe(CURLcode result)
+{
+    if (result != CURLE_OK && !transfer->probeResult.bodyRefused)
+    {
+        transfer->failure = result;
+        return false;
+    }
+    if (transfer->probeResult.responseCode < 200 || transfer->probeResult.responseCode >= 300)
+    {
+        transfer->failure = CURLE_HTTP_RETURNED_ERROR;
+        return false;
+    }
+
+    totalSize = transfer->probeResult.size;
+    if (expectedSize >= 0 && totalSize >= 0 && totalSize != expectedSize)
+    {
+        transfer->sizeMismatch = true; // A different file than the one listed: nothing is written
+        transfer->failure = CURLE_FILESIZE_EXCEEDED;
+        return false;
+    }
+    transfer->rangesSupported = transfer->probeResult.acceptsRanges && totalSize > 0;
+    return true;
+}
+
+void DownloadTask::planSegments(bool acceptsRanges)
+{
+    size_t count = 1;
+    if (acceptsRanges)
+    {
+        curl_off_t bySize = totalSize / MIN_SEGMENT_SIZE;
+        count = static_cast<size_t>(bySize < 1 ? 1 : bySize);
+        if (count > options.segmentCount)
+        {
+            count = options.segmentCount;
+        }
+    }
+
+    transfer->segments.clear();
+    transfer->segments.reserve(count);
+    // Range starts fall on alignment boundaries so full write buffers can use O_DIRECT
+    curl_off_t chunk = (count > 1) ? totalSize / count / FileWriter::ALIGNMENT * FileWriter::ALIGNMENT : 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        DownloadSegment segment;
+        segment.task = this;
+        segment.handle = NULL;
+        segment.begin = i * chunk;
+        segment.received = 0;
+        segment.verified = false;
+        segment.crcKnown = true;
+        segment.crc = 0;
+        segment.writer = &transfer->writer;
+        if (count == 1)
+        {
+            segment.end = acceptsRanges ? totalSize - 1 : -1;
+        }
+        else
+        {
+            segment.end = (i == count - 1) ? totalSize - 1 : (i + 1) * chunk - 1;
+        }
+        transfer->segments.push_back(segment);
+    }
+}
+
+// Continue from the journal of an earlier run if the remote file is unchanged
+bool DownloadTask::adoptJournal()
+{
+    if (!transfer->journal.load() || transfer->journal.url != url)
+    {
+        return false;
+    }
+
+    string filename = url.substr(url.find_last_of('/') + 1);
+    const ProbeResult &probe = transfer->probeResult;
+    if (!transfer->rangesSupported || !transfer->journal.matches(probe.etag, probe.lastModified, totalSize))
+    {
+        cout << "[CHANGED] " << filename << " - remote file differs from the partial download, restarting\n";
+        transfer->journal.remove();
+        return false;
+    }
+
+    ifstream existing(destinationPath, ifstream::binary);
+    if (!existing.is_open())
+    {
+        transfer->journal.remove();
+        return false;
+    }
+    for (const auto &range : transfer->journal.ranges)
+    {
+        if (range.begin < 0 || range.begin > range.end || range.end >= totalSize || range.done < 0 ||
+            range.done > range.end - range.begin + 1)
+        {
+            cout << "[DAMAGED] " << filename << " - resume journal does not fit the file, restarting\n";
+            transfer->journal.remove();
+            return false;
+        }
+    }
+
+    transfer->segments.clear();
+    transfer->segments.reserve(transfer->journal.ranges.size());
+    for (const auto &range : transfer->journal.ranges)
+    {
+        DownloadSegment segment;
+        segment.task = this;
+        segment.handle = NULL;
+        segment.begin = range.begin;
+        segment.end = range.end;
+        segment.received = range.done;
+        segment.verified = false;
+        segment.crcKnown = range.done == 0; // Bytes from an earlier run were never hashed here
+        segment.crc = 0;
+        segment.writer = &transfer->writer;
+        transfer->segments.push_back(segment);
+    }
+    publishProgress();
+    cout << "[RESUMING] " << filename << " from journal at " << countReceived() / 1024 << " KB\n";
+    return true;
+}
+
+bool DownloadTask::storeProbeBody()
+{
+    if (!transfer->writer.open(true))
+    {
+        return false;
+    }
+    totalSize = static_cast<curl_off_t>(transfer->probeResult.body.size());
+    planSegments(false);
+    const string &body = transfer->probeResult.body;
+    int written = transfer->writer.writeAt(0, body.data(), static_cast<int>(body.size()));
+    if (written > 0)
+    {
+        hashReceived(transfer->segments[0], body.data(), written);
+    }
+    transfer->segments[0].received = written;
+    reportDelivered(written > 0 ? written : 0);
+    publishProgress();
+    string().swap(transfer->probeResult.body);
+    return written == totalSize;
+}
+
+// Send the validators of a cached copy with the probe, so an unchanged file is answered with 304 and no body
+void DownloadTask::revalidateWithCache()
+{
+    CacheEntry entry;
+    if (!cache->lookup(url, entry))
+    {
+        return;
+    }
+    if (!transfer->expected.sha256.empty() && transfer->expected.sha256 != entry.sha256)
+    {
+        return; // The copy could never pass verification
+    }
+    if (!entry.etag.empty())
+    {
+        transfer->conditions = curl_slist_append(transfer->conditions, ("If-None-Match: " + entry.etag).c_str());
+    }
+    if (!entry.lastModified.empty())
+    {
+        transfer->conditions = curl_slist_append(transfer->conditions, ("If-Modified-Since: " + entry.lastModified).c_str());
+    }
+    if (transfer->conditions)
+    {
+        curl_easy_setopt(transfer->curlHandle, CURLOPT_HTTPHEADER, transfer->conditions);
+        transfer->cached = entry;
+    }
+}
+
+// Not modified: the destination becomes the cached copy, as one range that arrived in full
+bool DownloadTask::useCached()
+{
+    string filename = url.substr(url.find_last_of('/') + 1);
+    if (!cache->materialize(transfer->cached, destinationPath))
+    {
+        cout << "[CACHE] " << filename << " - could not copy the cached file to " << destinationPath << "\n";
+        cache->forget(url); // The retry downloads it
+        return false;
+    }
+    transfer->fromCache = true;
+    totalSize = transfer->cached.size;
+    planSegments(false);
+    transfer->segments[0].received = totalSize;
+    transfer->segments[0].crcKnown = false; // Nothing streamed through a CRC; verification reads the file
+    transfer->contentSha = transfer->cached.sha256;
+    publishProgress();
+    cout << "[CACHED] " << filename << " - not modified, " << totalSize / 1024 << " KB from the cache\n";
+    return true;
+}
+
+// Start a request for every range that still has bytes missing
+void DownloadTask::addSegments()
+{
+    bool firstHandle = true;
+    for (auto &segment : transfer->segments)
+    {
+        if (segment.end >= 0 && segment.received == segment.end - segment.begin + 1)
+        {
+            continue; // Finished before a pause
+        }
+
+        segment.handle = firstHandle ? transfer->curlHandle : acquireHandle();
+        segment.verified = true; // Only requests that carry a Range header need a 206
+        segment.writer->prepare(segment.buffer, segment.end >= 0 ? segment.end - segment.begin + 1 - segment.received : -1);
+        firstHandle = false;
+        if (!segment.handle)
+        {
+            transfer->failure = CURLE_FAILED_INIT;
+            return;
+        }
+
+        configureHandle(segment.handle);
+        curl_easy_setopt(segment.handle, CURLOPT_WRITEFUNCTION, write_data);
+        curl_easy_setopt(segment.handle, CURLOPT_WRITEDATA, &segment);
+        curl_easy_setopt(segment.handle, CURLOPT_NOPROGRESS, 0L);
+        curl_easy_setopt(segment.handle, CURLOPT_XFERINFOFUNCTION, progress_callback);
+        curl_easy_setopt(segment.handle, CURLOPT_XFERINFODATA, &segment);
+        if (segment.end >= 0 && (transfer->segments.size() > 1 || segment.received > 0))
+        {
+            string range = to_string(segment.begin + segment.received) + "-" + to_string(segment.end);
+            curl_easy_setopt(segment.handle, CURLOPT_RANGE, range.c_str()); // libcurl copies the string
+            segment.verified = false;
+        }
+    }
+
+    for (auto &segment : transfer->segments)
+    {
+        if (segment.handle)
+        {
+            curl_multi_add_handle(multi, segment.handle);
+            ++transfer->activeHandles;
+        }
+    }
+}
+
+void DownloadTask::detachSegments()
+{
+    for (auto &segment : transfer->segments)
+    {
+        if (segment.handle)
+        {
+            curl_multi_remove_handle(multi, segment.handle); // No-op for finished handles
+        }
+    }
+    if (transfer->sidecarHandle)
+    {
+        curl_multi_remove_handle(multi, transfer->sidecarHandle);
+    }
+    transfer->activeHandles = 0;
+}
+
+// Prepare the first request on the given multi handle; the owner of the multi
+// handle reports every finished transfer back through onHandleDone()
+bool DownloadTask::attach(CURLM *multiHandle)
+{
+    // Claim the task first: after a pause both the old driver and a fresh dispatch may get here
+    DownloadStatus expected = DownloadStatus::Starting;
+    if (!status.compare_exchange_strong(expected, DownloadStatus::Downloading))
+    {
+        return false;
+    }
+    recordTransition(expected, DownloadStatus::Downloading);
+
+    string filename = url.substr(url.find_last_of('/') + 1);
+
+    // A resumed task continues its ranges; anything else starts from byte zero
+    bool resuming = resumeRequested && transfer && transfer->rangesSupported && !transfer->segments.empty();
+    resumeRequested = false;
+    if (resuming)
+    {
+        cout << "\n[RESUMING] " << filename << " at " << countReceived() / 1024 << " KB\n";
+    }
+    else
+    {
+        cout << "\n[STARTING] " << filename << "\n";
+        transfer.reset(new Transfer(destinationPath, options)); // Writer, journal and ranges exist from here on
+        transfer->writer.setTrace(trace, id);
+        transfer->writer.setBufferPool(buffers);
+        lock_guard<mutex> lock(statsMutex);
+        ExpectedDigest::parse(checksum, transfer->expected); // Validated by setChecksum
+        transfer->verifying = !transfer->expected.empty();
+        transfer->caching = cache && cache->enabled();
+        transfer->hashSha = !transfer->expected.sha256.empty() || transfer->caching; // The cache is keyed by content
+        progress = 0.0f;
+        receivedBytes = 0;
+    }
+
+    transfer->failure = CURLE_OK;
+    pausedByCallback = false;
+
+    if (!transfer->curlHandle)
+    {
+        transfer->curlHandle = acquireHandle();
+    }
+    if (!transfer->curlHandle)
+    {
+        transfer.reset();
+        setStatus(DownloadStatus::Failed);
+        cout << "\n[FAILED] " << filename << " - CURL handle not initialized\n";
+        return false;
+    }
+
+    multi = multiHandle;
+    if (resuming)
+    {
+        if (!transfer->writer.isOpen())
+        {
+            if (!transfer->writer.open(false))
+            {
+                transfer->failure = CURLE_WRITE_ERROR;
+                finish();
+                return false;
+            }
+            if (totalSize > 0)
+            {
+                transfer->writer.preallocate(totalSize); // Maps the file again when it qualifies
+            }
+        }
+        if (options.fetchSidecar && transfer->expected.empty())
+        {
+            startSidecar(); // The earlier request was dropped by the pause
+        }
+        addSegments();
+        if (transfer->failure != CURLE_OK)
+        {
+            detachSegments();
+        }
+        if (transfer->activeHandles == 0)
+        {
+            finish();
+        }
+        return isAttached(multiHandle);
+    }
+
+    // Ask for the first byte only to learn the size and whether ranges work
+    transfer->probeResult = {0, -1, false, "", "", "", false};
+    configureHandle(transfer->curlHandle);
+    curl_easy_setopt(transfer->curlHandle, CURLOPT_RANGE, "0-0");
+    curl_easy_setopt(transfer->curlHandle, CURLOPT_HEADERFUNCTION, probe_header);
+    curl_easy_setopt(transfer->curlHandle, CURLOPT_HEADERDATA, &transfer->probeResult);
+    curl_easy_setopt(transfer->curlHandle, CURLOPT_WRITEFUNCTION, probe_body);
+    curl_easy_setopt(transfer->curlHandle, CURLOPT_WRITEDATA, &transfer->probeResult);
+    if (transfer->caching)
+    {
+        revalidateWithCache();
+    }
+
+    transfer->probing = true;
+    transfer->activeHandles = 1;
+    curl_multi_add_handle(multi, transfer->curlHandle);
+    if (options.fetchSidecar && transfer->expected.empty())
+    {
+        startSidecar();
+    }
+    return true;
+}
+
+void DownloadTask::onHandleDone(CURL *handle, CURLcode result)
+{
+    if (trace && trace->enabled())
+    {
+        traceRequest(handle, result);
+    }
+    curl_multi_remove_handle(multi, handle);
+    --transfer->activeHandles;
+    if (handle == transfer->sidecarHandle)
+    {
+        sidecarDone(result);
+        if (transfer->activeHandles == 0)
+        {
+            finish();
+        }
+        return;
+    }
+
+    if (noteHttpError(handle)) // Before the probe handle is reset
+    {
+        result = CURLE_HTTP_RETURNED_ERROR; // Not the write error the refused body turned into
+    }
+    if (transfer->probing && transfer->probeResult.responseCode == 416 && transfer->probeResult.size == 0)
+    {
+        // A zero-byte file has no byte 0: "Content-Range: bytes */0" announces the whole, empty file
+        transfer->probeResult.responseCode = 200;
+        transfer->probeResult.body.clear(); // The error page is not its content
+        transfer->probeResult.bodyRefused = false;
+        transfer->httpStatus = 0;
+        result = CURLE_OK;
+    }
+    curl_off_t firstByte = 0;
+    if (result == CURLE_OK)
+    {
+        curl_easy_getinfo(handle, CURLINFO_STARTTRANSFER_TIME_T, &firstByte);
+    }
+    if (transfer->probing)
+    {
+        firstByteMicros = firstByte;
+    }
+    if (metrics)
+    {
+        metrics->recordRequest(result, firstByte);
+    }
+
+    if (transfer->probing)
+    {
+        transfer->probing = false;
+        curl_easy_reset(transfer->curlHandle); // Keeps the connection for the first segment
+        curl_slist_free_all(transfer->conditions); // No longer referenced by the handle
+        transfer->conditions = NULL;
+
+        if (result == CURLE_OK && transfer->probeResult.responseCode == 304 && !transfer->cached.url.empty())
+        {
+            detachSegments(); // Drops a sidecar request as well
+            if (!useCached())
+            {
+                transfer->failure = CURLE_WRITE_ERROR;
+            }
+            finish();
+            return;
+        }
+
+        if (!checkProbe(result))
+        {
+            detachSegments(); // Drops a sidecar request as well
+            finish();
+            return;
+        }
+        if (transfer->probeResult.responseCode == 200 && !transfer->probeResult.bodyRefused)
+        {
+            // The probe already carried the whole file
+            if (!storeProbeBody())
+            {
+                transfer->failure = CURLE_WRITE_ERROR;
+            }
+            if (transfer->activeHandles == 0) // Otherwise the sidecar finishes it
+            {
+                finish();
+            }
+            return;
+        }
+
+        // The file is opened only now so a journal from an earlier run can keep its bytes
+        bool adopted = adoptJournal();
+        if (!transfer->writer.open(!adopted))
+        {
+            transfer->failure = CURLE_WRITE_ERROR;
+            finish();
+            return;
+        }
+        if (!adopted)
+        {
+            planSegments(transfer->rangesSupported);
+        }
+        if (totalSize > 0)
+        {
+            transfer->writer.preallocate(totalSize);
+        }
+        transfer->lastCheckpoint = chrono::steady_clock::now();
+        if (transfer->segments.size() > 1)
+        {
+            string filename = url.substr(url.find_last_of('/') + 1);
+            cout << "[SEGMENTED] " << filename << " - " << transfer->segments.size() << " parallel ranges\n";
+        }
+        addSegments();
+    }
+    else if (result != CURLE_OK && transfer->failure == CURLE_OK &&
+             !(pausedByCallback && result == CURLE_ABORTED_BY_CALLBACK))
+    {
+        transfer->failure = result;
+    }
+
+    // One broken range fails the whole file, and a pause stops all of them
+    if (transfer->failure != CURLE_OK || pausedByCallback)
+    {
+        detachSegments();
+    }
+    if (transfer->activeHandles == 0)
+    {
+        finish();
+    }
+}
+
+// Spans for the phases of a finished request, from curl's own timings (microseconds since it started)
+void DownloadTask::traceRequest(CURL *handle, CURLcode result)
+{
+    curl_off_t dns = 0, connect = 0, tls = 0, pretransfer = 0, firstByte = 0, total = 0, bytes = 0;
+    curl_easy_getinfo(handle, CURLINFO_NAMELOOKUP_TIME_T, &dns);
+    curl_easy_getinfo(handle, CURLINFO_CONNECT_TIME_T, &connect);
+    curl_easy_getinfo(handle, CURLINFO_APPCONNECT_TIME_T, &tls);
+    curl_easy_getinfo(handle, CURLINFO_PRETRANSFER_TIME_T, &pretransfer);
+    curl_easy_getinfo(handle, CURLINFO_STARTTRANSFER_TIME_T, &firstByte);
+    curl_easy_getinfo(handle, CURLINFO_TOTAL_TIME_T, &total);
+    curl_easy_getinfo(handle, CURLINFO_SIZE_DOWNLOAD_T, &bytes);
+
+    const char *name = "range";
+    int lane = TraceRecorder::requestLane(0);
+    if (handle == transfer->sidecarHandle)
+    {
+        name = "sidecar";
+        lane = TraceRecorder::SIDECAR;
+    }
+    else if (transfer->probing)
+    {
+        name = "probe";
+    }
+    else
+    {
+        for (size_t i = 0; i < transfer->segments.size(); ++i)
+        {
+            if (transfer->segments[i].handle == handle)
+            {
+                lane = TraceRecorder::requestLane(i);
+            }
+        }
+    }
+
+    // A reused connection reports no lookup or connect; those phases are left out
+    long long end = trace->now();
+    long long begin = end - total;
+    trace->span(name, "http", id, lane, begin, end, bytes);
+    if (dns > 0)
+    {
+        trace->span("dns", "http", id, lane, begin, begin + dns);
+    }
+    if (connect > dns)
+    {
+        trace->span("connect", "http", id, lane, begin + dns, begin + connect);
+    }
+    if (tls > connect)
+    {
+        trace->span("tls", "http", id, lane, begin + connect, begin + tls);
+    }
+    if (firstByte > pretransfer)
+    {
+        trace->span("first byte", "http", id, lane, begin + pretransfer, begin + firstByte);
+    }
+    if (firstByte > 0 && total > firstByte)
+    {
+        trace->span("receive", "http", id, lane, begin + firstByte, end, bytes);
+    }
+    long responseCode = 0;
+    curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &responseCode);
+    if (result != CURLE_OK)
+    {
+        trace->instant("error", "error", id, lane, result);
+    }
+    else if (responseCode >= 400)
+    {
+        trace->instant("http error", "http error", id, lane, responseCode);
+    }
+}
+
+void DownloadTask::finish()
+{
+    releaseHandles();
+    multi = NULL;
+
+    // Buffered bytes count as received, so they must reach the file first
+    if (!flushSegments() && transfer->failure == CURLE_OK)
+    {
+        transfer->failure = CURLE_WRITE_ERROR;
+    }
+    publishProgress();
+    for (auto &segment : transfer->segments)
+    {
+        transfer->writer.release(segment.buffer);
+    }
+
+    // Record what is on disk before the file is closed, then close and flush it
+    bool stopped = status == DownloadStatus::Failed || status == DownloadStatus::Cancelled;
+    bool completed = transfer->failure == CURLE_OK && !pausedByCallback && !stopped;
+    for (const auto &segment : transfer->segments)
+    {
+        if (segment.end >= 0 && segment.received != segment.end - segment.begin + 1)
+        {
+            completed = false;
+        }
+    }
+    if (completed && expectedSize >= 0 && countReceived() != expectedSize)
+    {
+        completed = false; // The server gave no size up front
+        transfer->sizeMismatch = true;
+    }
+    if (completed && transfer->verifying && !verifyDownload())
+    {
+        completed = false; // The journal keeps the good ranges for the retry
+        transfer->checksumFailed = true;
+        if (transfer->fromCache)
+        {
+            cache->forget(url); // The retry downloads the file instead
+        }
+    }
+    if (completed)
+    {
+        if (syncer)
+        {
+            syncer->wait(transfer.get()); // A checkpoint still syncing would bring the journal back
+        }
+        transfer->journal.remove();
+    }
+    else
+    {
+        checkpoint(true);
+    }
+    transfer->writer.close();
+    if (completed && transfer->caching && !transfer->fromCache)
+    {
+        const ProbeResult &probe = transfer->probeResult;
+        CacheEntry entry = {url, probe.etag, probe.lastModified, countReceived(), contentHash()};
+        cache->store(entry, destinationPath); // Skipped without validators to revalidate with
+    }
+
+    string filename = url.substr(url.find_last_of('/') + 1);
+    if (pausedByCallback && transfer->failure == CURLE_OK)
+    {
+        lock_guard<mutex> lock(stateMutex);
+        if (status == DownloadStatus::Paused)
+        {
+            pausedDetached = true;
+            cout << "\n[PAUSED] " << filename << " at " << countReceived() / 1024 << " KB\n";
+            return;
+        }
+        if (status == DownloadStatus::Downloading)
+        {
+            // Resumed while the pause was tearing the transfer down; the driver attaches again
+            resumeRequested = true;
+            setStatus(DownloadStatus::Starting);
+            return;
+        }
+    }
+
+    CURLcode failure = transfer->failure;
+    bool corrupt = transfer->checksumFailed;
+    bool resized = transfer->sizeMismatch;
+    long httpStatus = transfer->httpStatus;
+    long long retryAfter = transfer->retryAfter;
+    for (const auto &segment : transfer->segments)
+    {
+        if (!corrupt && failure == CURLE_OK && segment.end >= 0 && segment.received != segment.end - segment.begin + 1)
+        {
+            failure = CURLE_PARTIAL_FILE;
+        }
+    }
+
+    // Done with this attempt: a retry starts a new transfer, continuing from the journal
+    transfer.reset();
+    stopped = status == DownloadStatus::Failed || status == DownloadStatus::Cancelled;
+    if (!corrupt && !resized && failure == CURLE_OK && !stopped)
+    {
+        setStatus(DownloadStatus::Completed);
+        progress = 1.0f;
+        cout << "\n[COMPLETED] " << filename << " - Download finished successfully!\n";
+    }
+    else if (status == DownloadStatus::Cancelled)
+    {
+        cout << "\n[CANCELLED] " << filename << " at " << receivedBytes / 1024 << " KB\n";
+    }
+    else
+    {
+        int error = corrupt ? CHECKSUM_MISMATCH : (resized ? SIZE_MISMATCH : failure);
+        {
+            lock_guard<mutex> lock(statsMutex);
+            lastError = error;
+            lastHttpStatus = (corrupt || resized) ? 0 : httpStatus;
+            lastRetryAfter = (corrupt || resized) ? 0 : retryAfter;
+        }
+        cout << "\n[FAILED] " << filename << " - Error: " << errorText(error) << "\n";
+        setStatus(DownloadStatus::Failed); // Last: the status listener may already plan a retry
+    }
+}
+
+bool DownloadTask::isAttached(CURLM *multiHandle) const
+{
+    return multiHandle != NULL && multi == multiHandle;
+}
+
+bool DownloadTask::flushSegments()
+{
+    bool ok = true;
+    for (auto &segment : transfer->segments)
+    {
+        if (!transfer->writer.flush(segment.buffer))
+        {
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+void DownloadTask::hashReceived(DownloadSegment &segment, const char *data, size_t bytes)
+{
+    if (!transfer->verifying && !transfer->hashSha)
+    {
+        return;
+    }
+    if (transfer->verifying && segment.crcKnown)
+    {
+        segment.crc = Crc32c::update(segment.crc, data, bytes);
+    }
+    if (transfer->hashSha && segment.begin + segment.received == transfer->hashedUpTo)
+    {
+        transfer->sha.update(data, bytes);
+        transfer->hashedUpTo += bytes;
+    }
+}
+
+// Reads [begin, end) of a finished file back in large blocks
+static bool readRange(const string &path, curl_off_t begin, curl_off_t end, const function<void(const char *, size_t)> &consume)
+{
+    ifstream file(path, ifstream::binary);
+    if (!file.is_open())
+    {
+        return false;
+    }
+    file.seekg(begin);
+    vector<char> block(1024 * 1024);
+    while (begin < end)
+    {
+        size_t want = static_cast<size_t>(min<curl_off_t>(end - begin, static_cast<curl_off_t>(block.size())));
+        file.read(block.data(), want);
+        if (static_cast<size_t>(file.gcount()) != want)
+        {
+            return false;
+        }
+        consume(block.data(), want);
+        begin += want;
+    }
+    return true;
+}
+
+// Ask for "<url>.sha256" next to the transfer; until it answers, everything is hashed
+void DownloadTask::startSidecar()
+{
+    CURL *handle = acquireHandle();
+    if (!handle)
+    {
+        return;
+    }
+    size_t query = url.find_first_of("?#");
+    string sidecarUrl = (query == string::npos) ? url + ".sha256" : url.substr(0, query) + ".sha256" + url.substr(query);
+    configureHandle(handle);
+    curl_easy_setopt(handle, CURLOPT_URL, sidecarUrl.c_str());
+    curl_easy_setopt(handle, CURLOPT_FAILONERROR, 1L);
+    curl_easy_setopt(handle, CURLOPT_WRITEFUNCTION, sidecar_body);
+    curl_easy_setopt(handle, CURLOPT_WRITEDATA, &transfer->sidecarBody);
+    transfer->sidecarHandle = handle;
+    transfer->sidecarBody.clear();
+    transfer->verifying = true;
+    transfer->hashSha = true;
+    ++transfer->activeHandles;
+    curl_multi_add_handle(multi, handle);
+}
+
+// sha256sum format: "<hex>  <name>" per line; the line for this file, or the only one
+void DownloadTask::sidecarDone(CURLcode result)
+{
+    string filename = url.substr(url.find_last_of('/') + 1);
+    string name = filename.substr(0, filename.find_first_of("?#"));
+    string body;
+    body.swap(transfer->sidecarBody);
+    returnHandle(transfer->sidecarHandle);
+    transfer->sidecarHandle = NULL;
+
+    ExpectedDigest digest;
+    size_t lines = 0;
+    istringstream in(result == CURLE_OK ? body : string());
+    string line;
+    while (getline(in, line))
+    {
+        istringstream fields(line);
+        string hex;
+        string listed;
+        if (!(fields >> hex))
+        {
+            continue;
+        }
+        ++lines;
+        fields >> listed;
+        if (!listed.empty() && listed[0] == '*')
+        {
+            listed.erase(0, 1); // Binary mode marker
+        }
+        ExpectedDigest candidate;
+        if (ExpectedDigest::parse(hex, candidate) && (listed.empty() || listed == name || lines == 1))
+        {
+            digest = candidate;
+            if (listed == name)
+            {
+                break;
+            }
+        }
+    }
+
+    if (digest.sha256.empty())
+    {
+        transfer->verifying = false;
+        transfer->hashSha = transfer->caching;
+        cout << "[UNVERIFIED] " << filename << " - no usable .sha256 sidecar\n";
+        return;
+    }
+    transfer->expected = digest;
+}
+
+// Compares a complete file with its digest. Bytes the SHA-256 did not see
+// arrive are read back; CRCs of the ranges are combined without a read. On a
+// mismatch, ranges whose bytes on disk differ from what arrived are reset, or
+// all of them when the data was already wrong on arrival, so the retry only
+// fetches those.
+bool DownloadTask::verifyDownload()
+{
+    Transfer &state = *transfer;
+    string filename = url.substr(url.find_last_of('/') + 1);
+    if (state.expected.empty() || state.segments.empty())
+    {
+        return true;
+    }
+
+    string kind;
+    string expected;
+    string actual;
+    bool readable = true;
+    if (!state.expected.sha256.empty())
+    {
+        kind = "sha256";
+        expected = state.expected.sha256;
+        actual = contentHash();
+        readable = actual != "unreadable";
+    }
+    if (readable && actual == expected && state.expected.hasCrc32c)
+    {
+        uint32_t whole = 0;
+        for (auto &segment : state.segments)
+        {
+            uint32_t crc = segment.crc;
+            if (!segment.crcKnown)
+            {
+                crc = 0;
+                readable = readable && readRange(destinationPath, segment.begin, segment.begin + segment.received,
+                                                 [&crc](const char *data, size_t bytes)
+                                                 { crc = Crc32c::update(crc, data, bytes); });
+            }
+            whole = Crc32c::combine(whole, crc, segment.received);
+        }
+        char hex[9];
+        kind = "crc32c";
+        snprintf(hex, sizeof(hex), "%08x", state.expected.crc32c);
+        expected = hex;
+        snprintf(hex, sizeof(hex), "%08x", whole);
+        actual = readable ? hex : "unreadable";
+    }
+    if (readable && actual == expected)
+    {
+        cout << "[VERIFIED] " << filename << " - " << kind << " matches\n";
+        return true;
+    }
+
+    // Find the ranges that changed between the network and the disk
+    size_t bad = 0;
+    for (auto &segment : state.segments)
+    {
+        uint32_t onDisk = 0;
+        bool same = segment.crcKnown &&
+                    readRange(destinationPath, segment.begin, segment.begin + segment.received,
+                              [&onDisk](const char *data, size_t bytes)
+                              { onDisk = Crc32c::update(onDisk, data, bytes); }) &&
+                    onDisk == segment.crc;
+        if (!same)
+        {
+            segment.received = 0;
+            ++bad;
+        }
+    }
+    if (bad == 0)
+    {
+        for (auto &segment : state.segments)
+        {
+            segment.received = 0;
+        }
+        bad = state.segments.size();
+    }
+    for (auto &segment : state.segments)
+    {
+        if (segment.received == 0)
+        {
+            segment.crcKnown = true;
+            segment.crc = 0;
+        }
+    }
+    publishProgress();
+
+    cout << "[CORRUPT] " << filename << " - " << kind << " mismatch: expected " << expected << ", got " << actual;
+    if (state.rangesSupported)
+    {
+        cout << "; " << bad << " of " << state.segments.size() << " ranges will be fetched again\n";
+    }
+    else
+    {
+        cout << "; the file will be fetched again\n";
+    }
+    return false;
+}
+
+// SHA-256 of the complete file; bytes the hash did not see arrive in order are read back, once
+string DownloadTask::contentHash()
+{
+    Transfer &state = *transfer;
+    if (state.contentSha.empty() && !state.segments.empty())
+    {
+        const DownloadSegment &last = state.segments.back();
+        Sha256 &sha = state.sha;
+        bool readable = readRange(destinationPath, state.hashedUpTo, last.begin + last.received,
+                                  [&sha](const char *data, size_t bytes)
+                                  { sha.update(data, bytes); });
+        state.contentSha = readable ? sha.finalHex() : "unreadable";
+    }
+    return state.contentSha;
+}
+
+// Give back the handles but keep the ranges so a pause can resume them
+void DownloadTask::releaseHandles()
+{
+    if (!transfer)
+    {
+        return;
     }
-    
-    return written;
+    transfer->writer.cancelWaits();
+    BandwidthScheduler::cancelWakeups(this);
+    for (auto &segment : transfer->segments)
+    {
+        if (segment.handle != transfer->curlHandle)
+        {
+            returnHandle(segment.handle);
+        }
+        segment.handle = NULL;
+    }
+    returnHandle(transfer->curlHandle);
+    transfer->curlHandle = NULL;
+    returnHandle(transfer->sidecarHandle); // Already off the multi handle
+    transfer->sidecarHandle = NULL;
 }
 
-// Progress callback function (using new XFERINFO API)
-static int progress_callback(void *clientp, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow)
+// Blocking variant used by the thread pool: drive this task on a private multi handle
+void DownloadTask::start()
 {
-    DownloadTask *task = static_cast<DownloadTask *>(clientp);
-    
-    // Check if download should be paused or cancelled
-    if (task->getStatus() == DownloadStatus::Paused)
+    CURLM *localMulti = curl_multi_init();
+    if (!localMulti)
     {
-        return 0; // Continue but paused
+        setStatus(DownloadStatus::Failed);
+        return;
     }
-    
-    if (task->getStatus() == DownloadStatus::Failed)
+
+    // Asynchronous disk writes complete on this thread, so wait for them alongside the sockets
+    curl_waitfd completions = {FileWriter::completionDescriptor(), CURL_WAIT_POLLIN, 0};
+    unsigned int extraCount = (completions.fd >= 0) ? 1 : 0;
+
+    // Loops only when a resume raced with a pause and the task is Starting again
+    takeSlot(true);
+    while (getStartCommand() && attach(localMulti))
     {
-        return 1; // Abort download
+        while (isAttached(localMulti))
+        {
+            int running = 0;
+            CURLMcode mc = curl_multi_perform(localMulti, &running);
+            if (mc == CURLM_OK && running)
+            {
+                int timeout = BandwidthScheduler::nextWakeupMs(1000);
+                mc = curl_multi_poll(localMulti, extraCount ? &completions : NULL, extraCount, timeout, NULL);
+                FileWriter::processCompletions();
+                BandwidthScheduler::runDueWakeups();
+            }
+            if (mc != CURLM_OK)
+            {
+                cerr << "curl multi error: " << curl_multi_strerror(mc) << endl;
+                transfer->failure = CURLE_FAILED_INIT;
+                curl_multi_remove_handle(localMulti, transfer->curlHandle);
+                detachSegments();
+                finish();
+                break;
+            }
+
+            CURLMsg *msg;
+            int queued;
+            while ((msg = curl_multi_info_read(localMulti, &queued)) != NULL)
+            {
+                if (msg->msg == CURLMSG_DONE)
+                {
+                    onHandleDone(msg->easy_handle, msg->data.result);
+                }
+            }
+        }
     }
-    
-    if (dltotal > 0)
+
+    releaseSlot();
+    curl_multi_cleanup(localMulti);
+}
+
+const string &DownloadTask::getUrl() const
+{
+    return url;
+}
+
+TaskId DownloadTask::getId() const
+{
+    return id;
+}
+
+void DownloadTask::setRegistry(TaskRegistry *registry, TaskId id)
+{
+    this->registry = registry;
+    this->id = id;
+}
+
+void DownloadTask::setCompletionCallback(const CompletionCallback &callback)
+{
+    completionCallback = callback;
+}
+
+shared_future<DownloadResult> DownloadTask::getFuture()
+{
+    lock_guard<mutex> lock(statsMutex);
+    if (!completion)
     {
-        double progress = static_cast<double>(dlnow) / static_cast<double>(dltotal);
-        task->updateProgress(progress); // Update internal progress
-        
-        string url = task->getUrl();
-        string filename = url.substr(url.find_last_of('/') + 1);
-        
-        lock_guard<mutex> lock(progress_mutex);
-        
-        // Show progress every 10%
-        int percentage = static_cast<int>(progress * 100);
-        static int last_percentage = -1;
-        
-        if (percentage != last_percentage && (percentage % 10 == 0 || percentage == 100))
+        // Most tasks are never asked, so the shared state is only made on demand
+        completion.reset(new promise<DownloadResult>());
+        completionFuture = completion->get_future().share();
+        if (completionSet)
         {
-            cout << "[" << filename << "] " << percentage << "% downloaded ("
-                 << dlnow / 1024 << " KB / " << dltotal / 1024 << " KB)" << endl;
-            last_percentage = percentage;
+            completion->set_value(makeResult(completedAs, lastError));
         }
     }
-    
-    return 0;
+    return completionFuture;
 }
 
-DownloadTask::DownloadTask(const string &url, const string &destination)
-    : url(url), destinationPath(destination), status(DownloadStatus::Pending), progress(0.0f)
+DownloadResult DownloadTask::makeResult(DownloadStatus outcome, int error) const
 {
-    writer = new FileWriter(destinationPath);
-    curlHandle = curl_easy_init();
-    
-    if (!curlHandle)
+    DownloadResult result;
+    result.id = id;
+    result.url = url;
+    result.destination = destinationPath;
+    result.status = outcome;
+    result.size = totalSize;
+    result.error = (outcome == DownloadStatus::Failed) ? error : 0;
+    result.httpStatus = (outcome == DownloadStatus::Failed) ? lastHttpStatus : 0;
+    result.retryAfter = (outcome == DownloadStatus::Failed) ? lastRetryAfter : 0;
+    return result;
+}
+
+// True when the handle got an HTTP error answer; the first one of the attempt is kept
+// so a retry policy can tell a 404 from a 503
+bool DownloadTask::noteHttpError(CURL *handle)
+{
+    long responseCode = 0;
+    curl_easy_getinfo(handle, CURLINFO_RESPONSE_CODE, &responseCode);
+    if (responseCode < 400)
+    {
+        return false;
+    }
+    if (transfer->httpStatus == 0)
     {
-        cerr << "Failed to initialize CURL handle" << endl;
-        status = DownloadStatus::Failed;
+        transfer->httpStatus = responseCode;
+        curl_off_t retryAfter = 0;
+        curl_easy_getinfo(handle, CURLINFO_RETRY_AFTER, &retryAfter);
+        transfer->retryAfter = retryAfter;
     }
+    return true;
 }
 
-void DownloadTask::start()
+void DownloadTask::setAwaitingRetry(bool waiting)
 {
-    string filename = url.substr(url.find_last_of('/') + 1);
-    cout << "\n[STARTING] " << filename << "\n";
-    
-    status = DownloadStatus::Downloading;
-    progress = 0.0f;
+    lock_guard<mutex> lock(statsMutex);
+    awaitingRetry = waiting;
+}
+
+bool DownloadTask::isAwaitingRetry()
+{
+    lock_guard<mutex> lock(statsMutex);
+    return awaitingRetry;
+}
+
+DownloadResult DownloadTask::getResult()
+{
+    lock_guard<mutex> lock(statsMutex);
+    return makeResult(status, lastError);
+}
 
-    if (!curlHandle)
+// Runs after every move to Completed, Failed or Cancelled, once the index knows about it
+void DownloadTask::complete(DownloadStatus outcome)
+{
+    DownloadResult result;
     {
-        status = DownloadStatus::Failed;
-        cout << "\n[FAILED] " << filename << " - CURL handle not initialized\n";
-        return;
+        lock_guard<mutex> lock(statsMutex);
+        if (outcome == DownloadStatus::Failed && awaitingRetry)
+        {
+            return;
+        }
+        result = makeResult(outcome, lastError); // The task may already be on its way to a retry
+        if (!completionSet)
+        {
+            completionSet = true;
+            completedAs = outcome;
+            if (completion)
+            {
+                completion->set_value(result);
+            }
+        }
+    }
+    if (completionCallback)
+    {
+        completionCallback(result);
     }
+}
 
-    // Set CURL options
-    curl_easy_setopt(curlHandle, CURLOPT_URL, url.c_str());
-    curl_easy_setopt(curlHandle, CURLOPT_WRITEFUNCTION, write_data);
-    curl_easy_setopt(curlHandle, CURLOPT_WRITEDATA, this);
-    curl_easy_setopt(curlHandle, CURLOPT_NOPROGRESS, 0L);
-    curl_easy_setopt(curlHandle, CURLOPT_XFERINFOFUNCTION, progress_callback);
-    curl_easy_setopt(curlHandle, CURLOPT_XFERINFODATA, this);
-    curl_easy_setopt(curlHandle, CURLOPT_FOLLOWLOCATION, 1L);
-    curl_easy_setopt(curlHandle, CURLOPT_SSL_VERIFYPEER, 0L); // For HTTPS
-    curl_easy_setopt(curlHandle, CURLOPT_SSL_VERIFYHOST, 0L);
-    curl_easy_setopt(curlHandle, CURLOPT_USERAGENT, "Mozilla/5.0");
-    
-    // Perform the download
-    CURLcode res = curl_easy_perform(curlHandle);
-    
-    // Close and flush the file
-    writer->close();
-    
-    if (res == CURLE_OK)
+// Origins are shared by many tasks and live as long as the process
+static const string *internOrigin(const string &origin)
+{
+    static mutex internMutex;
+    static unordered_set<string> origins;
+    lock_guard<mutex> lock(internMutex);
+    return &*origins.insert(origin).first;
+}
+
+const string &DownloadTask::getOrigin() const
+{
+    const string *interned = origin.load(memory_order_acquire);
+    if (interned)
     {
-        status = DownloadStatus::Completed;
-        progress = 1.0f;
-        cout << "\n[COMPLETED] " << filename << " - Download finished successfully!\n";
+        return *interned;
     }
-    else
+
+    string parsedOrigin = url;
+    CURLU *parsed = curl_url();
+    char *scheme = NULL;
+    char *host = NULL;
+    char *port = NULL;
+    if (parsed && curl_url_set(parsed, CURLUPART_URL, url.c_str(), CURLU_GUESS_SCHEME) == CURLUE_OK &&
+        curl_url_get(parsed, CURLUPART_SCHEME, &scheme, 0) == CURLUE_OK &&
+        curl_url_get(parsed, CURLUPART_HOST, &host, 0) == CURLUE_OK &&
+        curl_url_get(parsed, CURLUPART_PORT, &port, CURLU_DEFAULT_PORT) == CURLUE_OK)
+    {
+        parsedOrigin = string(scheme) + "://" + host + ":" + port;
+    }
+    curl_free(scheme);
+    curl_free(host);
+    curl_free(port);
+    curl_url_cleanup(parsed);
+
+    // Racing callers intern the same string, so either store is fine
+    interned = internOrigin(parsedOrigin);
+    origin.store(interned, memory_order_release);
+    return *interned;
+}
+
+size_t DownloadTask::getMaxConnections() const
+{
+    return (options.segmentCount > 1 && !options.multiplex) ? options.segmentCount : 1;
+}
+
+void DownloadTask::setSegmentCount(size_t count)
+{
+    if (!options.multiplex)
     {
-        status = DownloadStatus::Failed;
-        cout << "\n[FAILED] " << filename << " - Error: " << curl_easy_strerror(res) << "\n";
+        options.segmentCount = (count > 0) ? count : 1;
     }
 }
 
-string DownloadTask::getUrl() const
+bool DownloadTask::setChecksum(const string &digest)
 {
-    return url;
+    ExpectedDigest parsed;
+    if (!digest.empty() && !ExpectedDigest::parse(digest, parsed))
+    {
+        return false;
+    }
+    lock_guard<mutex> lock(statsMutex);
+    checksum = digest;
+    return true;
+}
+
+void DownloadTask::setExpectedSize(long long bytes)
+{
+    expectedSize = (bytes >= 0) ? bytes : -1;
+}
+
+string DownloadTask::errorText(int error)
+{
+    if (error == CHECKSUM_MISMATCH)
+    {
+        return "Downloaded data does not match the expected checksum";
+    }
+    if (error == HOST_UNAVAILABLE)
+    {
+        return "Host keeps failing; waiting for it to recover";
+    }
+    if (error == SIZE_MISMATCH)
+    {
+        return "Server file size differs from the expected size";
+    }
+    if (error == UNKNOWN_TASK)
+    {
+        return "No download has this ID";
+    }
+    return curl_easy_strerror(static_cast<CURLcode>(error));
 }
 
 bool DownloadTask::getStartCommand() const
@@ -134,24 +1508,52 @@ bool DownloadTask::getStartCommand() const
     return (status == DownloadStatus::Starting);
 }
 
-void DownloadTask::setStartCommand()
+bool DownloadTask::setStartCommand()
 {
-    if (status == DownloadStatus::Pending || status == DownloadStatus::Failed)
+    DownloadStatus expected = DownloadStatus::Pending;
+    if (status.compare_exchange_strong(expected, DownloadStatus::Starting))
     {
-        status = DownloadStatus::Starting;
+        recordTransition(expected, DownloadStatus::Starting);
+        return true;
     }
-    else
+    for (DownloadStatus from : {DownloadStatus::Failed, DownloadStatus::Cancelled})
+    {
+        expected = from;
+        if (status.compare_exchange_strong(expected, DownloadStatus::Starting))
+        {
+            recordTransition(expected, DownloadStatus::Starting);
+            return true;
+        }
+    }
+
+    cout << "Download is already in progress or completed" << endl;
+    return false;
+}
+
+void DownloadTask::reject(int error)
+{
+    {
+        lock_guard<mutex> lock(statsMutex);
+        lastError = error;
+        lastHttpStatus = 0;
+        lastRetryAfter = 0;
+    }
+    DownloadStatus expected = DownloadStatus::Starting;
+    if (status.compare_exchange_strong(expected, DownloadStatus::Failed))
     {
-        cout << "Download is already in progress or completed" << endl;
+        string filename = url.substr(url.find_last_of('/') + 1);
+        cout << "\n[FAILED] " << filename << " - Error: " << errorText(error) << "\n";
+        recordTransition(expected, DownloadStatus::Failed);
     }
 }
 
 void DownloadTask::pause()
 {
+    lock_guard<mutex> lock(stateMutex);
     if (status == DownloadStatus::Downloading)
     {
-        status = DownloadStatus::Paused;
-        cout << "Download paused (note: current transfer will complete first)" << endl;
+        setStatus(DownloadStatus::Paused);
+        cout << "Download paused (connection released, resume continues from the bytes on disk)" << endl;
     }
     else
     {
@@ -159,26 +1561,311 @@ void DownloadTask::pause()
     }
 }
 
-void DownloadTask::resume()
+bool DownloadTask::resume()
 {
+    lock_guard<mutex> lock(stateMutex);
     if (status != DownloadStatus::Paused)
     {
         cout << "Download is not paused" << endl;
+        return false;
+    }
+
+    cout << "Download resumed" << endl;
+    if (pausedDetached)
+    {
+        pausedDetached = false;
+        resumeRequested = true;
+        setStatus(DownloadStatus::Starting);
+        return true;
+    }
+
+    // Still connected: the progress callback simply keeps going
+    setStatus(DownloadStatus::Downloading);
+    return false;
+}
+
+// Polled from the progress callback on the transfer thread
+bool DownloadTask::shouldStop()
+{
+    DownloadStatus current = status;
+    if (current == DownloadStatus::Paused)
+    {
+        pausedByCallback = true;
+        return true;
+    }
+    return current == DownloadStatus::Failed || current == DownloadStatus::Cancelled;
+}
+
+// Sync the file and rewrite the journal; rate limited unless forced. The
+// periodic checkpoint runs on the transfer thread, so it only snapshots the
+// bytes already in the file and leaves fdatasync and the journal write to the
+// syncer; forced ones (pause, failure, end) flush everything and block.
+void DownloadTask::checkpoint(bool force)
+{
+    if (!transfer || !transfer->rangesSupported || transfer->segments.empty() || !transfer->writer.isOpen())
+    {
         return;
     }
-    else
+    auto now = chrono::steady_clock::now();
+    if (!force && now - transfer->lastCheckpoint < CHECKPOINT_INTERVAL)
+    {
+        return;
+    }
+    transfer->lastCheckpoint = now;
+
+    // Forced, or with nowhere to hand the sync: flush and sync here. Data must be durable before the journal claims it
+    int descriptor = (!force && syncer) ? transfer->writer.duplicateDescriptor() : -1;
+    if (descriptor < 0)
+    {
+        if (syncer)
+        {
+            syncer->wait(transfer.get()); // An older checkpoint must not land after this one
+        }
+        if (!flushSegments() || !transfer->writer.sync())
+        {
+            return;
+        }
+    }
+
+    transfer->journal.url = url;
+    transfer->journal.totalSize = totalSize;
+    transfer->journal.etag = transfer->probeResult.etag;
+    transfer->journal.lastModified = transfer->probeResult.lastModified;
+    transfer->journal.ranges.clear();
+    for (const auto &segment : transfer->segments)
+    {
+        long long done = segment.received;
+        if (descriptor >= 0)
+        {
+            long long received = segment.begin + segment.received;
+            done = transfer->writer.writtenUpTo(segment.buffer, segment.begin, received) - segment.begin;
+        }
+        transfer->journal.ranges.push_back({segment.begin, segment.end, done});
+    }
+    if (descriptor >= 0)
     {
-        status = DownloadStatus::Downloading;
-        cout << "Download resumed" << endl;
+        syncer->submit(transfer.get(), descriptor, transfer->journal);
+        return;
     }
+    transfer->journal.save();
 }
 
 void DownloadTask::cancel()
 {
-    status = DownloadStatus::Failed;
+    lock_guard<mutex> lock(stateMutex);
+    DownloadStatus current = status;
+    if (current == DownloadStatus::Completed || current == DownloadStatus::Cancelled)
+    {
+        cout << "Download is already finished" << endl;
+        return;
+    }
+    // A detached pause keeps its transfer: the next attach() replaces it on its driver, else the destructor frees it
+    setStatus(DownloadStatus::Cancelled);
+    pausedDetached = false;
     cout << "Download cancelled" << endl;
 }
 
+void DownloadTask::setRateLimit(long long bytesPerSecond)
+{
+    if (scheduler)
+    {
+        scheduler->setFlowRate(flow, bytesPerSecond);
+    }
+}
+
+void DownloadTask::setPriority(TransferPriority priority)
+{
+    if (scheduler)
+    {
+        scheduler->setFlowPriority(flow, priority);
+    }
+}
+
+long long DownloadTask::requestBandwidth(size_t bytes)
+{
+    return scheduler ? scheduler->request(flow, bytes) : 0;
+}
+
+void DownloadTask::reportDelivered(size_t bytes)
+{
+    deliveredBytes.fetch_add(static_cast<long long>(bytes), memory_order_relaxed);
+    if (metrics)
+    {
+        metrics->add(TransferMetrics::Bytes, bytes);
+    }
+}
+
+void DownloadTask::recordEvent(TransferMetrics::Counter counter)
+{
+    if (metrics)
+    {
+        metrics->add(counter);
+    }
+}
+
+bool DownloadTask::onProgress()
+{
+    if (shouldStop())
+    {
+        return true;
+    }
+    checkpoint();
+    sampleRate();
+    publishProgress();
+    return false;
+}
+
+void DownloadTask::publishProgress()
+{
+    curl_off_t received = countReceived();
+    receivedBytes.store(received, memory_order_relaxed);
+    curl_off_t total = totalSize;
+    if (total > 0)
+    {
+        progress.store(static_cast<float>(static_cast<double>(received) / total), memory_order_relaxed);
+    }
+}
+
+void DownloadTask::sampleRate()
+{
+    auto now = chrono::steady_clock::now();
+    if (now - transfer->rateSampledAt < RATE_INTERVAL)
+    {
+        return;
+    }
+    long long bytes = deliveredBytes.load(memory_order_relaxed);
+    // After a pause the old sample would average over the gap
+    if (now - transfer->rateSampledAt < RATE_INTERVAL * 4)
+    {
+        double seconds = chrono::duration<double>(now - transfer->rateSampledAt).count();
+        rate.store((bytes - transfer->rateBytes) / seconds, memory_order_relaxed);
+    }
+    transfer->rateSampledAt = now;
+    transfer->rateBytes = bytes;
+}
+
+void DownloadTask::setStatus(DownloadStatus next)
+{
+    DownloadStatus previous = status.exchange(next);
+    if (previous != next)
+    {
+        recordTransition(previous, next);
+    }
+}
+
+// Time in the old status, queue wait, retries and outcomes, per task and in the shared metrics
+void DownloadTask::recordTransition(DownloadStatus from, DownloadStatus to)
+{
+    auto now = chrono::steady_clock::now();
+    auto since = now;
+    long long micros;
+    long long downloadingMicros;
+    {
+        lock_guard<mutex> lock(statsMutex);
+        since = statusSince;
+        micros = chrono::duration_cast<chrono::microseconds>(now - statusSince).count();
+        statusSince = now;
+        statusMicros[static_cast<int>(from)] += micros;
+        downloadingMicros = statusMicros[static_cast<int>(DownloadStatus::Downloading)];
+        if (from == DownloadStatus::Starting && to == DownloadStatus::Downloading)
+        {
+            queueWaitMicros = micros;
+        }
+        if (from == DownloadStatus::Failed && to == DownloadStatus::Starting)
+        {
+            ++retries;
+        }
+        if (to != DownloadStatus::Failed)
+        {
+            awaitingRetry = false;
+        }
+    }
+    if (to != DownloadStatus::Downloading)
+    {
+        rate.store(0, memory_order_relaxed);
+    }
+    if (metrics)
+    {
+        metrics->recordStatusTime(static_cast<int>(from), micros);
+        if (from == DownloadStatus::Starting && to == DownloadStatus::Downloading)
+        {
+            metrics->observe(TransferMetrics::QueueWait, micros);
+        }
+        if (to == DownloadStatus::Starting)
+        {
+            if (from == DownloadStatus::Pending)
+            {
+                metrics->add(TransferMetrics::Started);
+            }
+            else if (from == DownloadStatus::Failed)
+            {
+                metrics->add(TransferMetrics::Retries);
+            }
+        }
+        else if (to == DownloadStatus::Completed)
+        {
+            metrics->add(TransferMetrics::Completed);
+            metrics->observe(TransferMetrics::TransferTime, downloadingMicros);
+        }
+        else if (to == DownloadStatus::Failed)
+        {
+            metrics->add(TransferMetrics::Failed);
+        }
+        else if (to == DownloadStatus::Cancelled)
+        {
+            metrics->add(TransferMetrics::Cancelled);
+        }
+    }
+
+    if (trace && trace->enabled())
+    {
+        // The status track shows how long each status lasted; final ones are marked where they begin
+        trace->span(TRACE_STATUS[static_cast<int>(from)], "status", id, TraceRecorder::LIFECYCLE, trace->toMicros(since),
+                    trace->toMicros(now));
+        if (to == DownloadStatus::Completed || to == DownloadStatus::Failed || to == DownloadStatus::Cancelled)
+        {
+            trace->instant(TRACE_STATUS[static_cast<int>(to)], "status", id, TraceRecorder::LIFECYCLE);
+        }
+    }
+
+    // Index first, so a woken waiter sees the new status everywhere
+    if (registry)
+    {
+        registry->statusChanged(id);
+    }
+    if (to == DownloadStatus::Completed || to == DownloadStatus::Failed || to == DownloadStatus::Cancelled)
+    {
+        complete(to);
+    }
+}
+
+TaskStats DownloadTask::getStats()
+{
+    TaskStats stats;
+    stats.id = id;
+    stats.url = url;
+    stats.status = status;
+    stats.bytes = deliveredBytes.load(memory_order_relaxed);
+    stats.totalSize = totalSize;
+    stats.throughput = (stats.status == DownloadStatus::Downloading) ? rate.load(memory_order_relaxed) : 0;
+    stats.firstByteMs = firstByteMicros / 1000.0;
+
+    lock_guard<mutex> lock(statsMutex);
+    // Include the time spent so far in the current status
+    long long current = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - statusSince).count();
+    for (int i = 0; i < TransferMetrics::STATUS_COUNT; ++i)
+    {
+        long long micros = statusMicros[i] + (i == static_cast<int>(stats.status) ? current : 0);
+        stats.statusSeconds[i] = micros / 1e6;
+    }
+    double downloading = stats.statusSeconds[static_cast<int>(DownloadStatus::Downloading)];
+    stats.averageThroughput = (downloading > 0) ? stats.bytes / downloading : 0;
+    stats.queueWaitMs = queueWaitMicros / 1000.0;
+    stats.retries = retries;
+    stats.lastError = lastError;
+    return stats;
+}
+
 DownloadStatus DownloadTask::getStatus() const
 {
     return status;
@@ -194,11 +1881,43 @@ void DownloadTask::updateProgress(float newProgress)
     progress = newProgress;
 }
 
+curl_off_t DownloadTask::getTotalSize() const
+{
+    return totalSize;
+}
+
+curl_off_t DownloadTask::getReceivedBytes() const
+{
+    return receivedBytes.load(memory_order_relaxed);
+}
+
+// Transfer thread only: the segments change under any other thread
+curl_off_t DownloadTask::countReceived() const
+{
+    curl_off_t received = 0;
+    if (!transfer)
+    {
+        return received;
+    }
+    for (const auto &segment : transfer->segments)
+    {
+        received += segment.received;
+    }
+    return received;
+}
+
 DownloadTask::~DownloadTask()
 {
-    if (curlHandle)
+    releaseHandles();
+    if (transfer)
+    {
+        for (auto &segment : transfer->segments)
+        {
+            transfer->writer.release(segment.buffer);
+        }
+    }
+    if (scheduler)
     {
-        curl_easy_cleanup(curlHandle);
+        scheduler->removeFlow(flow);
     }
-    delete writer;
-}
\ No newline at end of file
+}
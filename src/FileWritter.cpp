@@ -2,55 +2,783 @@
 
 // FileWriter.cpp
 #include "FileWritter.hpp"
+#include "TraceRecorder.hpp"
+#include "BufferPool.hpp"
 #include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <chrono>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <malloc.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef DM_WITH_IO_URING
+#include "UringBackend.hpp"
+#endif
 
 using namespace std;
 
+static bool isAligned(long long value)
+{
+    return value % static_cast<long long>(FileWriter::ALIGNMENT) == 0;
+}
+
 FileWriter::FileWriter(const string &filePath)
+    : path(filePath), position(0), bufferSize(1024 * 1024), directIoThreshold(0), mappedThreshold(0), writeCalls(0), bytesWritten(0),
+      pool(NULL), trace(NULL), traceTask(0)
+{
+#ifdef _WIN32
+    fileHandle = NULL;
+#else
+    fileDescriptor = -1;
+    directDescriptor = -1;
+    mapDescriptor = -1;
+    mappedSize = 0;
+#endif
+#ifdef DM_WITH_IO_URING
+    backend = NULL;
+    inFlight = 0;
+    asyncFailed = false;
+#endif
+}
+
+void FileWriter::setBufferSize(size_t bytes)
+{
+    // Whole alignment units so full buffers stay valid for O_DIRECT
+    bufferSize = (bytes + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+    if (bufferSize == 0)
+    {
+        bufferSize = ALIGNMENT;
+    }
+}
+
+void FileWriter::setDirectIoThreshold(long long bytes)
+{
+    directIoThreshold = bytes;
+}
+
+void FileWriter::setMappedThreshold(long long bytes)
+{
+    mappedThreshold = bytes;
+}
+
+void FileWriter::setBufferPool(BufferPool *buffers)
+{
+    pool = (buffers && buffers->enabled()) ? buffers : NULL;
+}
+
+void FileWriter::setTrace(TraceRecorder *recorder, unsigned long long task)
+{
+    trace = recorder;
+    traceTask = task;
+}
+
+bool FileWriter::open(bool truncate)
 {
-    fileStream.open(filePath, ofstream::out | ofstream::binary | ofstream::trunc);
-    if (!fileStream.is_open())
+    close();
+    position = 0;
+#ifdef _WIN32
+    HANDLE handle = CreateFileA(path.c_str(), GENERIC_WRITE, FILE_SHARE_READ, NULL,
+                                truncate ? CREATE_ALWAYS : OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    fileHandle = (handle == INVALID_HANDLE_VALUE) ? NULL : handle;
+#else
+    // A file linked elsewhere (e.g. a content cache blob) is replaced rather than truncated under the other name
+    struct stat existing;
+    if (truncate && ::stat(path.c_str(), &existing) == 0 && existing.st_nlink > 1)
     {
-        cerr << "Failed to open file: " << filePath << endl;
+        ::unlink(path.c_str());
     }
+    fileDescriptor = ::open(path.c_str(), O_WRONLY | O_CREAT | (truncate ? O_TRUNC : 0), 0644);
+#endif
+    if (!isOpen())
+    {
+        cerr << "Failed to open file: " << path << endl;
+        return false;
+    }
+#ifdef DM_WITH_IO_URING
+    backend = UringBackend::current();
+    asyncFailed = false;
+#endif
+    return true;
 }
 
 FileWriter::~FileWriter()
 {
-    if (fileStream.is_open())
+    close();
+}
+
+bool FileWriter::isOpen() const
+{
+#ifdef _WIN32
+    return fileHandle != NULL;
+#else
+    return fileDescriptor >= 0;
+#endif
+}
+
+// Reserve the blocks up front so the file does not fragment while ranges fill in
+bool FileWriter::preallocate(long long size)
+{
+    if (!isOpen())
+    {
+        return false;
+    }
+#ifdef _WIN32
+    LARGE_INTEGER distance;
+    distance.QuadPart = size;
+    return SetFilePointerEx(fileHandle, distance, NULL, FILE_BEGIN) && SetEndOfFile(fileHandle);
+#else
+    bool allocated = false;
+#ifdef __linux__
+    allocated = fallocate(fileDescriptor, 0, 0, size) == 0;
+#endif
+    if (!allocated && ftruncate(fileDescriptor, size) != 0)
     {
-        fileStream.flush(); // CRITICAL: Flush before closing
-        fileStream.close();
+        return false;
     }
+
+#ifdef O_DIRECT
+    // Very large files bypass the page cache so they do not evict everything else
+    if (directIoThreshold > 0 && size >= directIoThreshold && directDescriptor < 0)
+    {
+        directDescriptor = ::open(path.c_str(), O_WRONLY | O_DIRECT);
+    }
+#endif
+
+    // Large files take the ranges' data straight into a mapping of the file, but only with the blocks
+    // really reserved: storing into a hole the disk cannot fill raises SIGBUS instead of failing a write
+    bool mappable = allocated && mappedThreshold > 0 && size >= mappedThreshold && directDescriptor < 0;
+#ifdef DM_WITH_IO_URING
+    mappable = mappable && !backend;
+#endif
+    if (mappable && mapDescriptor < 0)
+    {
+        mapDescriptor = ::open(path.c_str(), O_RDWR);
+        mappedSize = size;
+    }
+    return true;
+#endif
 }
 
 int FileWriter::write(char *data, int size)
 {
-    if (!fileStream.is_open() || !fileStream.good())
+    lock_guard<mutex> lock(positionMutex);
+    int written = writeAt(position, data, size);
+    position += written;
+    return written;
+}
+
+int FileWriter::writeAt(long long offset, const char *data, int size)
+{
+    if (!isOpen())
     {
-        cerr << "File not opened or stream is bad" << endl;
+        cerr << "File not opened" << endl;
         return 0; // Return 0 to tell curl to abort
     }
-    
-    fileStream.write(data, size);
-    
-    if (fileStream.fail())
+
+    long long began = (trace && trace->enabled()) ? trace->now() : -1;
+    int total = 0;
+    while (total < size)
     {
-        cerr << "Error writing to file" << endl;
-        return 0; // Return 0 to tell curl to abort
+        ++writeCalls;
+#ifdef _WIN32
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = static_cast<DWORD>((offset + total) & 0xFFFFFFFF);
+        overlapped.OffsetHigh = static_cast<DWORD>((offset + total) >> 32);
+        DWORD done = 0;
+        if (!WriteFile(fileHandle, data + total, size - total, &done, &overlapped))
+        {
+            cerr << "Error writing to file" << endl;
+            return total;
+        }
+#else
+        // O_DIRECT only takes aligned memory, offsets and lengths; the rest goes through the cache
+        int descriptor = fileDescriptor;
+        if (directDescriptor >= 0 && isAligned(offset + total) && isAligned(size - total) &&
+            isAligned(reinterpret_cast<uintptr_t>(data + total)))
+        {
+            descriptor = directDescriptor;
+        }
+        ssize_t done = pwrite(descriptor, data + total, size - total, offset + total);
+        if (done < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (done < 0)
+        {
+            cerr << "Error writing to file" << endl;
+            return total;
+        }
+#endif
+        total += static_cast<int>(done);
+    }
+
+    bytesWritten += total;
+    if (began >= 0)
+    {
+        trace->span("write", "disk", traceTask, TraceRecorder::THREAD, began, trace->now(), total);
+    }
+    return total; // Return actual bytes written
+}
+
+void FileWriter::prepare(WriteBuffer &buffer, long long expectedBytes)
+{
+    release(buffer);
+    buffer.capacity = bufferSize;
+    if (expectedBytes >= 0 && static_cast<unsigned long long>(expectedBytes) < bufferSize)
+    {
+        // Small ranges do not need a full-size buffer
+        buffer.capacity = static_cast<size_t>((expectedBytes + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT);
+        if (buffer.capacity == 0)
+        {
+            buffer.capacity = ALIGNMENT;
+        }
+    }
+    if (pool && buffer.capacity > pool->getBufferSize())
+    {
+        buffer.capacity = pool->getBufferSize();
+    }
+    buffer.remaining = expectedBytes;
+}
+
+// Gather data for the range; it reaches the file when the buffer is full,
+// when a non-contiguous offset arrives or on flush()
+int FileWriter::append(WriteBuffer &buffer, long long offset, const char *data, int size)
+{
+#ifndef _WIN32
+    if (mapDescriptor >= 0)
+    {
+        return appendMapped(buffer, offset, data, size);
+    }
+#endif
+#ifdef DM_WITH_IO_URING
+    if (backend)
+    {
+        return appendAsync(buffer, offset, data, size);
+    }
+#endif
+    if (buffer.capacity == 0)
+    {
+        buffer.capacity = (pool && pool->getBufferSize() < bufferSize) ? pool->getBufferSize() : bufferSize;
+    }
+    if (buffer.used > 0 && offset != buffer.offset + static_cast<long long>(buffer.used))
+    {
+        if (!flush(buffer))
+        {
+            return 0;
+        }
+    }
+
+    // Data that would fill the buffer anyway, or that ends the range, needs no staging
+    if (buffer.used == 0 && (static_cast<size_t>(size) >= buffer.capacity || size == buffer.remaining))
+    {
+        int written = writeAt(offset, data, size);
+        if (written != size)
+        {
+            return 0;
+        }
+        if (buffer.remaining > 0)
+        {
+            buffer.remaining -= size;
+        }
+        returnToPool(buffer);
+        return size;
+    }
+
+    if (!buffer.data && pool && pool->enabled())
+    {
+        buffer.data = pool->acquire(buffer.poolIndex);
+        if (!buffer.data || buffer.stalledSince > 0)
+        {
+            long long now = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+            if (!buffer.data)
+            {
+                // Nothing consumed: curl hands over the same data once the transfer is unpaused
+                buffer.stalledSince = (buffer.stalledSince > 0) ? buffer.stalledSince : now;
+                return POOL_EXHAUSTED;
+            }
+            pool->recordStall(now - buffer.stalledSince);
+            buffer.stalledSince = 0;
+        }
+    }
+    if (!buffer.data)
+    {
+#ifdef _WIN32
+        buffer.data = static_cast<char *>(_aligned_malloc(buffer.capacity, ALIGNMENT));
+#else
+        void *memory = NULL;
+        buffer.data = (posix_memalign(&memory, ALIGNMENT, buffer.capacity) == 0) ? static_cast<char *>(memory) : NULL;
+#endif
+        if (!buffer.data)
+        {
+            return writeAt(offset, data, size); // Out of memory: fall back to direct writes
+        }
+    }
+    if (buffer.used == 0)
+    {
+        buffer.offset = offset;
+    }
+
+    int copied = 0;
+    while (copied < size)
+    {
+        size_t room = buffer.capacity - buffer.used;
+        size_t chunk = (static_cast<size_t>(size - copied) < room) ? static_cast<size_t>(size - copied) : room;
+        memcpy(buffer.data + buffer.used, data + copied, chunk);
+        buffer.used += chunk;
+        copied += static_cast<int>(chunk);
+        if (buffer.used == buffer.capacity && !flush(buffer))
+        {
+            return 0;
+        }
+    }
+    if (buffer.remaining > 0)
+    {
+        buffer.remaining -= size;
+    }
+    // A complete range writes its tail now rather than hold a buffer until the whole file is done
+    if (buffer.remaining == 0 && !flush(buffer))
+    {
+        return 0;
+    }
+    if (buffer.used == 0)
+    {
+        returnToPool(buffer); // Only partly filled buffers stay out between callbacks
+    }
+    return size;
+}
+
+void FileWriter::returnToPool(WriteBuffer &buffer)
+{
+    if (buffer.data && pool && buffer.poolIndex >= 0)
+    {
+        pool->release(buffer.poolIndex);
+        buffer.data = NULL;
+        buffer.poolIndex = -1;
+    }
+}
+
+bool FileWriter::flush(WriteBuffer &buffer)
+{
+    if (buffer.mapped)
+    {
+        return true; // Mapped bytes are in the page cache already, as after a write
+    }
+#ifdef DM_WITH_IO_URING
+    if (backend)
+    {
+        // Hand the tail to the ring, then wait for everything this file has queued
+        bool submitted = buffer.used == 0 || submit(buffer);
+        drain();
+        return submitted && !asyncFailed;
+    }
+#endif
+    if (buffer.used == 0)
+    {
+        return true;
+    }
+    int written = writeAt(buffer.offset, buffer.data, static_cast<int>(buffer.used));
+    if (written != static_cast<int>(buffer.used))
+    {
+        return false;
+    }
+    buffer.offset += buffer.used;
+    buffer.used = 0;
+    return true;
+}
+
+void FileWriter::release(WriteBuffer &buffer)
+{
+#ifndef _WIN32
+    if (buffer.mapped)
+    {
+        unmapWindow(buffer);
+        return;
+    }
+#endif
+    if (buffer.poolIndex >= 0)
+    {
+#ifdef DM_WITH_IO_URING
+        if (backend)
+        {
+            backend->releaseBuffer(buffer.poolIndex);
+            buffer = WriteBuffer();
+            return;
+        }
+#endif
+        returnToPool(buffer);
+    }
+    if (buffer.data)
+    {
+#ifdef _WIN32
+        _aligned_free(buffer.data);
+#else
+        free(buffer.data);
+#endif
     }
-    
-    // Flush periodically to ensure data is written
-    fileStream.flush();
-    
-    return size; // Return actual bytes written
+    buffer = WriteBuffer();
+}
+
+// Push written data to the disk itself, not just the OS cache
+bool FileWriter::sync()
+{
+    if (!isOpen())
+    {
+        return false;
+    }
+#ifdef DM_WITH_IO_URING
+    drain();
+#endif
+    long long began = (trace && trace->enabled()) ? trace->now() : -1;
+#ifdef _WIN32
+    bool synced = FlushFileBuffers(fileHandle) != 0;
+#elif defined(__linux__)
+    bool synced = fdatasync(fileDescriptor) == 0; // Also writes back pages stored through mapped windows
+#else
+    bool synced = fsync(fileDescriptor) == 0;
+#endif
+    if (began >= 0)
+    {
+        trace->span("sync", "disk", traceTask, TraceRecorder::THREAD, began, trace->now());
+    }
+    return synced;
+}
+
+// A descriptor another thread can sync after this writer has moved on or closed the file
+int FileWriter::duplicateDescriptor()
+{
+#ifdef _WIN32
+    return -1;
+#else
+    return (fileDescriptor >= 0) ? dup(fileDescriptor) : -1;
+#endif
+}
+
+bool FileWriter::syncDescriptor(int descriptor)
+{
+#ifdef _WIN32
+    (void)descriptor;
+    return false;
+#elif defined(__linux__)
+    return fdatasync(descriptor) == 0;
+#else
+    return fsync(descriptor) == 0;
+#endif
+}
+
+void FileWriter::closeDescriptor(int descriptor)
+{
+#ifndef _WIN32
+    if (descriptor >= 0)
+    {
+        ::close(descriptor);
+    }
+#else
+    (void)descriptor;
+#endif
+}
+
+// Bytes still gathered in the buffer or queued on the ring have not reached the file
+long long FileWriter::writtenUpTo(const WriteBuffer &buffer, long long begin, long long end)
+{
+    long long written = end;
+    if (!buffer.mapped && buffer.used > 0 && buffer.offset >= begin && buffer.offset < written)
+    {
+        written = buffer.offset;
+    }
+#ifdef DM_WITH_IO_URING
+    if (backend && inFlight > 0)
+    {
+        written = backend->firstPending(this, begin, written);
+    }
+#endif
+    return written;
 }
 
 void FileWriter::close()
 {
-    if (fileStream.is_open())
+#ifdef DM_WITH_IO_URING
+    drain(); // The ring must not write into a closed or reused descriptor
+#endif
+#ifdef _WIN32
+    if (fileHandle != NULL)
+    {
+        CloseHandle(fileHandle);
+        fileHandle = NULL;
+    }
+#else
+    if (directDescriptor >= 0)
+    {
+        ::close(directDescriptor);
+        directDescriptor = -1;
+    }
+    if (mapDescriptor >= 0)
+    {
+        ::close(mapDescriptor); // Windows are released with their buffers first
+        mapDescriptor = -1;
+        mappedSize = 0;
+    }
+    if (fileDescriptor >= 0)
+    {
+        ::close(fileDescriptor);
+        fileDescriptor = -1;
+    }
+#endif
+}
+
+unsigned long long FileWriter::getWriteCalls() const
+{
+    return writeCalls;
+}
+
+unsigned long long FileWriter::getBytesWritten() const
+{
+    return bytesWritten;
+}
+
+#ifndef _WIN32
+// Copy straight into the file: no staging buffer and no write call. Each
+// range keeps one window mapped and moves it along as it fills; bytes past
+// the preallocated size, or a window that cannot be mapped, go through writeAt()
+int FileWriter::appendMapped(WriteBuffer &buffer, long long offset, const char *data, int size)
+{
+    int copied = 0;
+    while (copied < size)
+    {
+        long long at = offset + copied;
+        bool inWindow = buffer.mapped && at >= buffer.offset && at < buffer.offset + static_cast<long long>(buffer.capacity);
+        if (!inWindow && (at >= mappedSize || !mapWindow(buffer, at)))
+        {
+            int written = writeAt(at, data + copied, size - copied);
+            return (written == size - copied) ? size : 0;
+        }
+        size_t room = static_cast<size_t>(buffer.offset + static_cast<long long>(buffer.capacity) - at);
+        size_t chunk = (static_cast<size_t>(size - copied) < room) ? static_cast<size_t>(size - copied) : room;
+        memcpy(buffer.data + (at - buffer.offset), data + copied, chunk);
+        copied += static_cast<int>(chunk);
+    }
+    bytesWritten += size;
+    return size;
+}
+
+// Window of MAP_WINDOW bytes around offset, aligned to MAP_WINDOW so it starts on a page
+bool FileWriter::mapWindow(WriteBuffer &buffer, long long offset)
+{
+    unmapWindow(buffer);
+    long long start = offset / static_cast<long long>(MAP_WINDOW) * static_cast<long long>(MAP_WINDOW);
+    long long length = mappedSize - start;
+    if (length > static_cast<long long>(MAP_WINDOW))
+    {
+        length = static_cast<long long>(MAP_WINDOW);
+    }
+    long long began = (trace && trace->enabled()) ? trace->now() : -1;
+    void *window = mmap(NULL, static_cast<size_t>(length), PROT_READ | PROT_WRITE, MAP_SHARED, mapDescriptor, start);
+    if (window == MAP_FAILED)
+    {
+        return false;
+    }
+    madvise(window, static_cast<size_t>(length), MADV_SEQUENTIAL); // A range fills its window front to back
+    buffer.data = static_cast<char *>(window);
+    buffer.capacity = static_cast<size_t>(length);
+    buffer.offset = start;
+    buffer.used = 0;
+    buffer.mapped = true;
+    if (began >= 0)
+    {
+        trace->span("map", "disk", traceTask, TraceRecorder::THREAD, began, trace->now(), length);
+    }
+    return true;
+}
+
+// Unmap a window the range moved past and start writing it back, without waiting for the disk
+void FileWriter::unmapWindow(WriteBuffer &buffer)
+{
+    if (!buffer.mapped)
     {
-        fileStream.flush(); // Flush before closing
-        fileStream.close();
+        return;
     }
-}
\ No newline at end of file
+    munmap(buffer.data, buffer.capacity);
+#ifdef __linux__
+    sync_file_range(mapDescriptor, buffer.offset, static_cast<off_t>(buffer.capacity), SYNC_FILE_RANGE_WRITE);
+#endif
+    buffer = WriteBuffer();
+}
+#endif
+
+#ifdef DM_WITH_IO_URING
+// Fill pool buffers and queue each one as soon as it is full, without
+// waiting for the disk. Returns WRITE_STALLED, having consumed nothing,
+// when no buffer is free or this file already has enough writes queued
+// and some write in flight will free one; with none in flight the data is
+// written synchronously instead.
+int FileWriter::appendAsync(WriteBuffer &buffer, long long offset, const char *data, int size)
+{
+    if (asyncFailed)
+    {
+        return 0;
+    }
+    if (buffer.used > 0 && offset != buffer.offset + static_cast<long long>(buffer.used) && !submit(buffer))
+    {
+        return 0;
+    }
+
+    // Reserve every buffer the data needs before copying, so a stall never leaves it half taken
+    size_t room = buffer.data ? buffer.capacity - buffer.used : 0;
+    size_t needed = 0;
+    if (static_cast<size_t>(size) > room)
+    {
+        size_t poolSize = backend->getBufferSize();
+        needed = (size - room + poolSize - 1) / poolSize;
+    }
+    if (needed > 0 && (inFlight + static_cast<int>(needed) > MAX_IN_FLIGHT || !backend->hasFreeBuffer()))
+    {
+        // Queue the partial buffer rather than hold it while parked: when every pool buffer sits
+        // half filled in some range, nothing is in flight and no completion would ever wake us
+        if (buffer.used > 0 && !submit(buffer))
+        {
+            return 0;
+        }
+        if (backend->hasWritesInFlight())
+        {
+            return WRITE_STALLED;
+        }
+        int written = writeAt(offset, data, size);
+        return (written == size) ? size : 0;
+    }
+
+    int copied = 0;
+    while (copied < size)
+    {
+        if (!buffer.data)
+        {
+            buffer.data = backend->acquireBuffer(buffer.poolIndex);
+            if (!buffer.data)
+            {
+                // Pool drained part way through: finish this callback synchronously
+                int written = writeAt(offset + copied, data + copied, size - copied);
+                return (written == size - copied) ? size : 0;
+            }
+            buffer.capacity = backend->getBufferSize();
+            buffer.used = 0;
+            buffer.offset = offset + copied;
+        }
+        if (buffer.used == 0)
+        {
+            buffer.offset = offset + copied;
+        }
+
+        size_t space = buffer.capacity - buffer.used;
+        size_t chunk = (static_cast<size_t>(size - copied) < space) ? static_cast<size_t>(size - copied) : space;
+        memcpy(buffer.data + buffer.used, data + copied, chunk);
+        buffer.used += chunk;
+        copied += static_cast<int>(chunk);
+        if (buffer.used == buffer.capacity && !submit(buffer))
+        {
+            return 0;
+        }
+    }
+    return size;
+}
+
+// Queue the buffer's contents; the buffer goes back to the pool on completion
+bool FileWriter::submit(WriteBuffer &buffer)
+{
+    int descriptor = fileDescriptor;
+    if (directDescriptor >= 0 && isAligned(buffer.offset) && isAligned(static_cast<long long>(buffer.used)))
+    {
+        descriptor = directDescriptor; // Pool buffers are page aligned
+    }
+    if (!backend->submitWrite(this, descriptor, buffer.poolIndex, buffer.used, buffer.offset))
+    {
+        cerr << "Error writing to file" << endl;
+        asyncFailed = true;
+        buffer = WriteBuffer();
+        return false;
+    }
+    ++inFlight;
+    ++writeCalls;
+    bytesWritten += buffer.used;
+    if (trace && trace->enabled())
+    {
+        trace->instant("write queued", "disk", traceTask, TraceRecorder::THREAD, static_cast<long long>(buffer.used));
+    }
+    long long next = buffer.offset + static_cast<long long>(buffer.used);
+    buffer = WriteBuffer();
+    buffer.offset = next;
+    return true;
+}
+
+void FileWriter::drain()
+{
+    while (backend && inFlight > 0)
+    {
+        backend->reap(true);
+    }
+}
+#endif
+
+void FileWriter::waitForBuffer(void (*wake)(void *), void *context)
+{
+#ifdef DM_WITH_IO_URING
+    if (backend)
+    {
+        backend->waitForBuffer(this, wake, context);
+        return;
+    }
+#endif
+    wake(context);
+}
+
+void FileWriter::cancelWaits()
+{
+#ifdef DM_WITH_IO_URING
+    if (backend)
+    {
+        backend->cancelWaits(this);
+    }
+#endif
+}
+
+void FileWriter::asyncWriteFinished(bool ok)
+{
+#ifdef DM_WITH_IO_URING
+    --inFlight;
+    if (!ok)
+    {
+        cerr << "Error writing to file" << endl;
+        asyncFailed = true;
+    }
+#else
+    (void)ok;
+#endif
+}
+
+int FileWriter::completionDescriptor()
+{
+#ifdef DM_WITH_IO_URING
+    UringBackend *backend = UringBackend::current();
+    return backend ? backend->completionDescriptor() : -1;
+#else
+    return -1;
+#endif
+}
+
+void FileWriter::processCompletions()
+{
+#ifdef DM_WITH_IO_URING
+    UringBackend *backend = UringBackend::current();
+    if (backend)
+    {
+        backend->service();
+    }
+#endif
+}
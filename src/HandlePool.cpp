@@ -0,0 +1,170 @@
+#define _HAS_STD_BYTE 0  // Fix Windows SDK byte conflict
+
+// HandlePool.cpp
+#include "HandlePool.hpp"
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+using namespace std;
+
+HandlePool::HandlePool(size_t maxIdle)
+    : maxIdle(maxIdle), reservedHandles(0), openFiles(0), waiting(false)
+{
+    // Sockets of the handles and descriptors of the files (up to three with O_DIRECT and mmap)
+    // leave an eighth of the limit to the rest of the process
+    size_t descriptors = 1024;
+#ifndef _WIN32
+    rlimit limit;
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur != RLIM_INFINITY)
+    {
+        descriptors = static_cast<size_t>(limit.rlim_cur);
+    }
+#endif
+    maxHandles = descriptors / 2;
+    maxFiles = (descriptors / 8 > 0) ? descriptors / 8 : 1;
+
+    share = curl_share_init();
+    if (share)
+    {
+        curl_share_setopt(share, CURLSHOPT_LOCKFUNC, lockShare);
+        curl_share_setopt(share, CURLSHOPT_UNLOCKFUNC, unlockShare);
+        curl_share_setopt(share, CURLSHOPT_USERDATA, this);
+        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+        // Not CURL_LOCK_DATA_CONNECT: curl does not support a connection cache used from several threads at
+        // once. Connections stay with each multi handle (event loops) or easy handle (pool workers)
+        curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    }
+}
+
+// Several event loops and pool workers use the share at once, so curl asks
+// for a lock around every access; shared and exclusive access are treated alike
+void HandlePool::lockShare(CURL *, curl_lock_data data, curl_lock_access, void *pool)
+{
+    static_cast<HandlePool *>(pool)->shareLocks[data].lock();
+}
+
+void HandlePool::unlockShare(CURL *, curl_lock_data data, void *pool)
+{
+    static_cast<HandlePool *>(pool)->shareLocks[data].unlock();
+}
+
+CURL *HandlePool::acquire()
+{
+    CURL *handle = NULL;
+    {
+        lock_guard<mutex> lock(poolMutex);
+        if (!idle.empty())
+        {
+            handle = idle.back();
+            idle.pop_back();
+        }
+    }
+    if (!handle)
+    {
+        handle = curl_easy_init();
+    }
+    if (handle && share)
+    {
+        curl_easy_setopt(handle, CURLOPT_SHARE, share);
+    }
+    return handle;
+}
+
+void HandlePool::release(CURL *handle)
+{
+    if (!handle)
+    {
+        return;
+    }
+    curl_easy_reset(handle); // Drops per-transfer options; the handle keeps its connections
+    {
+        lock_guard<mutex> lock(poolMutex);
+        if (idle.size() < maxIdle)
+        {
+            idle.push_back(handle);
+            return;
+        }
+    }
+    curl_easy_cleanup(handle);
+}
+
+void HandlePool::setLimits(size_t handles, size_t files)
+{
+    {
+        lock_guard<mutex> lock(poolMutex);
+        maxHandles = handles;
+        maxFiles = files;
+    }
+    slotFreed.notify_all();
+}
+
+bool HandlePool::fits(size_t handles) const
+{
+    if (maxFiles > 0 && openFiles >= maxFiles)
+    {
+        return false;
+    }
+    return maxHandles == 0 || reservedHandles == 0 || reservedHandles + handles <= maxHandles;
+}
+
+bool HandlePool::tryReserve(size_t handles)
+{
+    lock_guard<mutex> lock(poolMutex);
+    if (!fits(handles))
+    {
+        waiting = true;
+        return false;
+    }
+    reservedHandles += handles;
+    ++openFiles;
+    return true;
+}
+
+void HandlePool::reserve(size_t handles)
+{
+    unique_lock<mutex> lock(poolMutex);
+    slotFreed.wait(lock, [this, handles] { return fits(handles); });
+    reservedHandles += handles;
+    ++openFiles;
+}
+
+void HandlePool::unreserve(size_t handles)
+{
+    bool notify;
+    function<void()> listener;
+    {
+        lock_guard<mutex> lock(poolMutex);
+        reservedHandles -= (handles < reservedHandles) ? handles : reservedHandles;
+        openFiles -= (openFiles > 0) ? 1 : 0;
+        notify = waiting;
+        waiting = false;
+        listener = releaseListener;
+    }
+    slotFreed.notify_all();
+    if (notify && listener)
+    {
+        listener();
+    }
+}
+
+void HandlePool::setReleaseListener(const function<void()> &listener)
+{
+    lock_guard<mutex> lock(poolMutex);
+    releaseListener = listener;
+}
+
+HandlePool::~HandlePool()
+{
+    // The share can only go once no easy handle refers to it
+    for (CURL *handle : idle)
+    {
+        curl_easy_cleanup(handle);
+    }
+    idle.clear();
+    if (share)
+    {
+        curl_share_cleanup(share);
+    }
+}
@@ -0,0 +1,101 @@
+#define _HAS_STD_BYTE 0  // Fix Windows SDK byte conflict
+
+// JournalSyncer.cpp
+#include "JournalSyncer.hpp"
+#include "FileWritter.hpp"
+
+using namespace std;
+
+JournalSyncer::JournalSyncer() : syncing(NULL), running(false) {}
+
+JournalSyncer::~JournalSyncer()
+{
+    stop();
+}
+
+void JournalSyncer::submit(const void *owner, int fileDescriptor, const ProgressJournal &journal)
+{
+    lock_guard<mutex> lock(queueMutex);
+    for (auto &job : jobs)
+    {
+        if (job.owner == owner)
+        {
+            FileWriter::closeDescriptor(job.fileDescriptor); // Superseded before it was synced
+            job.fileDescriptor = fileDescriptor;
+            job.journal = journal;
+            return;
+        }
+    }
+    jobs.push_back(Job{owner, fileDescriptor, journal});
+    if (!running)
+    {
+        running = true;
+        worker = thread(&JournalSyncer::run, this);
+    }
+    wake.notify_one();
+}
+
+void JournalSyncer::wait(const void *owner)
+{
+    unique_lock<mutex> lock(queueMutex);
+    finished.wait(lock, [this, owner]
+    {
+        if (syncing == owner)
+        {
+            return false;
+        }
+        for (const auto &job : jobs)
+        {
+            if (job.owner == owner)
+            {
+                return false;
+            }
+        }
+        return true;
+    });
+}
+
+void JournalSyncer::stop()
+{
+    {
+        lock_guard<mutex> lock(queueMutex);
+        if (!running)
+        {
+            return;
+        }
+        running = false;
+    }
+    wake.notify_all();
+    if (worker.joinable())
+    {
+        worker.join();
+    }
+}
+
+void JournalSyncer::run()
+{
+    unique_lock<mutex> lock(queueMutex);
+    while (true)
+    {
+        wake.wait(lock, [this] { return !jobs.empty() || !running; });
+        if (jobs.empty())
+        {
+            return; // Stopped with nothing left to sync
+        }
+        Job job = jobs.front();
+        jobs.pop_front();
+        syncing = job.owner;
+        lock.unlock();
+
+        // Data must be durable before the journal claims it
+        if (FileWriter::syncDescriptor(job.fileDescriptor))
+        {
+            job.journal.save();
+        }
+        FileWriter::closeDescriptor(job.fileDescriptor);
+
+        lock.lock();
+        syncing = NULL;
+        finished.notify_all();
+    }
+}
@@ -0,0 +1,353 @@
+#define _HAS_STD_BYTE 0  // Fix Windows SDK byte conflict
+
+// ManifestReader.cpp
+#include "ManifestReader.hpp"
+#include "Checksum.hpp"
+#include <cctype>
+#include <cstring>
+#include <cstdlib>
+
+using namespace std;
+
+ManifestReader::ManifestReader(const string &path, size_t chunkSize)
+    : file(path, ios::binary), chunk(chunkSize > 0 ? chunkSize : 1), begin(0), end(0), eof(false), stats()
+{
+}
+
+bool ManifestReader::isOpen() const
+{
+    return file.is_open();
+}
+
+const ManifestStats &ManifestReader::getStats() const
+{
+    return stats;
+}
+
+// Keep the unfinished line and read more after it; false once nothing more arrives
+bool ManifestReader::fill()
+{
+    if (eof)
+    {
+        return false;
+    }
+    size_t kept = end - begin;
+    if (begin > 0)
+    {
+        memmove(chunk.data(), chunk.data() + begin, kept);
+    }
+    else if (kept == chunk.size())
+    {
+        chunk.resize(chunk.size() * 2); // A single line longer than the chunk
+    }
+    begin = 0;
+    end = kept;
+
+    file.read(chunk.data() + end, chunk.size() - end);
+    size_t count = static_cast<size_t>(file.gcount());
+    end += count;
+    stats.bytes += count;
+    if (count == 0)
+    {
+        eof = true;
+        return false;
+    }
+    return true;
+}
+
+size_t ManifestReader::next(vector<ManifestEntry> &entries, size_t maxEntries)
+{
+    entries.clear();
+    if (!isOpen())
+    {
+        return 0;
+    }
+    while (entries.size() < maxEntries)
+    {
+        const char *start = chunk.data() + begin;
+        const char *newline = static_cast<const char *>(memchr(start, '\n', end - begin));
+        if (!newline)
+        {
+            if (fill())
+            {
+                continue;
+            }
+            if (begin == end)
+            {
+                break;
+            }
+            start = chunk.data() + begin; // fill() may have moved the data
+            newline = chunk.data() + end; // Last line without a newline
+        }
+
+        ++stats.lines;
+        ManifestEntry entry;
+        const char *lineEnd = newline;
+        begin = (newline - chunk.data()) + (newline < chunk.data() + end ? 1 : 0);
+        while (start < lineEnd && isspace(static_cast<unsigned char>(*start)))
+        {
+            ++start;
+        }
+        if (start == lineEnd || *start == '#')
+        {
+            continue;
+        }
+        if (parseLine(start, lineEnd, entry))
+        {
+            ++stats.entries;
+            entries.push_back(move(entry));
+        }
+        else
+        {
+            ++stats.malformed;
+        }
+    }
+    return entries.size();
+}
+
+static void skipSpace(const char *&at, const char *end)
+{
+    while (at < end && isspace(static_cast<unsigned char>(*at)))
+    {
+        ++at;
+    }
+}
+
+static void appendUtf8(string &out, unsigned code)
+{
+    if (code < 0x80)
+    {
+        out += static_cast<char>(code);
+    }
+    else if (code < 0x800)
+    {
+        out += static_cast<char>(0xC0 | (code >> 6));
+        out += static_cast<char>(0x80 | (code & 0x3F));
+    }
+    else
+    {
+        out += static_cast<char>(0xE0 | (code >> 12));
+        out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (code & 0x3F));
+    }
+}
+
+// JSON string starting at the opening quote
+static bool parseString(const char *&at, const char *end, string &out)
+{
+    ++at;
+    out.clear();
+    while (at < end && *at != '"')
+    {
+        if (*at != '\\')
+        {
+            out += *at++;
+            continue;
+        }
+        if (++at == end)
+        {
+            return false;
+        }
+        char escaped = *at++;
+        switch (escaped)
+        {
+        case 'n':
+            out += '\n';
+            break;
+        case 't':
+            out += '\t';
+            break;
+        case 'r':
+            out += '\r';
+            break;
+        case 'b':
+            out += '\b';
+            break;
+        case 'f':
+            out += '\f';
+            break;
+        case 'u':
+        {
+            if (end - at < 4)
+            {
+                return false;
+            }
+            char digits[5] = {at[0], at[1], at[2], at[3], 0};
+            char *parsed = NULL;
+            unsigned code = static_cast<unsigned>(strtoul(digits, &parsed, 16));
+            if (parsed != digits + 4)
+            {
+                return false;
+            }
+            appendUtf8(out, code);
+            at += 4;
+            break;
+        }
+        default:
+            out += escaped; // \" \\ \/
+        }
+    }
+    if (at == end)
+    {
+        return false;
+    }
+    ++at;
+    return true;
+}
+
+static bool parsePriority(const string &text, TransferPriority &priority)
+{
+    if (text == "low" || text == "0")
+    {
+        priority = TransferPriority::Low;
+    }
+    else if (text == "normal" || text == "1")
+    {
+        priority = TransferPriority::Normal;
+    }
+    else if (text == "high" || text == "2")
+    {
+        priority = TransferPriority::High;
+    }
+    else
+    {
+        return false;
+    }
+    return true;
+}
+
+// Flat JSON object; nested values are not part of the format
+static bool parseJson(const char *at, const char *end, ManifestEntry &entry)
+{
+    ++at;
+    string key;
+    string value;
+    skipSpace(at, end);
+    if (at < end && *at == '}')
+    {
+        return false; // No URL
+    }
+    while (at < end)
+    {
+        skipSpace(at, end);
+        if (at == end || *at != '"' || !parseString(at, end, key))
+        {
+            return false;
+        }
+        skipSpace(at, end);
+        if (at == end || *at++ != ':')
+        {
+            return false;
+        }
+        skipSpace(at, end);
+        if (at == end)
+        {
+            return false;
+        }
+        bool quoted = *at == '"';
+        if (quoted)
+        {
+            if (!parseString(at, end, value))
+            {
+                return false;
+            }
+        }
+        else
+        {
+            const char *start = at;
+            while (at < end && *at != ',' && *at != '}' && !isspace(static_cast<unsigned char>(*at)))
+            {
+                ++at;
+            }
+            value.assign(start, at);
+            if (value.empty() || value[0] == '{' || value[0] == '[')
+            {
+                return false;
+            }
+        }
+
+        if (!quoted && value == "null")
+        {
+            // Same as leaving the key out
+        }
+        else if (key == "url")
+        {
+            entry.url = value;
+        }
+        else if (key == "destination" || key == "dest" || key == "path")
+        {
+            entry.destination = value;
+        }
+        else if (key == "size")
+        {
+            char *parsed = NULL;
+            entry.size = strtoll(value.c_str(), &parsed, 10);
+            if (*parsed != '\0' || entry.size < 0)
+            {
+                return false;
+            }
+        }
+        else if (key == "sha256" || key == "hash" || key == "checksum")
+        {
+            entry.hash = value;
+        }
+        else if (key == "crc32c")
+        {
+            entry.hash = "crc32c:" + value;
+        }
+        else if (key == "priority" && !parsePriority(value, entry.priority))
+        {
+            return false;
+        }
+
+        skipSpace(at, end);
+        if (at < end && *at == ',')
+        {
+            ++at;
+            continue;
+        }
+        if (at < end && *at == '}')
+        {
+            ++at;
+            skipSpace(at, end);
+            ExpectedDigest digest;
+            return at == end && !entry.url.empty() && (entry.hash.empty() || ExpectedDigest::parse(entry.hash, digest));
+        }
+        return false;
+    }
+    return false;
+}
+
+bool ManifestReader::parseLine(const char *line, const char *lineEnd, ManifestEntry &entry)
+{
+    entry.url.clear();
+    entry.destination.clear();
+    entry.size = -1;
+    entry.hash.clear();
+    entry.priority = TransferPriority::Normal;
+
+    while (lineEnd > line && isspace(static_cast<unsigned char>(lineEnd[-1])))
+    {
+        --lineEnd; // Also drops the \r of CRLF files
+    }
+    skipSpace(line, lineEnd);
+    if (line == lineEnd)
+    {
+        return false;
+    }
+    if (*line == '{')
+    {
+        return parseJson(line, lineEnd, entry);
+    }
+
+    // Plain: URL, then optionally the destination (the rest of the line, so it may contain spaces)
+    const char *at = line;
+    while (at < lineEnd && !isspace(static_cast<unsigned char>(*at)))
+    {
+        ++at;
+    }
+    entry.url.assign(line, at);
+    skipSpace(at, lineEnd);
+    entry.destination.assign(at, lineEnd);
+    return true;
+}
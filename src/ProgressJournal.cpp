@@ -0,0 +1,145 @@
+#define _HAS_STD_BYTE 0  // Fix Windows SDK byte conflict
+
+// ProgressJournal.cpp
+#include "ProgressJournal.hpp"
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+static const char *JOURNAL_MAGIC = "dmjournal 1";
+
+ProgressJournal::ProgressJournal(const string &destinationPath)
+    : path(destinationPath + ".journal"), totalSize(-1) {}
+
+bool ProgressJournal::load()
+{
+    ifstream in(path);
+    string line;
+    if (!in.is_open() || !getline(in, line) || line != JOURNAL_MAGIC)
+    {
+        return false;
+    }
+
+    url.clear();
+    etag.clear();
+    lastModified.clear();
+    ranges.clear();
+    totalSize = -1;
+
+    while (getline(in, line))
+    {
+        size_t space = line.find(' ');
+        string key = line.substr(0, space);
+        string value = (space == string::npos) ? "" : line.substr(space + 1);
+
+        if (key == "url")
+        {
+            url = value;
+        }
+        else if (key == "size")
+        {
+            char *end = NULL;
+            totalSize = strtoll(value.c_str(), &end, 10);
+            if (value.empty() || *end != '\0')
+            {
+                return false; // Damaged; never throw into the transfer thread
+            }
+        }
+        else if (key == "etag")
+        {
+            etag = value;
+        }
+        else if (key == "last-modified")
+        {
+            lastModified = value;
+        }
+        else if (key == "range")
+        {
+            JournalRange range;
+            istringstream fields(value);
+            if (!(fields >> range.begin >> range.end >> range.done))
+            {
+                return false;
+            }
+            ranges.push_back(range);
+        }
+    }
+
+    return !url.empty() && totalSize > 0 && !ranges.empty();
+}
+
+// Written to a temporary file, synced and renamed, so a crash leaves either the old journal or the new one
+bool ProgressJournal::save() const
+{
+    ostringstream out;
+    out << JOURNAL_MAGIC << "\n";
+    out << "url " << url << "\n";
+    out << "size " << totalSize << "\n";
+    if (!etag.empty())
+    {
+        out << "etag " << etag << "\n";
+    }
+    if (!lastModified.empty())
+    {
+        out << "last-modified " << lastModified << "\n";
+    }
+    for (const auto &range : ranges)
+    {
+        out << "range " << range.begin << " " << range.end << " " << range.done << "\n";
+    }
+    string text = out.str();
+
+    string temporary = path + ".tmp";
+    FILE *file = fopen(temporary.c_str(), "wb");
+    if (!file)
+    {
+        return false;
+    }
+    bool written = fwrite(text.data(), 1, text.size(), file) == text.size() && fflush(file) == 0;
+#ifdef _WIN32
+    written = written && _commit(_fileno(file)) == 0;
+#else
+    written = written && fsync(fileno(file)) == 0; // Else the rename may reach the disk before the contents
+#endif
+    if (fclose(file) != 0 || !written)
+    {
+        return false;
+    }
+
+#ifdef _WIN32
+    std::remove(path.c_str()); // rename() does not replace on Windows
+#endif
+    return std::rename(temporary.c_str(), path.c_str()) == 0;
+}
+
+void ProgressJournal::remove() const
+{
+    std::remove(path.c_str());
+}
+
+// The partial file is only reusable if the server still has the same content
+bool ProgressJournal::matches(const string &remoteEtag, const string &remoteLastModified, long long remoteSize) const
+{
+    if (remoteSize != totalSize)
+    {
+        return false;
+    }
+    if (!etag.empty() || !remoteEtag.empty())
+    {
+        return etag == remoteEtag;
+    }
+    if (!lastModified.empty() || !remoteLastModified.empty())
+    {
+        return lastModified == remoteLastModified;
+    }
+    return false; // No validator: cannot prove the bytes on disk are still right
+}
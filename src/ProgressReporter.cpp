@@ -0,0 +1,163 @@
+#define _HAS_STD_BYTE 0  // Fix Windows SDK byte conflict
+
+// ProgressReporter.cpp
+#include "ProgressReporter.hpp"
+#include "DownloadTask.hpp"
+#include <cstdio>
+
+using namespace std;
+
+// Weight of the newest sample in the smoothed speed
+static const double SPEED_SMOOTHING = 0.5;
+
+static string formatBytes(double bytes)
+{
+    const char *units[] = {"B", "KB", "MB", "GB", "TB"};
+    int unit = 0;
+    while (bytes >= 1024 && unit < 4)
+    {
+        bytes /= 1024;
+        ++unit;
+    }
+    char text[32];
+    snprintf(text, sizeof(text), unit ? "%.1f %s" : "%.0f %s", bytes, units[unit]);
+    return text;
+}
+
+static string formatEta(double seconds)
+{
+    if (seconds < 0 || seconds > 99 * 3600)
+    {
+        return "--:--";
+    }
+    long long total = static_cast<long long>(seconds + 0.5);
+    char text[32];
+    if (total >= 3600)
+    {
+        snprintf(text, sizeof(text), "%lld:%02lld:%02lld", total / 3600, total / 60 % 60, total % 60);
+    }
+    else
+    {
+        snprintf(text, sizeof(text), "%lld:%02lld", total / 60, total % 60);
+    }
+    return text;
+}
+
+static string formatRow(const string &name, curl_off_t bytes, curl_off_t total, double speed, const char *state)
+{
+    string shown = (name.size() > 28) ? name.substr(0, 25) + "..." : name;
+    char percent[8] = "  ?";
+    if (total > 0)
+    {
+        snprintf(percent, sizeof(percent), "%3d", static_cast<int>(100.0 * bytes / total));
+    }
+    string size = formatBytes(static_cast<double>(bytes)) + " / " + (total > 0 ? formatBytes(static_cast<double>(total)) : "?");
+    string eta = state ? state : (total > 0 && speed > 0 ? formatEta((total - bytes) / speed) : "--:--");
+
+    char row[160];
+    snprintf(row, sizeof(row), "%-28s %s%%  %-21s %10s/s  ETA %s\n", shown.c_str(), percent, size.c_str(),
+             formatBytes(speed).c_str(), eta.c_str());
+    return row;
+}
+
+ProgressReporter::ProgressReporter(function<vector<ProgressSample>()> source, ostream &out)
+    : source(source), out(out), interval(1000), running(false) {}
+
+ProgressReporter::~ProgressReporter()
+{
+    stop();
+}
+
+void ProgressReporter::start(chrono::milliseconds interval)
+{
+    stop();
+    this->interval = interval;
+    running = true;
+    worker = thread(&ProgressReporter::run, this);
+}
+
+void ProgressReporter::stop()
+{
+    {
+        lock_guard<mutex> lock(reporterMutex);
+        running = false;
+    }
+    wake.notify_all();
+    if (worker.joinable())
+    {
+        worker.join();
+    }
+}
+
+void ProgressReporter::run()
+{
+    unique_lock<mutex> lock(reporterMutex);
+    while (running)
+    {
+        wake.wait_for(lock, interval);
+        if (!running)
+        {
+            break;
+        }
+        string frame = render(source());
+        if (!frame.empty())
+        {
+            out << frame << flush;
+        }
+    }
+}
+
+string ProgressReporter::render(const vector<ProgressSample> &samples)
+{
+    auto now = chrono::steady_clock::now();
+    double elapsed = chrono::duration<double>(now - lastSample).count();
+    bool first = lastSample.time_since_epoch().count() == 0;
+    lastSample = now;
+
+    unordered_map<unsigned long long, Track> updated;
+    string rows;
+    curl_off_t bytes = 0;
+    curl_off_t total = 0;
+    bool totalKnown = true;
+    double speed = 0;
+    bool downloading = false;
+    for (const auto &sample : samples)
+    {
+        if (sample.status != DownloadStatus::Downloading && sample.status != DownloadStatus::Paused)
+        {
+            continue;
+        }
+        Track track = {sample.bytes, 0};
+        auto previous = tracks.find(sample.id);
+        if (previous != tracks.end() && !first && elapsed > 0)
+        {
+            double current = (sample.bytes - previous->second.bytes) / elapsed;
+            current = (current < 0) ? 0 : current; // Restarted from zero
+            track.speed = SPEED_SMOOTHING * current + (1 - SPEED_SMOOTHING) * previous->second.speed;
+        }
+        if (sample.status == DownloadStatus::Paused)
+        {
+            track.speed = 0;
+        }
+        else
+        {
+            downloading = true;
+        }
+        updated[sample.id] = track;
+
+        string name = sample.url.substr(sample.url.find_last_of('/') + 1);
+        rows += formatRow(name, sample.bytes, sample.total, track.speed,
+                          sample.status == DownloadStatus::Paused ? "paused" : NULL);
+        bytes += sample.bytes;
+        total += (sample.total > 0) ? sample.total : 0;
+        totalKnown = totalKnown && sample.total > 0;
+        speed += track.speed;
+    }
+    tracks.swap(updated);
+
+    if (!downloading)
+    {
+        return "";
+    }
+    return "\n--- Progress ---\n" + rows + formatRow("Total", bytes, totalKnown ? total : -1, speed, NULL);
+}
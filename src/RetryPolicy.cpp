@@ -0,0 +1,298 @@
+#define _HAS_STD_BYTE 0  // Fix Windows SDK byte conflict
+
+// RetryPolicy.cpp
+#include "RetryPolicy.hpp"
+#include <algorithm>
+
+using namespace std;
+
+RetryPolicy::RetryPolicy()
+    : tracked(0), unhealthy(0),
+      random(static_cast<unsigned>(chrono::steady_clock::now().time_since_epoch().count()))
+{
+}
+
+void RetryPolicy::setSettings(const RetrySettings &settings)
+{
+    lock_guard<mutex> lock(policyMutex);
+    this->settings = settings;
+}
+
+RetrySettings RetryPolicy::getSettings() const
+{
+    lock_guard<mutex> lock(policyMutex);
+    return settings;
+}
+
+FailureClass RetryPolicy::classify(const DownloadResult &result)
+{
+    if (result.status == DownloadStatus::Cancelled)
+    {
+        return FailureClass::Cancelled;
+    }
+    if (result.error == DownloadTask::CHECKSUM_MISMATCH || result.error == DownloadTask::HOST_UNAVAILABLE)
+    {
+        return FailureClass::Transient; // Bad ranges are fetched again; a rejected download waits for the cool-down
+    }
+    if (result.error == DownloadTask::SIZE_MISMATCH)
+    {
+        return FailureClass::Permanent; // The server has another file than the one listed
+    }
+
+    long http = result.httpStatus;
+    if (http == 429 || http == 503)
+    {
+        return FailureClass::Throttled;
+    }
+    if (http == 408 || http >= 500)
+    {
+        return FailureClass::Transient;
+    }
+    if (http >= 400)
+    {
+        return FailureClass::Permanent;
+    }
+
+    switch (static_cast<CURLcode>(result.error))
+    {
+    case CURLE_UNSUPPORTED_PROTOCOL:
+    case CURLE_URL_MALFORMAT:
+    case CURLE_NOT_BUILT_IN:
+    case CURLE_REMOTE_ACCESS_DENIED:
+    case CURLE_TOO_MANY_REDIRECTS:
+    case CURLE_LOGIN_DENIED:
+    case CURLE_REMOTE_FILE_NOT_FOUND:
+    case CURLE_FILESIZE_EXCEEDED:
+    case CURLE_PEER_FAILED_VERIFICATION:
+    case CURLE_SSL_CERTPROBLEM:
+    case CURLE_SSL_CACERT_BADFILE:
+    case CURLE_BAD_CONTENT_ENCODING:
+        return FailureClass::Permanent;
+    default:
+        return FailureClass::Transient;
+    }
+}
+
+// Only failures that say something about the host count toward its breaker, not a full disk, a corrupt range
+// or a rejection by the breaker itself
+bool RetryPolicy::blamesHost(FailureClass failure, const DownloadResult &result)
+{
+    if (failure == FailureClass::Throttled)
+    {
+        return true;
+    }
+    return failure == FailureClass::Transient && result.error != DownloadTask::CHECKSUM_MISMATCH &&
+           result.error != DownloadTask::HOST_UNAVAILABLE && result.error != CURLE_WRITE_ERROR && result.error != CURLE_OUT_OF_MEMORY &&
+           result.error != CURLE_ABORTED_BY_CALLBACK;
+}
+
+// Window doubles per attempt up to maxDelay; the first half of it is always waited, the second half is random
+chrono::milliseconds RetryPolicy::backoff(unsigned attempt)
+{
+    long long window = max<long long>(settings.baseDelay.count(), 1);
+    for (unsigned i = 1; i < attempt && window < settings.maxDelay.count(); ++i)
+    {
+        window *= 2;
+    }
+    window = min<long long>(window, max<long long>(settings.maxDelay.count(), 1));
+    uniform_int_distribution<long long> jitter(0, window / 2);
+    return chrono::milliseconds(window - window / 2 + jitter(random));
+}
+
+void RetryPolicy::update(Breaker &breaker, BreakerState state, unsigned failures)
+{
+    bool wasTracked = breaker.state != BreakerState::Closed || breaker.failures > 0;
+    bool wasUnhealthy = breaker.state != BreakerState::Closed;
+    breaker.state = state;
+    breaker.failures = failures;
+    bool isTracked = state != BreakerState::Closed || failures > 0;
+    bool isUnhealthy = state != BreakerState::Closed;
+    if (wasTracked != isTracked)
+    {
+        isTracked ? ++tracked : --tracked;
+    }
+    if (wasUnhealthy != isUnhealthy)
+    {
+        isUnhealthy ? ++unhealthy : --unhealthy;
+    }
+}
+
+void RetryPolicy::open(Breaker &breaker, chrono::milliseconds atLeast, RetryDecision &decision)
+{
+    // A test download that failed doubles the wait; a breaker opening from closed starts over
+    if (breaker.state == BreakerState::HalfOpen && breaker.cooldown.count() > 0)
+    {
+        breaker.cooldown = min(breaker.cooldown * 2, settings.maxBreakerCooldown);
+    }
+    else
+    {
+        breaker.cooldown = settings.breakerCooldown;
+    }
+    breaker.cooldown = max(breaker.cooldown, atLeast);
+    breaker.openUntil = chrono::steady_clock::now() + breaker.cooldown;
+    breaker.trial = 0;
+    update(breaker, BreakerState::Open, 0);
+    decision.breakerOpened = true;
+    decision.breakerOpenFor = breaker.cooldown;
+    // Held tasks are rejected now, one attempt each, and come back after this cool-down
+    decision.released.assign(breaker.held.begin(), breaker.held.end());
+    breaker.held.clear();
+}
+
+RetryDecision RetryPolicy::onFailure(const string &origin, const DownloadResult &result)
+{
+    RetryDecision decision = {classify(result), false, 0, chrono::milliseconds(0), false, chrono::milliseconds(0),
+                              vector<TaskId>()};
+    if (decision.failure == FailureClass::Cancelled)
+    {
+        return decision;
+    }
+
+    lock_guard<mutex> lock(policyMutex);
+    chrono::milliseconds retryAfter = min(chrono::milliseconds(result.retryAfter * 1000), settings.maxRetryAfter);
+    if (settings.breakerThreshold > 0 && blamesHost(decision.failure, result))
+    {
+        Breaker &breaker = breakers[origin];
+        if (breaker.state == BreakerState::HalfOpen && (breaker.trial == result.id || breaker.trial == 0))
+        {
+            open(breaker, retryAfter, decision); // The host is still down
+        }
+        else if (breaker.state == BreakerState::Closed)
+        {
+            update(breaker, BreakerState::Closed, breaker.failures + 1);
+            // A Retry-After is the host asking every client to stay away, not just this download
+            if (breaker.failures >= settings.breakerThreshold ||
+                (decision.failure == FailureClass::Throttled && retryAfter.count() > 0))
+            {
+                open(breaker, retryAfter, decision);
+            }
+        }
+        // Failures of downloads that were already running when it opened change nothing
+    }
+    chrono::milliseconds wait = retryAfter;
+    auto breaker = breakers.find(origin);
+    if (breaker != breakers.end() && breaker->second.state == BreakerState::Open)
+    {
+        // No point in coming back before the host gets its test download
+        wait = max(wait, chrono::duration_cast<chrono::milliseconds>(breaker->second.openUntil - chrono::steady_clock::now()));
+    }
+
+    auto found = attempts.find(result.id);
+    unsigned done = (found != attempts.end()) ? found->second : 0;
+    if (decision.failure == FailureClass::Permanent || done >= settings.maxAttempts)
+    {
+        if (found != attempts.end())
+        {
+            attempts.erase(found);
+            --tracked;
+        }
+        return decision;
+    }
+    if (found == attempts.end())
+    {
+        found = attempts.emplace(result.id, 0).first;
+        ++tracked;
+    }
+    decision.retry = true;
+    decision.attempt = ++found->second;
+    decision.delay = max(backoff(decision.attempt), wait);
+    return decision;
+}
+
+vector<TaskId> RetryPolicy::onSuccess(TaskId id, const string &origin)
+{
+    if (tracked.load() == 0)
+    {
+        return vector<TaskId>(); // Nothing failed lately: no lock on the completion path
+    }
+    lock_guard<mutex> lock(policyMutex);
+    if (attempts.erase(id) > 0)
+    {
+        --tracked;
+    }
+    auto found = breakers.find(origin);
+    if (found == breakers.end())
+    {
+        return vector<TaskId>();
+    }
+    Breaker &breaker = found->second;
+    bool wasOpen = breaker.state != BreakerState::Closed;
+    update(breaker, BreakerState::Closed, 0);
+    breaker.trial = 0;
+    breaker.cooldown = chrono::milliseconds(0);
+    if (!wasOpen)
+    {
+        return vector<TaskId>();
+    }
+    vector<TaskId> released(breaker.held.begin(), breaker.held.end());
+    breaker.held.clear();
+    return released;
+}
+
+vector<TaskId> RetryPolicy::forget(TaskId id, const string &origin)
+{
+    if (tracked.load() == 0)
+    {
+        return vector<TaskId>();
+    }
+    lock_guard<mutex> lock(policyMutex);
+    if (attempts.erase(id) > 0)
+    {
+        --tracked;
+    }
+    auto found = breakers.find(origin);
+    if (found == breakers.end() || found->second.state != BreakerState::HalfOpen || found->second.trial != id)
+    {
+        return vector<TaskId>();
+    }
+    // The test download is gone; let the next held one test the host
+    Breaker &breaker = found->second;
+    breaker.trial = 0;
+    vector<TaskId> released(breaker.held.begin(), breaker.held.end());
+    breaker.held.clear();
+    return released;
+}
+
+Admission RetryPolicy::admit(TaskId id, const string &origin)
+{
+    if (unhealthy.load() == 0)
+    {
+        return Admission::Run;
+    }
+    lock_guard<mutex> lock(policyMutex);
+    auto found = breakers.find(origin);
+    if (found == breakers.end() || found->second.state == BreakerState::Closed)
+    {
+        return Admission::Run;
+    }
+    Breaker &breaker = found->second;
+    if (breaker.state == BreakerState::Open)
+    {
+        return Admission::Reject;
+    }
+    if (breaker.trial == 0 || breaker.trial == id)
+    {
+        breaker.trial = id;
+        return Admission::Run;
+    }
+    breaker.held.push_back(id);
+    return Admission::Hold;
+}
+
+void RetryPolicy::endCooldown(const string &origin)
+{
+    lock_guard<mutex> lock(policyMutex);
+    auto found = breakers.find(origin);
+    if (found != breakers.end() && found->second.state == BreakerState::Open)
+    {
+        update(found->second, BreakerState::HalfOpen, 0);
+        found->second.trial = 0;
+    }
+}
+
+BreakerState RetryPolicy::getState(const string &origin) const
+{
+    lock_guard<mutex> lock(policyMutex);
+    auto found = breakers.find(origin);
+    return (found != breakers.end()) ? found->second.state : BreakerState::Closed;
+}
@@ -2,29 +2,257 @@
 
 // TaskQueue.cpp
 #include "TaskQueue.hpp"
+#include <functional>
 
 using namespace std;
 
+TaskQueue::TaskQueue(size_t capacity, size_t workers)
+    : incoming(capacity), sleepingWorkers(0), closed(false), policy(DispatchPolicy::PerHost),
+      connectionsPerHost(8), activeLimit(static_cast<size_t>(-1)), rotations(workers > 0 ? workers : 1), queued(0) {}
+
 void TaskQueue::addTask(const shared_ptr<DownloadTask> &task)
 {
-    lock_guard<std::mutex> lock(mutex);
-    queue.push(task);
+    while (!incoming.tryPush(task))
+    {
+        // Ring full: sort it into the host queues ourselves rather than wait for a worker
+        lock_guard<mutex> lock(scheduleMutex);
+        sortIncoming();
+    }
+
+    // Same handshake as MpmcQueue: publish, then look for sleepers
+    atomic_thread_fence(memory_order_seq_cst);
+    if (sleepingWorkers.load(memory_order_relaxed) > 0)
+    {
+        lock_guard<mutex> lock(scheduleMutex);
+        workAvailable.notify_one();
+    }
 }
 
-shared_ptr<DownloadTask> TaskQueue::getNextTask()
+string TaskQueue::hostOf(const DownloadTask &task) const
 {
-    lock_guard<std::mutex> lock(mutex);
-    if (queue.empty())
+    return (policy == DispatchPolicy::Fifo) ? string() : task.getOrigin();
+}
+
+size_t TaskQueue::limitFor(const string &host) const
+{
+    if (policy == DispatchPolicy::Fifo)
     {
-        return nullptr;
+        return static_cast<size_t>(-1);
+    }
+    auto found = hostLimits.find(host);
+    return (found != hostLimits.end()) ? found->second : connectionsPerHost;
+}
+
+// A host may always run one task, even one that alone needs more than the cap
+bool TaskQueue::eligible(const string &host, const HostQueue &queue) const
+{
+    if (queue.pending.empty())
+    {
+        return false;
+    }
+    size_t needed = queue.pending.front()->getMaxConnections();
+    return queue.connections == 0 || queue.connections + needed <= limitFor(host);
+}
+
+void TaskQueue::addTasks(const vector<shared_ptr<DownloadTask>> &tasks)
+{
+    if (tasks.empty())
+    {
+        return;
+    }
+    {
+        lock_guard<mutex> lock(scheduleMutex);
+        sortIncoming(); // Tasks handed over earlier go first
+        for (const auto &task : tasks)
+        {
+            place(task);
+        }
     }
-    auto task = queue.front();
-    queue.pop();
+    workAvailable.notify_all();
+}
+
+// Append a task to its host queue (called with scheduleMutex held)
+void TaskQueue::place(const shared_ptr<DownloadTask> &task)
+{
+    string host = hostOf(*task);
+    HostQueue &queue = hosts[host];
+    if (!queue.scheduled)
+    {
+        queue.home = hash<string>()(host) % rotations.size();
+        queue.scheduled = true;
+        rotations[queue.home].push_back(host);
+    }
+    queue.pending.push_back(task);
+    ++queued;
+}
+
+// Move handed-over tasks into their host queues (called with scheduleMutex held)
+void TaskQueue::sortIncoming()
+{
+    shared_ptr<DownloadTask> task;
+    while (incoming.tryPop(task))
+    {
+        place(task);
+    }
+}
+
+shared_ptr<DownloadTask> TaskQueue::takeFrom(const string &host, HostQueue &queue)
+{
+    shared_ptr<DownloadTask> task = queue.pending.front();
+    queue.pending.pop_front();
+    --queued;
+    size_t connections = task->getMaxConnections();
+    queue.connections += connections;
+    running.insert({task.get(), Running{host, connections}});
     return task;
 }
 
+shared_ptr<DownloadTask> TaskQueue::pick(size_t worker)
+{
+    sortIncoming();
+    if (running.size() >= activeLimit)
+    {
+        return nullptr;
+    }
+
+    // Round-robin over this worker's hosts; a host at its cap keeps its turn for later
+    deque<string> &rotation = rotations[worker % rotations.size()];
+    for (size_t turns = rotation.size(); turns > 0; --turns)
+    {
+        string host = rotation.front();
+        rotation.pop_front();
+        HostQueue &queue = hosts[host];
+        if (queue.pending.empty())
+        {
+            queue.scheduled = false; // Emptied by a thief
+            forgetIfIdle(host);
+            continue;
+        }
+        rotation.push_back(host);
+        if (eligible(host, queue))
+        {
+            return takeFrom(host, queue);
+        }
+    }
+
+    // Nothing runnable at home: steal from the longest eligible backlog
+    string busiest;
+    HostQueue *victim = NULL;
+    for (auto &entry : hosts)
+    {
+        if (eligible(entry.first, entry.second) && (!victim || entry.second.pending.size() > victim->pending.size()))
+        {
+            busiest = entry.first;
+            victim = &entry.second;
+        }
+    }
+    return victim ? takeFrom(busiest, *victim) : nullptr;
+}
+
+// Hosts come and go with the batches; drop the ones with nothing left
+void TaskQueue::forgetIfIdle(const string &host)
+{
+    auto found = hosts.find(host);
+    if (found != hosts.end() && found->second.pending.empty() && found->second.connections == 0 &&
+        !found->second.scheduled)
+    {
+        hosts.erase(found);
+    }
+}
+
+shared_ptr<DownloadTask> TaskQueue::getNextTask(size_t worker)
+{
+    unique_lock<mutex> lock(scheduleMutex);
+    while (!closed)
+    {
+        shared_ptr<DownloadTask> task = pick(worker);
+        if (task)
+        {
+            return task;
+        }
+
+        ++sleepingWorkers;
+        atomic_thread_fence(memory_order_seq_cst);
+        if (incoming.isEmpty())
+        {
+            workAvailable.wait(lock);
+        }
+        --sleepingWorkers;
+    }
+    return nullptr;
+}
+
+void TaskQueue::taskFinished(const shared_ptr<DownloadTask> &task)
+{
+    lock_guard<mutex> lock(scheduleMutex);
+    auto found = running.find(task.get());
+    if (found == running.end())
+    {
+        return;
+    }
+    string host = found->second.host;
+    HostQueue &queue = hosts[host];
+    queue.connections -= found->second.connections;
+    running.erase(found);
+
+    // The freed slot may let a waiting task run
+    if (queued > 0)
+    {
+        workAvailable.notify_one();
+    }
+    forgetIfIdle(host);
+}
+
+void TaskQueue::setPolicy(DispatchPolicy newPolicy)
+{
+    lock_guard<mutex> lock(scheduleMutex);
+    policy = newPolicy;
+    workAvailable.notify_all();
+}
+
+void TaskQueue::setConnectionsPerHost(size_t connections)
+{
+    lock_guard<mutex> lock(scheduleMutex);
+    connectionsPerHost = (connections > 0) ? connections : 1;
+    workAvailable.notify_all();
+}
+
+void TaskQueue::setHostConnectionLimit(const string &origin, size_t connections)
+{
+    lock_guard<mutex> lock(scheduleMutex);
+    hostLimits[origin] = (connections > 0) ? connections : 1;
+    workAvailable.notify_all();
+}
+
+void TaskQueue::setActiveLimit(size_t tasks)
+{
+    lock_guard<mutex> lock(scheduleMutex);
+    activeLimit = (tasks > 0) ? tasks : static_cast<size_t>(-1);
+    workAvailable.notify_all();
+}
+
+size_t TaskQueue::pendingCount()
+{
+    lock_guard<mutex> lock(scheduleMutex);
+    sortIncoming();
+    return queued;
+}
+
+size_t TaskQueue::runningCount()
+{
+    lock_guard<mutex> lock(scheduleMutex);
+    return running.size();
+}
+
 bool TaskQueue::isEmpty()
 {
-    lock_guard<std::mutex> lock(mutex);
-    return queue.empty();
-}
\ No newline at end of file
+    lock_guard<mutex> lock(scheduleMutex);
+    return incoming.isEmpty() && queued == 0;
+}
+
+void TaskQueue::close()
+{
+    closed = true;
+    lock_guard<mutex> lock(scheduleMutex);
+    workAvailable.notify_all();
+}
@@ -0,0 +1,223 @@
+#define _HAS_STD_BYTE 0  // Fix Windows SDK byte conflict
+
+// TaskRegistry.cpp
+#include "TaskRegistry.hpp"
+#include <algorithm>
+#include <mutex>
+
+using namespace std;
+
+TaskRegistry::TaskRegistry() : nextId(1), count(0) {}
+
+void TaskRegistry::setListener(const Listener &listener)
+{
+    this->listener = listener;
+}
+
+TaskId TaskRegistry::add(const shared_ptr<DownloadTask> &task)
+{
+    TaskId id = nextId++;
+    // Transitions reported before the insert below are picked up by it
+    task->setRegistry(this, id);
+    {
+        Shard &shard = shardFor(id);
+        unique_lock<shared_mutex> lock(shard.shardMutex);
+        DownloadStatus status = task->getStatus();
+        shard.tasks[id] = {task, status};
+        shard.byStatus[static_cast<int>(status)].insert(id);
+    }
+    {
+        const string &url = task->getUrl();
+        UrlShard &shard = urlShardFor(url);
+        unique_lock<shared_mutex> lock(shard.shardMutex);
+        shard.ids.emplace(url, id);
+    }
+    ++count;
+    return id;
+}
+
+// Consecutive IDs cycle through the shards, so each shard is locked once per batch
+TaskId TaskRegistry::addBatch(const vector<shared_ptr<DownloadTask>> &batch)
+{
+    TaskId first = nextId.fetch_add(batch.size());
+    for (size_t i = 0; i < batch.size(); ++i)
+    {
+        batch[i]->setRegistry(this, first + i);
+    }
+    for (size_t offset = 0; offset < SHARD_COUNT && offset < batch.size(); ++offset)
+    {
+        Shard &shard = shardFor(first + offset);
+        unique_lock<shared_mutex> lock(shard.shardMutex);
+        for (size_t i = offset; i < batch.size(); i += SHARD_COUNT)
+        {
+            DownloadStatus status = batch[i]->getStatus();
+            shard.tasks[first + i] = {batch[i], status};
+            shard.byStatus[static_cast<int>(status)].insert(first + i);
+        }
+    }
+
+    vector<vector<size_t>> byUrlShard(SHARD_COUNT);
+    for (size_t i = 0; i < batch.size(); ++i)
+    {
+        byUrlShard[hash<string_view>()(batch[i]->getUrl()) % SHARD_COUNT].push_back(i);
+    }
+    for (size_t index = 0; index < SHARD_COUNT; ++index)
+    {
+        if (byUrlShard[index].empty())
+        {
+            continue;
+        }
+        UrlShard &shard = urlShards[index];
+        unique_lock<shared_mutex> lock(shard.shardMutex);
+        for (size_t i : byUrlShard[index])
+        {
+            shard.ids.emplace(batch[i]->getUrl(), first + i);
+        }
+    }
+    count += batch.size();
+    return first;
+}
+
+bool TaskRegistry::remove(TaskId id)
+{
+    shared_ptr<DownloadTask> task; // Keeps the URL the index points into alive until it is unlinked
+    {
+        Shard &shard = shardFor(id);
+        unique_lock<shared_mutex> lock(shard.shardMutex);
+        auto entry = shard.tasks.find(id);
+        if (entry == shard.tasks.end())
+        {
+            return false;
+        }
+        task = entry->second.task;
+        shard.byStatus[static_cast<int>(entry->second.indexed)].erase(id);
+        shard.tasks.erase(entry);
+    }
+    {
+        UrlShard &shard = urlShardFor(task->getUrl());
+        unique_lock<shared_mutex> lock(shard.shardMutex);
+        auto range = shard.ids.equal_range(task->getUrl());
+        for (auto it = range.first; it != range.second; ++it)
+        {
+            if (it->second == id)
+            {
+                shard.ids.erase(it);
+                break;
+            }
+        }
+    }
+    --count;
+    return true;
+}
+
+shared_ptr<DownloadTask> TaskRegistry::find(TaskId id) const
+{
+    const Shard &shard = shardFor(id);
+    shared_lock<shared_mutex> lock(shard.shardMutex);
+    auto entry = shard.tasks.find(id);
+    return (entry != shard.tasks.end()) ? entry->second.task : NULL;
+}
+
+bool TaskRegistry::issued(TaskId id) const
+{
+    return id != 0 && id < nextId.load();
+}
+
+vector<TaskId> TaskRegistry::findByUrl(const string &url) const
+{
+    vector<TaskId> ids;
+    {
+        const UrlShard &shard = urlShardFor(url);
+        shared_lock<shared_mutex> lock(shard.shardMutex);
+        auto range = shard.ids.equal_range(url);
+        for (auto it = range.first; it != range.second; ++it)
+        {
+            ids.push_back(it->second);
+        }
+    }
+    sort(ids.begin(), ids.end()); // IDs grow, so this is oldest first
+    return ids;
+}
+
+vector<TaskId> TaskRegistry::withStatus(DownloadStatus status) const
+{
+    vector<TaskId> ids;
+    for (const auto &shard : shards)
+    {
+        shared_lock<shared_mutex> lock(shard.shardMutex);
+        const auto &matching = shard.byStatus[static_cast<int>(status)];
+        ids.insert(ids.end(), matching.begin(), matching.end());
+    }
+    return ids;
+}
+
+vector<shared_ptr<DownloadTask>> TaskRegistry::tasksWithStatus(DownloadStatus status) const
+{
+    vector<shared_ptr<DownloadTask>> tasks;
+    for (const auto &shard : shards)
+    {
+        shared_lock<shared_mutex> lock(shard.shardMutex);
+        for (TaskId id : shard.byStatus[static_cast<int>(status)])
+        {
+            tasks.push_back(shard.tasks.at(id).task);
+        }
+    }
+    return tasks;
+}
+
+size_t TaskRegistry::countWithStatus(DownloadStatus status) const
+{
+    size_t total = 0;
+    for (const auto &shard : shards)
+    {
+        shared_lock<shared_mutex> lock(shard.shardMutex);
+        total += shard.byStatus[static_cast<int>(status)].size();
+    }
+    return total;
+}
+
+size_t TaskRegistry::size() const
+{
+    return count;
+}
+
+void TaskRegistry::forEach(const function<void(TaskId, const shared_ptr<DownloadTask> &)> &visit) const
+{
+    for (const auto &shard : shards)
+    {
+        shared_lock<shared_mutex> lock(shard.shardMutex);
+        for (const auto &entry : shard.tasks)
+        {
+            visit(entry.first, entry.second.task);
+        }
+    }
+}
+
+void TaskRegistry::statusChanged(TaskId id)
+{
+    shared_ptr<DownloadTask> task;
+    DownloadStatus current;
+    {
+        Shard &shard = shardFor(id);
+        unique_lock<shared_mutex> lock(shard.shardMutex);
+        auto entry = shard.tasks.find(id);
+        if (entry == shard.tasks.end())
+        {
+            return;
+        }
+        // Re-read instead of trusting the caller: concurrent transitions may report out of order
+        current = entry->second.task->getStatus();
+        if (current == entry->second.indexed)
+        {
+            return;
+        }
+        shard.byStatus[static_cast<int>(entry->second.indexed)].erase(id);
+        shard.byStatus[static_cast<int>(current)].insert(id);
+        entry->second.indexed = current;
+        task = entry->second.task;
+    }
+    if (listener)
+    {
+        listener(task, current);
+    }
+}
@@ -6,11 +6,11 @@
 
 using namespace std;
 
-ThreadPool::ThreadPool(size_t threads) : stopFlag(false)
+ThreadPool::ThreadPool(size_t threads, TraceRecorder *trace) : taskQueue(1024, threads), stopFlag(false), trace(trace)
 {
     for (size_t i = 0; i < threads; ++i)
     {
-        workers.emplace_back(&ThreadPool::workerFunction, this);
+        workers.emplace_back(&ThreadPool::workerFunction, this, i);
     }
 }
 
@@ -24,47 +24,85 @@ void ThreadPool::enqueueTask(const shared_ptr<DownloadTask> &task)
     taskQueue.addTask(task);
 }
 
-void ThreadPool::workerFunction()
+void ThreadPool::enqueueTasks(const vector<shared_ptr<DownloadTask>> &tasks)
 {
+    taskQueue.addTasks(tasks);
+}
+
+void ThreadPool::setDispatchPolicy(DispatchPolicy policy)
+{
+    taskQueue.setPolicy(policy);
+}
+
+void ThreadPool::setConnectionsPerHost(size_t connections)
+{
+    taskQueue.setConnectionsPerHost(connections);
+}
+
+void ThreadPool::setHostConnectionLimit(const string &origin, size_t connections)
+{
+    taskQueue.setHostConnectionLimit(origin, connections);
+}
+
+void ThreadPool::setActiveLimit(size_t transfers)
+{
+    {
+        lock_guard<mutex> lock(workersMutex);
+        while (!stopFlag && transfers > 0 && workers.size() < transfers)
+        {
+            workers.emplace_back(&ThreadPool::workerFunction, this, workers.size());
+        }
+    }
+    taskQueue.setActiveLimit(transfers);
+}
+
+size_t ThreadPool::queuedTasks()
+{
+    return taskQueue.pendingCount();
+}
+
+size_t ThreadPool::runningTasks()
+{
+    return taskQueue.runningCount();
+}
+
+void ThreadPool::workerFunction(size_t index)
+{
+    TraceRecorder::nameThread("worker");
     while (!stopFlag)
     {
-        auto task = taskQueue.getNextTask();
-        
-        if (task != nullptr)
+        // Parks until a started task is available or the pool shuts down
+        long long idleSince = (trace && trace->enabled()) ? trace->now() : -1;
+        auto task = taskQueue.getNextTask(index);
+        if (task == nullptr)
         {
-            // Check if task should be started
-            if (task->getStartCommand())
-            {
-                // Execute the task - this blocks until download completes/fails
-                task->start();
-                // Task is done, don't re-add it to queue
-            }
-            else
-            {
-                // Task not ready to start yet
-                DownloadStatus status = task->getStatus();
-                
-                // Only re-add if still pending or starting
-                if (status == DownloadStatus::Pending || status == DownloadStatus::Starting)
-                {
-                    taskQueue.addTask(task);
-                    // Sleep briefly to avoid busy-waiting
-                    this_thread::sleep_for(chrono::milliseconds(100));
-                }
-                // If completed, failed, paused, or downloading - don't re-add
-            }
+            break;
+        }
+        if (idleSince >= 0)
+        {
+            trace->span("idle", "dispatch", 0, TraceRecorder::THREAD, idleSince, trace->now());
         }
-        else
+
+        // Tasks cancelled while queued are dropped
+        if (task->getStartCommand())
         {
-            // No task available, sleep briefly
-            this_thread::sleep_for(chrono::milliseconds(100));
+            // Execute the task - this blocks until download completes/fails
+            long long began = (trace && trace->enabled()) ? trace->now() : -1;
+            task->start();
+            if (began >= 0)
+            {
+                trace->span("run", "dispatch", task->getId(), TraceRecorder::THREAD, began, trace->now());
+            }
         }
+        taskQueue.taskFinished(task);
     }
 }
 
 void ThreadPool::shutdown()
 {
     stopFlag = true;
+    taskQueue.close();
+    lock_guard<mutex> lock(workersMutex);
     for (auto &worker : workers)
     {
         if (worker.joinable())
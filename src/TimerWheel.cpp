@@ -0,0 +1,140 @@
+#define _HAS_STD_BYTE 0  // Fix Windows SDK byte conflict
+
+// TimerWheel.cpp
+#include "TimerWheel.hpp"
+
+using namespace std;
+
+TimerWheel::TimerWheel(chrono::milliseconds tick, size_t slotCount)
+    : tick(tick.count() > 0 ? tick : chrono::milliseconds(1)), origin(chrono::steady_clock::now()),
+      slots(slotCount > 0 ? slotCount : 1), currentTick(0), nextId(1), running(false) {}
+
+TimerWheel::~TimerWheel()
+{
+    stop();
+}
+
+unsigned long long TimerWheel::tickAt(chrono::steady_clock::time_point when) const
+{
+    return (when <= origin) ? 0 : static_cast<unsigned long long>((when - origin) / tick);
+}
+
+TimerWheel::TimerId TimerWheel::schedule(chrono::milliseconds delay, const Callback &callback)
+{
+    lock_guard<mutex> lock(wheelMutex);
+    // Due in the first tick that starts at or after now + delay, and never in one already expired
+    auto due = chrono::steady_clock::now() + delay + tick - chrono::steady_clock::duration(1);
+    unsigned long long target = tickAt(due);
+    if (target <= currentTick)
+    {
+        target = currentTick + 1;
+    }
+
+    size_t slot = target % slots.size();
+    TimerId id = nextId++;
+    slots[slot].push_back(Timer{id, (target - currentTick - 1) / slots.size(), callback});
+    locations[id] = Location{slot, prev(slots[slot].end())};
+
+    if (!running)
+    {
+        running = true;
+        worker = thread(&TimerWheel::run, this);
+    }
+    wake.notify_one(); // It may now be due sooner than the tick the thread sleeps toward
+    return id;
+}
+
+bool TimerWheel::cancel(TimerId id)
+{
+    lock_guard<mutex> lock(wheelMutex);
+    auto found = locations.find(id);
+    if (found == locations.end())
+    {
+        return false;
+    }
+    slots[found->second.slot].erase(found->second.timer);
+    locations.erase(found);
+    return true;
+}
+
+size_t TimerWheel::pending()
+{
+    lock_guard<mutex> lock(wheelMutex);
+    return locations.size();
+}
+
+void TimerWheel::stop()
+{
+    {
+        lock_guard<mutex> lock(wheelMutex);
+        if (!running)
+        {
+            return;
+        }
+        running = false;
+    }
+    wake.notify_all();
+    if (worker.joinable())
+    {
+        worker.join();
+    }
+    lock_guard<mutex> lock(wheelMutex);
+    for (auto &slot : slots)
+    {
+        slot.clear();
+    }
+    locations.clear();
+}
+
+void TimerWheel::run()
+{
+    vector<Callback> due;
+    unique_lock<mutex> lock(wheelMutex);
+    while (running)
+    {
+        if (locations.empty())
+        {
+            wake.wait(lock);
+            continue;
+        }
+
+        // Catch up on every tick that has passed, one slot each
+        unsigned long long now = tickAt(chrono::steady_clock::now());
+        while (currentTick < now)
+        {
+            ++currentTick;
+            list<Timer> &slot = slots[currentTick % slots.size()];
+            for (auto timer = slot.begin(); timer != slot.end();)
+            {
+                if (timer->rounds > 0)
+                {
+                    --timer->rounds;
+                    ++timer;
+                    continue;
+                }
+                due.push_back(move(timer->callback));
+                locations.erase(timer->id);
+                timer = slot.erase(timer);
+            }
+        }
+        if (!due.empty())
+        {
+            lock.unlock();
+            for (auto &callback : due)
+            {
+                callback();
+            }
+            due.clear();
+            lock.lock();
+            continue;
+        }
+
+        // Sleep through the empty slots up to the next one with a timer in it
+        unsigned long long ahead = 1;
+        while (ahead < slots.size() && slots[(currentTick + ahead) % slots.size()].empty())
+        {
+            ++ahead;
+        }
+        wake.wait_until(lock, origin + tick * (currentTick + ahead));
+    }
+}
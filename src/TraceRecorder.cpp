@@ -0,0 +1,282 @@
+#define _HAS_STD_BYTE 0  // Fix Windows SDK byte conflict
+
+// TraceRecorder.cpp
+#include "TraceRecorder.hpp"
+#include "TransferMetrics.hpp"
+#include <algorithm>
+#include <sstream>
+#include <set>
+#include <unordered_map>
+
+using namespace std;
+
+static atomic<unsigned long long> nextRecorderId(1);
+static atomic<int> nextThread(1);
+
+// Track name and ordinal of this thread, the ordinal assigned on first use
+static thread_local const char *threadLabel = "thread";
+static thread_local int threadOrdinal = 0;
+
+// Rings this thread writes to, one per recorder it has touched
+static thread_local unordered_map<unsigned long long, void *> localRings;
+
+TraceRecorder::TraceRecorder()
+    : id(nextRecorderId++), created(chrono::steady_clock::now()), recording(false), generation(0), capacity(65536)
+{
+}
+
+void TraceRecorder::start(size_t eventsPerThread)
+{
+    size_t rounded = 16; // A power of two, so the slot of an event is a mask rather than a division
+    while (rounded < eventsPerThread)
+    {
+        rounded *= 2;
+    }
+    capacity.store(rounded, memory_order_relaxed);
+    generation.fetch_add(1, memory_order_release); // A thread that sees the new session sees its capacity
+    recording = true;
+}
+
+void TraceRecorder::stop()
+{
+    recording = false;
+}
+
+long long TraceRecorder::now() const
+{
+    return toMicros(chrono::steady_clock::now());
+}
+
+long long TraceRecorder::toMicros(chrono::steady_clock::time_point time) const
+{
+    return chrono::duration_cast<chrono::microseconds>(time - created).count();
+}
+
+void TraceRecorder::nameThread(const char *label)
+{
+    threadLabel = label;
+}
+
+TraceRecorder::Ring &TraceRecorder::local()
+{
+    static thread_local unsigned long long cachedId = 0;
+    static thread_local Ring *cached = NULL;
+    unsigned long long current = generation.load(memory_order_acquire);
+    if (cachedId == id && cached->generation == current)
+    {
+        return *cached;
+    }
+
+    void *&slot = localRings[id];
+    if (!slot)
+    {
+        if (threadOrdinal == 0)
+        {
+            threadOrdinal = nextThread++;
+        }
+        lock_guard<mutex> lock(ringsMutex);
+        rings.push_back(unique_ptr<Ring>(new Ring(capacity.load(memory_order_relaxed), current, threadOrdinal, threadLabel)));
+        slot = rings.back().get();
+    }
+    else if (static_cast<Ring *>(slot)->generation != current)
+    {
+        // A new session: this thread's ring starts over, under the lock toJson() copies with
+        Ring &ring = *static_cast<Ring *>(slot);
+        size_t size = capacity.load(memory_order_relaxed);
+        lock_guard<mutex> lock(ringsMutex);
+        if (ring.size != size)
+        {
+            ring.slots.reset(new Slot[size]);
+            ring.size = size;
+        }
+        else
+        {
+            for (size_t i = 0; i < size; ++i)
+            {
+                ring.slots[i].sequence.store(0, memory_order_relaxed);
+            }
+        }
+        ring.written.store(0, memory_order_relaxed);
+        ring.generation = current;
+    }
+    cachedId = id;
+    cached = static_cast<Ring *>(slot);
+    return *cached;
+}
+
+void TraceRecorder::record(const char *name, const char *category, unsigned long long task, int lane, long long start,
+                           long long duration, long long value)
+{
+    Ring &ring = local();
+    unsigned long long index = ring.written.load(memory_order_relaxed);
+    Slot &slot = ring.slots[index & (ring.size - 1)];
+    slot.sequence.store(0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release); // Readers see the slot emptied before any field changes
+    slot.name.store(name, memory_order_relaxed);
+    slot.category.store(category, memory_order_relaxed);
+    slot.task.store(task, memory_order_relaxed);
+    slot.lane.store(lane, memory_order_relaxed);
+    slot.start.store(start, memory_order_relaxed);
+    slot.duration.store(duration, memory_order_relaxed);
+    slot.value.store(value, memory_order_relaxed);
+    slot.sequence.store(index + 1, memory_order_release);
+    ring.written.store(index + 1, memory_order_release);
+}
+
+// What the value of an event counts, by category
+static const char *valueName(const string &category)
+{
+    if (category == "retry")
+    {
+        return "delay_ms";
+    }
+    if (category == "error")
+    {
+        return "curl_code";
+    }
+    if (category == "http error")
+    {
+        return "status";
+    }
+    return (category == "dispatch") ? "tasks" : "bytes";
+}
+
+static const int THREADS_PID = 1;
+static const int DOWNLOADS_PID = 2;
+
+static void metadata(ostringstream &out, bool &first, const char *kind, int pid, long long tid, const string &name)
+{
+    out << (first ? "\n" : ",\n") << "{\"ph\": \"M\", \"name\": \"" << kind << "\", \"pid\": " << pid;
+    if (tid >= 0)
+    {
+        out << ", \"tid\": " << tid;
+    }
+    out << ", \"args\": {\"name\": " << TransferMetrics::jsonString(name) << "}}";
+    if (tid >= 0)
+    {
+        out << ",\n{\"ph\": \"M\", \"name\": \"thread_sort_index\", \"pid\": " << pid << ", \"tid\": " << tid
+            << ", \"args\": {\"sort_index\": " << tid << "}}";
+    }
+    first = false;
+}
+
+string TraceRecorder::toJson(const function<string(unsigned long long)> &label)
+{
+    struct Copy
+    {
+        int thread;
+        string label;
+        vector<TraceEvent> events;
+    };
+    vector<Copy> copies;
+    {
+        lock_guard<mutex> lock(ringsMutex);
+        unsigned long long current = generation.load();
+        for (const auto &ring : rings)
+        {
+            if (ring->generation != current)
+            {
+                continue;
+            }
+            unsigned long long size = ring->size;
+            unsigned long long end = ring->written.load(memory_order_acquire);
+            unsigned long long begin = (end > size) ? end - size : 0;
+            Copy copy = {ring->thread, ring->label, vector<TraceEvent>()};
+            for (unsigned long long i = begin; i < end; ++i)
+            {
+                // Keep the event only if its slot held it before and after the fields were read
+                const Slot &slot = ring->slots[i & (size - 1)];
+                if (slot.sequence.load(memory_order_acquire) != i + 1)
+                {
+                    continue;
+                }
+                TraceEvent event = {slot.name.load(memory_order_relaxed), slot.category.load(memory_order_relaxed),
+                                    slot.task.load(memory_order_relaxed), slot.lane.load(memory_order_relaxed),
+                                    slot.start.load(memory_order_relaxed), slot.duration.load(memory_order_relaxed),
+                                    slot.value.load(memory_order_relaxed)};
+                atomic_thread_fence(memory_order_acquire);
+                if (slot.sequence.load(memory_order_relaxed) == i + 1)
+                {
+                    copy.events.push_back(event);
+                }
+            }
+            copies.push_back(move(copy));
+        }
+    }
+
+    ostringstream out;
+    bool first = true;
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    metadata(out, first, "process_name", THREADS_PID, -1, "threads");
+    metadata(out, first, "process_name", DOWNLOADS_PID, -1, "downloads");
+
+    set<long long> lanes; // Task tracks that have events
+    for (const Copy &copy : copies)
+    {
+        // Threads that only recorded for task tracks get no track of their own
+        if (any_of(copy.events.begin(), copy.events.end(), [](const TraceEvent &event)
+                   { return event.lane == THREAD; }))
+        {
+            metadata(out, first, "thread_name", THREADS_PID, copy.thread, copy.label + " " + to_string(copy.thread));
+        }
+        for (const TraceEvent &event : copy.events)
+        {
+            bool onThread = event.lane == THREAD;
+            long long tid = onThread ? copy.thread : static_cast<long long>(event.task) * LANES + event.lane;
+            if (!onThread)
+            {
+                lanes.insert(tid);
+            }
+            out << ",\n{\"name\": \"" << event.name << "\", \"cat\": \"" << event.category << "\", \"ph\": \""
+                << (event.duration < 0 ? "i" : "X") << "\", \"ts\": " << event.start;
+            if (event.duration >= 0)
+            {
+                out << ", \"dur\": " << event.duration;
+            }
+            else
+            {
+                out << ", \"s\": \"t\"";
+            }
+            out << ", \"pid\": " << (onThread ? THREADS_PID : DOWNLOADS_PID) << ", \"tid\": " << tid;
+            if (event.task != 0 || event.value >= 0)
+            {
+                out << ", \"args\": {";
+                if (event.task != 0)
+                {
+                    out << "\"task\": " << event.task << (event.value >= 0 ? ", " : "");
+                }
+                if (event.value >= 0)
+                {
+                    out << "\"" << valueName(event.category) << "\": " << event.value;
+                }
+                out << "}";
+            }
+            out << "}";
+        }
+    }
+
+    unordered_map<unsigned long long, string> names;
+    for (long long tid : lanes)
+    {
+        unsigned long long task = static_cast<unsigned long long>(tid / LANES);
+        int lane = static_cast<int>(tid % LANES);
+        auto found = names.find(task);
+        if (found == names.end())
+        {
+            string name = label ? label(task) : string();
+            found = names.emplace(task, "#" + to_string(task) + (name.empty() ? "" : " " + name)).first;
+        }
+        string track = found->second;
+        if (lane == SIDECAR)
+        {
+            track += " sidecar";
+        }
+        else if (lane != LIFECYCLE)
+        {
+            track += " requests " + to_string(lane);
+        }
+        metadata(out, first, "thread_name", DOWNLOADS_PID, tid, track);
+    }
+    out << "\n]}\n";
+    return out.str();
+}
@@ -0,0 +1,533 @@
+#define _HAS_STD_BYTE 0  // Fix Windows SDK byte conflict
+
+// TransferEngine.cpp
+#include "TransferEngine.hpp"
+
+#ifdef __linux__
+#include <cerrno>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+TransferEngine::TransferEngine(size_t loopCount, bool multiplex, TraceRecorder *trace)
+    : stopFlag(false), multiplex(multiplex), loopLimit(DEFAULT_LOOP_LIMIT), streamsPerOrigin(100), trace(trace)
+{
+    for (size_t i = 0; i < loopCount; ++i)
+    {
+        unique_ptr<EventLoop> loop(new EventLoop());
+        loop->multi = curl_multi_init();
+        loop->load = 0;
+        if (multiplex)
+        {
+            // Streams are limited per origin by the engine itself; curl should not cap them lower
+            curl_multi_setopt(loop->multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+            curl_multi_setopt(loop->multi, CURLMOPT_MAX_CONCURRENT_STREAMS, 1000L);
+        }
+#ifdef __linux__
+        loop->epollFd = epoll_create1(EPOLL_CLOEXEC);
+        loop->wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        loop->timerArmed = false;
+
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.fd = loop->wakeFd;
+        epoll_ctl(loop->epollFd, EPOLL_CTL_ADD, loop->wakeFd, &event);
+
+        // curl tells us which sockets and timeouts to watch
+        curl_multi_setopt(loop->multi, CURLMOPT_SOCKETFUNCTION, socketCallback);
+        curl_multi_setopt(loop->multi, CURLMOPT_SOCKETDATA, loop.get());
+        curl_multi_setopt(loop->multi, CURLMOPT_TIMERFUNCTION, timerCallback);
+        curl_multi_setopt(loop->multi, CURLMOPT_TIMERDATA, loop.get());
+#endif
+        loops.push_back(move(loop));
+    }
+
+    for (auto &loop : loops)
+    {
+        loop->worker = thread(&TransferEngine::loopFunction, this, loop.get());
+    }
+}
+
+TransferEngine::~TransferEngine()
+{
+    shutdown();
+}
+
+// Least loaded loop gets a new transfer, unless its origin already lives on one
+size_t TransferEngine::pickLoop(const DownloadTask &task, const vector<size_t> &added)
+{
+    if (multiplex)
+    {
+        return hash<string>()(task.getOrigin()) % loops.size();
+    }
+    size_t best = 0;
+    for (size_t i = 1; i < loops.size(); ++i)
+    {
+        if (loops[i]->load + added[i] < loops[best]->load + added[best])
+        {
+            best = i;
+        }
+    }
+    return best;
+}
+
+void TransferEngine::submitAll(const vector<shared_ptr<DownloadTask>> &tasks)
+{
+    if (loops.empty())
+    {
+        return;
+    }
+    vector<size_t> added(loops.size(), 0);
+    vector<vector<shared_ptr<DownloadTask>>> perLoop(loops.size());
+    for (const auto &task : tasks)
+    {
+        size_t index = pickLoop(*task, added);
+        ++added[index];
+        perLoop[index].push_back(task);
+    }
+    for (size_t i = 0; i < loops.size(); ++i)
+    {
+        if (perLoop[i].empty())
+        {
+            continue;
+        }
+        {
+            lock_guard<mutex> lock(loops[i]->inboxMutex);
+            loops[i]->inbox.insert(loops[i]->inbox.end(), perLoop[i].begin(), perLoop[i].end());
+            loops[i]->load += perLoop[i].size();
+        }
+        wake(loops[i].get());
+    }
+}
+
+void TransferEngine::submit(const shared_ptr<DownloadTask> &task)
+{
+    if (loops.empty())
+    {
+        return;
+    }
+
+    EventLoop *target = loops[pickLoop(*task, vector<size_t>(loops.size(), 0))].get();
+    {
+        lock_guard<mutex> lock(target->inboxMutex);
+        target->inbox.push_back(task);
+        ++target->load;
+    }
+    wake(target);
+}
+
+size_t TransferEngine::activeTransfers() const
+{
+    size_t total = 0;
+    for (const auto &loop : loops)
+    {
+        total += loop->load;
+    }
+    return total;
+}
+
+void TransferEngine::wake(EventLoop *loop)
+{
+#ifdef __linux__
+    uint64_t one = 1;
+    ssize_t ignored = ::write(loop->wakeFd, &one, sizeof(one));
+    (void)ignored;
+#else
+    curl_multi_wakeup(loop->multi);
+#endif
+}
+
+void TransferEngine::attachSubmitted(EventLoop *loop)
+{
+    vector<shared_ptr<DownloadTask>> submitted;
+    {
+        lock_guard<mutex> lock(loop->inboxMutex);
+        submitted.swap(loop->inbox);
+    }
+
+    drainBacklog(loop); // Waited longer than anything in the inbox
+    long long began = (trace && trace->enabled() && !submitted.empty()) ? trace->now() : -1;
+    for (auto &task : submitted)
+    {
+        admit(loop, task);
+    }
+    if (began >= 0)
+    {
+        trace->span("attach", "dispatch", 0, TraceRecorder::THREAD, began, trace->now(), static_cast<long long>(submitted.size()));
+    }
+}
+
+// False when the task was parked in the backlog
+bool TransferEngine::admit(EventLoop *loop, const shared_ptr<DownloadTask> &task, bool fromBacklog)
+{
+    // Skip duplicates and tasks cancelled while waiting in the inbox
+    if (!task->getStartCommand())
+    {
+        --loop->load;
+        return true;
+    }
+
+    // Every attached file holds sockets and descriptors, so a large batch waits its turn
+    if (loop->active.size() >= loopLimit)
+    {
+        park(loop, task, fromBacklog);
+        return false;
+    }
+
+    string origin;
+    if (multiplex)
+    {
+        origin = task->getOrigin();
+        OriginQueue &queue = loop->origins[origin];
+        if (queue.active >= streamLimit(origin))
+        {
+            queue.waiting.push_back(task);
+            return true;
+        }
+    }
+
+    // The manager-wide handle and file caps come last, so no stream is held while waiting for them
+    if (!task->takeSlot(false))
+    {
+        park(loop, task, fromBacklog);
+        return false;
+    }
+    if (multiplex)
+    {
+        ++loop->origins[origin].active;
+        loop->originOf[task.get()] = origin;
+    }
+
+    if (task->attach(loop->multi))
+    {
+        loop->active[task.get()] = task;
+    }
+    else
+    {
+        retire(loop, task.get());
+    }
+    return true;
+}
+
+void TransferEngine::park(EventLoop *loop, const shared_ptr<DownloadTask> &task, bool front)
+{
+    if (front)
+    {
+        loop->backlog.push_front(task); // Keeps its place in line
+    }
+    else
+    {
+        loop->backlog.push_back(task);
+    }
+}
+
+// The task left the loop: free its stream and start the next file from the same origin, then from the backlog
+void TransferEngine::retire(EventLoop *loop, DownloadTask *task)
+{
+    task->releaseSlot();
+    loop->active.erase(task);
+    --loop->load;
+
+    auto found = loop->originOf.find(task);
+    if (found != loop->originOf.end())
+    {
+        string origin = found->second;
+        loop->originOf.erase(found);
+        OriginQueue &queue = loop->origins[origin];
+        --queue.active;
+
+        size_t limit = streamLimit(origin);
+        while (!stopFlag && !queue.waiting.empty() && queue.active < limit)
+        {
+            shared_ptr<DownloadTask> next = queue.waiting.front();
+            queue.waiting.pop_front();
+            admit(loop, next);
+        }
+    }
+    drainBacklog(loop);
+}
+
+void TransferEngine::drainBacklog(EventLoop *loop)
+{
+    while (!stopFlag && !loop->backlog.empty() && loop->active.size() < loopLimit)
+    {
+        shared_ptr<DownloadTask> next = loop->backlog.front();
+        loop->backlog.pop_front();
+        if (!admit(loop, next, true))
+        {
+            break; // Nothing frees up before the next retire or release
+        }
+    }
+}
+
+void TransferEngine::slotsReleased()
+{
+    if (stopFlag)
+    {
+        return;
+    }
+    for (auto &loop : loops)
+    {
+        wake(loop.get());
+    }
+}
+
+void TransferEngine::setActiveLimit(size_t transfers)
+{
+    size_t perLoop = DEFAULT_LOOP_LIMIT;
+    if (transfers > 0 && !loops.empty())
+    {
+        perLoop = (transfers + loops.size() - 1) / loops.size();
+    }
+    if (loopLimit.exchange(perLoop) < perLoop)
+    {
+        for (auto &loop : loops)
+        {
+            wake(loop.get()); // Room for backlogged files
+        }
+    }
+}
+
+size_t TransferEngine::streamLimit(const string &origin)
+{
+    lock_guard<mutex> lock(limitMutex);
+    auto found = originLimits.find(origin);
+    return (found != originLimits.end()) ? found->second : streamsPerOrigin;
+}
+
+void TransferEngine::setStreamsPerOrigin(size_t streams)
+{
+    lock_guard<mutex> lock(limitMutex);
+    streamsPerOrigin = (streams > 0) ? streams : 1;
+}
+
+void TransferEngine::setOriginStreamLimit(const string &origin, size_t streams)
+{
+    lock_guard<mutex> lock(limitMutex);
+    originLimits[origin] = (streams > 0) ? streams : 1;
+}
+
+void TransferEngine::processCompletions(EventLoop *loop)
+{
+    CURLMsg *msg;
+    int queued;
+    while ((msg = curl_multi_info_read(loop->multi, &queued)) != NULL)
+    {
+        if (msg->msg != CURLMSG_DONE)
+        {
+            continue;
+        }
+
+        CURL *handle = msg->easy_handle;
+        CURLcode result = msg->data.result;
+        DownloadTask *task = NULL;
+        curl_easy_getinfo(handle, CURLINFO_PRIVATE, reinterpret_cast<char **>(&task));
+        if (!task)
+        {
+            continue;
+        }
+
+        task->onHandleDone(handle, result);
+        if (task->isAttached(loop->multi))
+        {
+            continue;
+        }
+
+        // A resume that raced with a pause is picked up again right here
+        if (!(task->getStartCommand() && task->attach(loop->multi)))
+        {
+            retire(loop, task);
+        }
+    }
+}
+
+#ifdef __linux__
+int TransferEngine::socketCallback(CURL * /*easy*/, curl_socket_t socket, int what, void *userp, void *socketp)
+{
+    EventLoop *loop = static_cast<EventLoop *>(userp);
+
+    if (what == CURL_POLL_REMOVE)
+    {
+        epoll_ctl(loop->epollFd, EPOLL_CTL_DEL, socket, NULL);
+        return 0;
+    }
+
+    epoll_event event = {};
+    event.data.fd = socket;
+    if (what == CURL_POLL_IN || what == CURL_POLL_INOUT)
+    {
+        event.events |= EPOLLIN;
+    }
+    if (what == CURL_POLL_OUT || what == CURL_POLL_INOUT)
+    {
+        event.events |= EPOLLOUT;
+    }
+
+    if (socketp)
+    {
+        epoll_ctl(loop->epollFd, EPOLL_CTL_MOD, socket, &event);
+    }
+    else
+    {
+        epoll_ctl(loop->epollFd, EPOLL_CTL_ADD, socket, &event);
+        curl_multi_assign(loop->multi, socket, loop); // Any non-NULL marker means "registered"
+    }
+    return 0;
+}
+
+int TransferEngine::timerCallback(CURLM * /*multi*/, long timeoutMs, void *userp)
+{
+    EventLoop *loop = static_cast<EventLoop *>(userp);
+    if (timeoutMs < 0)
+    {
+        loop->timerArmed = false;
+    }
+    else
+    {
+        loop->timerArmed = true;
+        loop->deadline = chrono::steady_clock::now() + chrono::milliseconds(timeoutMs);
+    }
+    return 0;
+}
+
+void TransferEngine::loopFunction(EventLoop *loop)
+{
+    const int maxEvents = 64;
+    epoll_event events[maxEvents];
+    int running = 0;
+    TraceRecorder::nameThread("event loop");
+
+    // Disk write completions of this thread wake the loop like a socket would
+    int completionFd = FileWriter::completionDescriptor();
+    if (completionFd >= 0)
+    {
+        epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.fd = completionFd;
+        epoll_ctl(loop->epollFd, EPOLL_CTL_ADD, completionFd, &event);
+    }
+
+    // Keep going after a stop request until in-flight transfers are done
+    while (!stopFlag || !loop->active.empty())
+    {
+        int timeout = 1000;
+        if (loop->timerArmed)
+        {
+            auto remaining = chrono::duration_cast<chrono::milliseconds>(loop->deadline - chrono::steady_clock::now()).count();
+            timeout = (remaining < 0) ? 0 : static_cast<int>(remaining < timeout ? remaining : timeout);
+        }
+
+        timeout = BandwidthScheduler::nextWakeupMs(timeout);
+
+        long long idleSince = (trace && trace->enabled()) ? trace->now() : -1;
+        int count = epoll_wait(loop->epollFd, events, maxEvents, timeout);
+        if (idleSince >= 0)
+        {
+            long long woke = trace->now();
+            if (woke - idleSince >= 1000) // Shorter waits would flood the ring
+            {
+                trace->span("idle", "dispatch", 0, TraceRecorder::THREAD, idleSince, woke);
+            }
+        }
+        if (count < 0 && errno != EINTR)
+        {
+            break;
+        }
+
+        for (int i = 0; i < count; ++i)
+        {
+            int fd = events[i].data.fd;
+            if (fd == loop->wakeFd)
+            {
+                uint64_t value;
+                ssize_t ignored = ::read(loop->wakeFd, &value, sizeof(value));
+                (void)ignored;
+                continue;
+            }
+            if (fd == completionFd)
+            {
+                continue;
+            }
+
+            int flags = 0;
+            if (events[i].events & EPOLLIN)
+            {
+                flags |= CURL_CSELECT_IN;
+            }
+            if (events[i].events & EPOLLOUT)
+            {
+                flags |= CURL_CSELECT_OUT;
+            }
+            if (events[i].events & (EPOLLERR | EPOLLHUP))
+            {
+                flags |= CURL_CSELECT_ERR;
+            }
+            curl_multi_socket_action(loop->multi, fd, flags, &running);
+        }
+        FileWriter::processCompletions();
+        BandwidthScheduler::runDueWakeups();
+
+        if (loop->timerArmed && chrono::steady_clock::now() >= loop->deadline)
+        {
+            loop->timerArmed = false;
+            curl_multi_socket_action(loop->multi, CURL_SOCKET_TIMEOUT, 0, &running);
+        }
+
+        if (!stopFlag)
+        {
+            attachSubmitted(loop);
+        }
+        processCompletions(loop);
+    }
+}
+#else
+// Portable fallback: curl_multi_poll waits on all sockets of the loop at once
+void TransferEngine::loopFunction(EventLoop *loop)
+{
+    int running = 0;
+    TraceRecorder::nameThread("event loop");
+    while (!stopFlag || !loop->active.empty())
+    {
+        curl_multi_perform(loop->multi, &running);
+        processCompletions(loop);
+        curl_multi_poll(loop->multi, NULL, 0, BandwidthScheduler::nextWakeupMs(1000), NULL);
+        BandwidthScheduler::runDueWakeups();
+        if (!stopFlag)
+        {
+            attachSubmitted(loop);
+        }
+    }
+}
+#endif
+
+void TransferEngine::shutdown()
+{
+    if (stopFlag.exchange(true))
+    {
+        return;
+    }
+
+    for (auto &loop : loops)
+    {
+        wake(loop.get());
+    }
+    for (auto &loop : loops)
+    {
+        if (loop->worker.joinable())
+        {
+            loop->worker.join();
+        }
+    }
+    // Only now: a finishing loop may still wake the others
+    for (auto &loop : loops)
+    {
+        curl_multi_cleanup(loop->multi);
+#ifdef __linux__
+        ::close(loop->epollFd);
+        ::close(loop->wakeFd);
+#endif
+    }
+}
@@ -0,0 +1,441 @@
+#define _HAS_STD_BYTE 0  // Fix Windows SDK byte conflict
+
+// TransferMetrics.cpp
+#include "TransferMetrics.hpp"
+#include "DownloadTask.hpp"
+#include <unordered_map>
+#include <sstream>
+#include <iomanip>
+#include <cstdio>
+
+using namespace std;
+
+// 1 ms to 5 minutes, roughly 1-2.5-5 per decade
+const long long TransferMetrics::BUCKET_MICROS[BUCKET_COUNT] = {
+    1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000,
+    1000000, 2500000, 5000000, 10000000, 30000000, 60000000, 120000000, 300000000};
+
+// Same order as DownloadStatus
+static const char *STATUS_NAMES[TransferMetrics::STATUS_COUNT] = {
+    "starting", "pending", "downloading", "paused", "completed", "failed", "cancelled"};
+
+static atomic<unsigned long long> nextMetricsId(1);
+
+// Shards this thread writes to, one per metrics instance it has touched
+static thread_local unordered_map<unsigned long long, void *> localShards;
+
+TransferMetrics::Shard::Shard()
+{
+    for (auto &value : counters)
+    {
+        value.store(0, memory_order_relaxed);
+    }
+    for (auto &value : errors)
+    {
+        value.store(0, memory_order_relaxed);
+    }
+    for (auto &value : statusMicros)
+    {
+        value.store(0, memory_order_relaxed);
+    }
+    for (auto &histogram : buckets)
+    {
+        for (auto &value : histogram)
+        {
+            value.store(0, memory_order_relaxed);
+        }
+    }
+    for (auto &value : sums)
+    {
+        value.store(0, memory_order_relaxed);
+    }
+}
+
+TransferMetrics::TransferMetrics() : id(nextMetricsId++), created(chrono::steady_clock::now()) {}
+
+TransferMetrics::Shard &TransferMetrics::local()
+{
+    static thread_local unsigned long long cachedId = 0;
+    static thread_local Shard *cached = NULL;
+    if (cachedId == id)
+    {
+        return *cached;
+    }
+
+    void *&slot = localShards[id];
+    if (!slot)
+    {
+        lock_guard<mutex> lock(shardsMutex);
+        shards.push_back(unique_ptr<Shard>(new Shard()));
+        slot = shards.back().get();
+    }
+    cachedId = id;
+    cached = static_cast<Shard *>(slot);
+    return *cached;
+}
+
+void TransferMetrics::observe(Histogram histogram, long long micros)
+{
+    if (micros < 0)
+    {
+        micros = 0;
+    }
+    int bucket = 0;
+    while (bucket < BUCKET_COUNT && micros > BUCKET_MICROS[bucket])
+    {
+        ++bucket;
+    }
+    Shard &shard = local();
+    bump(shard.buckets[histogram][bucket], 1);
+    bump(shard.sums[histogram], static_cast<unsigned long long>(micros));
+}
+
+void TransferMetrics::recordRequest(CURLcode result, long long firstByteMicros)
+{
+    Shard &shard = local();
+    bump(shard.counters[Requests], 1);
+    if (result != CURLE_OK && result < CURL_LAST)
+    {
+        bump(shard.errors[result], 1);
+    }
+    else if (result == CURLE_OK && firstByteMicros > 0)
+    {
+        observe(FirstByte, firstByteMicros);
+    }
+}
+
+void TransferMetrics::recordStatusTime(int status, long long micros)
+{
+    if (status >= 0 && status < STATUS_COUNT && micros > 0)
+    {
+        bump(local().statusMicros[status], static_cast<unsigned long long>(micros));
+    }
+}
+
+TransferMetrics::Totals TransferMetrics::totals()
+{
+    Totals result = {};
+    lock_guard<mutex> lock(shardsMutex);
+    for (auto &shard : shards)
+    {
+        for (int i = 0; i < COUNTER_COUNT; ++i)
+        {
+            result.counters[i] += shard->counters[i].load(memory_order_relaxed);
+        }
+        for (int i = 0; i < HISTOGRAM_COUNT; ++i)
+        {
+            result.sums[i] += shard->sums[i].load(memory_order_relaxed);
+            for (auto &bucket : shard->buckets[i])
+            {
+                result.counts[i] += bucket.load(memory_order_relaxed);
+            }
+        }
+    }
+    return result;
+}
+
+// Called with shardsMutex held
+HistogramSnapshot TransferMetrics::histogram(Histogram which)
+{
+    HistogramSnapshot result;
+    for (long long bound : BUCKET_MICROS)
+    {
+        result.bounds.push_back(bound / 1e6);
+    }
+    result.counts.assign(BUCKET_COUNT + 1, 0);
+    unsigned long long micros = 0;
+    for (auto &shard : shards)
+    {
+        for (int i = 0; i <= BUCKET_COUNT; ++i)
+        {
+            result.counts[i] += shard->buckets[which][i].load(memory_order_relaxed);
+        }
+        micros += shard->sums[which].load(memory_order_relaxed);
+    }
+    result.sum = micros / 1e6;
+    result.count = 0;
+    for (auto count : result.counts)
+    {
+        result.count += count;
+    }
+    return result;
+}
+
+MetricsSnapshot TransferMetrics::snapshot()
+{
+    Totals sums = totals();
+    MetricsSnapshot result;
+    result.uptimeSeconds = chrono::duration<double>(chrono::steady_clock::now() - created).count();
+    result.bytes = sums.counters[Bytes];
+    result.requests = sums.counters[Requests];
+    result.started = sums.counters[Started];
+    result.completed = sums.counters[Completed];
+    result.failed = sums.counters[Failed];
+    result.cancelled = sums.counters[Cancelled];
+    result.retries = sums.counters[Retries];
+    result.throttled = sums.counters[Throttled];
+    result.writeStalls = sums.counters[WriteStalls];
+    result.throughput = 0;
+    result.averageThroughput = result.uptimeSeconds > 0 ? result.bytes / result.uptimeSeconds : 0;
+    result.queued = result.running = result.concurrency = 0;
+    result.bufferPoolBytes = result.bufferPoolUsedBytes = 0;
+    result.bufferPoolStallSeconds = 0;
+    result.cacheRevalidated = result.cacheBytesSaved = 0;
+
+    lock_guard<mutex> lock(shardsMutex);
+    for (int status = 0; status < STATUS_COUNT; ++status)
+    {
+        unsigned long long micros = 0;
+        for (auto &shard : shards)
+        {
+            micros += shard->statusMicros[status].load(memory_order_relaxed);
+        }
+        result.statusSeconds[status] = micros / 1e6;
+    }
+    for (int code = 1; code < CURL_LAST; ++code)
+    {
+        unsigned long long count = 0;
+        for (auto &shard : shards)
+        {
+            count += shard->errors[code].load(memory_order_relaxed);
+        }
+        if (count > 0)
+        {
+            result.errors[code] = count;
+        }
+    }
+    result.firstByte = histogram(FirstByte);
+    result.queueWait = histogram(QueueWait);
+    result.transferTime = histogram(TransferTime);
+    return result;
+}
+
+string TransferMetrics::jsonString(const string &text)
+{
+    string out = "\"";
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+        {
+            out += '\\';
+            out += c;
+        }
+        else if (static_cast<unsigned char>(c) < 0x20)
+        {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out += escaped;
+        }
+        else
+        {
+            out += c;
+        }
+    }
+    return out + "\"";
+}
+
+static void jsonHistogram(ostringstream &out, const char *name, const HistogramSnapshot &histogram)
+{
+    out << "\"" << name << "\": {\"count\": " << histogram.count << ", \"sum_seconds\": " << histogram.sum
+        << ", \"buckets\": [";
+    for (size_t i = 0; i < histogram.counts.size(); ++i)
+    {
+        out << (i ? ", " : "") << "{\"le\": ";
+        if (i < histogram.bounds.size())
+        {
+            out << histogram.bounds[i];
+        }
+        else
+        {
+            out << "\"+Inf\"";
+        }
+        out << ", \"count\": " << histogram.counts[i] << "}";
+    }
+    out << "]}";
+}
+
+static void jsonStatusSeconds(ostringstream &out, const double *seconds)
+{
+    out << "{";
+    for (int status = 0; status < TransferMetrics::STATUS_COUNT; ++status)
+    {
+        out << (status ? ", " : "") << "\"" << STATUS_NAMES[status] << "\": " << seconds[status];
+    }
+    out << "}";
+}
+
+string TransferMetrics::toJson(const MetricsSnapshot &snapshot)
+{
+    ostringstream out;
+    out << fixed << setprecision(3);
+    out << "{\"uptime_seconds\": " << snapshot.uptimeSeconds
+        << ", \"bytes\": " << snapshot.bytes
+        << ", \"requests\": " << snapshot.requests
+        << ", \"started\": " << snapshot.started
+        << ", \"completed\": " << snapshot.completed
+        << ", \"failed\": " << snapshot.failed
+        << ", \"cancelled\": " << snapshot.cancelled
+        << ", \"retries\": " << snapshot.retries
+        << ", \"throttled\": " << snapshot.throttled
+        << ", \"write_stalls\": " << snapshot.writeStalls
+        << ", \"throughput\": " << snapshot.throughput
+        << ", \"average_throughput\": " << snapshot.averageThroughput
+        << ", \"queued\": " << snapshot.queued
+        << ", \"running\": " << snapshot.running
+        << ", \"concurrency_limit\": " << snapshot.concurrency
+        << ", \"buffer_pool_bytes\": " << snapshot.bufferPoolBytes
+        << ", \"buffer_pool_used_bytes\": " << snapshot.bufferPoolUsedBytes
+        << ", \"buffer_pool_stall_seconds\": " << snapshot.bufferPoolStallSeconds
+        << ", \"cache_revalidated\": " << snapshot.cacheRevalidated
+        << ", \"cache_bytes_saved\": " << snapshot.cacheBytesSaved
+        << ", \"status_seconds\": ";
+    jsonStatusSeconds(out, snapshot.statusSeconds);
+    out << ", \"errors\": {";
+    bool first = true;
+    for (const auto &error : snapshot.errors)
+    {
+        out << (first ? "" : ", ") << "\"" << error.first << "\": " << error.second;
+        first = false;
+    }
+    out << "}, ";
+    jsonHistogram(out, "first_byte", snapshot.firstByte);
+    out << ", ";
+    jsonHistogram(out, "queue_wait", snapshot.queueWait);
+    out << ", ";
+    jsonHistogram(out, "transfer_time", snapshot.transferTime);
+    out << ", \"tasks\": [";
+    for (size_t i = 0; i < snapshot.tasks.size(); ++i)
+    {
+        const TaskStats &task = snapshot.tasks[i];
+        out << (i ? ", " : "") << "{\"id\": " << task.id
+            << ", \"url\": " << jsonString(task.url)
+            << ", \"status\": \"" << STATUS_NAMES[static_cast<int>(task.status)] << "\""
+            << ", \"bytes\": " << task.bytes
+            << ", \"total_size\": " << task.totalSize
+            << ", \"throughput\": " << task.throughput
+            << ", \"average_throughput\": " << task.averageThroughput
+            << ", \"first_byte_ms\": " << task.firstByteMs
+            << ", \"queue_wait_ms\": " << task.queueWaitMs
+            << ", \"retries\": " << task.retries
+            << ", \"last_error\": " << task.lastError
+            << ", \"status_seconds\": ";
+        jsonStatusSeconds(out, task.statusSeconds);
+        out << "}";
+    }
+    out << "]}";
+    return out.str();
+}
+
+static void promHeader(ostringstream &out, const string &name, const char *type, const char *help)
+{
+    out << "# HELP " << name << " " << help << "\n# TYPE " << name << " " << type << "\n";
+}
+
+static void promHistogram(ostringstream &out, const string &name, const char *help, const HistogramSnapshot &histogram)
+{
+    promHeader(out, name, "histogram", help);
+    unsigned long long cumulative = 0;
+    for (size_t i = 0; i < histogram.counts.size(); ++i)
+    {
+        cumulative += histogram.counts[i];
+        out << name << "_bucket{le=\"";
+        if (i < histogram.bounds.size())
+        {
+            out << histogram.bounds[i];
+        }
+        else
+        {
+            out << "+Inf";
+        }
+        out << "\"} " << cumulative << "\n";
+    }
+    out << name << "_sum " << histogram.sum << "\n" << name << "_count " << histogram.count << "\n";
+}
+
+// Aggregates only: per-task series would give every URL its own time series
+string TransferMetrics::toPrometheus(const MetricsSnapshot &snapshot)
+{
+    const string prefix = "download_manager_";
+    ostringstream out;
+    out << setprecision(10);
+
+    struct
+    {
+        const char *name;
+        unsigned long long value;
+        const char *help;
+    } counters[] = {
+        {"received_bytes_total", snapshot.bytes, "Bytes received over the network."},
+        {"requests_total", snapshot.requests, "HTTP requests finished, successful or not."},
+        {"downloads_started_total", snapshot.started, "Downloads started for the first time."},
+        {"downloads_completed_total", snapshot.completed, "Downloads that finished successfully."},
+        {"downloads_failed_total", snapshot.failed, "Download attempts that failed."},
+        {"downloads_cancelled_total", snapshot.cancelled, "Downloads cancelled by the user."},
+        {"download_retries_total", snapshot.retries, "Failed downloads started again."},
+        {"throttle_pauses_total", snapshot.throttled, "Transfers paused by the bandwidth scheduler."},
+        {"write_stalls_total", snapshot.writeStalls, "Transfers paused while the disk caught up."},
+    };
+    for (const auto &counter : counters)
+    {
+        promHeader(out, prefix + counter.name, "counter", counter.help);
+        out << prefix << counter.name << " " << counter.value << "\n";
+    }
+
+    promHeader(out, prefix + "request_errors_total", "counter", "Failed requests by curl error code.");
+    for (const auto &error : snapshot.errors)
+    {
+        out << prefix << "request_errors_total{code=\"" << error.first << "\",error=\""
+            << curl_easy_strerror(static_cast<CURLcode>(error.first)) << "\"} " << error.second << "\n";
+    }
+
+    promHeader(out, prefix + "status_seconds_total", "counter", "Time downloads spent in each status.");
+    for (int status = 0; status < STATUS_COUNT; ++status)
+    {
+        out << prefix << "status_seconds_total{status=\"" << STATUS_NAMES[status] << "\"} "
+            << snapshot.statusSeconds[status] << "\n";
+    }
+
+    int perStatus[STATUS_COUNT] = {};
+    for (const auto &task : snapshot.tasks)
+    {
+        ++perStatus[static_cast<int>(task.status)];
+    }
+    promHeader(out, prefix + "downloads", "gauge", "Downloads known to the manager by status.");
+    for (int status = 0; status < STATUS_COUNT; ++status)
+    {
+        out << prefix << "downloads{status=\"" << STATUS_NAMES[status] << "\"} " << perStatus[status] << "\n";
+    }
+
+    struct
+    {
+        const char *name;
+        double value;
+        const char *help;
+    } gauges[] = {
+        {"throughput_bytes_per_second", snapshot.throughput, "Current receive rate of all downloads."},
+        {"average_throughput_bytes_per_second", snapshot.averageThroughput, "Bytes received divided by uptime."},
+        {"queued_downloads", static_cast<double>(snapshot.queued), "Started downloads waiting for a worker."},
+        {"running_downloads", static_cast<double>(snapshot.running), "Downloads a worker or event loop is driving."},
+        {"concurrency_limit", static_cast<double>(snapshot.concurrency), "Connections allowed by the adaptive controller."},
+        {"buffer_pool_bytes", static_cast<double>(snapshot.bufferPoolBytes), "Memory set aside for write buffers."},
+        {"buffer_pool_used_bytes", static_cast<double>(snapshot.bufferPoolUsedBytes), "Write buffer memory lent to transfers."},
+        {"uptime_seconds", snapshot.uptimeSeconds, "Seconds since the manager was created."},
+    };
+    for (const auto &gauge : gauges)
+    {
+        promHeader(out, prefix + gauge.name, "gauge", gauge.help);
+        out << prefix << gauge.name << " " << gauge.value << "\n";
+    }
+
+    promHeader(out, prefix + "buffer_pool_stall_seconds_total", "counter", "Time transfers spent paused waiting for a write buffer.");
+    out << prefix << "buffer_pool_stall_seconds_total " << snapshot.bufferPoolStallSeconds << "\n";
+    promHeader(out, prefix + "cache_revalidated_total", "counter", "Downloads the server answered with 304, served from the content cache.");
+    out << prefix << "cache_revalidated_total " << snapshot.cacheRevalidated << "\n";
+    promHeader(out, prefix + "cache_saved_bytes_total", "counter", "Bytes not downloaded or not stored twice thanks to the content cache.");
+    out << prefix << "cache_saved_bytes_total " << snapshot.cacheBytesSaved << "\n";
+
+    promHistogram(out, prefix + "first_byte_seconds", "Time to first byte per request.", snapshot.firstByte);
+    promHistogram(out, prefix + "queue_wait_seconds", "Time between starting a download and a worker taking it.", snapshot.queueWait);
+    promHistogram(out, prefix + "transfer_seconds", "Time spent downloading per successful download.", snapshot.transferTime);
+    return out.str();
+}
@@ -0,0 +1,353 @@
+#define _HAS_STD_BYTE 0  // Fix Windows SDK byte conflict
+
+// UringBackend.cpp
+#include "UringBackend.hpp"
+#include "FileWritter.hpp"
+#include <memory>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <cstdint>
+#include <linux/io_uring.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+using namespace std;
+
+// Registered pool per thread: 64 buffers of 256 KB
+static const unsigned POOL_BUFFERS = 64;
+static const size_t POOL_BUFFER_SIZE = 256 * 1024;
+
+static int ringSetup(unsigned entries, io_uring_params *params)
+{
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int ringEnter(int fd, unsigned toSubmit, unsigned minComplete, unsigned flags)
+{
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, NULL, 0));
+}
+
+static int ringRegister(int fd, unsigned opcode, const void *arg, unsigned count)
+{
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, count));
+}
+
+UringBackend::UringBackend(unsigned bufferCount, size_t bufferSize)
+    : ringFd(-1), eventFd(-1), fixedBuffers(false), sqRing(MAP_FAILED), cqRing(MAP_FAILED),
+      sqRingSize(0), cqRingSize(0), sqeMemory(MAP_FAILED), sqeMemorySize(0), poolMemory(NULL),
+      bufferSize(bufferSize), writesInFlight(0)
+{
+    if (!setup(bufferCount))
+    {
+        return;
+    }
+
+    void *memory = NULL;
+    if (posix_memalign(&memory, FileWriter::ALIGNMENT, bufferCount * bufferSize) != 0)
+    {
+        return;
+    }
+    poolMemory = static_cast<char *>(memory);
+    buffers.resize(bufferCount);
+    inFlight.resize(bufferCount);
+    for (unsigned i = 0; i < bufferCount; ++i)
+    {
+        buffers[i].iov_base = poolMemory + i * bufferSize;
+        buffers[i].iov_len = bufferSize;
+        freeBuffers.push_back(static_cast<int>(bufferCount - 1 - i));
+    }
+
+    // Registered buffers skip the per-write page pinning; plain writes still work without them
+    fixedBuffers = ringRegister(ringFd, IORING_REGISTER_BUFFERS, buffers.data(), bufferCount) == 0;
+
+    // Completions signal an eventfd so event loops can poll for them
+    eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (eventFd >= 0)
+    {
+        ringRegister(ringFd, IORING_REGISTER_EVENTFD, &eventFd, 1);
+    }
+}
+
+bool UringBackend::setup(unsigned entries)
+{
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ringFd = ringSetup(entries, &params);
+    if (ringFd < 0)
+    {
+        return false;
+    }
+
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (singleMap)
+    {
+        sqRingSize = cqRingSize = (sqRingSize > cqRingSize) ? sqRingSize : cqRingSize;
+    }
+
+    sqRing = mmap(NULL, sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQ_RING);
+    if (sqRing == MAP_FAILED)
+    {
+        return false;
+    }
+    cqRing = singleMap ? sqRing : mmap(NULL, cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_CQ_RING);
+    if (cqRing == MAP_FAILED)
+    {
+        return false;
+    }
+    sqeMemorySize = params.sq_entries * sizeof(io_uring_sqe);
+    sqeMemory = mmap(NULL, sqeMemorySize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd, IORING_OFF_SQES);
+    if (sqeMemory == MAP_FAILED)
+    {
+        return false;
+    }
+
+    char *sq = static_cast<char *>(sqRing);
+    char *cq = static_cast<char *>(cqRing);
+    sqHead = reinterpret_cast<unsigned *>(sq + params.sq_off.head);
+    sqTail = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+    sqMask = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+    sqArray = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+    cqHead = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+    cqTail = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+    cqMask = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+    cqes = cq + params.cq_off.cqes;
+    return true;
+}
+
+UringBackend::~UringBackend()
+{
+    // Writers drain before closing, so anything left here has no owner any more
+    while (ringFd >= 0 && freeBuffers.size() < buffers.size())
+    {
+        for (auto &write : inFlight)
+        {
+            write.owner = NULL;
+        }
+        size_t before = freeBuffers.size();
+        reap(true);
+        if (freeBuffers.size() == before)
+        {
+            break;
+        }
+    }
+
+    if (sqeMemory != MAP_FAILED)
+    {
+        munmap(sqeMemory, sqeMemorySize);
+    }
+    if (cqRing != MAP_FAILED && cqRing != sqRing)
+    {
+        munmap(cqRing, cqRingSize);
+    }
+    if (sqRing != MAP_FAILED)
+    {
+        munmap(sqRing, sqRingSize);
+    }
+    if (eventFd >= 0)
+    {
+        close(eventFd);
+    }
+    if (ringFd >= 0)
+    {
+        close(ringFd);
+    }
+    free(poolMemory);
+}
+
+UringBackend *UringBackend::current()
+{
+    thread_local unique_ptr<UringBackend> backend;
+    thread_local bool initialized = false;
+    if (!initialized)
+    {
+        initialized = true;
+        unique_ptr<UringBackend> candidate(new UringBackend(POOL_BUFFERS, POOL_BUFFER_SIZE));
+        if (candidate->poolMemory && candidate->eventFd >= 0)
+        {
+            backend = move(candidate);
+        }
+    }
+    return backend.get();
+}
+
+int UringBackend::completionDescriptor() const
+{
+    return eventFd;
+}
+
+size_t UringBackend::getBufferSize() const
+{
+    return bufferSize;
+}
+
+bool UringBackend::hasFreeBuffer() const
+{
+    return !freeBuffers.empty();
+}
+
+bool UringBackend::hasWritesInFlight() const
+{
+    return writesInFlight > 0;
+}
+
+char *UringBackend::acquireBuffer(int &index)
+{
+    if (freeBuffers.empty())
+    {
+        return NULL;
+    }
+    index = freeBuffers.back();
+    freeBuffers.pop_back();
+    return static_cast<char *>(buffers[index].iov_base);
+}
+
+void UringBackend::releaseBuffer(int index)
+{
+    freeBuffers.push_back(index);
+}
+
+bool UringBackend::submitWrite(FileWriter *owner, int fileDescriptor, int index, size_t length, long long offset)
+{
+    unsigned tail = *sqTail;
+    unsigned slot = tail & *sqMask;
+    io_uring_sqe *sqe = static_cast<io_uring_sqe *>(sqeMemory) + slot;
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = fixedBuffers ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+    sqe->fd = fileDescriptor;
+    sqe->addr = reinterpret_cast<uintptr_t>(buffers[index].iov_base);
+    sqe->len = static_cast<unsigned>(length);
+    sqe->off = static_cast<unsigned long long>(offset);
+    sqe->buf_index = fixedBuffers ? static_cast<unsigned short>(index) : 0;
+    sqe->user_data = static_cast<unsigned long long>(index);
+    sqArray[slot] = slot;
+    inFlight[index] = {owner, fileDescriptor, offset, length};
+    __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+
+    // Every buffer owns at most one entry, so the submission queue never overflows
+    while (true)
+    {
+        int submitted = ringEnter(ringFd, 1, 0, 0);
+        if (submitted >= 0)
+        {
+            ++writesInFlight;
+            return true;
+        }
+        if (errno == EBUSY)
+        {
+            reap(false); // Completion queue is full, make room first
+            continue;
+        }
+        if (errno != EINTR && errno != EAGAIN)
+        {
+            return false; // The buffer stays out of the pool: the kernel may still read it
+        }
+    }
+}
+
+long long UringBackend::firstPending(FileWriter *owner, long long begin, long long end) const
+{
+    for (const auto &write : inFlight)
+    {
+        if (write.owner == owner && write.offset >= begin && write.offset < end)
+        {
+            end = write.offset;
+        }
+    }
+    return end;
+}
+
+void UringBackend::reap(bool wait)
+{
+    if (wait)
+    {
+        ringEnter(ringFd, 0, 1, IORING_ENTER_GETEVENTS);
+    }
+
+    unsigned head = *cqHead;
+    unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+    while (head != tail)
+    {
+        io_uring_cqe *cqe = static_cast<io_uring_cqe *>(cqes) + (head & *cqMask);
+        complete(static_cast<int>(cqe->user_data), cqe->res);
+        ++head;
+    }
+    __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+}
+
+void UringBackend::complete(int index, int result)
+{
+    InFlightWrite &write = inFlight[index];
+    bool ok = result >= 0;
+
+    // Short writes are rare; finish them synchronously from the same buffer
+    size_t done = ok ? static_cast<size_t>(result) : 0;
+    char *data = static_cast<char *>(buffers[index].iov_base);
+    while (ok && done < write.length)
+    {
+        ssize_t written = pwrite(write.fileDescriptor, data + done, write.length - done, write.offset + done);
+        if (written < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        ok = written > 0;
+        done += ok ? written : 0;
+    }
+
+    FileWriter *owner = write.owner;
+    write.owner = NULL;
+    --writesInFlight;
+    releaseBuffer(index);
+    if (owner)
+    {
+        owner->asyncWriteFinished(ok);
+    }
+}
+
+void UringBackend::waitForBuffer(FileWriter *owner, void (*wake)(void *), void *context)
+{
+    waiters.push_back({owner, wake, context});
+}
+
+void UringBackend::cancelWaits(FileWriter *owner)
+{
+    for (size_t i = 0; i < waiters.size();)
+    {
+        if (waiters[i].owner == owner)
+        {
+            waiters[i] = waiters.back();
+            waiters.pop_back();
+        }
+        else
+        {
+            ++i;
+        }
+    }
+}
+
+// Called by the thread's event loop: collect completions and restart stalled transfers
+void UringBackend::service()
+{
+    uint64_t signalled;
+    ssize_t ignored = read(eventFd, &signalled, sizeof(signalled));
+    (void)ignored;
+
+    size_t freeBefore = freeBuffers.size();
+    reap(false);
+    if (freeBuffers.size() == freeBefore || waiters.empty())
+    {
+        return;
+    }
+
+    // A woken transfer may stall again and re-register, so wake from a copy
+    vector<Waiter> woken;
+    woken.swap(waiters);
+    for (auto &waiter : woken)
+    {
+        waiter.wake(waiter.context);
+    }
+}